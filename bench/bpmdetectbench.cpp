@@ -0,0 +1,255 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/**
+ * @file
+ * Benchmark of the BPM detectors on synthetic signals.
+ *
+ * Every case (detector, signal, tempo, format and length) runs in a child process so its peak
+ * memory can be read from the operating system without the other cases skewing it. The result is
+ * one JSON document on standard output or in the file given with `--output`.
+ */
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDateTime>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QProcess>
+#include <QtCore/QSysInfo>
+
+#include "autocorrelationbpmdetector.h"
+#include "signals.h"
+#include "soundtouchbpmdetector.h"
+
+/** Number of frames passed to inputSamples() at a time, like the decoders. */
+static constexpr int kBlockFrames = 4096;
+
+/** Detector implementation under test. */
+struct DetectorInfo {
+    /** Name used on the command line and in the output. */
+    QString name;
+    /** Creates a detector. */
+    std::function<AbstractBpmDetector *()> create;
+};
+
+/** One benchmark case. */
+struct BenchCase {
+    /** Index into the detector list. */
+    qsizetype detector;
+    /** Signal to detect on. */
+    SignalSpec signal;
+};
+
+static QList<DetectorInfo> detectors() {
+    return {
+        {QStringLiteral("soundtouch"), []() { return new SoundTouchBpmDetector; }},
+        {QStringLiteral("autocorrelation"), []() { return new AutocorrelationBpmDetector; }},
+    };
+}
+
+static QList<BenchCase> benchCases(bool quick) {
+    // Mono at 11025 Hz is the default detection format; stereo at 44100 Hz is what the app used to
+    // feed the detectors.
+    const QList<std::pair<int, int>> formats = {{11025, 1}, {44100, 2}};
+    const QList<double> tempos = {90, 120, 128, 140, 174};
+    const auto lengths = quick ? QList<double>{30} : QList<double>{30, 180};
+    QList<BenchCase> ret;
+    for (qsizetype detector = 0; detector < detectors().size(); ++detector) {
+        for (const auto type : {SignalType::Click, SignalType::DrumLoop}) {
+            for (const auto &[sampleRate, channels] : formats) {
+                for (const auto seconds : lengths) {
+                    for (const auto bpm : tempos) {
+                        ret.append({detector, {type, bpm, sampleRate, channels, seconds}});
+                    }
+                }
+            }
+        }
+    }
+    return ret;
+}
+
+/** Get the peak resident set size of this process in bytes, or -1 if unknown. */
+static qint64 peakResidentBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return static_cast<qint64>(counters.PeakWorkingSetSize);
+    }
+    return -1;
+#else
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1;
+    }
+#ifdef __APPLE__
+    // Bytes on macOS, kibibytes elsewhere.
+    return usage.ru_maxrss;
+#else
+    return static_cast<qint64>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+/** Run a single case in this process and return its result. */
+static QJsonObject runCase(const BenchCase &benchCase, int repeat) {
+    const auto detector = detectors().at(benchCase.detector);
+    const auto &spec = benchCase.signal;
+    const auto samples = generateSignal(spec);
+    const auto frames = static_cast<qint64>(samples.size()) / spec.channels;
+    const auto baseline = peakResidentBytes();
+    auto best = std::numeric_limits<qint64>::max();
+    bpmtype bpm = 0;
+    QElapsedTimer timer;
+    for (auto i = 0; i < repeat; ++i) {
+        std::unique_ptr<AbstractBpmDetector> instance(detector.create());
+        instance->setFormat(spec.channels, spec.sampleRate);
+        instance->reset();
+        timer.start();
+        for (qint64 offset = 0; offset < frames; offset += kBlockFrames) {
+            const auto count = std::min<qint64>(kBlockFrames, frames - offset);
+            instance->inputSamples(samples.data() + offset * spec.channels,
+                                   static_cast<int>(count));
+        }
+        bpm = instance->getBpm();
+        best = std::min(best, timer.nsecsElapsed());
+    }
+    const auto peak = peakResidentBytes();
+    const auto error = bpm - spec.bpm;
+    return {
+        {QStringLiteral("detector"), detector.name},
+        {QStringLiteral("signal"), QString::fromLatin1(signalTypeName(spec.type))},
+        {QStringLiteral("bpm"), spec.bpm},
+        {QStringLiteral("sampleRate"), spec.sampleRate},
+        {QStringLiteral("channels"), spec.channels},
+        {QStringLiteral("seconds"), spec.seconds},
+        {QStringLiteral("detectedBpm"), bpm},
+        {QStringLiteral("error"), error},
+        {QStringLiteral("relativeError"), std::abs(error) / spec.bpm},
+        {QStringLiteral("processingNs"), best},
+        // Processing time over audio time, so lower is faster.
+        {QStringLiteral("realTimeFactor"), static_cast<double>(best) / (spec.seconds * 1e9)},
+        {QStringLiteral("nsPerSample"), static_cast<double>(best) / static_cast<double>(frames)},
+        {QStringLiteral("peakResidentBytes"), peak},
+        {QStringLiteral("detectorPeakBytes"),
+         peak < 0 || baseline < 0 ? -1 : std::max<qint64>(0, peak - baseline)},
+    };
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("bpmdetect-bench"));
+    QCoreApplication::setApplicationVersion(QStringLiteral(BPMDETECT_VERSION));
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        QStringLiteral("Benchmark the BPM detectors on synthetic signals and print JSON."));
+    QCommandLineOption caseOpt(QStringLiteral("case"), QString(), QStringLiteral("index"));
+    caseOpt.setFlags(QCommandLineOption::HiddenFromHelp);
+    QCommandLineOption detectorOpt(
+        QStringLiteral("detector"),
+        QStringLiteral("Only run this detector (soundtouch or autocorrelation). Can be repeated."),
+        QStringLiteral("name"));
+    QCommandLineOption outputOpt({QStringLiteral("o"), QStringLiteral("output")},
+                                 QStringLiteral("Write the JSON to this file instead of stdout."),
+                                 QStringLiteral("file"));
+    QCommandLineOption quickOpt(QStringLiteral("quick"),
+                                QStringLiteral("Only run the 30 second signals."));
+    QCommandLineOption repeatOpt(
+        QStringLiteral("repeat"),
+        QStringLiteral("Runs per case; the fastest is reported (default: 3)."),
+        QStringLiteral("count"),
+        QStringLiteral("3"));
+    parser.addOption(caseOpt);
+    parser.addOption(detectorOpt);
+    parser.addOption(outputOpt);
+    parser.addOption(quickOpt);
+    parser.addOption(repeatOpt);
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.process(app);
+
+    const auto quick = parser.isSet(quickOpt);
+    const auto repeat = std::max(1, parser.value(repeatOpt).toInt());
+    const auto cases = benchCases(quick);
+    if (parser.isSet(caseOpt)) {
+        const auto index = parser.value(caseOpt).toLongLong();
+        if (index < 0 || index >= cases.size()) {
+            std::cerr << "Invalid case index." << std::endl;
+            return 1;
+        }
+        std::cout << QJsonDocument(runCase(cases.at(index), repeat))
+                         .toJson(QJsonDocument::Compact)
+                         .toStdString()
+                  << std::endl;
+        return 0;
+    }
+
+    const auto selected = parser.values(detectorOpt);
+    QJsonArray results;
+    for (qsizetype index = 0; index < cases.size(); ++index) {
+        const auto &name = detectors().at(cases.at(index).detector).name;
+        if (!selected.isEmpty() && !selected.contains(name)) {
+            continue;
+        }
+        QStringList arguments{QStringLiteral("--case"),
+                              QString::number(index),
+                              QStringLiteral("--repeat"),
+                              QString::number(repeat)};
+        if (quick) {
+            arguments.append(QStringLiteral("--quick"));
+        }
+        QProcess child;
+        child.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+        child.start(QCoreApplication::applicationFilePath(), arguments);
+        if (!child.waitForFinished(-1) || child.exitStatus() != QProcess::NormalExit ||
+            child.exitCode() != 0) {
+            std::cerr << "Case " << index << " failed." << std::endl;
+            return 1;
+        }
+        const auto result = QJsonDocument::fromJson(child.readAllStandardOutput()).object();
+        std::cerr << result[QStringLiteral("detector")].toString().toStdString() << ' '
+                  << result[QStringLiteral("signal")].toString().toStdString() << ' '
+                  << result[QStringLiteral("bpm")].toDouble() << " BPM "
+                  << result[QStringLiteral("sampleRate")].toInt() << " Hz "
+                  << result[QStringLiteral("seconds")].toDouble() << " s: "
+                  << result[QStringLiteral("detectedBpm")].toDouble() << " BPM, "
+                  << result[QStringLiteral("nsPerSample")].toDouble() << " ns/sample"
+                  << std::endl;
+        results.append(result);
+    }
+
+    const QJsonObject document{
+        {QStringLiteral("version"), QCoreApplication::applicationVersion()},
+        {QStringLiteral("timestamp"),
+         QDateTime::currentDateTimeUtc().toString(Qt::ISODate)},
+        {QStringLiteral("cpu"), QSysInfo::currentCpuArchitecture()},
+        {QStringLiteral("os"), QSysInfo::prettyProductName()},
+        {QStringLiteral("repeat"), repeat},
+        {QStringLiteral("blockFrames"), kBlockFrames},
+        {QStringLiteral("results"), results},
+    };
+    const auto json = QJsonDocument(document).toJson();
+    if (parser.isSet(outputOpt)) {
+        QFile file(parser.value(outputOpt));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json) < 0) {
+            std::cerr << "Cannot write " << file.fileName().toStdString() << '.' << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+    std::cout << json.toStdString();
+    return 0;
+}
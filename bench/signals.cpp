@@ -0,0 +1,111 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+#include <random>
+
+#include "signals.h"
+
+/**
+ * Interleaved buffer the signal is mixed into. Only the first channel is mixed; the others are
+ * copied from it at the end. Mixing in place keeps the peak memory of generation at the size of
+ * the result, so the benchmark can attribute anything above it to the detector.
+ */
+struct MixBuffer {
+    std::vector<float> &samples;
+    size_t frames;
+    size_t stride;
+};
+
+/** Add a decaying sine at @a frequency (falling towards @a endFrequency) starting at @a start. */
+static void addTone(MixBuffer &out,
+                    size_t start,
+                    double frequency,
+                    double endFrequency,
+                    double decay,
+                    double gain,
+                    int sampleRate) {
+    const auto length = std::min(out.frames - start, static_cast<size_t>(5 * decay * sampleRate));
+    auto phase = 0.0;
+    for (size_t i = 0; i < length; ++i) {
+        const auto t = static_cast<double>(i) / sampleRate;
+        const auto envelope = std::exp(-t / decay);
+        const auto f = endFrequency + (frequency - endFrequency) * envelope;
+        phase += 2 * std::numbers::pi * f / sampleRate;
+        out.samples[(start + i) * out.stride] +=
+            static_cast<float>(gain * envelope * std::sin(phase));
+    }
+}
+
+/** Add decaying white noise (or its first difference if @a bright) starting at @a start. */
+static void addNoise(MixBuffer &out,
+                     size_t start,
+                     double decay,
+                     double gain,
+                     bool bright,
+                     int sampleRate,
+                     std::minstd_rand &random) {
+    std::uniform_real_distribution<double> distribution(-1, 1);
+    const auto length = std::min(out.frames - start, static_cast<size_t>(5 * decay * sampleRate));
+    auto previous = 0.0;
+    for (size_t i = 0; i < length; ++i) {
+        const auto t = static_cast<double>(i) / sampleRate;
+        const auto value = distribution(random);
+        out.samples[(start + i) * out.stride] += static_cast<float>(
+            gain * std::exp(-t / decay) * (bright ? 0.5 * (value - previous) : value));
+        previous = value;
+    }
+}
+
+std::vector<soundtouch::SAMPLETYPE> generateSignal(const SignalSpec &spec) {
+    const auto frames = static_cast<size_t>(spec.seconds * spec.sampleRate);
+    const auto channels = static_cast<size_t>(spec.channels);
+    const auto beat = 60.0 * spec.sampleRate / spec.bpm;
+    std::vector<float> samples(frames * channels);
+    MixBuffer out{samples, frames, channels};
+    std::minstd_rand random(1);
+    // Eighth notes, so the drum loop can place hi-hats between beats.
+    for (auto step = 0;; ++step) {
+        const auto start = static_cast<size_t>(std::lround(step * beat / 2));
+        if (start >= frames) {
+            break;
+        }
+        if (spec.type == SignalType::Click) {
+            if (step % 2 == 0) {
+                addTone(out, start, 1000, 1000, 0.01, 0.8, spec.sampleRate);
+            }
+            continue;
+        }
+        switch (step % 8) {
+        case 0:
+        case 4:
+            addTone(out, start, 150, 50, 0.08, 0.7, spec.sampleRate);
+            break;
+        case 2:
+        case 6:
+            addTone(out, start, 200, 180, 0.05, 0.3, spec.sampleRate);
+            addNoise(out, start, 0.06, 0.3, false, spec.sampleRate, random);
+            break;
+        default:
+            break;
+        }
+        addNoise(out, start, 0.015, 0.15, true, spec.sampleRate, random);
+    }
+    for (size_t i = 0; i < samples.size(); i += channels) {
+        samples[i] = std::clamp(samples[i], -1.0f, 1.0f);
+        std::fill_n(samples.begin() + static_cast<std::ptrdiff_t>(i + 1), channels - 1, samples[i]);
+    }
+#if defined(SOUNDTOUCH_INTEGER_SAMPLES) && SOUNDTOUCH_INTEGER_SAMPLES
+    std::vector<soundtouch::SAMPLETYPE> converted(samples.size());
+    std::transform(samples.cbegin(), samples.cend(), converted.begin(), [](float value) {
+        return static_cast<soundtouch::SAMPLETYPE>(value * 32767);
+    });
+    return converted;
+#else
+    return samples;
+#endif
+}
+
+const char *signalTypeName(SignalType type) {
+    return type == SignalType::Click ? "click" : "drum-loop";
+}
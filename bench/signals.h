@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/** @file */
+#pragma once
+#include <vector>
+
+#include <STTypes.h>
+
+/** Kinds of synthetic test signal. */
+enum class SignalType {
+    Click,    //!< Decaying 1 kHz burst on every beat.
+    DrumLoop, //!< Kick on beats 1 and 3, snare on 2 and 4, hi-hat on every eighth note.
+};
+
+/** Parameters of a synthetic signal. */
+struct SignalSpec {
+    /** Kind of signal. */
+    SignalType type = SignalType::Click;
+    /** Tempo in BPM. */
+    double bpm = 120;
+    /** Sample rate in Hz. */
+    int sampleRate = 44100;
+    /** Number of interleaved channels. All channels carry the same signal. */
+    int channels = 1;
+    /** Length in seconds. */
+    double seconds = 30;
+};
+
+/**
+ * Generate a synthetic signal at a known tempo. The noise in the drum loop is seeded, so the same
+ * spec always gives the same samples.
+ * @param spec Signal parameters.
+ * @return Interleaved samples in the SoundTouch sample format.
+ */
+std::vector<soundtouch::SAMPLETYPE> generateSignal(const SignalSpec &spec);
+
+/**
+ * Get the name of a signal type as used in the benchmark output.
+ * @param type Signal type.
+ * @return `"click"` or `"drum-loop"`.
+ */
+const char *signalTypeName(SignalType type);
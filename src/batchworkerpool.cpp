@@ -0,0 +1,132 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <algorithm>
+
+#include <QtCore/QThread>
+#include <QtCore/QTimer>
+
+#include "batchworkerpool.h"
+#include "debug.h"
+
+/** Default for setBatchInterval(). */
+static constexpr int kDefaultBatchInterval = 100;
+
+BatchWorkerPool::BatchWorkerPool(QObject *parent) : QObject(parent), timer_(new QTimer(this)) {
+    timer_->setInterval(kDefaultBatchInterval);
+    connect(timer_, &QTimer::timeout, this, [this]() {
+        if (session_) {
+            publish();
+        }
+    });
+}
+
+BatchWorkerPool::~BatchWorkerPool() {
+    cancelAndWait();
+}
+
+void BatchWorkerPool::setMaximumThreads(int count) {
+    maximumThreads_ = count;
+}
+
+int BatchWorkerPool::maximumThreads() const {
+    return maximumThreads_ > 0 ? maximumThreads_ : QThread::idealThreadCount();
+}
+
+void BatchWorkerPool::setBatchInterval(int msec) {
+    timer_->setInterval(msec);
+}
+
+bool BatchWorkerPool::isRunning() const {
+    return session_ != nullptr;
+}
+
+void BatchWorkerPool::setThreadName(const QString &name) {
+    threadName_ = name;
+}
+
+void BatchWorkerPool::add(const QStringList &paths) {
+    if (paths.isEmpty()) {
+        return;
+    }
+    if (!session_) {
+        session_ = createSession();
+        timer_->start();
+    }
+    const auto session = session_;
+    int newWorkers;
+    {
+        QMutexLocker locker(&session->mutex);
+        enqueue(*session, paths);
+        newWorkers = static_cast<int>(std::max<qsizetype>(
+            0, std::min<qsizetype>(maximumThreads(), usefulWorkers(*session)) - session->workers));
+        session->workers += newWorkers;
+        session->queued.wakeAll();
+    }
+    qCDebug(gLogBpmDetect) << metaObject()->className() << "queued" << paths.size() << "paths,"
+                           << newWorkers << "new threads.";
+    for (auto i = 0; i < newWorkers; ++i) {
+        auto thread = QThread::create([this, session]() { runWorker(session); });
+        if (!threadName_.isEmpty()) {
+            thread->setObjectName(threadName_);
+        }
+        connect(thread, &QThread::finished, this, [this, thread]() {
+            threads_.removeOne(thread);
+            thread->deleteLater();
+        });
+        threads_ << thread;
+        thread->start();
+    }
+}
+
+void BatchWorkerPool::enqueue(Session &session, const QStringList &paths) {
+    session.queue.append(paths);
+}
+
+qsizetype BatchWorkerPool::usefulWorkers(const Session &session) const {
+    return session.queue.size();
+}
+
+void BatchWorkerPool::cancel() {
+    if (!session_) {
+        return;
+    }
+    const auto session = std::move(session_);
+    session->cancelled = true;
+    timer_->stop();
+    QMutexLocker locker(&session->mutex);
+    session->queue.clear();
+    session->queued.wakeAll();
+}
+
+void BatchWorkerPool::cancelAndWait() {
+    cancel();
+    for (auto thread : threads_) {
+        thread->wait();
+        delete thread;
+    }
+    threads_.clear();
+}
+
+void BatchWorkerPool::exitWorker(const std::shared_ptr<Session> &session) {
+    if (--session->workers == 0 && !session->cancelled) {
+        QMetaObject::invokeMethod(
+            this, [this, session]() { finish(session); }, Qt::QueuedConnection);
+    }
+}
+
+void BatchWorkerPool::finish(const std::shared_ptr<Session> &session) {
+    if (session != session_) {
+        return;
+    }
+    {
+        QMutexLocker locker(&session->mutex);
+        // Paths were added after the last worker exited; the workers started for them finish.
+        if (session->workers > 0 || !session->queue.isEmpty()) {
+            return;
+        }
+    }
+    publish();
+    session_.reset();
+    timer_->stop();
+    qCDebug(gLogBpmDetect) << metaObject()->className() << "finished.";
+    emit finished();
+}
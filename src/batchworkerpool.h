@@ -0,0 +1,128 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/** @file */
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QObject>
+#include <QtCore/QQueue>
+#include <QtCore/QStringList>
+#include <QtCore/QWaitCondition>
+
+class QThread;
+class QTimer;
+
+/**
+ * Base of objects that process queued paths on worker threads and publish the results on their own
+ * thread in batches.
+ *
+ * A session starts when paths are added while none is running and ends when its workers have
+ * emptied the queue, or on cancel(). Workers are started on demand up to maximumThreads(). While
+ * a session runs, publish() is called at most once per batch interval, and once more before
+ * finished() is emitted.
+ *
+ * Workers call the virtual methods of the subclass, so a subclass must call cancelAndWait() in its
+ * destructor.
+ */
+class BatchWorkerPool : public QObject {
+    Q_OBJECT
+public:
+    /**
+     * Constructor.
+     * @param parent Parent object.
+     */
+    explicit BatchWorkerPool(QObject *parent = nullptr);
+    ~BatchWorkerPool() override;
+    /**
+     * Set the maximum number of paths processed at the same time.
+     * @param count Number of worker threads. Values below 1 use `QThread::idealThreadCount()`.
+     */
+    void setMaximumThreads(int count);
+    /** Get the maximum number of paths processed at the same time. */
+    int maximumThreads() const;
+    /**
+     * Set how often batches are published.
+     * @param msec Interval in milliseconds.
+     */
+    void setBatchInterval(int msec);
+    /** If paths are queued or being processed. */
+    bool isRunning() const;
+    /**
+     * Queue paths. Starts a session if none is running.
+     * @param paths Paths to process.
+     */
+    void add(const QStringList &paths);
+    /**
+     * Drop the queued paths. Returns immediately: results of paths being processed are discarded
+     * and no further signals are emitted for the session.
+     */
+    void cancel();
+
+Q_SIGNALS:
+    /** Emitted when every queued path has been processed. Not emitted after cancel(). */
+    void finished();
+
+protected:
+    /** State shared by the workers started for the paths added since the session started. */
+    struct Session {
+        virtual ~Session() = default;
+        /** Guards everything but `cancelled`. */
+        QMutex mutex;
+        /** Woken when paths are queued and on cancel(). */
+        QWaitCondition queued;
+        QQueue<QString> queue;
+        /**
+         * Workers that have not exited. Counted under the mutex so that add() cannot queue paths
+         * just after the last worker decided to exit.
+         */
+        int workers = 0;
+        std::atomic_bool cancelled = false;
+    };
+
+    /** Create the state of a new session. */
+    virtual std::shared_ptr<Session> createSession() const = 0;
+    /**
+     * Queue paths. Called with the session mutex held. The default appends them to the queue.
+     * @param session Running session.
+     * @param paths Paths passed to add().
+     */
+    virtual void enqueue(Session &session, const QStringList &paths);
+    /**
+     * Get how many workers the queued paths can use. Called with the session mutex held. The
+     * default is the length of the queue.
+     */
+    virtual qsizetype usefulWorkers(const Session &session) const;
+    /** Process paths from the queue until it is empty or the session is cancelled. */
+    virtual void runWorker(const std::shared_ptr<Session> &session) = 0;
+    /** Publish the results collected since the last batch. Called only while a session runs. */
+    virtual void publish() = 0;
+    /** Cancel the session and wait for the worker threads to exit. */
+    void cancelAndWait();
+    /**
+     * Account for a worker that returns from runWorker(). Must be called with the session mutex
+     * held. The last worker to exit finishes the session on the thread that owns the pool.
+     */
+    void exitWorker(const std::shared_ptr<Session> &session);
+    /** Get the running session, or `nullptr`. */
+    template <class T>
+    T *session() const {
+        return static_cast<T *>(session_.get());
+    }
+    /**
+     * Set the object name of the worker threads.
+     * @param name Name.
+     */
+    void setThreadName(const QString &name);
+
+private:
+    void finish(const std::shared_ptr<Session> &session);
+
+    QList<QThread *> threads_;
+    QTimer *timer_ = nullptr;
+    std::shared_ptr<Session> session_;
+    QString threadName_;
+    int maximumThreads_ = 0;
+};
@@ -1,13 +1,34 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <vector>
 
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QEventLoop>
+#include <QtCore/QFileInfo>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QScopedPointer>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+#ifndef NO_GUI
 #include <QtMultimedia/QAudioDecoder>
+#endif
 
 #include "consolemain.h"
 #include "debug.h"
+#include "directorywalker.h"
 #include "ffmpegutils.h"
+#include "resultwriter.h"
+#include "track/bpmcache.h"
+#include "track/envelopecache.h"
+#include "track/fileidentity.h"
+#include "track/resultindex.h"
+#include "track/tagwriter.h"
 #include "track/track.h"
+#include "xattrtags.h"
 
 #ifndef TESTING
 #define SHOW_HELP(parser) parser.showHelp(1);
@@ -15,68 +36,631 @@
 #define SHOW_HELP(parser) return -1;
 #endif
 
-int consoleMain(QCoreApplication &app, QCommandLineParser &parser, const QStringList &files) {
+namespace {
+/** Options shared by every worker. */
+struct ConsoleOptions {
+    QString format;
+    /** Writes the tags when saving, so detection does not wait for them. */
+    TagWriter *writer = nullptr;
+    /** Format of `--output`, or nothing for plain text. */
+    std::optional<ResultWriter::Format> output;
+    bool candidates = false;
+    bool consoleProgress = true;
+    bool dedupe = false;
+    bool detect = false;
+    bool save = false;
+};
+
+/** Outcome of processing one file. Results are printed by the main thread in input order. */
+struct FileResult {
+    QString hostFileName;
+    /** BPM formatted with `--format`. */
+    QString bpm;
+    /** Formatted tempo candidates, if requested. */
+    QString candidates;
+    /** Why the file could not be processed. */
+    QString error;
+    /** Unformatted value of @a bpm. */
+    bpmtype exactBpm = 0;
+    /** Detection result before folding, or 0 if not detected. */
+    bpmtype rawBpm = 0;
+    double decodedFraction = 0;
+    /** Length in milliseconds, or 0 if not known. */
+    qint64 length = 0;
+    /** Wall times of the probe, decoding and detection stages in nanoseconds. */
+    qint64 probeTime = 0;
+    qint64 decodeTime = 0;
+    qint64 detectTime = 0;
+    /** Size of the onset envelope stored for the file. */
+    qint64 envelopeSize = 0;
+    bool cached = false;
+    bool decodable = true;
+    bool detected = false;
+    bool done = false;
+    /** If the result came from the result index, so it is not appended to it again. */
+    bool indexed = false;
+    /** If a tag write was queued for the file. */
+    bool saving = false;
+};
+
+/**
+ * Files claimed by the workers, so that a file reached under several paths (hard links), or the
+ * same audio in several files, is processed once and its result given to every path.
+ */
+class Duplicates {
+public:
+    /**
+     * Claim a file by its device and inode.
+     * @return The index of the file that claimed it first, which is @a index if none did.
+     */
+    qsizetype claimFile(const FileIdentity &identity, qsizetype index) {
+        return claim(files_, std::pair(identity.device, identity.inode), index);
+    }
+    /**
+     * Claim audio by hashAudio().
+     * @return The index of the file that claimed it first, which is @a index if none did.
+     */
+    qsizetype claimAudio(quint64 hash, qsizetype index) {
+        return claim(audio_, hash, index);
+    }
+    /** Publish the result of a file for the files waiting for it. */
+    void publish(qsizetype index, const FileResult &result) {
+        QMutexLocker locker(&mutex_);
+        results_.insert(index, result);
+        published_.wakeAll();
+    }
+    /**
+     * Wait for the result of a file. The first claimant of a file only waits for the first
+     * claimant of its audio, which never waits, so this returns.
+     */
+    FileResult wait(qsizetype index) {
+        QMutexLocker locker(&mutex_);
+        while (!results_.contains(index)) {
+            published_.wait(&mutex_);
+        }
+        return results_.value(index);
+    }
+
+private:
+    template <typename Key>
+    qsizetype claim(QHash<Key, qsizetype> &owners, const Key &key, qsizetype index) {
+        QMutexLocker locker(&mutex_);
+        const auto it = owners.constFind(key);
+        if (it != owners.cend()) {
+            return *it;
+        }
+        owners.insert(key, index);
+        return index;
+    }
+
+    QMutex mutex_;
+    QWaitCondition published_;
+    QHash<std::pair<quint64, quint64>, qsizetype> files_;
+    QHash<quint64, qsizetype> audio_;
+    QHash<qsizetype, FileResult> results_;
+};
+} // namespace
+
+static QString formatCandidates(const QList<AbstractBpmDetector::Candidate> &candidates,
+                                const QString &format) {
+    QStringList parts;
+    for (const auto &candidate : candidates) {
+        parts << QStringLiteral("%1 %2%")
+                     .arg(bpmToString(candidate.bpm, format))
+                     .arg(qRound(candidate.score * 100));
+    }
+    return parts.join(QStringLiteral(", "));
+}
+
+/**
+ * Answer from the cache without opening the file. Only used if processing the file would not
+ * change it or need its tags.
+ */
+static bool answerFromCache(const QString &file,
+                            const ConsoleOptions &options,
+                            FileResult &result) {
+    const auto cache = Track::cache();
+    BpmCache::Entry entry;
+    if (!cache || !cache->lookup(file, &entry)) {
+        return false;
+    }
+    const auto inRange = [](bpmtype bpm) {
+        return bpm >= Track::minimumBpm() && bpm <= Track::maximumBpm();
+    };
+    if (!options.detect && entry.saved && inRange(entry.bpm)) {
+        result.bpm = bpmToString(entry.bpm, options.format);
+        result.exactBpm = entry.bpm;
+    } else if (entry.rawBpm > 0 && entry.detectorVersion == Track::detectorVersion() &&
+               inRange(Track::correctBpm(entry.rawBpm))) {
+        const auto exactBpm = Track::correctBpm(entry.rawBpm);
+        const auto bpm = bpmToString(exactBpm, options.format);
+        // Saving a different value has to write the file.
+        if (options.save && !(entry.saved && bpmToString(entry.bpm, options.format) == bpm)) {
+            return false;
+        }
+        if (options.candidates) {
+            // Without stored candidates, detection runs again (from the envelope if cached).
+            const auto envelopeCache = Track::envelopeCache();
+            EnvelopeCache::Entry envelope;
+            if (!envelopeCache || !envelopeCache->lookup(file, &envelope, false) ||
+                envelope.version != Track::envelopeVersion() || envelope.candidates.isEmpty()) {
+                return false;
+            }
+            result.candidates =
+                formatCandidates(Track::foldCandidates(envelope.candidates), options.format);
+        }
+        result.bpm = bpm;
+        result.exactBpm = exactBpm;
+        result.detected = true;
+    } else {
+        return false;
+    }
+    result.hostFileName = Track::hostFileName(file);
+    result.rawBpm = entry.rawBpm;
+    result.length = entry.length;
+    result.cached = true;
+    return true;
+}
+
+/**
+ * Answer from the result index without opening the file. Only used if the file is not to be
+ * detected again or saved.
+ */
+static bool answerFromIndex(const QString &file,
+                            const ConsoleOptions &options,
+                            FileResult &result) {
+    const auto index = Track::index();
+    ResultIndex::Entry entry;
+    if (!index || options.detect || options.save || !index->lookup(file, &entry) ||
+        entry.bpm <= 0) {
+        return false;
+    }
+    result.hostFileName = Track::hostFileName(file);
+    result.bpm = bpmToString(entry.bpm, options.format);
+    result.exactBpm = entry.bpm;
+    result.rawBpm = entry.rawBpm;
+    result.length = entry.length;
+    result.cached = true;
+    result.indexed = true;
+    return true;
+}
+
+/**
+ * Answer from the BPM attribute (see Track::setBpmAttribute()) without opening the file. Only used
+ * if the file is not to be detected again.
+ */
+static bool answerFromAttribute(const QString &file,
+                                const ConsoleOptions &options,
+                                FileResult &result) {
+    if (options.detect || Track::bpmAttribute().isEmpty()) {
+        return false;
+    }
+    const auto bpm = readBpmFromAttribute(file, Track::bpmAttribute());
+    if (bpm < Track::minimumBpm() || bpm > Track::maximumBpm()) {
+        return false;
+    }
+    result.hostFileName = Track::hostFileName(file);
+    result.bpm = bpmToString(bpm, options.format);
+    result.exactBpm = bpm;
+    return true;
+}
+
+/** Append a result to the result index, if one is set. */
+static void indexResult(const QString &file, const FileResult &result) {
+    const auto index = Track::index();
+    if (!index || result.indexed || !result.decodable || result.bpm.isEmpty()) {
+        return;
+    }
+    ResultIndex::Entry entry;
+    entry.bpm = result.exactBpm;
+    entry.length = result.length;
+    if (result.detected) {
+        entry.rawBpm = result.rawBpm;
+        entry.detector = Track::detectorType() == Track::AutocorrelationDetector ?
+                             QStringLiteral("autocorrelation") :
+                             QStringLiteral("soundtouch");
+        entry.detectorVersion = Track::detectorVersion();
+    }
+    index->insert(file, entry);
+}
+
+/**
+ * Take the result of the file @a owner for @a file, which has the same audio. The tag is saved if
+ * requested, unless @a file is the same file.
+ */
+static FileResult useResultOf(qsizetype owner,
+                               const QString &file,
+                               const ConsoleOptions &options,
+                               Duplicates &duplicates,
+                               bool sameFile) {
+    auto result = duplicates.wait(owner);
+    qCDebug(gLogBpmDetect) << "Using the result of" << result.hostFileName << "for" << file;
+    if (!result.decodable) {
+        return result;
+    }
+    result.hostFileName = Track::hostFileName(file);
+    result.envelopeSize = 0;
+    result.indexed = false;
+    // The work was done for the other file.
+    result.probeTime = result.decodeTime = result.detectTime = 0;
+    result.saving = false;
+    if (options.save && !sameFile && !result.bpm.isEmpty()) {
+        Track track(file);
+        track.setFormat(options.format);
+        track.setBpm(result.exactBpm);
+        track.saveBpm(options.writer);
+        result.saving = true;
+    }
+    return result;
+}
+
+static FileResult processFile(const QString &file,
+                              qsizetype index,
+                              AbstractBpmDetector *detector,
+                              const ConsoleOptions &options,
+                              Duplicates &duplicates,
+                              const std::function<void(const QString &, qint64)> &onProgress) {
+    FileResult result;
+    result.done = true;
+    // Hard links are found by inode without reading the file.
+    FileIdentity identity;
+    if (identifyFile(file, false, &identity)) {
+        const auto owner = duplicates.claimFile(identity, index);
+        if (owner != index) {
+            return useResultOf(owner, file, options, duplicates, true);
+        }
+    }
+    if (answerFromIndex(file, options, result) || answerFromAttribute(file, options, result) ||
+        answerFromCache(file, options, result)) {
+        return result;
+    }
+    // One open serves validation, tags, the audio hash and (with the FFmpeg backend) decoding.
+    const auto useFfmpeg = Track::decoderBackend() == Track::FfmpegBackend;
+    QElapsedTimer probeTimer;
+    probeTimer.start();
+    auto probe = probeFile(file, useFfmpeg);
+    result.probeTime = probeTimer.nsecsElapsed();
+    if (!probe.hasAudio) {
+        result.decodable = false;
+        result.error = probe.error;
+        return result;
+    }
+    QAudioDecoder *decoder = nullptr;
+#ifndef NO_GUI
+    QScopedPointer<QAudioDecoder> ownedDecoder;
+    if (Track::decoderBackend() == Track::QtMultimediaBackend) {
+        ownedDecoder.reset(new QAudioDecoder);
+        decoder = ownedDecoder.data();
+    }
+#endif
+    // The context is kept back from the track until it has been hashed.
+    auto context = std::move(probe.formatContext);
+    Track track(file, probe, decoder);
+    result.hostFileName = track.hostFileName();
+    result.length = track.length();
+    if (track.hasValidBpm() && !options.detect) {
+        result.bpm = track.formatted();
+        result.exactBpm = track.bpm();
+        return result;
+    }
+    // A file's own tag wins over the result for the same audio elsewhere, so only files that are
+    // detected are read in full for the hash.
+    if (options.dedupe) {
+        probeTimer.start();
+        const auto hash = useFfmpeg ? hashAudio(context) : hashAudio(file);
+        result.probeTime += probeTimer.nsecsElapsed();
+        const auto owner = hash ? duplicates.claimAudio(hash, index) : index;
+        if (owner != index) {
+            return useResultOf(owner, file, options, duplicates, false);
+        }
+    }
+    track.setFormatContext(context);
+    context.reset();
+    track.setFormat(options.format);
+    track.setDetector(detector);
+    QEventLoop loop;
+    QObject::connect(&track, &Track::hasBpm, [&track, &result, &options](bpmtype bpm) {
+        Q_UNUSED(bpm)
+        result.detected = true;
+        result.bpm = track.formatted();
+        result.exactBpm = track.bpm();
+        result.rawBpm = track.rawBpm();
+        result.decodedFraction = track.decodedFraction();
+        result.envelopeSize = track.envelopeCacheSize();
+        if (options.candidates) {
+            result.candidates = formatCandidates(track.candidates(), options.format);
+        }
+        if (options.save) {
+            track.saveBpm(options.writer);
+            result.saving = true;
+        }
+    });
+    QObject::connect(&track, &Track::finished, &loop, &QEventLoop::quit);
+    if (options.consoleProgress) {
+        auto lastPercent = qint64(-1);
+        QObject::connect(&track,
+                         &Track::progress,
+                         [&result, &onProgress, &lastPercent](qint64 pos, qint64 length) {
+                             const auto percent = length ? (pos * 100 / length) : 0;
+                             if (percent != lastPercent) {
+                                 lastPercent = percent;
+                                 onProgress(result.hostFileName, percent);
+                             }
+                         });
+    }
+    if (track.detectBpm() == Track::Detecting) {
+        loop.exec();
+    }
+    result.detectTime = track.detectorTime();
+    result.decodeTime = std::max<qint64>(0, track.detectionTime() - track.detectorTime());
+    return result;
+}
+
+/**
+ * Make the `--output` record of a file.
+ * @param write Result of saving the tag, or `nullptr` if it was not saved.
+ */
+static ResultWriter::Record makeRecord(const QString &file,
+                                       const FileResult &result,
+                                       const TagWriteResult *write) {
+    ResultWriter::Record record;
+    record.path = result.hostFileName.isEmpty() ? file : result.hostFileName;
+    record.bpm = result.bpm;
+    record.rawBpm = result.rawBpm;
+    record.length = result.length;
+    record.probeTime = result.probeTime;
+    record.decodeTime = result.decodeTime;
+    record.detectTime = result.detectTime;
+    record.writeTime = write ? write->elapsed : 0;
+    if (!result.decodable) {
+        record.status = QStringLiteral("failed");
+        record.error =
+            result.error.isEmpty() ? QStringLiteral("File is not decodable.") : result.error;
+    } else if (result.bpm.isEmpty()) {
+        record.status = QStringLiteral("failed");
+        record.error = QStringLiteral("No BPM detected.");
+    } else if (write && !write->ok) {
+        record.status = QStringLiteral("failed");
+        record.error = write->error;
+    } else if (result.cached) {
+        record.status = QStringLiteral("cached");
+    } else if (result.detected) {
+        record.status = QStringLiteral("detected");
+    } else {
+        record.status = QStringLiteral("tagged");
+    }
+    return record;
+}
+
+int consoleMain(QCoreApplication &app, QCommandLineParser &parser, const QStringList &paths) {
+    Q_UNUSED(app)
     auto remove = parser.isSet(QStringLiteral("remove"));
-    auto consoleProgress = !parser.isSet(QStringLiteral("no-progress"));
-    auto detect = parser.isSet(QStringLiteral("detect"));
-    auto format = parser.value(QStringLiteral("format"));
-    auto save = parser.isSet(QStringLiteral("save"));
-    if (files.isEmpty()) {
+    ConsoleOptions options;
+    options.candidates = parser.isSet(QStringLiteral("candidates"));
+    options.consoleProgress = !parser.isSet(QStringLiteral("no-progress"));
+    options.dedupe = parser.isSet(QStringLiteral("dedupe"));
+    options.detect = parser.isSet(QStringLiteral("detect"));
+    options.format = parser.value(QStringLiteral("format"));
+    options.save = parser.isSet(QStringLiteral("save"));
+    if (parser.isSet(QStringLiteral("output"))) {
+        options.output = ResultWriter::formatFromName(parser.value(QStringLiteral("output")));
+        if (!options.output) {
+            SHOW_HELP(parser)
+        }
+        // Progress would be mixed into the records.
+        options.consoleProgress = false;
+    }
+    TagWriter writer;
+    options.writer = &writer;
+    if (paths.isEmpty()) {
         SHOW_HELP(parser)
     }
+    auto jobs = QThread::idealThreadCount();
+    if (parser.isSet(QStringLiteral("jobs"))) {
+        auto ok = false;
+        jobs = parser.value(QStringLiteral("jobs")).toInt(&ok);
+        if (!ok || jobs < 1) {
+            SHOW_HELP(parser)
+        }
+    }
+    QStringList files, dirs;
+    const auto recursive = parser.isSet(QStringLiteral("recursive"));
+    for (const auto &path : paths) {
+        (recursive && QFileInfo(path).isDir() ? dirs : files) << path;
+    }
+    DirectoryWalker walker;
     if (remove) {
-        for (const auto &file : files) {
+        for (const auto &file : std::as_const(files)) {
             Track(file).clearBpm();
         }
+        if (!dirs.isEmpty()) {
+            QEventLoop loop;
+            QObject::connect(&walker, &DirectoryWalker::filesFound, [](const QStringList &found) {
+                for (const auto &file : found) {
+                    Track(file).clearBpm();
+                }
+            });
+            QObject::connect(&walker, &DirectoryWalker::finished, &loop, &QEventLoop::quit);
+            walker.add(dirs);
+            loop.exec();
+        }
         return 0;
     }
-    const auto detector = new SoundTouchBpmDetector();
-    for (const auto &file : files) {
-        QEventLoop loop;
-        if (!isDecodableFile(file)) {
+    // While directories are walked, the number of files is not known, so every job is started.
+    if (dirs.isEmpty()) {
+        jobs = std::min(jobs, static_cast<int>(files.size()));
+    }
+    qCDebug(gLogBpmDetect) << "Processing" << files.size() << "files and" << dirs.size()
+                           << "directories with" << jobs << "jobs.";
+
+    // Workers pick the next file index, run detection in their own event loop and queue the result
+    // to the main thread. The main thread owns all output so lines never interleave and are printed
+    // in the order the files were given. Files found by the walker are appended to `files` as they
+    // arrive, so detection starts before the walk is complete. Tags are saved by `writer` while the
+    // workers go on to the next file, and all of them are written before returning.
+    std::vector<FileResult> results(static_cast<size_t>(files.size()));
+    QMutex filesMutex;
+    QWaitCondition filesAdded;
+    auto walking = !dirs.isEmpty();
+    qsizetype nextFile = 0;
+    qsizetype nextToPrint = 0;
+    Duplicates duplicates;
+    QEventLoop mainLoop;
+    QObject receiver;
+    std::optional<ResultWriter> output;
+    if (options.output) {
+        output.emplace(*options.output, std::cout);
+    }
+    /** Results of tag writes not yet printed with `--output`, by file. */
+    QHash<QString, TagWriteResult> writes;
+    const auto printReady = [&]() {
+        while (nextToPrint < files.size() && results[static_cast<size_t>(nextToPrint)].done) {
+            const auto &result = results[static_cast<size_t>(nextToPrint)];
+            if (output) {
+                // The record waits for the tag write so it can report its outcome and time.
+                const auto &file = files[nextToPrint];
+                const auto write = writes.constFind(file);
+                if (result.saving && write == writes.cend()) {
+                    break;
+                }
+                output->write(makeRecord(file, result, result.saving ? &*write : nullptr));
+                writes.remove(file);
+                ++nextToPrint;
+                continue;
+            }
+            if (!result.decodable) {
 #ifndef TESTING
-            qCWarning(gLogBpmDetect) << "File is not decodable, skipping:" << file;
+                qCWarning(gLogBpmDetect)
+                    << "File is not decodable, skipping:" << files[nextToPrint];
 #else
-            std::cout << "File is not decodable, skipping: " << file.toStdString() << "\n";
+                std::cout << "File is not decodable, skipping: "
+                          << files[nextToPrint].toStdString() << "\n";
 #endif
-            continue;
-        }
-        Track track(file, new QAudioDecoder(&app));
-        if (track.hasValidBpm() && !detect) {
-            track.printBpm();
-            continue;
-        }
-        track.setFormat(format);
-        detector->reset();
-        track.setDetector(detector);
-        QObject::connect(
-            &track, &Track::hasBpm, [&track, &loop, &save, &consoleProgress](bpmtype bpm) {
-                Q_UNUSED(bpm)
-                if (consoleProgress) {
+            } else if (!result.bpm.isEmpty()) {
+                if (result.detected && options.consoleProgress) {
                     QTextStream(stdout) << "\r";
                 }
-                track.printBpm();
-                if (save) {
-                    track.saveBpm();
+                std::cout << result.hostFileName.toStdString() << ": " << result.bpm.toStdString()
+                          << " BPM";
+                if (result.detected && !result.cached && Track::convergence().enabled) {
+                    // Shows how much decoding stopping early saved.
+                    std::cout << " (decoded " << qRound(result.decodedFraction * 100) << "%)";
                 }
-                loop.quit();
-                QTextStream(stdout).flush();
-            });
-        if (consoleProgress) {
-            QObject::connect(&track, &Track::progress, [&track](quint64 pos, quint64 length) {
-                const auto percent = length ? (pos * 100 / length) : 0;
-                QTextStream(stdout) << "\r" << track.hostFileName() << ": " << percent << "%";
-                if (pos >= length) {
+                if (!result.candidates.isEmpty()) {
+                    std::cout << " [candidates: " << result.candidates.toStdString() << "]";
+                }
+                std::cout << std::endl;
+            }
+            ++nextToPrint;
+        }
+        QTextStream(stdout).flush();
+        if (!walking && nextToPrint == files.size()) {
+            mainLoop.quit();
+        }
+    };
+    const auto onProgress = [&receiver](const QString &hostFileName, qint64 percent) {
+        QMetaObject::invokeMethod(
+            &receiver,
+            [hostFileName, percent]() {
+                QTextStream(stdout) << "\r" << hostFileName << ": " << percent << "%";
+                if (percent >= 100) {
                     // LCOV_EXCL_START
                     QTextStream(stdout) << "\n";
                     // LCOV_EXCL_STOP
                 }
                 QTextStream(stdout).flush();
+            },
+            Qt::QueuedConnection);
+    };
+    const auto worker = [&]() {
+        std::unique_ptr<AbstractBpmDetector> detector(Track::createDetector());
+        while (true) {
+            qsizetype index;
+            QString file;
+            {
+                QMutexLocker locker(&filesMutex);
+                while (nextFile >= files.size() && walking) {
+                    filesAdded.wait(&filesMutex);
+                }
+                if (nextFile >= files.size()) {
+                    break;
+                }
+                index = nextFile++;
+                file = files[index];
+            }
+            auto result =
+                processFile(file, index, detector.get(), options, duplicates, onProgress);
+            indexResult(file, result);
+            duplicates.publish(index, result);
+            QMetaObject::invokeMethod(
+                &receiver,
+                [&results, &printReady, index, result]() {
+                    results[static_cast<size_t>(index)] = result;
+                    printReady();
+                },
+                Qt::QueuedConnection);
+        }
+    };
+    QObject::connect(&walker, &DirectoryWalker::filesFound, [&](const QStringList &found) {
+        // Only the main thread writes `files` and `results`, so it may read them unlocked.
+        results.resize(static_cast<size_t>(files.size() + found.size()));
+        QMutexLocker locker(&filesMutex);
+        files.append(found);
+        filesAdded.wakeAll();
+    });
+    QObject::connect(&walker, &DirectoryWalker::finished, [&]() {
+        {
+            QMutexLocker locker(&filesMutex);
+            walking = false;
+            filesAdded.wakeAll();
+        }
+        printReady();
+    });
+    if (output) {
+        QObject::connect(
+            &writer,
+            &TagWriter::written,
+            &receiver,
+            [&](const QString &fileName, const QString &bpm, const TagWriteResult &result) {
+                Q_UNUSED(bpm)
+                writes.insert(fileName, result);
+                printReady();
             });
+    }
+    walker.add(dirs);
+    QList<QThread *> threads;
+    for (auto i = 0; i < jobs; ++i) {
+        auto thread = QThread::create(worker);
+        thread->setObjectName(QStringLiteral("worker %1").arg(i + 1));
+        threads << thread;
+        thread->start();
+    }
+    mainLoop.exec();
+    for (auto thread : threads) {
+        thread->wait();
+        delete thread;
+    }
+    writer.flush();
+    if (output) {
+        output->finish();
+    }
+    if (options.save) {
+        const auto summary = writer.summary();
+        std::cerr << "Saved " << summary.written << " tags in " << summary.directories
+                  << " directories (" << summary.inPlace << " in place), " << summary.failed
+                  << " failed." << std::endl;
+    }
+    qint64 envelopeBytes = 0;
+    qint64 envelopes = 0;
+    for (const auto &result : results) {
+        if (result.envelopeSize > 0) {
+            envelopeBytes += result.envelopeSize;
+            ++envelopes;
         }
-        track.detectBpm();
-        loop.exec();
     }
-    delete detector;
+    if (envelopes > 0) {
+        std::cerr << "Cached " << envelopes << " onset envelopes: " << envelopeBytes / 1024
+                  << " KiB, " << envelopeBytes / envelopes << " bytes per track." << std::endl;
+    }
     return 0;
 }
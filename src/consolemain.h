@@ -9,7 +9,8 @@
 /**
  * Console entry point.
  * @param parser Command line parser.
- * @param files List of files to process.
+ * @param files List of files to process. With the `recursive` option, directories are walked
+ * (see DirectoryWalker) and the files found are processed after the other files.
  * @return Exit code of the application.
  */
 int consoleMain(QCoreApplication &app, QCommandLineParser &parser, const QStringList &files);
@@ -0,0 +1,157 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <QtCore/QDirIterator>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QSet>
+
+#include "directorywalker.h"
+
+/** Bytes read by isAudioFile() for files without a known extension. */
+static constexpr qint64 kSignatureSize = 12;
+
+/** Session of a walk. `queued` is also woken when the last busy worker finds the queue empty. */
+struct DirectoryWalker::Walk : Session {
+    /** Files found but not yet published. */
+    QStringList ready;
+    /** Workers listing a directory, which may queue subdirectories. */
+    int busy = 0;
+};
+
+static const QSet<QString> &audioSuffixes() {
+    static const QSet<QString> suffixes{
+        QStringLiteral("aac"),  QStringLiteral("ac3"),  QStringLiteral("aif"),
+        QStringLiteral("aifc"), QStringLiteral("aiff"), QStringLiteral("alac"),
+        QStringLiteral("ape"),  QStringLiteral("caf"),  QStringLiteral("dff"),
+        QStringLiteral("dsf"),  QStringLiteral("flac"), QStringLiteral("m4a"),
+        QStringLiteral("mka"),  QStringLiteral("mp2"),  QStringLiteral("mp3"),
+        QStringLiteral("mp4"),  QStringLiteral("mpc"),  QStringLiteral("oga"),
+        QStringLiteral("ogg"),  QStringLiteral("opus"), QStringLiteral("spx"),
+        QStringLiteral("tta"),  QStringLiteral("wav"),  QStringLiteral("wave"),
+        QStringLiteral("webm"), QStringLiteral("wma"),  QStringLiteral("wv"),
+    };
+    return suffixes;
+}
+
+/** If @a header starts with the signature of a container or stream FFmpeg commonly decodes. */
+static bool hasAudioSignature(const QByteArray &header) {
+    static const QList<QByteArray> prefixes{
+        QByteArrayLiteral("ID3"),  // MP3 with ID3v2 tag.
+        QByteArrayLiteral("fLaC"), // FLAC.
+        QByteArrayLiteral("OggS"), // Ogg.
+        QByteArrayLiteral("RIFF"), // WAV.
+        QByteArrayLiteral("RF64"), // WAV over 4 GiB.
+        QByteArrayLiteral("FORM"), // AIFF.
+        QByteArrayLiteral("FRM8"), // DSDIFF.
+        QByteArrayLiteral("DSD "), // DSF.
+        QByteArrayLiteral("MAC "), // Monkey's Audio.
+        QByteArrayLiteral("wvpk"), // WavPack.
+        QByteArrayLiteral("MPCK"), // Musepack SV8.
+        QByteArrayLiteral("MP+"),  // Musepack SV7.
+        QByteArrayLiteral("TTA1"), // True Audio.
+        QByteArrayLiteral("caff"), // Core Audio Format.
+        QByteArrayLiteral("\x1a\x45\xdf\xa3"), // Matroska and WebM.
+        QByteArrayLiteral("\x30\x26\xb2\x75"), // ASF (WMA).
+        QByteArrayLiteral("\x0b\x77"),         // AC-3.
+    };
+    for (const auto &prefix : prefixes) {
+        if (header.startsWith(prefix)) {
+            return true;
+        }
+    }
+    // ISO base media (MP4, M4A).
+    if (header.mid(4, 4) == QByteArrayLiteral("ftyp")) {
+        return true;
+    }
+    // MPEG audio or ADTS frame sync without a tag.
+    return header.size() >= 2 && static_cast<quint8>(header.at(0)) == 0xff &&
+           (static_cast<quint8>(header.at(1)) & 0xe0) == 0xe0;
+}
+
+DirectoryWalker::DirectoryWalker(QObject *parent) : BatchWorkerPool(parent) {
+}
+
+DirectoryWalker::~DirectoryWalker() {
+    cancelAndWait();
+}
+
+bool DirectoryWalker::isAudioFile(const QString &fileName) {
+    const auto suffix = QFileInfo(fileName).suffix().toLower();
+    if (audioSuffixes().contains(suffix)) {
+        return true;
+    }
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    return hasAudioSignature(file.read(kSignatureSize));
+}
+
+std::shared_ptr<BatchWorkerPool::Session> DirectoryWalker::createSession() const {
+    return std::make_shared<Walk>();
+}
+
+void DirectoryWalker::enqueue(Session &session, const QStringList &paths) {
+    for (const auto &path : paths) {
+        session.queue.enqueue(QFileInfo(path).absoluteFilePath());
+    }
+}
+
+qsizetype DirectoryWalker::usefulWorkers(const Session &session) const {
+    Q_UNUSED(session)
+    // Each directory listed may queue subdirectories.
+    return maximumThreads();
+}
+
+void DirectoryWalker::publish() {
+    const auto walk = session<Walk>();
+    QStringList files;
+    {
+        QMutexLocker locker(&walk->mutex);
+        files.swap(walk->ready);
+    }
+    if (!files.isEmpty()) {
+        emit filesFound(files);
+    }
+}
+
+void DirectoryWalker::runWorker(const std::shared_ptr<Session> &session) {
+    auto &walk = static_cast<Walk &>(*session);
+    QMutexLocker locker(&walk.mutex);
+    while (true) {
+        // Busy workers may still queue subdirectories, so an empty queue alone does not end the
+        // walk.
+        while (!walk.cancelled && walk.queue.isEmpty() && walk.busy > 0) {
+            walk.queued.wait(&walk.mutex);
+        }
+        if (walk.cancelled || walk.queue.isEmpty()) {
+            walk.queued.wakeAll();
+            exitWorker(session);
+            return;
+        }
+        const auto path = walk.queue.dequeue();
+        ++walk.busy;
+        locker.unlock();
+
+        QStringList dirs, files;
+        QDirIterator it(path,
+                        QDir::Dirs | QDir::Files | QDir::Hidden | QDir::NoSymLinks |
+                            QDir::NoDotAndDotDot);
+        while (it.hasNext() && !walk.cancelled) {
+            const auto info = it.nextFileInfo();
+            if (info.isDir()) {
+                dirs << info.absoluteFilePath();
+            } else if (isAudioFile(info.absoluteFilePath())) {
+                files << info.absoluteFilePath();
+            }
+        }
+        files.sort();
+
+        locker.relock();
+        --walk.busy;
+        if (!walk.cancelled) {
+            walk.queue.append(dirs);
+            walk.ready.append(files);
+        }
+        walk.queued.wakeAll();
+    }
+}
@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/** @file */
+#pragma once
+
+#include "batchworkerpool.h"
+
+/**
+ * Finds audio files under directories on worker threads.
+ *
+ * Directories are listed in parallel, one directory per worker at a time, so deep or slow (network)
+ * trees are not walked one level after another. Symbolic links are not followed. Files with a
+ * known audio extension are accepted without being opened; other files are accepted if their first
+ * bytes look like an audio container (see isAudioFile()). Found files are published on the thread
+ * that owns the walker in batches, at most once per batch interval, while the walk continues.
+ */
+class DirectoryWalker : public BatchWorkerPool {
+    Q_OBJECT
+public:
+    /**
+     * Constructor.
+     * @param parent Parent object.
+     */
+    explicit DirectoryWalker(QObject *parent = nullptr);
+    /** Cancels the walk and waits for the worker threads to exit. */
+    ~DirectoryWalker() override;
+    /**
+     * Check cheaply if a file is likely to be audio.
+     * @param fileName Path to the file.
+     * @return `true` if the extension is a known audio extension, or if the file starts with the
+     * signature of an audio container or stream.
+     */
+    static bool isAudioFile(const QString &fileName);
+
+Q_SIGNALS:
+    /**
+     * Audio files found since the last batch.
+     * @param files Absolute paths, sorted within each directory.
+     */
+    void filesFound(const QStringList &files);
+
+protected:
+    std::shared_ptr<Session> createSession() const override;
+    void enqueue(Session &session, const QStringList &paths) override;
+    qsizetype usefulWorkers(const Session &session) const override;
+    void runWorker(const std::shared_ptr<Session> &session) override;
+    void publish() override;
+
+private:
+    struct Walk;
+};
@@ -1,14 +1,21 @@
-#include <QtCore/QDir>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+
 #include <QtCore/QFile>
 #include <QtCore/QFileInfo>
 #include <QtCore/QString>
 #include <QtCore/QTemporaryFile>
 extern "C" {
 #include <libavformat/avformat.h>
+#include <libavutil/murmur3.h>
 }
 
 #include "debug.h"
 #include "ffmpegutils.h"
+#include "inplacetagwriter.h"
+#include "profiler.h"
+#include "tracer.h"
 #include "utils.h"
 
 static const auto kBpmKeyTBpm = QStringLiteral("TBPM");
@@ -18,360 +25,369 @@ static const auto kNameM4a = QStringLiteral("m4a");
 static const auto kNameMp3 = QStringLiteral("mp3");
 
 // https://github.com/joncampbell123/composite-video-simulator/issues/5#issuecomment-611885908
-Q_ALWAYS_INLINE QString av_errToQString(int errnum) {
+QString av_errToQString(int errnum) {
     char str[AV_ERROR_MAX_STRING_SIZE];
     return QString::fromUtf8(av_make_error_string(str, AV_ERROR_MAX_STRING_SIZE, errnum));
 }
 
-static QString lastError;
-
-static void setLastError(const QString &error) {
-    lastError = error;
-}
-
-QString getLastError() {
-    return lastError;
-}
-
-bool isDecodableFile(const QString &fileName) {
-    AVFormatContext *fmt_ctx = nullptr;
+static bool findStreamInfo(AVFormatContext *fmt_ctx, const QString &fileName, ProbeResult *result) {
     int ret;
-    if ((ret = avformat_open_input(&fmt_ctx, fileName.toUtf8().constData(), nullptr, nullptr)) !=
-        0) {
-        auto errStr = av_errToQString(ret);
-        // LCOV_EXCL_START
-        qCDebug(gLogBpmDetect) << "libavformat failed to open file:" << fileName
-                               << ". avformat_open_input() returned" << ret << errStr;
-        // LCOV_EXCL_STOP
-        setLastError(errStr);
-        return false;
-    }
     if ((ret = avformat_find_stream_info(fmt_ctx, nullptr)) < 0) {
         // LCOV_EXCL_START
-        auto errStr = av_errToQString(ret);
+        result->error = av_errToQString(ret);
         qCDebug(gLogBpmDetect) << "libavformat failed to open file:" << fileName
-                               << ". avformat_find_stream_info() returned" << ret << errStr;
-        setLastError(errStr);
-        avformat_close_input(&fmt_ctx);
+                               << ". avformat_find_stream_info() returned" << ret << result->error;
         return false;
+        // LCOV_EXCL_STOP
+    }
+    return true;
+}
+
+/**
+ * Hash the compressed packets of an audio stream with MurmurHash3. Tags are not part of the
+ * packets, so files that only differ in their tags hash the same.
+ * @return The hash, never 0, or 0 if a packet could not be read.
+ */
+static quint64 hashAudioPackets(AVFormatContext *fmt_ctx, const AVStream *stream) {
+    std::unique_ptr<AVMurMur3, decltype(&av_free)> murmur(av_murmur3_alloc(), av_free);
+    std::unique_ptr<AVPacket, void (*)(AVPacket *)> packet(
+        av_packet_alloc(), [](AVPacket *p) { av_packet_free(&p); });
+    if (!murmur || !packet) {
+        return 0; // LCOV_EXCL_LINE
     }
-    // LCOV_EXCL_STOP
-    auto hasAudio = false;
-    for (AVStream *stream : unsafeSpan(fmt_ctx->streams, fmt_ctx->nb_streams)) {
+    av_murmur3_init(murmur.get());
+    // The same packets in another codec are other audio.
+    const auto codecId = static_cast<quint32>(stream->codecpar->codec_id);
+    av_murmur3_update(murmur.get(), reinterpret_cast<const uint8_t *>(&codecId), sizeof(codecId));
+    int ret;
+    while ((ret = av_read_frame(fmt_ctx, packet.get())) >= 0) {
+        if (packet->stream_index == stream->index && packet->data) {
+            av_murmur3_update(murmur.get(), packet->data, static_cast<size_t>(packet->size));
+        }
+        av_packet_unref(packet.get());
+    }
+    if (ret != AVERROR_EOF) {
+        qCDebug(gLogBpmDetect) << "Cannot hash audio packets:" << av_errToQString(ret);
+        return 0;
+    }
+    uint8_t digest[16];
+    av_murmur3_final(murmur.get(), digest);
+    quint64 hash;
+    std::memcpy(&hash, digest, sizeof(hash));
+    return qMax<quint64>(1, hash);
+}
+
+/** Get the first audio stream, or `nullptr` if there is none. */
+static const AVStream *firstAudioStream(const AVFormatContext *fmt_ctx) {
+    for (const AVStream *stream : unsafeSpan(fmt_ctx->streams, fmt_ctx->nb_streams)) {
         if (stream && stream->codecpar && stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
-            hasAudio = true;
-            break;
+            return stream;
         }
     }
-    avformat_close_input(&fmt_ctx);
-    qCDebug(gLogBpmDetect) << "File:" << fileName << "has audio:" << hasAudio;
-    setLastError(QString());
-    return hasAudio;
+    return nullptr;
 }
 
-static QString getTemporaryFileName(const QString &fileName, bool *error) {
-    QTemporaryFile tempFile;
-    static const auto tempFileTemplate = QStringLiteral("/XXXXXX.");
-    tempFile.setFileTemplate(QDir::tempPath() + tempFileTemplate + QFileInfo(fileName).suffix());
-    *error = !tempFile.open();
-    if (*error) {
-        // LCOV_EXCL_START
-        qCDebug(gLogBpmDetect) << "Failed to create temporary file." << tempFile.errorString();
-        setLastError(tempFile.errorString());
-        return QString();
-        // LCOV_EXCL_STOP
+/**
+ * Get the length in milliseconds as known from the headers alone (Xing/Info frame, FLAC STREAMINFO,
+ * MP4 `mvhd`/`mdhd`, Ogg granule positions), or 0 if unknown.
+ */
+static qint64 headerDuration(const AVFormatContext *fmt_ctx) {
+    if (fmt_ctx->duration != AV_NOPTS_VALUE && fmt_ctx->duration > 0) {
+        return static_cast<qint64>(fmt_ctx->duration / (AV_TIME_BASE / 1000));
     }
-    tempFile.close();
-    setLastError(QString());
-    return tempFile.fileName();
+    qint64 length = 0;
+    for (const AVStream *stream : unsafeSpan(fmt_ctx->streams, fmt_ctx->nb_streams)) {
+        if (stream && stream->codecpar && stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO &&
+            stream->duration != AV_NOPTS_VALUE && stream->duration > 0) {
+            length = qMax(length,
+                          static_cast<qint64>(
+                              av_rescale_q(stream->duration, stream->time_base, {1, 1000})));
+        }
+    }
+    return length;
 }
 
-bool storeBpmInFile(const QString &fileName, const QString &sBpm) {
-    qCDebug(gLogBpmDetect) << "Storing BPM:" << sBpm << "to file:" << fileName;
+ProbeResult probeFile(const QString &fileName, bool keepOpen) {
+    const Profiler::Timer timer(Profiler::Probe);
+    Tracer::Span span("probe", fileName);
+    static const auto keyArtist = QStringLiteral("artist");
+    static const auto keyTitle = QStringLiteral("title");
+    ProbeResult result;
     AVFormatContext *fmt_ctx = nullptr;
-    auto ret = avformat_open_input(&fmt_ctx, fileName.toUtf8().constData(), nullptr, nullptr);
-    if (ret < 0) {
-        auto errStr = av_errToQString(ret);
-        // LCOV_EXCL_START
+    int ret;
+    const auto openStart = Tracer::now();
+    ret = avformat_open_input(&fmt_ctx, fileName.toUtf8().constData(), nullptr, nullptr);
+    Tracer::complete("open", fileName, openStart);
+    if (ret != 0) {
+        result.error = av_errToQString(ret);
         qCDebug(gLogBpmDetect) << "libavformat failed to open file:" << fileName
-                               << ". avformat_open_input() returned" << ret << errStr;
-        // LCOV_EXCL_STOP
-        setLastError(errStr);
-        return false;
+                               << ". avformat_open_input() returned" << ret << result.error;
+        return result;
     }
-    // Retrieve stream information.
-    ret = avformat_find_stream_info(fmt_ctx, nullptr);
-    if (ret < 0) {
-        // LCOV_EXCL_START
-        auto errStr = av_errToQString(ret);
-        qCDebug(gLogBpmDetect) << "libavformat failed to open file:" << fileName
-                               << ". avformat_find_stream_info() returned" << ret << errStr;
-        avformat_close_input(&fmt_ctx);
-        setLastError(errStr);
-        return false;
+    result.opened = true;
+    std::shared_ptr<AVFormatContext> context(
+        fmt_ctx, [](AVFormatContext *ctx) { avformat_close_input(&ctx); });
+    // Tags, stream types and (for most formats) the length are known once the headers are read, so
+    // avformat_find_stream_info(), which decodes frames, is only used when the headers are not
+    // enough.
+    const auto needsStreamInfo =
+        fmt_ctx->nb_streams == 0 || (fmt_ctx->ctx_flags & AVFMTCTX_NOHEADER);
+    if (needsStreamInfo && !findStreamInfo(fmt_ctx, fileName, &result)) {
+        return result; // LCOV_EXCL_LINE
     }
-    // LCOV_EXCL_STOP
-    // Set BPM metadata.
+    result.hasAudio = firstAudioStream(fmt_ctx) != nullptr;
+    qCDebug(gLogBpmDetect) << "File:" << fileName << "has audio:" << result.hasAudio;
     const auto name = QString::fromUtf8(fmt_ctx->iformat ? fmt_ctx->iformat->name : "");
-    const auto key = name.contains(kNameMp3) ? "TBPM" : name.contains(kNameM4a) ? "tmpo" : "bpm";
-    qCDebug(gLogBpmDetect) << "Using metadata key:" << key;
-    av_dict_set(&fmt_ctx->metadata, key, sBpm.toUtf8().constData(), 0);
-    // Prepare output file name.
-    bool error = false;
-    auto outFile = getTemporaryFileName(fileName, &error);
-    if (error) {
+    result.bpmKey = name.contains(kNameMp3) ? kBpmKeyTBpm :
+                    name.contains(kNameM4a) ? kBpmKeyTmpo :
+                                              kBpmKeyBpm;
+    qCDebug(gLogBpmDetect) << "Using metadata key for BPM:" << result.bpmKey;
+    const auto bpmKey = result.bpmKey.toLower();
+    const AVDictionaryEntry *e = nullptr;
+    while ((e = av_dict_iterate(fmt_ctx->metadata, e))) {
         // LCOV_EXCL_START
-        avformat_close_input(&fmt_ctx);
-        return false;
-    }
-    // LCOV_EXCL_STOP
-    qCDebug(gLogBpmDetect) << "Temporary file for updated metadata:" << outFile;
-    AVFormatContext *out_ctx = nullptr;
-    ret = avformat_alloc_output_context2(&out_ctx, nullptr, nullptr, outFile.toUtf8().constData());
-    if (ret < 0 || !out_ctx) {
-        // LCOV_EXCL_START
-        auto errStr = av_errToQString(ret);
-        qCDebug(gLogBpmDetect) << "libavformat failed to allocate output context for file:"
-                               << outFile << ". avformat_alloc_output_context2() returned" << ret
-                               << errStr;
-        avformat_close_input(&fmt_ctx);
-        setLastError(errStr);
-        return false;
-    }
-    // LCOV_EXCL_STOP
-    // Copy streams from input to output.
-    auto streams = unsafeSpan(fmt_ctx->streams, fmt_ctx->nb_streams);
-    for (const auto *in_stream : streams) {
-        auto *out_stream = avformat_new_stream(out_ctx, nullptr);
-        if (!out_stream) {
-            // LCOV_EXCL_START
-            qCDebug(gLogBpmDetect) << "libavformat failed to create output stream.";
-            setLastError(QObject::tr("libavformat failed to create output stream."));
-            avformat_close_input(&fmt_ctx);
-            avformat_free_context(out_ctx);
-            return false;
-            // LCOV_EXCL_STOP
-        }
-        ret = avcodec_parameters_copy(out_stream->codecpar, in_stream->codecpar);
-        if (ret < 0) {
-            // LCOV_EXCL_START
-            auto errStr = av_errToQString(ret);
-            qCDebug(gLogBpmDetect)
-                << "libavformat failed to copy codec parameters. avcodec_parameters_copy() returned"
-                << ret << errStr;
-            setLastError(errStr);
-            avformat_close_input(&fmt_ctx);
-            avformat_free_context(out_ctx);
-            return false;
+        auto key = QString::fromUtf8(e->key).toLower();
+        qCDebug(gLogBpmDetect) << "Metadata key:" << key;
+        if (key == bpmKey) {
+            result.bpm = QString::fromUtf8(e->value).toDouble();
+        } else if (key == keyArtist) {
+            result.artist = QString::fromUtf8(e->value);
+        } else if (key == keyTitle) {
+            result.title = QString::fromUtf8(e->value);
         }
         // LCOV_EXCL_STOP
-        out_stream->time_base = in_stream->time_base;
     }
-    // Copy global metadata.
-    av_dict_copy(&out_ctx->metadata, fmt_ctx->metadata, 0);
-    // Open output file.
-    if (!(out_ctx->oformat->flags & AVFMT_NOFILE)) {
-        ret = avio_open(&out_ctx->pb, outFile.toUtf8().constData(), AVIO_FLAG_WRITE);
-        if (ret < 0) {
+    if ((!static_cast<int>(result.bpm) || result.artist.isEmpty() || result.title.isEmpty()) &&
+        fmt_ctx->nb_streams > 0 && fmt_ctx->streams[0] && fmt_ctx->streams[0]->metadata) {
+        // Get the first stream's metadata if there is no global metadata.
+        e = nullptr;
+        while ((e = av_dict_iterate(fmt_ctx->streams[0]->metadata, e))) {
             // LCOV_EXCL_START
-            auto errStr = av_errToQString(ret);
-            qCDebug(gLogBpmDetect) << "libavformat failed to open output file:" << outFile
-                                   << ". avio_open() returned" << ret << errStr;
-            setLastError(errStr);
-            avformat_close_input(&fmt_ctx);
-            avformat_free_context(out_ctx);
-            return false;
+            auto key = QString::fromUtf8(e->key).toLower();
+            qCDebug(gLogBpmDetect) << "Stream Metadata key:" << key;
+            if (key == bpmKey && !static_cast<int>(result.bpm)) {
+                result.bpm = QString::fromUtf8(e->value).toDouble();
+            } else if (key == keyArtist && result.artist.isEmpty()) {
+                result.artist = QString::fromUtf8(e->value);
+            } else if (key == keyTitle && result.title.isEmpty()) {
+                result.title = QString::fromUtf8(e->value);
+            }
+            // LCOV_EXCL_STOP
         }
-        // LCOV_EXCL_STOP
     }
-    // Write header.
-    ret = avformat_write_header(out_ctx, nullptr);
-    if (ret < 0) {
-        // LCOV_EXCL_START
-        auto errStr = av_errToQString(ret);
-        qCDebug(gLogBpmDetect) << "libavformat failed to write header to output file:" << outFile
-                               << ". avformat_write_header() returned" << ret << errStr;
-        setLastError(errStr);
-        avformat_close_input(&fmt_ctx);
-        if (!(out_ctx->oformat->flags & AVFMT_NOFILE)) {
-            avio_closep(&out_ctx->pb);
+    // Read length in milliseconds.
+    result.length = headerDuration(fmt_ctx);
+    if (!result.length && !needsStreamInfo) {
+        qCDebug(gLogBpmDetect) << "Length not in headers, probing stream info for file:"
+                               << fileName;
+        if (!findStreamInfo(fmt_ctx, fileName, &result)) {
+            return result; // LCOV_EXCL_LINE
         }
-        avformat_free_context(out_ctx);
-        return false;
-    }
-    // LCOV_EXCL_STOP
-    // Write packets (copy mode).
-    AVPacket pkt;
-    while (av_read_frame(fmt_ctx, &pkt) >= 0) {
-        // Find output stream index.
-        pkt.stream_index = pkt.stream_index;
-        ret = av_interleaved_write_frame(out_ctx, &pkt);
-        av_packet_unref(&pkt);
-        if (ret < 0) {
-            // LCOV_EXCL_START
-            auto errStr = av_errToQString(ret);
-            qCCritical(gLogBpmDetect)
-                << "libavformat failed to write frame. av_interleaved_write_frame() returned" << ret
-                << errStr;
-            setLastError(errStr);
-            break;
+        if (fmt_ctx->duration != AV_NOPTS_VALUE) {
+            result.length = static_cast<qint64>(fmt_ctx->duration / (AV_TIME_BASE / 1000));
         }
-        // LCOV_EXCL_STOP
     }
-    // Write trailer.
-    av_write_trailer(out_ctx);
-    // Clean up.
-    avformat_close_input(&fmt_ctx);
-    if (!(out_ctx->oformat->flags & AVFMT_NOFILE)) {
-        avio_closep(&out_ctx->pb);
+    span.setArg(QStringLiteral("durationMs"), result.length);
+    if (keepOpen && result.hasAudio) {
+        result.formatContext = context;
     }
-    avformat_free_context(out_ctx);
-    // Replace original file with new file.
-    QFile fi(fileName);
-    if (!fi.remove(fileName)) {
+    return result;
+}
+
+quint64 hashAudio(std::shared_ptr<AVFormatContext> &context) {
+    const auto stream = context ? firstAudioStream(context.get()) : nullptr;
+    if (!stream) {
+        return 0;
+    }
+    const auto hash = hashAudioPackets(context.get(), stream);
+    const auto start = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+    int ret;
+    if ((ret = av_seek_frame(context.get(), stream->index, start, AVSEEK_FLAG_BACKWARD)) < 0) {
         // LCOV_EXCL_START
-        qCCritical(gLogBpmDetect) << "Failed to delete original file" << fileName << "."
-                                  << fi.errorString();
-        setLastError(fi.errorString());
-        return false;
+        qCDebug(gLogBpmDetect) << "Cannot rewind after hashing audio:" << av_errToQString(ret);
+        context.reset();
         // LCOV_EXCL_STOP
     }
-    if (!fi.rename(outFile, fileName)) {
-        // LCOV_EXCL_START
-        qCCritical(gLogBpmDetect) << "Failed to replace original file with updated metadata file:"
-                                  << fileName << "." << fi.errorString();
-        setLastError(fi.errorString());
+    return hash;
+}
+
+quint64 hashAudio(const QString &fileName) {
+    auto context = probeFile(fileName, true).formatContext;
+    return hashAudio(context);
+}
+
+bool isDecodableFile(const QString &fileName, QString *error) {
+    const auto probe = probeFile(fileName);
+    if (error) {
+        *error = probe.error;
+    }
+    return probe.hasAudio;
+}
+
+/** Deletes a format context opened with `avformat_open_input()`. */
+struct InputContextDeleter {
+    void operator()(AVFormatContext *ctx) const {
+        avformat_close_input(&ctx);
+    }
+};
+
+/** Closes the file of an output format context and deletes it. */
+struct OutputContextDeleter {
+    void operator()(AVFormatContext *ctx) const {
+        if (ctx->pb && !(ctx->oformat->flags & AVFMT_NOFILE)) {
+            avio_closep(&ctx->pb);
+        }
+        avformat_free_context(ctx);
+    }
+};
+
+static TagWriteResult writeFailed(const QString &error) {
+    TagWriteResult result;
+    result.error = error;
+    return result;
+}
+
+/**
+ * Replace @a target with @a source with a single `rename(2)` (`MoveFileEx()` on Windows), so that
+ * @a target is always either the old or the new file. Both must be on the same file system.
+ */
+static bool replaceFile(const QString &source, const QString &target, QString *error) {
+    std::error_code ec;
+    std::filesystem::rename(std::filesystem::path(source.toStdU16String()),
+                            std::filesystem::path(target.toStdU16String()),
+                            ec);
+    if (ec) {
+        *error = QString::fromStdString(ec.message());
         return false;
-        // LCOV_EXCL_STOP
     }
-    setLastError(QString());
     return true;
 }
 
-bool removeBpmFromFile(const QString &fileName) {
-    qCDebug(gLogBpmDetect) << "Removing BPM metadata from file:" << fileName;
+/**
+ * Copy the packets of a file into a new file with the BPM tag set or removed, and replace the file
+ * with it.
+ * @param fileName The path to the audio file.
+ * @param sBpm The BPM value to store, or an empty string to remove the tag.
+ */
+static TagWriteResult remuxWithBpm(const QString &fileName, const QString &sBpm) {
+    const auto remove = sBpm.isEmpty();
     AVFormatContext *fmt_ctx = nullptr;
     auto ret = avformat_open_input(&fmt_ctx, fileName.toUtf8().constData(), nullptr, nullptr);
     if (ret < 0) {
-        auto errStr = av_errToQString(ret);
-        qCCritical(gLogBpmDetect) << "libavformat failed to open file:" << fileName
-                                  << ". avformat_open_input() returned" << ret << errStr;
-        setLastError(errStr);
-        return false;
+        const auto errStr = av_errToQString(ret);
+        qCWarning(gLogBpmDetect) << "libavformat failed to open file:" << fileName
+                                 << ". avformat_open_input() returned" << ret << errStr;
+        return writeFailed(errStr);
     }
+    std::unique_ptr<AVFormatContext, InputContextDeleter> input(fmt_ctx);
     // Retrieve stream information.
     ret = avformat_find_stream_info(fmt_ctx, nullptr);
     if (ret < 0) {
         // LCOV_EXCL_START
-        auto errStr = av_errToQString(ret);
-        qCCritical(gLogBpmDetect) << "libavformat failed to open file:" << fileName
-                                  << ". avformat_find_stream_info() returned" << ret << errStr;
-        setLastError(errStr);
-        avformat_close_input(&fmt_ctx);
-        return false;
+        const auto errStr = av_errToQString(ret);
+        qCWarning(gLogBpmDetect) << "libavformat failed to open file:" << fileName
+                                 << ". avformat_find_stream_info() returned" << ret << errStr;
+        return writeFailed(errStr);
+        // LCOV_EXCL_STOP
     }
-    // LCOV_EXCL_STOP
-    // Remove BPM from global metadata.
+    // Set or remove BPM metadata.
     const auto name = QString::fromUtf8(fmt_ctx->iformat ? fmt_ctx->iformat->name : "");
-    const auto key = name.contains(kNameMp3) ? "TBPM" : name.contains(kNameM4a) ? "tmpo" : "bpm";
-    qCDebug(gLogBpmDetect) << "Using metadata key:" << key;
-    av_dict_set(&fmt_ctx->metadata, key, nullptr, 0);
-    // Prepare output file name.
-    bool error = false;
-    auto outFile = getTemporaryFileName(fileName, &error);
-    if (error) {
+    const auto &bpmKey = name.contains(kNameMp3) ? kBpmKeyTBpm :
+                         name.contains(kNameM4a) ? kBpmKeyTmpo :
+                                                   kBpmKeyBpm;
+    qCDebug(gLogBpmDetect) << "Using metadata key:" << bpmKey;
+    av_dict_set(&fmt_ctx->metadata,
+                bpmKey.toUtf8().constData(),
+                remove ? nullptr : sBpm.toUtf8().constData(),
+                0);
+    // The new file is written next to the file it replaces (the target of a symbolic link), so that
+    // the rename is atomic rather than a copy between file systems.
+    const QFileInfo info(fileName);
+    const auto target = info.isSymLink() ? info.canonicalFilePath() : info.absoluteFilePath();
+    const QFileInfo targetInfo(target);
+    QTemporaryFile tempFile;
+    tempFile.setFileTemplate(QStringLiteral("%1/.%2.XXXXXX.%3")
+                                 .arg(targetInfo.absolutePath(),
+                                      targetInfo.completeBaseName(),
+                                      targetInfo.suffix()));
+    if (!tempFile.open()) {
         // LCOV_EXCL_START
-        avformat_close_input(&fmt_ctx);
-        return false;
+        qCWarning(gLogBpmDetect) << "Failed to create temporary file." << tempFile.errorString();
+        return writeFailed(tempFile.errorString());
+        // LCOV_EXCL_STOP
     }
-    // LCOV_EXCL_STOP
-    // Open output context.
+    // The temporary file is removed on failure when tempFile goes out of scope.
+    const auto outFile = tempFile.fileName();
+    tempFile.close();
+    qCDebug(gLogBpmDetect) << "Temporary file for updated metadata:" << outFile;
     AVFormatContext *out_ctx = nullptr;
     ret = avformat_alloc_output_context2(&out_ctx, nullptr, nullptr, outFile.toUtf8().constData());
     if (ret < 0 || !out_ctx) {
         // LCOV_EXCL_START
-        auto errStr = av_errToQString(ret);
-        qCCritical(gLogBpmDetect) << "libavformat failed to allocate output context for file:"
-                                  << outFile << ". avformat_alloc_output_context2() returned" << ret
-                                  << errStr;
-        setLastError(errStr);
-        avformat_close_input(&fmt_ctx);
-        return false;
+        const auto errStr = av_errToQString(ret);
+        qCWarning(gLogBpmDetect) << "libavformat failed to allocate output context for file:"
+                                 << outFile << ". avformat_alloc_output_context2() returned" << ret
+                                 << errStr;
+        return writeFailed(errStr);
+        // LCOV_EXCL_STOP
     }
-    // LCOV_EXCL_STOP
+    std::unique_ptr<AVFormatContext, OutputContextDeleter> output(out_ctx);
     // Copy streams from input to output.
-    auto streams = unsafeSpan(fmt_ctx->streams, fmt_ctx->nb_streams);
-    for (const auto *in_stream : streams) {
-        auto out_stream = avformat_new_stream(out_ctx, nullptr);
+    for (const auto *in_stream : unsafeSpan(fmt_ctx->streams, fmt_ctx->nb_streams)) {
+        auto *out_stream = avformat_new_stream(out_ctx, nullptr);
         if (!out_stream) {
             // LCOV_EXCL_START
-            qCCritical(gLogBpmDetect) << "libavformat failed to create output stream.";
-            setLastError(QObject::tr("libavformat failed to create output stream."));
-            avformat_close_input(&fmt_ctx);
-            avformat_free_context(out_ctx);
-            return false;
+            qCWarning(gLogBpmDetect) << "libavformat failed to create output stream.";
+            return writeFailed(QObject::tr("libavformat failed to create output stream."));
             // LCOV_EXCL_STOP
         }
         ret = avcodec_parameters_copy(out_stream->codecpar, in_stream->codecpar);
         if (ret < 0) {
             // LCOV_EXCL_START
-            auto errStr = av_errToQString(ret);
-            qCCritical(gLogBpmDetect)
-                << "libavformat failed to copy codec parameters." << ret << errStr;
-            setLastError(errStr);
-            avformat_close_input(&fmt_ctx);
-            avformat_free_context(out_ctx);
-            return false;
+            const auto errStr = av_errToQString(ret);
+            qCWarning(gLogBpmDetect)
+                << "libavformat failed to copy codec parameters. avcodec_parameters_copy() returned"
+                << ret << errStr;
+            return writeFailed(errStr);
+            // LCOV_EXCL_STOP
         }
-        // LCOV_EXCL_STOP
         out_stream->time_base = in_stream->time_base;
-        // Copy stream metadata except TBPM for MP3.
-        const auto formatName = QString::fromUtf8(fmt_ctx->iformat ? fmt_ctx->iformat->name : "");
-        auto bpmKey = fmt_ctx->iformat && formatName.contains(kNameMp3) ? kBpmKeyTBpm :
-                      formatName.contains(kNameM4a)                     ? kBpmKeyTmpo :
-                                                                          kBpmKeyBpm;
-        AVDictionary *newTags = nullptr;
-        AVDictionaryEntry *entry = nullptr;
-        while ((entry = av_dict_get(in_stream->metadata, "", entry, AV_DICT_IGNORE_SUFFIX))) {
-            if (QString::fromUtf8(entry->key) != bpmKey) {
-                av_dict_set(&newTags, entry->key, entry->value, 0);
+        if (remove) {
+            // Copy stream metadata except the BPM.
+            AVDictionary *newTags = nullptr;
+            const AVDictionaryEntry *entry = nullptr;
+            while ((entry = av_dict_iterate(in_stream->metadata, entry))) {
+                if (QString::fromUtf8(entry->key) != bpmKey) {
+                    av_dict_set(&newTags, entry->key, entry->value, 0);
+                }
             }
+            out_stream->metadata = newTags;
         }
-        out_stream->metadata = newTags;
     }
-    // Copy global metadata (BPM already removed).
+    // Copy global metadata.
     av_dict_copy(&out_ctx->metadata, fmt_ctx->metadata, 0);
     // Open output file.
     if (!(out_ctx->oformat->flags & AVFMT_NOFILE)) {
         ret = avio_open(&out_ctx->pb, outFile.toUtf8().constData(), AVIO_FLAG_WRITE);
         if (ret < 0) {
             // LCOV_EXCL_START
-            auto errStr = av_errToQString(ret);
-            qCCritical(gLogBpmDetect) << "libavformat failed to open output file:" << outFile
-                                      << ". avio_open() returned" << ret << errStr;
-            setLastError(errStr);
-            avformat_close_input(&fmt_ctx);
-            avformat_free_context(out_ctx);
-            return false;
+            const auto errStr = av_errToQString(ret);
+            qCWarning(gLogBpmDetect) << "libavformat failed to open output file:" << outFile
+                                     << ". avio_open() returned" << ret << errStr;
+            return writeFailed(errStr);
+            // LCOV_EXCL_STOP
         }
-        // LCOV_EXCL_STOP
     }
     // Write header.
     ret = avformat_write_header(out_ctx, nullptr);
     if (ret < 0) {
         // LCOV_EXCL_START
-        auto errStr = av_errToQString(ret);
-        qCCritical(gLogBpmDetect) << "libavformat failed to write header to output file:" << outFile
-                                  << ". avformat_write_header() returned" << ret << errStr;
-        setLastError(errStr);
-        avformat_close_input(&fmt_ctx);
-        if (!(out_ctx->oformat->flags & AVFMT_NOFILE)) {
-            avio_closep(&out_ctx->pb);
-        }
-        avformat_free_context(out_ctx);
-        return false;
+        const auto errStr = av_errToQString(ret);
+        qCWarning(gLogBpmDetect) << "libavformat failed to write header to output file:" << outFile
+                                 << ". avformat_write_header() returned" << ret << errStr;
+        return writeFailed(errStr);
+        // LCOV_EXCL_STOP
     }
-    // LCOV_EXCL_STOP
     // Write packets (copy mode).
     AVPacket pkt;
     while (av_read_frame(fmt_ctx, &pkt) >= 0) {
@@ -379,116 +395,87 @@ bool removeBpmFromFile(const QString &fileName) {
         av_packet_unref(&pkt);
         if (ret < 0) {
             // LCOV_EXCL_START
-            auto errStr = av_errToQString(ret);
-            qCCritical(gLogBpmDetect)
+            const auto errStr = av_errToQString(ret);
+            qCWarning(gLogBpmDetect)
                 << "libavformat failed to write frame. av_interleaved_write_frame() returned" << ret
                 << errStr;
-            setLastError(errStr);
-            break;
+            return writeFailed(errStr);
+            // LCOV_EXCL_STOP
         }
-        // LCOV_EXCL_STOP
     }
-    // Write trailer.
-    av_write_trailer(out_ctx);
-    // Cleanup
-    avformat_close_input(&fmt_ctx);
-    if (!(out_ctx->oformat->flags & AVFMT_NOFILE)) {
-        avio_closep(&out_ctx->pb);
+    // A short file must not replace the original, so errors flushing it count.
+    ret = av_write_trailer(out_ctx);
+    if (ret >= 0 && !(out_ctx->oformat->flags & AVFMT_NOFILE)) {
+        ret = avio_closep(&out_ctx->pb);
     }
-    avformat_free_context(out_ctx);
-    // Replace original file with new file.
-    QFile fi(fileName);
-    if (!fi.remove(fileName)) {
+    if (ret < 0) {
         // LCOV_EXCL_START
-        qCCritical(gLogBpmDetect) << "Failed to delete original file" << fileName << "."
-                                  << fi.errorString();
-        setLastError(fi.errorString());
-        return false;
+        const auto errStr = av_errToQString(ret);
+        qCWarning(gLogBpmDetect) << "libavformat failed to write output file:" << outFile << "."
+                                 << errStr;
+        return writeFailed(errStr);
+        // LCOV_EXCL_STOP
     }
-    // LCOV_EXCL_STOP
-    if (!fi.rename(outFile, fileName)) {
+    input.reset();
+    output.reset();
+    // The temporary file is only readable by the owner.
+    QFile::setPermissions(outFile, targetInfo.permissions());
+    QString error;
+    if (!replaceFile(outFile, target, &error)) {
         // LCOV_EXCL_START
-        qCCritical(gLogBpmDetect) << "Failed to replace original file with updated metadata file:"
-                                  << fileName << "." << fi.errorString();
-        setLastError(fi.errorString());
-        return false;
+        qCWarning(gLogBpmDetect) << "Failed to replace original file with updated metadata file:"
+                                 << target << "." << error;
+        return writeFailed(error);
+        // LCOV_EXCL_STOP
     }
-    // LCOV_EXCL_STOP
-    setLastError(QString());
-    return true;
+    tempFile.setAutoRemove(false);
+    TagWriteResult result;
+    result.ok = true;
+    return result;
 }
 
-QMap<QString, QVariant> readTagsFromFile(const QString &fileName) {
-    AVFormatContext *fmt_ctx = nullptr;
-    QMap<QString, QVariant> returnTags;
-    static const auto keyArtist = QStringLiteral("artist");
-    static const auto keyTitle = QStringLiteral("title");
-    static const auto keyLength = QStringLiteral("length");
-    static const auto emptyString = QStringLiteral("");
-    returnTags.insert(keyArtist, QVariant(emptyString));
-    returnTags.insert(keyTitle, QVariant(emptyString));
-    returnTags.insert(kBpmKeyBpm, QVariant(0));
-    returnTags.insert(keyLength, QVariant(0));
-    int ret;
-    if ((ret = avformat_open_input(&fmt_ctx, fileName.toUtf8().constData(), nullptr, nullptr)) ==
-        0) {
-        if ((ret = avformat_find_stream_info(fmt_ctx, nullptr)) >= 0) {
-            const auto name = QString::fromUtf8(fmt_ctx->iformat ? fmt_ctx->iformat->name : "");
-            const auto bpmKey = name.contains(kNameMp3) ? kBpmKeyTBpm :
-                                name.contains(kNameM4a) ? kBpmKeyTmpo :
-                                                          kBpmKeyBpm;
-            qCDebug(gLogBpmDetect) << "Using metadata key for BPM:" << bpmKey;
-            const AVDictionaryEntry *e = nullptr;
-            while ((e = av_dict_iterate(fmt_ctx->metadata, e))) {
-                // LCOV_EXCL_START
-                auto key = QString::fromUtf8(e->key).toLower();
-                qCDebug(gLogBpmDetect) << "Metadata key:" << key;
-                if (key == bpmKey) {
-                    returnTags[kBpmKeyBpm] = QString::fromUtf8(e->value).toDouble();
-                } else if (key == keyArtist || key == keyTitle) {
-                    returnTags[key] = QString::fromUtf8(e->value);
-                }
-                // LCOV_EXCL_STOP
-            }
-            if ((!returnTags[kBpmKeyBpm].toInt() || returnTags[keyArtist].toString().isEmpty() ||
-                 returnTags[keyTitle].toString().isEmpty()) &&
-                fmt_ctx->nb_streams > 0 && fmt_ctx->streams[0] && fmt_ctx->streams[0]->metadata) {
-                // Get the first stream's metadata if there is no global metadata.
-                e = nullptr;
-                while ((e = av_dict_iterate(fmt_ctx->streams[0]->metadata, e))) {
-                    // LCOV_EXCL_START
-                    auto key = QString::fromUtf8(e->key).toLower();
-                    qCDebug(gLogBpmDetect) << "Stream Metadata key:" << key;
-                    if (key == bpmKey && !returnTags[kBpmKeyBpm].toInt()) {
-                        returnTags[kBpmKeyBpm] = QString::fromUtf8(e->value).toDouble();
-                    } else if ((key == keyArtist || key == keyTitle) &&
-                               returnTags[key].toString().isEmpty()) {
-                        returnTags[key] = QString::fromUtf8(e->value);
-                    }
-                    // LCOV_EXCL_STOP
-                }
-            }
-            // Read length in milliseconds.
-            if (fmt_ctx->duration != AV_NOPTS_VALUE) {
-                returnTags[keyLength] =
-                    static_cast<qint64>(fmt_ctx->duration / (AV_TIME_BASE / 1000));
-            }
-        } else {
-            // LCOV_EXCL_START
-            auto errStr = av_errToQString(ret);
-            qCCritical(gLogBpmDetect) << "libavformat failed to open file:" << fileName
-                                      << ". avformat_find_stream_info() returned" << ret << errStr;
-            setLastError(errStr);
-        }
-        // LCOV_EXCL_STOP
-        avformat_close_input(&fmt_ctx);
-    } else {
-        auto errStr = av_errToQString(ret);
-        qCCritical(gLogBpmDetect) << "libavformat failed to open file:" << fileName
-                                  << ". avformat_open_input() returned" << ret << errStr;
-        setLastError(errStr);
+TagWriteResult storeBpmInFile(const QString &fileName, const QString &sBpm) {
+    qCDebug(gLogBpmDetect) << "Storing BPM:" << sBpm << "to file:" << fileName;
+    if (writeBpmInPlace(fileName, sBpm)) {
+        TagWriteResult result;
+        result.ok = true;
+        result.inPlace = true;
+        return result;
+    }
+    if (rewriteBpmWithPadding(fileName, sBpm)) {
+        TagWriteResult result;
+        result.ok = true;
+        return result;
+    }
+    return remuxWithBpm(fileName, sBpm);
+}
+
+TagWriteResult removeBpmFromFile(const QString &fileName) {
+    qCDebug(gLogBpmDetect) << "Removing BPM metadata from file:" << fileName;
+    if (writeBpmInPlace(fileName, QString())) {
+        TagWriteResult result;
+        result.ok = true;
+        result.inPlace = true;
+        return result;
+    }
+    if (rewriteBpmWithPadding(fileName, QString())) {
+        TagWriteResult result;
+        result.ok = true;
+        return result;
+    }
+    return remuxWithBpm(fileName, QString());
+}
+
+QMap<QString, QVariant> readTagsFromFile(const QString &fileName, QString *error) {
+    const auto probe = probeFile(fileName);
+    if (error) {
+        *error = probe.error;
+    }
+    if (!probe.opened) {
         return {};
     }
-    setLastError(QString());
-    return returnTags;
+    return {{QStringLiteral("artist"), probe.artist},
+            {QStringLiteral("title"), probe.title},
+            {kBpmKeyBpm, probe.bpm},
+            {QStringLiteral("length"), probe.length}};
 }
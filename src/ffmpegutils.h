@@ -2,13 +2,81 @@
 /** @file */
 #pragma once
 
+#include <memory>
+
 #include <QtCore/QMap>
+#include <QtCore/QString>
 #include <QtCore/QVariant>
 
-class QString;
+struct AVFormatContext;
+
+/** Everything probeFile() learns about a file from a single open. */
+struct ProbeResult {
+    /** Format context left open for decoding. Only set if requested and the file has audio. */
+    std::shared_ptr<AVFormatContext> formatContext;
+    /** Artist tag. */
+    QString artist;
+    /** Metadata key the container uses for the BPM (`TBPM`, `tmpo` or `bpm`). */
+    QString bpmKey;
+    /** Error message if the file could not be opened or probed. */
+    QString error;
+    /** Title tag. */
+    QString title;
+    /** BPM tag, or 0 if not set. */
+    double bpm = 0;
+    /** Length in milliseconds, or 0 if unknown. */
+    qint64 length = 0;
+    /** If the file has at least one audio stream. */
+    bool hasAudio = false;
+    /** If libavformat could open the file at all. */
+    bool opened = false;
+};
+
+/** Outcome of storeBpmInFile() and removeBpmFromFile(). */
+struct TagWriteResult {
+    /** Error message if the file could not be changed. */
+    QString error;
+    /** If the tag was written or removed. */
+    bool ok = false;
+    /** If the tag was edited in place (see writeBpmInPlace()) rather than by remuxing the file. */
+    bool inPlace = false;
+    /** Wall time of the write in nanoseconds. Only set by Track::writeBpm(). */
+    qint64 elapsed = 0;
+};
 
-/** Check if a file can be decoded using ffmpeg. */
-bool isDecodableFile(const QString &file);
+/** Convert a libav* error code to a string. */
+QString av_errToQString(int errnum);
+
+/**
+ * Open a file once and read audio stream presence, tags, length and BPM together.
+ * @param fileName The path to the audio file.
+ * @param keepOpen If `true`, the format context is kept open in the result so it can be handed to
+ * the decoder without opening the file again.
+ * @return The probe result.
+ */
+ProbeResult probeFile(const QString &fileName, bool keepOpen = false);
+
+/**
+ * Hash the compressed packets of the first audio stream, which leaves out tags, so files that only
+ * differ in their tags hash the same. This reads the whole file but decodes nothing.
+ * @param[in,out] context Format context kept open by probeFile(). It is rewound to the start so it
+ * can still be decoded, or reset if that fails.
+ * @return The hash, never 0, or 0 if there is no audio stream or a packet could not be read.
+ */
+quint64 hashAudio(std::shared_ptr<AVFormatContext> &context);
+/**
+ * Open a file and hash its audio like hashAudio(std::shared_ptr<AVFormatContext> &).
+ * @param fileName The path to the audio file.
+ * @return The hash, or 0 if the file has no audio or could not be read.
+ */
+quint64 hashAudio(const QString &fileName);
+
+/**
+ * Check if a file can be decoded using ffmpeg.
+ * @param file The path to the audio file.
+ * @param[out] error Error message if the file could not be opened or probed. May be `nullptr`.
+ */
+bool isDecodableFile(const QString &file, QString *error = nullptr);
 
 /**
  * Store BPM to audio file.
@@ -17,30 +85,34 @@ bool isDecodableFile(const QString &file);
  * have the BPM saved in a generic "BPM" tag. This will return `false` in those cases as well as for
  * any errors.
  *
+ * The tag is edited in place when the format has room for it (see writeBpmInPlace()). Otherwise the
+ * file is remuxed into a new file which replaces the original.
+ *
+ * Like the other functions here, this keeps no state between calls and can be called from several
+ * threads, for different files.
+ *
  * @param fileName The path to the audio file.
  * @param sBpm The BPM value to store.
- * @return `true` if the BPM was successfully stored, `false` otherwise.
+ * @return The result, with `ok` set if the BPM was successfully stored.
  */
-bool storeBpmInFile(const QString &fileName, const QString &sBpm);
+TagWriteResult storeBpmInFile(const QString &fileName, const QString &sBpm);
 
 /**
  * Remove BPM metadata from audio file.
  *
  * If this is a MP3 file, the TBPM tag of ID3v2 will be removed. Other formats will have the
- * generic "BPM" tag removed.
+ * generic "BPM" tag removed. Like storeBpmInFile(), this edits the tag in place when possible.
  *
  * @param fileName The path to the audio file.
- * @return `true` if the BPM metadata was successfully removed, `false` otherwise.
+ * @return The result, with `ok` set if the BPM metadata was successfully removed.
  */
-bool removeBpmFromFile(const QString &fileName);
+TagWriteResult removeBpmFromFile(const QString &fileName);
 
 /**
  * Tag reader using ffmpeg. Gets artist, title, bpm and length (in milliseconds) and puts them in a
  * map.
  * @param fileName The path to the audio file.
+ * @param[out] error Error message if the file could not be opened. May be `nullptr`.
  * @return A map with the tags read. If a tag is not found, the key will have a sane default value.
  */
-QMap<QString, QVariant> readTagsFromFile(const QString &fileName);
-
-/** Get the last error message. */
-QString getLastError();
+QMap<QString, QVariant> readTagsFromFile(const QString &fileName, QString *error = nullptr);
@@ -1,10 +1,16 @@
 #include "guimain.h"
-#include "track/soundtouchbpmdetector.h"
+#include "track/track.h"
 #include "widgets/dlgbpmdetect.h"
 
-int guiMain(const QApplication &app, const QStringList &files) {
+int guiMain(const QApplication &app, const QCommandLineParser &parser, const QStringList &files) {
     DlgBpmDetect mainWin;
-    mainWin.setDetector(new SoundTouchBpmDetector(qApp));
+    // The dialog restores the saved detector; --detector takes precedence over it.
+    if (parser.isSet(QStringLiteral("detector"))) {
+        mainWin.setDetectorType(Track::detectorType());
+    }
+    if (parser.isSet(QStringLiteral("jobs"))) {
+        mainWin.setMaximumJobs(parser.value(QStringLiteral("jobs")).toInt());
+    }
     mainWin.slotAddFiles(files);
     mainWin.show();
     return app.exec();
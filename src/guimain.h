@@ -2,13 +2,15 @@
 /** @file */
 #pragma once
 
+#include <QtCore/QCommandLineParser>
 #include <QtCore/QStringList>
 #include <QtWidgets/QApplication>
 
 /**
  * GUI entry point.
  * @param app Application instance.
+ * @param parser Command line parser.
  * @param files List of files to add to the view.
  * @return Exit code of the application.
  */
-int guiMain(const QApplication &app, const QStringList &files);
+int guiMain(const QApplication &app, const QCommandLineParser &parser, const QStringList &files);
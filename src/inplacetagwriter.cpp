@@ -0,0 +1,702 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <algorithm>
+#include <array>
+
+#include <QtCore/QDebug>
+#include <QtCore/QFile>
+#include <QtCore/QList>
+#include <QtCore/QSaveFile>
+#include <QtCore/QtEndian>
+#ifdef Q_OS_LINUX
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+#include "debug.h"
+#include "inplacetagwriter.h"
+
+static constexpr qint64 kId3HeaderSize = 10;
+static constexpr qint64 kId3FrameHeaderSize = 10;
+static constexpr uchar kId3FlagUnsynchronisation = 0x80;
+static constexpr uchar kId3FlagExtendedHeader = 0x40;
+static constexpr uchar kId3FlagFooter = 0x10;
+static constexpr qint64 kFlacBlockHeaderSize = 4;
+static constexpr uchar kFlacBlockLast = 0x80;
+static constexpr uchar kFlacBlockPadding = 1;
+static constexpr uchar kFlacBlockVorbisComment = 4;
+static constexpr quint32 kFlacMaxBlockSize = 0xffffff;
+static constexpr qint64 kOggPageHeaderSize = 27;
+static constexpr qint64 kOggCrcOffset = 22;
+static constexpr uchar kOggContinuedPacket = 0x01;
+static constexpr qint64 kMp4BoxHeaderSize = 8;
+static constexpr qint64 kMp4FullBoxHeaderSize = 4;
+static constexpr quint32 kMp4DataTypeInteger = 0x15;
+/** Largest ID3v2 tag size (28 bits). */
+static constexpr qint64 kId3MaxSize = 0x0fffffff;
+/** Least padding left by rewriteBpmWithPadding() for later updates in place. */
+static constexpr qint64 kRewritePadding = 4096;
+/**
+ * rewriteBpmWithPadding() keeps the audio at the same offset modulo this, so that the blocks
+ * holding it can be shared with the original file (see copyTail()).
+ */
+static constexpr qint64 kCloneAlignment = 4096;
+/** Chunk size when copying through memory. */
+static constexpr qint64 kCopyChunkSize = 1 << 20;
+
+static quint32 syncsafeToInt(const char *data) {
+    const auto *bytes = reinterpret_cast<const uchar *>(data);
+    return static_cast<quint32>((bytes[0] & 0x7f) << 21 | (bytes[1] & 0x7f) << 14 |
+                                (bytes[2] & 0x7f) << 7 | (bytes[3] & 0x7f));
+}
+
+static QByteArray intToSyncsafe(quint32 value) {
+    QByteArray ret(4, '\0');
+    ret[0] = static_cast<char>((value >> 21) & 0x7f);
+    ret[1] = static_cast<char>((value >> 14) & 0x7f);
+    ret[2] = static_cast<char>((value >> 7) & 0x7f);
+    ret[3] = static_cast<char>(value & 0x7f);
+    return ret;
+}
+
+/** Get the offset of the end of the ID3v2 tag starting with @a header. */
+static qint64 id3v2End(const QByteArray &header) {
+    return kId3HeaderSize + syncsafeToInt(header.constData() + 6) +
+           ((static_cast<uchar>(header[5]) & kId3FlagFooter) ? 10 : 0);
+}
+
+static void appendBigEndian32(QByteArray *data, quint32 value) {
+    char bytes[4];
+    qToBigEndian(value, bytes);
+    data->append(bytes, 4);
+}
+
+static void appendLittleEndian32(QByteArray *data, quint32 value) {
+    char bytes[4];
+    qToLittleEndian(value, bytes);
+    data->append(bytes, 4);
+}
+
+static QByteArray readAt(QFile &file, qint64 offset, qint64 size) {
+    if (!file.seek(offset)) {
+        return {}; // LCOV_EXCL_LINE
+    }
+    return file.read(size);
+}
+
+static bool writeAt(QFile &file, qint64 offset, const QByteArray &data) {
+    return file.seek(offset) && file.write(data) == data.size();
+}
+
+/**
+ * Replace or remove the BPM field of a Vorbis comment structure. @a data starts at the vendor
+ * string length. Anything after the comments (such as the Vorbis framing bit) is kept.
+ * @return The new structure, or a null array if @a data cannot be parsed.
+ */
+static QByteArray updateVorbisComment(const QByteArray &data, const QByteArray &bpm) {
+    static const QByteArray bpmField("bpm=");
+    qint64 pos = 0;
+    const auto readLength = [&data, &pos](quint32 *value) {
+        if (pos + 4 > data.size()) {
+            return false;
+        }
+        *value = qFromLittleEndian<quint32>(data.constData() + pos);
+        pos += 4;
+        return true;
+    };
+    quint32 length = 0;
+    if (!readLength(&length) || pos + length > data.size()) {
+        return {};
+    }
+    pos += length;
+    const auto vendorEnd = pos;
+    quint32 count = 0;
+    if (!readLength(&count)) {
+        return {};
+    }
+    QList<QByteArray> comments;
+    for (quint32 i = 0; i < count; ++i) {
+        if (!readLength(&length) || pos + length > data.size()) {
+            return {};
+        }
+        const auto comment = data.mid(pos, length);
+        pos += length;
+        if (!comment.toLower().startsWith(bpmField)) {
+            comments.append(comment);
+        }
+    }
+    if (!bpm.isEmpty()) {
+        comments.append(QByteArrayLiteral("BPM=") + bpm);
+    }
+    auto ret = data.left(vendorEnd);
+    appendLittleEndian32(&ret, static_cast<quint32>(comments.size()));
+    for (const auto &comment : comments) {
+        appendLittleEndian32(&ret, static_cast<quint32>(comment.size()));
+        ret.append(comment);
+    }
+    ret.append(data.mid(pos));
+    return ret;
+}
+
+/**
+ * Read an ID3v2 tag and build its frames with the BPM frame replaced or removed.
+ * @param header First 10 bytes of the file.
+ * @param[out] body Tag after the header, including the extended header and padding.
+ * @param[out] framesStart Offset of the frames in @a body.
+ * @param[out] hasCrc If the extended header holds a CRC of the frames, which would become invalid.
+ * @return The new frames without padding, or a null array if the tag cannot be updated.
+ */
+static QByteArray updateId3v2Frames(QFile &file,
+                                    const QByteArray &header,
+                                    const QByteArray &bpm,
+                                    QByteArray *body,
+                                    qint64 *framesStart,
+                                    bool *hasCrc) {
+    const auto version = static_cast<uchar>(header[3]);
+    const auto flags = static_cast<uchar>(header[5]);
+    if ((version != 3 && version != 4) || (flags & (kId3FlagUnsynchronisation | kId3FlagFooter))) {
+        qCDebug(gLogBpmDetect) << "ID3v2 version" << version << "with flags" << flags
+                               << "cannot be updated in place.";
+        return {};
+    }
+    *body = readAt(file, kId3HeaderSize, syncsafeToInt(header.constData() + 6));
+    *framesStart = 0;
+    *hasCrc = false;
+    if (flags & kId3FlagExtendedHeader) {
+        if (body->size() < 6) {
+            return {};
+        }
+        *hasCrc = version == 4 ? static_cast<uchar>(body->at(5)) & 0x20 :
+                                 static_cast<uchar>(body->at(4)) & 0x80;
+        *framesStart = version == 4 ? syncsafeToInt(body->constData()) :
+                                      4 + qFromBigEndian<quint32>(body->constData());
+        if (*framesStart > body->size()) {
+            return {};
+        }
+    }
+    // Not null even if there are no frames left.
+    QByteArray frames("");
+    auto pos = *framesStart;
+    while (pos + kId3FrameHeaderSize <= body->size() && body->at(pos) != '\0') {
+        const auto *frameSize = body->constData() + pos + 4;
+        const auto size = kId3FrameHeaderSize + (version == 4 ? syncsafeToInt(frameSize) :
+                                                                qFromBigEndian<quint32>(frameSize));
+        if (pos + size > body->size()) {
+            qCDebug(gLogBpmDetect) << "Damaged ID3v2 frame at offset" << pos;
+            return {};
+        }
+        if (body->mid(pos, 4) != QByteArrayLiteral("TBPM")) {
+            frames.append(body->mid(pos, size));
+        }
+        pos += size;
+    }
+    if (!bpm.isEmpty()) {
+        // Text encoding byte (ISO-8859-1) followed by the value.
+        const auto size = static_cast<quint32>(bpm.size() + 1);
+        frames.append(QByteArrayLiteral("TBPM"));
+        if (version == 4) {
+            frames.append(intToSyncsafe(size));
+        } else {
+            appendBigEndian32(&frames, size);
+        }
+        frames.append(2, '\0');
+        frames.append('\0');
+        frames.append(bpm);
+    }
+    return frames;
+}
+
+static bool updateId3v2(QFile &file, const QByteArray &header, const QByteArray &bpm) {
+    QByteArray body;
+    qint64 framesStart;
+    bool hasCrc;
+    auto frames = updateId3v2Frames(file, header, bpm, &body, &framesStart, &hasCrc);
+    if (frames.isNull() || hasCrc) {
+        return false;
+    }
+    const auto room = body.size() - framesStart;
+    if (frames.size() > room) {
+        qCDebug(gLogBpmDetect) << "Not enough ID3v2 padding. Need" << frames.size() << "bytes, have"
+                               << room;
+        return false;
+    }
+    frames.append(room - frames.size(), '\0');
+    if (frames == body.mid(framesStart)) {
+        return true;
+    }
+    return writeAt(file, kId3HeaderSize + framesStart, frames);
+}
+
+/** FLAC metadata block. */
+struct FlacBlock {
+    uchar type;
+    QByteArray data;
+};
+
+/**
+ * Read the metadata blocks of a FLAC stream and replace or remove the BPM field of the
+ * `VORBIS_COMMENT` block, adding one if needed. Padding blocks are dropped.
+ * @param offset Offset of the `fLaC` signature.
+ * @param[out] blocks New metadata blocks.
+ * @param[out] regionEnd Offset of the first audio frame.
+ * @return `false` if the metadata cannot be parsed.
+ */
+static bool updateFlacBlocks(QFile &file,
+                             qint64 offset,
+                             const QByteArray &bpm,
+                             QList<FlacBlock> *blocks,
+                             qint64 *regionEnd) {
+    auto pos = offset + 4;
+    auto last = false;
+    auto hasComment = false;
+    while (!last) {
+        const auto header = readAt(file, pos, kFlacBlockHeaderSize);
+        if (header.size() != kFlacBlockHeaderSize) {
+            return false;
+        }
+        last = static_cast<uchar>(header[0]) & kFlacBlockLast;
+        const auto type = static_cast<uchar>(static_cast<uchar>(header[0]) & ~kFlacBlockLast);
+        const auto size = qFromBigEndian<quint32>(header.constData()) & kFlacMaxBlockSize;
+        pos += kFlacBlockHeaderSize + size;
+        if (type == kFlacBlockPadding) {
+            continue;
+        }
+        auto data = file.read(size);
+        if (data.size() != size) {
+            return false;
+        }
+        if (type == kFlacBlockVorbisComment) {
+            data = updateVorbisComment(data, bpm);
+            if (data.isNull()) {
+                return false;
+            }
+            hasComment = true;
+        }
+        blocks->append({type, data});
+    }
+    if (!hasComment && !bpm.isEmpty()) {
+        QByteArray empty;
+        appendLittleEndian32(&empty, 0);
+        appendLittleEndian32(&empty, 0);
+        blocks->append({kFlacBlockVorbisComment, updateVorbisComment(empty, bpm)});
+    }
+    *regionEnd = pos;
+    return true;
+}
+
+/** Serialize FLAC metadata blocks, followed by a padding block of @a padding bytes if not 0. */
+static QByteArray flacRegion(QList<FlacBlock> blocks, qint64 padding) {
+    if (padding != 0) {
+        blocks.append({kFlacBlockPadding, QByteArray(padding - kFlacBlockHeaderSize, '\0')});
+    }
+    QByteArray region;
+    for (qsizetype i = 0; i < blocks.size(); ++i) {
+        const auto &block = blocks.at(i);
+        appendBigEndian32(&region, static_cast<quint32>(block.data.size()));
+        region[region.size() - 4] = static_cast<char>(
+            block.type | (i == blocks.size() - 1 ? kFlacBlockLast : 0));
+        region.append(block.data);
+    }
+    return region;
+}
+
+static bool updateFlac(QFile &file, qint64 offset, const QByteArray &bpm) {
+    const auto regionStart = offset + 4;
+    QList<FlacBlock> blocks;
+    qint64 regionEnd;
+    if (!updateFlacBlocks(file, offset, bpm, &blocks, &regionEnd)) {
+        return false;
+    }
+    // Without comments there is no BPM to remove.
+    if (std::none_of(blocks.cbegin(), blocks.cend(), [](const FlacBlock &block) {
+            return block.type == kFlacBlockVorbisComment;
+        })) {
+        return true;
+    }
+    qint64 size = 0;
+    for (const auto &block : std::as_const(blocks)) {
+        size += kFlacBlockHeaderSize + block.data.size();
+    }
+    // Whatever is left over becomes a single padding block at the end.
+    const auto slack = (regionEnd - regionStart) - size;
+    if (slack != 0 &&
+        (slack < kFlacBlockHeaderSize || slack - kFlacBlockHeaderSize > kFlacMaxBlockSize)) {
+        qCDebug(gLogBpmDetect) << "Not enough FLAC padding. Need" << size << "bytes, have"
+                               << (regionEnd - regionStart);
+        return false;
+    }
+    const auto region = flacRegion(blocks, slack);
+    if (region == readAt(file, regionStart, region.size())) {
+        return true;
+    }
+    return writeAt(file, regionStart, region);
+}
+
+static quint32 oggCrc(const QByteArray &page) {
+    static const auto table = [] {
+        std::array<quint32, 256> ret{};
+        for (quint32 i = 0; i < 256; ++i) {
+            auto r = i << 24;
+            for (auto j = 0; j < 8; ++j) {
+                r = r & 0x80000000 ? (r << 1) ^ 0x04c11db7 : r << 1;
+            }
+            ret.at(i) = r;
+        }
+        return ret;
+    }();
+    quint32 crc = 0;
+    for (const auto c : page) {
+        crc = (crc << 8) ^ table.at(((crc >> 24) & 0xff) ^ static_cast<uchar>(c));
+    }
+    return crc;
+}
+
+static bool updateOgg(QFile &file, const QByteArray &bpm) {
+    // The identification header is alone on the first page and the comment header starts the
+    // second one.
+    qint64 pageOffset = 0;
+    QByteArray header;
+    QByteArray lacing;
+    QByteArray body;
+    for (auto page = 0; page < 2; ++page) {
+        header = readAt(file, pageOffset, kOggPageHeaderSize);
+        if (header.size() != kOggPageHeaderSize || !header.startsWith("OggS")) {
+            return false;
+        }
+        lacing = file.read(static_cast<uchar>(header[kOggPageHeaderSize - 1]));
+        qint64 bodySize = 0;
+        for (const auto c : lacing) {
+            bodySize += static_cast<uchar>(c);
+        }
+        body = file.read(bodySize);
+        if (body.size() != bodySize) {
+            return false;
+        }
+        if (page == 0) {
+            pageOffset += kOggPageHeaderSize + lacing.size() + bodySize;
+        }
+    }
+    qint64 packetSize = 0;
+    auto complete = false;
+    for (const auto c : lacing) {
+        packetSize += static_cast<uchar>(c);
+        if (static_cast<uchar>(c) < 255) {
+            complete = true;
+            break;
+        }
+    }
+    if ((static_cast<uchar>(header[5]) & kOggContinuedPacket) || !complete) {
+        qCDebug(gLogBpmDetect) << "Ogg comment header spans several pages.";
+        return false;
+    }
+    const auto packet = body.left(packetSize);
+    const auto prefixSize = packet.startsWith("\x03vorbis") ? 7 :
+                            packet.startsWith("OpusTags")   ? 8 :
+                                                              0;
+    if (!prefixSize) {
+        return false;
+    }
+    const auto comment = updateVorbisComment(packet.mid(prefixSize), bpm);
+    if (comment.isNull()) {
+        return false;
+    }
+    const auto newPacket = packet.left(prefixSize) + comment;
+    if (newPacket == packet) {
+        return true;
+    }
+    if (newPacket.size() != packet.size()) {
+        qCDebug(gLogBpmDetect) << "Ogg comment header would change size.";
+        return false;
+    }
+    auto page = header + lacing + newPacket + body.mid(packetSize);
+    page.replace(kOggCrcOffset, 4, QByteArray(4, '\0'));
+    char crc[4];
+    qToLittleEndian(oggCrc(page), crc);
+    page.replace(kOggCrcOffset, 4, QByteArray(crc, 4));
+    return writeAt(file, pageOffset, page);
+}
+
+struct Mp4Box {
+    QByteArray type;
+    qint64 offset = 0;
+    qint64 headerSize = 0;
+    qint64 size = 0;
+};
+
+static bool readMp4Box(QFile &file, qint64 offset, qint64 end, Mp4Box *box) {
+    const auto header = readAt(file, offset, kMp4BoxHeaderSize);
+    if (header.size() != kMp4BoxHeaderSize) {
+        return false;
+    }
+    box->type = header.mid(4, 4);
+    box->offset = offset;
+    box->headerSize = kMp4BoxHeaderSize;
+    box->size = qFromBigEndian<quint32>(header.constData());
+    if (box->size == 1) {
+        const auto largeSize = file.read(8);
+        if (largeSize.size() != 8) {
+            return false;
+        }
+        box->headerSize += 8;
+        box->size = qFromBigEndian<qint64>(largeSize.constData());
+    } else if (box->size == 0) {
+        box->size = end - offset;
+    }
+    return box->size >= box->headerSize && offset + box->size <= end;
+}
+
+static bool findMp4Box(QFile &file, qint64 start, qint64 end, const char *type, Mp4Box *box) {
+    for (auto offset = start; offset < end; offset += box->size) {
+        if (!readMp4Box(file, offset, end, box)) {
+            return false;
+        }
+        if (box->type == type) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool updateMp4(QFile &file, const QByteArray &bpm) {
+    Mp4Box moov;
+    Mp4Box udta;
+    Mp4Box meta;
+    Mp4Box ilst;
+    if (!findMp4Box(file, 0, file.size(), "moov", &moov) ||
+        !findMp4Box(
+            file, moov.offset + moov.headerSize, moov.offset + moov.size, "udta", &udta) ||
+        !findMp4Box(
+            file, udta.offset + udta.headerSize, udta.offset + udta.size, "meta", &meta) ||
+        !findMp4Box(file,
+                    meta.offset + meta.headerSize + kMp4FullBoxHeaderSize,
+                    meta.offset + meta.size,
+                    "ilst",
+                    &ilst)) {
+        qCDebug(gLogBpmDetect) << "No MP4 metadata item list to update.";
+        return false;
+    }
+    QByteArray items;
+    Mp4Box item;
+    for (auto offset = ilst.offset + ilst.headerSize; offset < ilst.offset + ilst.size;
+         offset += item.size) {
+        if (!readMp4Box(file, offset, ilst.offset + ilst.size, &item)) {
+            return false;
+        }
+        if (item.type != "tmpo") {
+            items.append(readAt(file, item.offset, item.size));
+        }
+    }
+    if (!bpm.isEmpty()) {
+        // Same layout as FFmpeg writes: 16-bit integer in a `data` atom. The value is truncated.
+        const auto value =
+            static_cast<quint16>(qBound(0, static_cast<int>(bpm.toDouble()), 0xffff));
+        QByteArray data;
+        appendBigEndian32(&data, static_cast<quint32>(kMp4BoxHeaderSize + 8 + sizeof(value)));
+        data.append(QByteArrayLiteral("data"));
+        appendBigEndian32(&data, kMp4DataTypeInteger);
+        appendBigEndian32(&data, 0);
+        data.append(static_cast<char>(value >> 8));
+        data.append(static_cast<char>(value & 0xff));
+        appendBigEndian32(&items, static_cast<quint32>(kMp4BoxHeaderSize + data.size()));
+        items.append(QByteArrayLiteral("tmpo"));
+        items.append(data);
+    }
+    // The new item list may use the `free` atom directly after it. The size of `meta` and so every
+    // chunk offset in the file stay the same.
+    auto regionSize = ilst.size;
+    Mp4Box next;
+    if (ilst.offset + ilst.size < meta.offset + meta.size &&
+        readMp4Box(file, ilst.offset + ilst.size, meta.offset + meta.size, &next) &&
+        next.type == "free") {
+        regionSize += next.size;
+    }
+    QByteArray region;
+    appendBigEndian32(&region, static_cast<quint32>(kMp4BoxHeaderSize + items.size()));
+    region.append(QByteArrayLiteral("ilst"));
+    region.append(items);
+    const auto slack = regionSize - region.size();
+    if (slack != 0 && slack < kMp4BoxHeaderSize) {
+        qCDebug(gLogBpmDetect) << "Not enough free space after MP4 item list. Need" << region.size()
+                               << "bytes, have" << regionSize;
+        return false;
+    }
+    if (slack != 0) {
+        appendBigEndian32(&region, static_cast<quint32>(slack));
+        region.append(QByteArrayLiteral("free"));
+        region.append(slack - kMp4BoxHeaderSize, '\0');
+    }
+    if (region == readAt(file, ilst.offset, region.size())) {
+        return true;
+    }
+    return writeAt(file, ilst.offset, region);
+}
+
+bool writeBpmInPlace(const QString &fileName, const QString &bpm) {
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadWrite)) {
+        qCDebug(gLogBpmDetect) << "Cannot open file for in-place update:" << fileName
+                               << file.errorString();
+        return false;
+    }
+    const auto value = bpm.toLatin1();
+    const auto magic = file.read(kId3HeaderSize);
+    auto updated = false;
+    if (magic.size() == kId3HeaderSize && magic.startsWith("ID3")) {
+        // FLAC files can start with an ID3v2 tag, but their tags live in the Vorbis comment.
+        const auto flacOffset = id3v2End(magic);
+        if (readAt(file, flacOffset, 4) == "fLaC") {
+            updated = updateFlac(file, flacOffset, value);
+        } else {
+            updated = updateId3v2(file, magic, value);
+        }
+    } else if (magic.startsWith("fLaC")) {
+        updated = updateFlac(file, 0, value);
+    } else if (magic.startsWith("OggS")) {
+        updated = updateOgg(file, value);
+    } else if (magic.mid(4, 4) == "ftyp") {
+        updated = updateMp4(file, value);
+    }
+    updated = updated && file.flush();
+    qCDebug(gLogBpmDetect) << (updated ? "Updated BPM tag in place in file:" :
+                                         "Cannot update BPM tag in place in file:")
+                           << fileName;
+    return updated;
+}
+
+/**
+ * Get the padding that leaves at least kRewritePadding bytes and moves the audio from
+ * @a audioOffset to an offset with the same remainder modulo kCloneAlignment.
+ * @param headSize Size of everything before the audio, without padding.
+ */
+static qint64 alignedPadding(qint64 headSize, qint64 audioOffset) {
+    const auto misalignment = (audioOffset - headSize - kRewritePadding) % kCloneAlignment;
+    return kRewritePadding + (misalignment + kCloneAlignment) % kCloneAlignment;
+}
+
+#ifdef Q_OS_LINUX
+/**
+ * Copy @a length bytes between files within the kernel. The offsets are advanced by what was
+ * copied, also on failure.
+ */
+static bool kernelCopy(int in, qint64 *inOffset, int out, qint64 *outOffset, qint64 length) {
+    while (length > 0) {
+        loff_t inPos = *inOffset;
+        loff_t outPos = *outOffset;
+        const auto copied =
+            copy_file_range(in, &inPos, out, &outPos, static_cast<size_t>(length), 0);
+        if (copied <= 0) {
+            return false;
+        }
+        *inOffset += copied;
+        *outOffset += copied;
+        length -= copied;
+    }
+    return true;
+}
+#endif
+
+/**
+ * Append the data of @a source from @a offset to its end to @a target.
+ *
+ * On Linux, the data is cloned with `FICLONERANGE` (Btrfs, XFS and others share the blocks instead
+ * of copying them) if the offsets in both files have the same remainder modulo kCloneAlignment.
+ * Otherwise, or if the file system cannot clone, it is copied within the kernel with
+ * `copy_file_range()`. Elsewhere, or if that fails too, it is copied through memory.
+ */
+static bool copyTail(QFile &source, qint64 offset, QFileDevice &target) {
+    if (!target.flush()) {
+        return false; // LCOV_EXCL_LINE
+    }
+    const auto end = source.size();
+    auto targetOffset = target.size();
+#ifdef Q_OS_LINUX
+    const auto in = source.handle();
+    const auto out = target.handle();
+    if (offset % kCloneAlignment == targetOffset % kCloneAlignment) {
+        // Cloning starts at a block boundary; the bytes before it are copied.
+        const auto head =
+            std::min(end - offset, (kCloneAlignment - offset % kCloneAlignment) % kCloneAlignment);
+        if (kernelCopy(in, &offset, out, &targetOffset, head)) {
+            // A length of 0 clones to the end of the source.
+            file_clone_range range{in,
+                                   static_cast<__u64>(offset),
+                                   0,
+                                   static_cast<__u64>(targetOffset)};
+            if (offset == end || ioctl(out, FICLONERANGE, &range) == 0) {
+                qCDebug(gLogBpmDetect) << "Cloned" << end - offset << "bytes of audio.";
+                return true;
+            }
+        }
+    }
+    if (kernelCopy(in, &offset, out, &targetOffset, end - offset)) {
+        return true;
+    }
+#endif
+    if (!source.seek(offset) || !target.seek(targetOffset)) {
+        return false; // LCOV_EXCL_LINE
+    }
+    while (offset < end) {
+        const auto chunk = source.read(std::min(kCopyChunkSize, end - offset));
+        if (chunk.isEmpty() || target.write(chunk) != chunk.size()) {
+            return false;
+        }
+        offset += chunk.size();
+    }
+    return true;
+}
+
+bool rewriteBpmWithPadding(const QString &fileName, const QString &bpm) {
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const auto value = bpm.toLatin1();
+    const auto magic = file.read(kId3HeaderSize);
+    const auto hasId3 = magic.size() == kId3HeaderSize && magic.startsWith("ID3");
+    const auto flacOffset = hasId3 ? id3v2End(magic) : 0;
+    // Everything before the audio in the new file, and where the audio starts in the old one.
+    QByteArray head;
+    qint64 audioOffset = 0;
+    if (readAt(file, flacOffset, 4) == "fLaC") {
+        QList<FlacBlock> blocks;
+        if (!updateFlacBlocks(file, flacOffset, value, &blocks, &audioOffset)) {
+            return false;
+        }
+        head = readAt(file, 0, flacOffset + 4);
+        const auto padding =
+            alignedPadding(head.size() + flacRegion(blocks, 0).size(), audioOffset);
+        head.append(flacRegion(blocks, padding));
+    } else if (hasId3) {
+        QByteArray body;
+        qint64 framesStart;
+        bool hasCrc;
+        const auto frames = updateId3v2Frames(file, magic, value, &body, &framesStart, &hasCrc);
+        if (frames.isNull()) {
+            return false;
+        }
+        audioOffset = kId3HeaderSize + body.size();
+        // The extended header is dropped: it may hold a CRC of the frames or the size of the
+        // padding, and nothing needs it.
+        const auto padding = alignedPadding(kId3HeaderSize + frames.size(), audioOffset);
+        const auto size = frames.size() + padding;
+        if (size > kId3MaxSize) {
+            return false; // LCOV_EXCL_LINE
+        }
+        head = magic.left(5) +
+               static_cast<char>(static_cast<uchar>(magic[5]) & ~kId3FlagExtendedHeader) +
+               intToSyncsafe(static_cast<quint32>(size)) + frames + QByteArray(padding, '\0');
+    } else {
+        return false;
+    }
+    // Written next to the file and renamed over it, so the file is either the old or the new one.
+    QSaveFile out(fileName);
+    auto written = out.open(QIODevice::WriteOnly) && out.write(head) == head.size() &&
+                   copyTail(file, audioOffset, out);
+    // Windows cannot replace a file that is open.
+    file.close();
+    written = written && out.commit();
+    qCDebug(gLogBpmDetect) << (written ? "Rewrote tags with new padding in file:" :
+                                         "Cannot rewrite tags with new padding in file:")
+                           << fileName << out.errorString();
+    return written;
+}
@@ -0,0 +1,44 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/** @file */
+#pragma once
+
+#include <QtCore/QString>
+
+/**
+ * Store or remove the BPM tag by editing the existing metadata region of a file in place.
+ *
+ * Only the tag bytes are rewritten, so the cost does not depend on the size of the audio data. This
+ * only works when the format leaves room for the change:
+ *
+ * - MP3: ID3v2.3 or ID3v2.4 tag with enough padding for the `TBPM` frame.
+ * - FLAC: `PADDING` block large enough to absorb the change to the `VORBIS_COMMENT` block.
+ * - Ogg Vorbis and Opus: comment header where the new value has the same length as the old one.
+ *   Ogg pages have no padding, so anything else changes the page size.
+ * - MP4: existing `tmpo` atom, or a `free` atom directly after `ilst`.
+ *
+ * @param fileName The path to the audio file.
+ * @param bpm The BPM value to store. If empty, the BPM tag is removed.
+ * @return `true` if the file was updated or did not need a change. `false` if the file has to be
+ * remuxed instead.
+ */
+bool writeBpmInPlace(const QString &fileName, const QString &bpm);
+
+/**
+ * Store or remove the BPM tag by writing the metadata region again with new padding, for when
+ * writeBpmInPlace() finds no room.
+ *
+ * The new file is written next to the old one and renamed over it, so an interruption leaves either
+ * file. The audio after the metadata is not parsed: it is cloned from the old file where the file
+ * system supports it, or else copied within the kernel, and the padding is sized so that the audio
+ * keeps its offset within a file system block. At least 4 KiB of padding is left for later updates
+ * in place. Hard links to the file are not updated.
+ *
+ * - MP3: ID3v2.3 or ID3v2.4 tag without unsynchronisation or footer. The extended header, if any,
+ *   is dropped.
+ * - FLAC: metadata blocks, optionally after an ID3v2 tag.
+ *
+ * @param fileName The path to the audio file.
+ * @param bpm The BPM value to store. If empty, the BPM tag is removed.
+ * @return `true` if the file was replaced. `false` if the file has to be remuxed instead.
+ */
+bool rewriteBpmWithPadding(const QString &fileName, const QString &bpm);
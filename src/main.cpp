@@ -1,4 +1,7 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
+#include <iostream>
+#include <memory>
+
 #ifndef NO_GUI
 #include <QtWidgets/QApplication>
 #else
@@ -6,7 +9,13 @@
 #endif
 
 #include "consolemain.h"
+#include "debug.h"
 #include "guimain.h"
+#include "profiler.h"
+#include "tracer.h"
+#include "track/bpmcache.h"
+#include "track/envelopecache.h"
+#include "track/resultindex.h"
 #include "track/track.h"
 #include "utils.h"
 #ifndef NO_GUI
@@ -25,18 +34,114 @@ int main(int argc, char *argv[]) {
     QCoreApplication::setOrganizationName(QStringLiteral("Tatsh"));
     QCommandLineParser parser;
     parseCommandLine(parser, app);
+    if (parser.isSet(QStringLiteral("profile"))) {
+        Profiler::setEnabled(true);
+    }
+    const auto traceFile = parser.value(QStringLiteral("trace"));
+    if (!traceFile.isEmpty()) {
+        Tracer::setEnabled(true);
+    }
     if (parser.isSet(QStringLiteral("min"))) {
         Track::setMinimumBpm(parser.value(QStringLiteral("min")).toDouble());
     }
     if (parser.isSet(QStringLiteral("max"))) {
         Track::setMaximumBpm(parser.value(QStringLiteral("max")).toDouble());
     }
+    if (parser.isSet(QStringLiteral("decoder"))) {
+        const auto backend = parser.value(QStringLiteral("decoder"));
+        if (backend == QStringLiteral("ffmpeg")) {
+            Track::setDecoderBackend(Track::FfmpegBackend);
+        } else if (backend == QStringLiteral("qt")) {
+            Track::setDecoderBackend(Track::QtMultimediaBackend);
+        } else {
+            qCWarning(gLogBpmDetect) << "Unknown decoder backend:" << backend;
+        }
+    }
+    if (parser.isSet(QStringLiteral("detector"))) {
+        const auto detector = parser.value(QStringLiteral("detector"));
+        if (detector == QStringLiteral("soundtouch")) {
+            Track::setDetectorType(Track::SoundTouchDetector);
+        } else if (detector == QStringLiteral("autocorrelation")) {
+            Track::setDetectorType(Track::AutocorrelationDetector);
+        } else {
+            qCWarning(gLogBpmDetect) << "Unknown detector:" << detector;
+        }
+    }
+    if (parser.isSet(QStringLiteral("detection-rate")) ||
+        parser.isSet(QStringLiteral("detection-channels"))) {
+        const auto channels = parser.isSet(QStringLiteral("detection-channels")) ?
+                                  parser.value(QStringLiteral("detection-channels")).toInt() :
+                                  Track::detectionChannels();
+        const auto sampleRate = parser.isSet(QStringLiteral("detection-rate")) ?
+                                    parser.value(QStringLiteral("detection-rate")).toInt() :
+                                    Track::detectionSampleRate();
+        Track::setDetectionFormat(channels, sampleRate);
+    }
+    if (parser.isSet(QStringLiteral("converge"))) {
+        auto convergence = Track::convergence();
+        convergence.enabled = true;
+        if (parser.isSet(QStringLiteral("converge-tolerance"))) {
+            convergence.tolerance = parser.value(QStringLiteral("converge-tolerance")).toDouble();
+        }
+        if (parser.isSet(QStringLiteral("converge-window"))) {
+            convergence.window = static_cast<qint64>(
+                parser.value(QStringLiteral("converge-window")).toDouble() * 1000);
+        }
+        Track::setConvergence(convergence);
+    }
+    if (parser.isSet(QStringLiteral("segments"))) {
+        auto sampling = Track::sampling();
+        sampling.windows = parser.value(QStringLiteral("segments")).toInt();
+        if (parser.isSet(QStringLiteral("segment-length"))) {
+            sampling.windowLength = static_cast<qint64>(
+                parser.value(QStringLiteral("segment-length")).toDouble() * 1000);
+        }
+        Track::setSampling(sampling);
+    }
+    if (parser.isSet(QStringLiteral("xattr"))) {
+        Track::setBpmAttribute(parser.value(QStringLiteral("xattr-name")));
+    }
+    std::unique_ptr<BpmCache> cache;
+    if (!parser.isSet(QStringLiteral("no-cache"))) {
+        cache = std::make_unique<BpmCache>(BpmCache::defaultFileName());
+        cache->setHashContent(parser.isSet(QStringLiteral("cache-hash")));
+        if (parser.isSet(QStringLiteral("rebuild-cache"))) {
+            cache->clear();
+        }
+        Track::setCache(cache.get());
+    }
+    std::unique_ptr<EnvelopeCache> envelopeCache;
+    if (parser.isSet(QStringLiteral("envelope-cache"))) {
+        envelopeCache = std::make_unique<EnvelopeCache>(EnvelopeCache::defaultDirectory());
+        envelopeCache->setHashContent(parser.isSet(QStringLiteral("cache-hash")));
+        if (parser.isSet(QStringLiteral("rebuild-cache"))) {
+            envelopeCache->clear();
+        }
+        Track::setEnvelopeCache(envelopeCache.get());
+    }
+    std::unique_ptr<ResultIndex> index;
+    if (parser.isSet(QStringLiteral("index"))) {
+        index = std::make_unique<ResultIndex>(parser.value(QStringLiteral("index")));
+        Track::setIndex(index.get());
+    }
+    int ret;
 #ifdef NO_GUI
-    return consoleMain(parser, parser.positionalArguments());
+    ret = consoleMain(app, parser, parser.positionalArguments());
 #else
     if (parser.isSet(QStringLiteral("console"))) {
-        return consoleMain(app, parser, parser.positionalArguments());
+        ret = consoleMain(app, parser, parser.positionalArguments());
+    } else {
+        ret = guiMain(app, parser, parser.positionalArguments());
     }
-    return guiMain(app, parser.positionalArguments());
 #endif
+    Track::setCache(nullptr);
+    Track::setEnvelopeCache(nullptr);
+    Track::setIndex(nullptr);
+    if (Profiler::isEnabled()) {
+        std::cerr << Profiler::report().toStdString();
+    }
+    if (Tracer::isEnabled() && !Tracer::write(traceFile) && ret == 0) {
+        ret = 1;
+    }
+    return ret;
 }
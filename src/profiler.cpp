@@ -0,0 +1,198 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+#include <QtCore/QFile>
+#include <QtCore/QMutex>
+#include <QtCore/QTextStream>
+#ifndef Q_OS_WIN
+#include <sys/resource.h>
+#endif
+
+#include "profiler.h"
+
+namespace {
+/** Counters of a profiled run. */
+struct State {
+    QMutex mutex;
+    std::array<std::vector<qint64>, Profiler::StageCount> times;
+    QElapsedTimer wallClock;
+    /** bytesRead() when profiling was enabled. */
+    qint64 bytesReadAtStart = 0;
+};
+} // namespace
+
+static std::atomic_bool gEnabled = false;
+static std::atomic<qint64> gDecodedFrames = 0;
+
+static State &state() {
+    static State instance;
+    return instance;
+}
+
+static const char *stageName(Profiler::Stage stage) {
+    switch (stage) {
+    case Profiler::Probe:
+        return "probe";
+    case Profiler::Decode:
+        return "decode";
+    case Profiler::Detect:
+        return "detect";
+    case Profiler::TagWrite:
+        return "tag write";
+    // LCOV_EXCL_START
+    default:
+        return "";
+        // LCOV_EXCL_STOP
+    }
+}
+
+/** Nearest-rank percentile of sorted values, in milliseconds. */
+static double percentile(const std::vector<qint64> &sorted, double fraction) {
+    const auto rank = static_cast<size_t>(std::ceil(fraction * static_cast<double>(sorted.size())));
+    return static_cast<double>(sorted[std::max<size_t>(rank, 1) - 1]) / 1e6;
+}
+
+Profiler::Timer::Timer(Stage stage) : stage_(stage) {
+    if (gEnabled.load(std::memory_order_relaxed)) {
+        timer_.start();
+    }
+}
+
+Profiler::Timer::~Timer() {
+    if (timer_.isValid()) {
+        record(stage_, timer_.nsecsElapsed());
+    }
+}
+
+void Profiler::setEnabled(bool enable) {
+    auto &s = state();
+    QMutexLocker locker(&s.mutex);
+    if (enable) {
+        for (auto &times : s.times) {
+            times.clear();
+        }
+        gDecodedFrames = 0;
+        s.bytesReadAtStart = bytesRead();
+        s.wallClock.start();
+    }
+    gEnabled = enable;
+}
+
+bool Profiler::isEnabled() {
+    return gEnabled;
+}
+
+void Profiler::record(Stage stage, qint64 nanoseconds) {
+    if (!gEnabled.load(std::memory_order_relaxed) || stage < 0 || stage >= StageCount) {
+        return;
+    }
+    auto &s = state();
+    QMutexLocker locker(&s.mutex);
+    s.times[stage].push_back(nanoseconds);
+}
+
+void Profiler::addDecodedFrames(qint64 frames) {
+    if (gEnabled.load(std::memory_order_relaxed)) {
+        gDecodedFrames.fetch_add(frames, std::memory_order_relaxed);
+    }
+}
+
+qint64 Profiler::peakResidentSetSize() {
+#ifdef Q_OS_WIN
+    // LCOV_EXCL_START
+    return -1;
+    // LCOV_EXCL_STOP
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1; // LCOV_EXCL_LINE
+    }
+#ifdef Q_OS_DARWIN
+    return static_cast<qint64>(usage.ru_maxrss);
+#else
+    // Kilobytes everywhere else.
+    return static_cast<qint64>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+qint64 Profiler::bytesRead() {
+#ifdef Q_OS_LINUX
+    QFile file(QStringLiteral("/proc/self/io"));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return -1; // LCOV_EXCL_LINE
+    }
+    // `rchar` counts every byte returned by read(2) and friends, including from the page cache.
+    while (!file.atEnd()) {
+        const auto line = file.readLine();
+        if (line.startsWith("rchar:")) {
+            return line.mid(6).trimmed().toLongLong();
+        }
+    }
+    return -1; // LCOV_EXCL_LINE
+#else
+    // LCOV_EXCL_START
+    return -1;
+    // LCOV_EXCL_STOP
+#endif
+}
+
+QString Profiler::report() {
+    auto &s = state();
+    QMutexLocker locker(&s.mutex);
+    QString ret;
+    QTextStream out(&ret);
+    out.setRealNumberNotation(QTextStream::FixedNotation);
+    out.setRealNumberPrecision(3);
+    out << QStringLiteral("%1 %2 %3 %4 %5 %6\n")
+               .arg(QStringLiteral("stage"), -10)
+               .arg(QStringLiteral("count"), 8)
+               .arg(QStringLiteral("p50 ms"), 10)
+               .arg(QStringLiteral("p90 ms"), 10)
+               .arg(QStringLiteral("p99 ms"), 10)
+               .arg(QStringLiteral("total s"), 10);
+    qint64 decodeTime = 0;
+    for (auto i = 0; i < StageCount; ++i) {
+        auto sorted = s.times[static_cast<size_t>(i)];
+        if (sorted.empty()) {
+            continue;
+        }
+        std::sort(sorted.begin(), sorted.end());
+        qint64 total = 0;
+        for (const auto time : sorted) {
+            total += time;
+        }
+        if (i == Decode) {
+            decodeTime = total;
+        }
+        out << QStringLiteral("%1 %2 %3 %4 %5 %6\n")
+                   .arg(QString::fromLatin1(stageName(static_cast<Stage>(i))), -10)
+                   .arg(static_cast<qint64>(sorted.size()), 8)
+                   .arg(percentile(sorted, 0.5), 10, 'f', 3)
+                   .arg(percentile(sorted, 0.9), 10, 'f', 3)
+                   .arg(percentile(sorted, 0.99), 10, 'f', 3)
+                   .arg(static_cast<double>(total) / 1e9, 10, 'f', 3);
+    }
+    const auto frames = gDecodedFrames.load();
+    out << "Samples decoded: " << frames;
+    if (decodeTime > 0) {
+        out << " (" << qRound64(static_cast<double>(frames) * 1e9 / static_cast<double>(decodeTime))
+            << " per second of decoding)";
+    }
+    out << "\n";
+    const auto read = bytesRead();
+    if (read >= 0) {
+        out << "Bytes read: " << read - s.bytesReadAtStart << "\n";
+    }
+    const auto rss = peakResidentSetSize();
+    if (rss >= 0) {
+        out << "Peak RSS: " << rss / 1024 << " KiB\n";
+    }
+    out << "Wall time: " << static_cast<double>(s.wallClock.nsecsElapsed()) / 1e9 << " s\n";
+    out.flush();
+    return ret;
+}
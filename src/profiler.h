@@ -0,0 +1,66 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/** @file */
+#pragma once
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QString>
+
+/**
+ * Process-wide latency and throughput counters for `--profile`.
+ *
+ * Each stage of the pipeline records one wall time per file, from a monotonic clock. Recording is
+ * a single atomic load while profiling is disabled, so the calls stay in release builds. report()
+ * summarises the stages with their 50th, 90th and 99th percentiles, along with the samples decoded
+ * per second of decoding, the bytes the process read and its peak resident set size.
+ *
+ * All methods are thread-safe.
+ */
+class Profiler {
+public:
+    /** Pipeline stages. */
+    enum Stage {
+        Probe,    //!< Opening a file and reading its headers and tags (probeFile()).
+        Decode,   //!< Decoding audio for detection, per file.
+        Detect,   //!< Time spent in the detector, per file.
+        TagWrite, //!< Saving or removing a tag (Track::writeBpm()).
+        StageCount,
+    };
+    /** Records the time from its construction to its destruction for a stage. */
+    class Timer {
+    public:
+        /**
+         * Constructor. Starts the timer if profiling is enabled.
+         * @param stage Stage to record.
+         */
+        explicit Timer(Stage stage);
+        ~Timer();
+
+    private:
+        QElapsedTimer timer_;
+        Stage stage_;
+    };
+    /**
+     * Enable or disable profiling. Enabling resets the counters and starts the wall clock of the
+     * run.
+     */
+    static void setEnabled(bool enable);
+    /** If profiling is enabled. */
+    static bool isEnabled();
+    /**
+     * Record the time one file spent in a stage. Does nothing if profiling is disabled.
+     * @param stage Stage.
+     * @param nanoseconds Wall time.
+     */
+    static void record(Stage stage, qint64 nanoseconds);
+    /**
+     * Count decoded sample frames. Does nothing if profiling is disabled.
+     * @param frames Number of frames fed to a detector.
+     */
+    static void addDecodedFrames(qint64 frames);
+    /** Get a text summary of the counters, one line per stage followed by the totals. */
+    static QString report();
+    /** Get the peak resident set size of the process in bytes, or -1 if unknown. */
+    static qint64 peakResidentSetSize();
+    /** Get how many bytes the process has read through system calls, or -1 if unknown. */
+    static qint64 bytesRead();
+};
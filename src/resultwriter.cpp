@@ -0,0 +1,120 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QStringList>
+
+#include "resultwriter.h"
+
+static const auto kColumns = QStringList{QStringLiteral("path"),
+                                         QStringLiteral("status"),
+                                         QStringLiteral("bpm"),
+                                         QStringLiteral("rawBpm"),
+                                         QStringLiteral("durationMs"),
+                                         QStringLiteral("error"),
+                                         QStringLiteral("probeMs"),
+                                         QStringLiteral("decodeMs"),
+                                         QStringLiteral("detectMs"),
+                                         QStringLiteral("writeMs")};
+
+/** Convert nanoseconds to milliseconds with microsecond precision. */
+static double toMilliseconds(qint64 nanoseconds) {
+    return static_cast<double>(nanoseconds / 1000) / 1000;
+}
+
+static QString csvField(const QString &value) {
+    if (!value.contains(QLatin1Char(',')) && !value.contains(QLatin1Char('"')) &&
+        !value.contains(QLatin1Char('\n')) && !value.contains(QLatin1Char('\r'))) {
+        return value;
+    }
+    auto quoted = value;
+    quoted.replace(QStringLiteral("\""), QStringLiteral("\"\""));
+    return QLatin1Char('"') + quoted + QLatin1Char('"');
+}
+
+std::optional<ResultWriter::Format> ResultWriter::formatFromName(const QString &name) {
+    if (name == QStringLiteral("json")) {
+        return Json;
+    } else if (name == QStringLiteral("jsonl")) {
+        return JsonLines;
+    } else if (name == QStringLiteral("csv")) {
+        return Csv;
+    }
+    return std::nullopt;
+}
+
+ResultWriter::ResultWriter(Format format, std::ostream &out) : out_(out), format_(format) {
+}
+
+ResultWriter::~ResultWriter() {
+    finish();
+}
+
+void ResultWriter::begin() {
+    if (format_ == Json) {
+        out_ << "[\n";
+    } else if (format_ == Csv) {
+        out_ << kColumns.join(QLatin1Char(',')).toStdString() << "\n";
+    }
+}
+
+void ResultWriter::write(const Record &record) {
+    if (finished_) {
+        return;
+    }
+    if (count_++ == 0) {
+        begin();
+    }
+    const auto probe = toMilliseconds(record.probeTime);
+    const auto decode = toMilliseconds(record.decodeTime);
+    const auto detect = toMilliseconds(record.detectTime);
+    const auto write = toMilliseconds(record.writeTime);
+    if (format_ == Csv) {
+        const QStringList fields{
+            csvField(record.path),
+            record.status,
+            record.bpm,
+            record.rawBpm > 0 ? QString::number(record.rawBpm) : QString(),
+            QString::number(record.length),
+            csvField(record.error),
+            QString::number(probe),
+            QString::number(decode),
+            QString::number(detect),
+            QString::number(write)};
+        out_ << fields.join(QLatin1Char(',')).toStdString() << std::endl;
+        return;
+    }
+    const QJsonObject object{
+        {QStringLiteral("path"), record.path},
+        {QStringLiteral("status"), record.status},
+        {QStringLiteral("bpm"), record.bpm.isEmpty() ? QJsonValue() : record.bpm.toDouble()},
+        {QStringLiteral("rawBpm"), record.rawBpm > 0 ? record.rawBpm : QJsonValue()},
+        {QStringLiteral("durationMs"), record.length},
+        {QStringLiteral("error"), record.error.isEmpty() ? QJsonValue() : record.error},
+        {QStringLiteral("probeMs"), probe},
+        {QStringLiteral("decodeMs"), decode},
+        {QStringLiteral("detectMs"), detect},
+        {QStringLiteral("writeMs"), write},
+    };
+    if (format_ == Json && count_ > 1) {
+        out_ << ",\n";
+    }
+    out_ << QJsonDocument(object).toJson(QJsonDocument::Compact).toStdString();
+    if (format_ == JsonLines) {
+        out_ << std::endl;
+    } else {
+        out_.flush();
+    }
+}
+
+void ResultWriter::finish() {
+    if (finished_) {
+        return;
+    }
+    finished_ = true;
+    if (format_ == Json) {
+        out_ << (count_ == 0 ? "[]\n" : "\n]\n");
+    } else if (format_ == Csv && count_ == 0) {
+        begin();
+    }
+    out_.flush();
+}
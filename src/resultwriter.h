@@ -0,0 +1,84 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/** @file */
+#pragma once
+
+#include <optional>
+#include <ostream>
+
+#include <QtCore/QString>
+
+#include "utils.h"
+
+/**
+ * Writes one machine-readable record per file for `--output`.
+ *
+ * Records are written as they come, so a consumer can follow a long run:
+ *
+ * - `json`: a single array of objects, closed by finish().
+ * - `jsonl`: one object per line.
+ * - `csv`: a header line, then one row per file. Fields are quoted as in RFC 4180.
+ *
+ * Keys (and CSV columns) are `path`, `status`, `bpm`, `rawBpm`, `durationMs`, `error`, `probeMs`,
+ * `decodeMs`, `detectMs` and `writeMs`. In JSON, a missing BPM, raw BPM or error is `null`.
+ */
+class ResultWriter {
+public:
+    /** Output formats. */
+    enum Format {
+        Json,      //!< JSON array.
+        JsonLines, //!< JSON Lines.
+        Csv,       //!< Comma-separated values.
+    };
+    /** Result for one file. Times are wall times in nanoseconds, 0 for stages not run. */
+    struct Record {
+        /** Path to the file. */
+        QString path;
+        /** Outcome, such as `detected` or `failed`. */
+        QString status;
+        /** Formatted BPM, or an empty string if there is none. */
+        QString bpm;
+        /** Error message, or an empty string. */
+        QString error;
+        /** Result of detection before folding into the BPM range, or 0 if not detected. */
+        bpmtype rawBpm = 0;
+        /** Length in milliseconds, or 0 if unknown. */
+        qint64 length = 0;
+        /** Time spent opening and probing the file. */
+        qint64 probeTime = 0;
+        /** Time spent decoding audio for detection. */
+        qint64 decodeTime = 0;
+        /** Time spent in the detector. */
+        qint64 detectTime = 0;
+        /** Time spent saving or removing the tag. */
+        qint64 writeTime = 0;
+    };
+    /**
+     * Get a format by its name as given to `--output`.
+     * @param name `json`, `jsonl` or `csv`.
+     * @return The format, or nothing if @a name is not one of them.
+     */
+    static std::optional<Format> formatFromName(const QString &name);
+    /**
+     * Constructor.
+     * @param format Output format.
+     * @param out Stream to write to. Must outlive the writer.
+     */
+    ResultWriter(Format format, std::ostream &out);
+    /** Calls finish(). */
+    ~ResultWriter();
+    /**
+     * Write a record and flush the stream.
+     * @param record Result for one file.
+     */
+    void write(const Record &record);
+    /** End the output (closes the JSON array). Nothing can be written after this. */
+    void finish();
+
+private:
+    void begin();
+
+    std::ostream &out_;
+    Format format_;
+    qint64 count_ = 0;
+    bool finished_ = false;
+};
@@ -0,0 +1,148 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <atomic>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFileInfo>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QMutex>
+#include <QtCore/QSaveFile>
+#include <QtCore/QThread>
+
+#include "debug.h"
+#include "tracer.h"
+
+namespace {
+/** Events of a traced run. */
+struct State {
+    QMutex mutex;
+    QJsonArray events;
+    QElapsedTimer clock;
+    /** Incremented by setEnabled() so threads name themselves again in a new trace. */
+    int generation = 0;
+    int nextThreadId = 1;
+};
+
+/** Identifier of a thread in the trace. */
+struct ThreadId {
+    int generation = -1;
+    int id = 0;
+};
+} // namespace
+
+static std::atomic_bool gEnabled = false;
+
+static State &state() {
+    static State instance;
+    return instance;
+}
+
+/** Get the identifier of the current thread, naming the thread in the trace on first use. */
+static int threadId(State &s) {
+    thread_local ThreadId tid;
+    if (tid.generation == s.generation) {
+        return tid.id;
+    }
+    tid = {s.generation, s.nextThreadId++};
+    const auto thread = QThread::currentThread();
+    auto name = thread->objectName();
+    if (name.isEmpty()) {
+        name = QCoreApplication::instance() && thread == QCoreApplication::instance()->thread() ?
+                   QStringLiteral("main") :
+                   QStringLiteral("thread %1").arg(tid.id);
+    }
+    s.events.append(QJsonObject{
+        {QStringLiteral("name"), QStringLiteral("thread_name")},
+        {QStringLiteral("ph"), QStringLiteral("M")},
+        {QStringLiteral("pid"), QCoreApplication::applicationPid()},
+        {QStringLiteral("tid"), tid.id},
+        {QStringLiteral("args"), QJsonObject{{QStringLiteral("name"), name}}},
+    });
+    return tid.id;
+}
+
+Tracer::Span::Span(const char *name, const QString &fileName)
+    : fileName_(fileName), name_(name), start_(now()) {
+}
+
+Tracer::Span::~Span() {
+    complete(name_, fileName_, start_, args_);
+}
+
+void Tracer::Span::setArg(const QString &key, const QJsonValue &value) {
+    if (start_ >= 0) {
+        args_.insert(key, value);
+    }
+}
+
+void Tracer::setEnabled(bool enable) {
+    auto &s = state();
+    QMutexLocker locker(&s.mutex);
+    if (enable) {
+        s.events = QJsonArray();
+        ++s.generation;
+        s.nextThreadId = 1;
+        s.clock.start();
+    }
+    gEnabled = enable;
+}
+
+bool Tracer::isEnabled() {
+    return gEnabled;
+}
+
+qint64 Tracer::now() {
+    if (!gEnabled.load(std::memory_order_relaxed)) {
+        return -1;
+    }
+    // QElapsedTimer is monotonic and reads the same clock from every thread.
+    return state().clock.nsecsElapsed();
+}
+
+void Tracer::complete(const char *name,
+                      const QString &fileName,
+                      qint64 start,
+                      const QJsonObject &args) {
+    const auto end = now();
+    if (end < 0 || start < 0) {
+        return;
+    }
+    auto allArgs = args;
+    if (!fileName.isEmpty()) {
+        allArgs.insert(QStringLiteral("file"), fileName);
+        // Read after the span so that a rewritten file reports its new size.
+        allArgs.insert(QStringLiteral("size"), QFileInfo(fileName).size());
+    }
+    auto &s = state();
+    QMutexLocker locker(&s.mutex);
+    // Microseconds, the unit of the format; fractions keep the nanosecond resolution.
+    s.events.append(QJsonObject{
+        {QStringLiteral("name"), QString::fromLatin1(name)},
+        {QStringLiteral("cat"), QStringLiteral("bpmdetect")},
+        {QStringLiteral("ph"), QStringLiteral("X")},
+        {QStringLiteral("ts"), static_cast<double>(start) / 1000},
+        {QStringLiteral("dur"), static_cast<double>(end - start) / 1000},
+        {QStringLiteral("pid"), QCoreApplication::applicationPid()},
+        {QStringLiteral("tid"), threadId(s)},
+        {QStringLiteral("args"), allArgs},
+    });
+}
+
+QByteArray Tracer::toJson() {
+    auto &s = state();
+    QMutexLocker locker(&s.mutex);
+    return QJsonDocument(QJsonObject{{QStringLiteral("traceEvents"), s.events},
+                                     {QStringLiteral("displayTimeUnit"), QStringLiteral("ms")}})
+        .toJson(QJsonDocument::Compact);
+}
+
+bool Tracer::write(const QString &fileName) {
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly) || file.write(toJson()) < 0 || !file.commit()) {
+        qCWarning(gLogBpmDetect) << "Cannot write the trace to" << fileName << ":"
+                                 << file.errorString();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,69 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/** @file */
+#pragma once
+
+#include <QtCore/QJsonObject>
+#include <QtCore/QString>
+
+/**
+ * Process-wide recorder of pipeline spans for `--trace`.
+ *
+ * Spans are kept in memory as complete events (`"ph": "X"`) of the Chrome Trace Event format and
+ * written out at exit, which Perfetto and `chrome://tracing` can open. Each event is placed on the
+ * thread that recorded it, so gaps between spans on a worker show time spent waiting. Spans of a
+ * file carry its path and size in their arguments.
+ *
+ * Recording is a single atomic load while tracing is disabled. All methods are thread-safe.
+ */
+class Tracer {
+public:
+    /** Records a span from its construction to its destruction. */
+    class Span {
+    public:
+        /**
+         * Constructor. Starts the span if tracing is enabled.
+         * @param name Event name, such as `probe`. Must outlive the span.
+         * @param fileName File being processed.
+         */
+        Span(const char *name, const QString &fileName);
+        ~Span();
+        /**
+         * Add an argument to the event.
+         * @param key Name.
+         * @param value Value.
+         */
+        void setArg(const QString &key, const QJsonValue &value);
+
+    private:
+        QJsonObject args_;
+        QString fileName_;
+        const char *name_;
+        qint64 start_ = -1;
+    };
+    /** Enable or disable tracing. Enabling drops recorded events and restarts the clock. */
+    static void setEnabled(bool enable);
+    /** If tracing is enabled. */
+    static bool isEnabled();
+    /** Get the time since tracing was enabled in nanoseconds, or -1 if disabled. */
+    static qint64 now();
+    /**
+     * Record a span on the current thread that ends now. Does nothing if tracing is disabled or
+     * @p start is negative.
+     * @param name Event name. Must be a string literal.
+     * @param fileName File being processed. Its path and size are added to the arguments.
+     * @param start Value of now() when the span started.
+     * @param args Additional arguments.
+     */
+    static void complete(const char *name,
+                         const QString &fileName,
+                         qint64 start,
+                         const QJsonObject &args = QJsonObject());
+    /** Get the recorded events as a Trace Event Format document. */
+    static QByteArray toJson();
+    /**
+     * Write the recorded events to a file.
+     * @param fileName Path to write to. The file is replaced atomically.
+     * @return `true` if the file was written.
+     */
+    static bool write(const QString &fileName);
+};
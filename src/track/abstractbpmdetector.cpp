@@ -1,8 +1,32 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 #include "abstractbpmdetector.h"
+#include "constants.h"
 
-AbstractBpmDetector::AbstractBpmDetector(QObject *parent) : QObject(parent) {
+AbstractBpmDetector::AbstractBpmDetector(QObject *parent)
+    : QObject(parent), channels_(kDefaultDetectionChannels),
+      sampleRate_(kDefaultDetectionSampleRate) {
 }
 
 AbstractBpmDetector::~AbstractBpmDetector() {
 }
+
+void AbstractBpmDetector::setFormat(int channels, int sampleRate) {
+    channels_ = channels;
+    sampleRate_ = sampleRate;
+}
+
+int AbstractBpmDetector::channels() const {
+    return channels_;
+}
+
+int AbstractBpmDetector::sampleRate() const {
+    return sampleRate_;
+}
+
+QList<AbstractBpmDetector::Candidate> AbstractBpmDetector::candidates(int count) const {
+    const auto bpm = getBpm();
+    if (count < 1 || bpm <= 0) {
+        return {};
+    }
+    return {{bpm, 1}};
+}
@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 /** @file */
 #pragma once
+#include <QtCore/QList>
 #include <STTypes.h>
 
 #include "utils.h"
@@ -8,6 +9,13 @@
 class AbstractBpmDetector : public QObject {
     Q_OBJECT
 public:
+    /** A tempo the input may have. */
+    struct Candidate {
+        /** Tempo in BPM, not folded into a range. */
+        bpmtype bpm = 0;
+        /** Strength relative to the best candidate, from 0 to 1. */
+        double score = 0;
+    };
     /** Constructs a BPM detector. */
     explicit AbstractBpmDetector(QObject *parent = nullptr);
     ~AbstractBpmDetector() override;
@@ -15,6 +23,25 @@ public:
     virtual void inputSamples(const soundtouch::SAMPLETYPE *samples, int numSamples) = 0;
     /** Get the BPM value. */
     virtual bpmtype getBpm() const = 0;
+    /**
+     * Get the most likely tempos, best first. The default returns getBpm() alone.
+     * @param count Maximum number of candidates.
+     */
+    virtual QList<Candidate> candidates(int count) const;
     /** Reset the class. */
     virtual void reset() = 0;
+    /**
+     * Set the format of the samples passed to inputSamples(). Takes effect on the next reset().
+     * @param channels Number of interleaved channels.
+     * @param sampleRate Sample rate in Hz.
+     */
+    void setFormat(int channels, int sampleRate);
+    /** Get the number of channels of the input samples. */
+    int channels() const;
+    /** Get the sample rate of the input samples. */
+    int sampleRate() const;
+
+private:
+    int channels_;
+    int sampleRate_;
 };
@@ -0,0 +1,192 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+extern "C" {
+#include <libavutil/mem.h>
+#include <libavutil/tx.h>
+}
+#include <QtCore/QDebug>
+
+#include "autocorrelationbpmdetector.h"
+#include "debug.h"
+
+/** Rate of the onset envelope in Hz. */
+static constexpr int kEnvelopeRate = 200;
+/** Lowest tempo considered by the lag search. */
+static constexpr double kMinimumBpm = 40;
+/** Highest tempo considered by the lag search. */
+static constexpr double kMaximumBpm = 240;
+/** Centre of the tempo prior, which keeps the octave closest to common dance tempos. */
+static constexpr double kPriorBpm = 120;
+/** Width of the tempo prior in octaves. */
+static constexpr double kPriorWidth = 1.4;
+/** Minimum envelope length for a result (about 4 seconds). */
+static constexpr size_t kMinimumEnvelope = 4 * kEnvelopeRate;
+
+AutocorrelationBpmDetector::AutocorrelationBpmDetector(QObject *parent)
+    : AbstractBpmDetector(parent) {
+    reset();
+}
+
+AutocorrelationBpmDetector::~AutocorrelationBpmDetector() {
+}
+
+void AutocorrelationBpmDetector::reset() {
+    envelope_.clear();
+    hopEnergy_ = 0;
+    lastLogEnergy_ = 0;
+    hopFill_ = 0;
+    hopSize_ = std::max(1, sampleRate() / kEnvelopeRate);
+    envelopeRate_ = static_cast<double>(sampleRate()) / hopSize_;
+}
+
+const std::vector<float> &AutocorrelationBpmDetector::envelope() const {
+    return envelope_;
+}
+
+double AutocorrelationBpmDetector::envelopeRate() const {
+    return envelopeRate_;
+}
+
+void AutocorrelationBpmDetector::setEnvelope(std::vector<float> envelope, double rate) {
+    envelope_ = std::move(envelope);
+    envelopeRate_ = rate;
+    hopEnergy_ = 0;
+    hopFill_ = 0;
+}
+
+void AutocorrelationBpmDetector::inputSamples(const soundtouch::SAMPLETYPE *samples,
+                                              int numSamples) {
+    const auto channelCount = channels();
+    const auto input = unsafeSpan(samples, static_cast<qsizetype>(numSamples) * channelCount);
+    for (qsizetype i = 0; i < input.size(); i += channelCount) {
+        double sum = 0;
+        for (auto c = 0; c < channelCount; ++c) {
+#if defined(SOUNDTOUCH_INTEGER_SAMPLES) && SOUNDTOUCH_INTEGER_SAMPLES
+            sum += input[i + c] / 32768.0;
+#else
+            sum += input[i + c];
+#endif
+        }
+        const auto mono = sum / channelCount;
+        hopEnergy_ += mono * mono;
+        if (++hopFill_ == hopSize_) {
+            // Onset strength: rise in log energy since the previous hop.
+            const auto logEnergy = static_cast<float>(std::log1p(1000 * hopEnergy_ / hopSize_));
+            envelope_.push_back(std::max(0.0f, logEnergy - lastLogEnergy_));
+            lastLogEnergy_ = logEnergy;
+            hopEnergy_ = 0;
+            hopFill_ = 0;
+        }
+    }
+}
+
+bpmtype AutocorrelationBpmDetector::getBpm() const {
+    const auto best = candidates(1);
+    return best.isEmpty() ? 0 : best.first().bpm;
+}
+
+QList<AbstractBpmDetector::Candidate> AutocorrelationBpmDetector::candidates(int count) const {
+    const auto envelopeSize = envelope_.size();
+    if (count < 1) {
+        return {};
+    }
+    if (envelopeSize < kMinimumEnvelope) {
+        qCDebug(gLogBpmDetect) << "Not enough audio for autocorrelation:" << envelopeSize
+                               << "hops.";
+        return {};
+    }
+    const auto envelopeRate = envelopeRate_;
+    // Zero-pad to at least twice the length so the circular correlation equals the linear one.
+    auto size = 1;
+    while (static_cast<size_t>(size) < 2 * envelopeSize) {
+        size *= 2;
+    }
+    AVTXContext *forward = nullptr;
+    AVTXContext *inverse = nullptr;
+    av_tx_fn forwardFn = nullptr;
+    av_tx_fn inverseFn = nullptr;
+    const auto scale = 1.0f;
+    const auto inverseScale = 1.0f / static_cast<float>(size);
+    auto *signal = static_cast<float *>(av_calloc(static_cast<size_t>(size) + 2, sizeof(float)));
+    auto *spectrum = static_cast<AVComplexFloat *>(
+        av_calloc(static_cast<size_t>(size) / 2 + 1, sizeof(AVComplexFloat)));
+    if (!signal || !spectrum ||
+        av_tx_init(&forward, &forwardFn, AV_TX_FLOAT_RDFT, 0, size, &scale, 0) < 0 ||
+        av_tx_init(&inverse, &inverseFn, AV_TX_FLOAT_RDFT, 1, size, &inverseScale, 0) < 0) {
+        // LCOV_EXCL_START
+        qCCritical(gLogBpmDetect) << "Failed to set up FFT of size" << size;
+        av_tx_uninit(&forward);
+        av_free(signal);
+        av_free(spectrum);
+        return {};
+        // LCOV_EXCL_STOP
+    }
+    const auto values = unsafeSpan(signal, size);
+    double mean = 0;
+    for (const auto value : envelope_) {
+        mean += value;
+    }
+    mean /= static_cast<double>(envelopeSize);
+    for (size_t i = 0; i < envelopeSize; ++i) {
+        values[static_cast<qsizetype>(i)] = envelope_[i] - static_cast<float>(mean);
+    }
+    forwardFn(forward, spectrum, signal, sizeof(float));
+    for (auto &bin : unsafeSpan(spectrum, size / 2 + 1)) {
+        bin.re = bin.re * bin.re + bin.im * bin.im;
+        bin.im = 0;
+    }
+    inverseFn(inverse, signal, spectrum, sizeof(AVComplexFloat));
+    // signal now holds the autocorrelation. Score each lag with its first harmonic (so the beat
+    // period beats its subdivisions) weighted by a log-Gaussian prior on the tempo.
+    const auto minLag =
+        std::max(static_cast<qsizetype>(std::floor(60 * envelopeRate / kMaximumBpm)), qsizetype(1));
+    const auto maxLag =
+        std::min(static_cast<qsizetype>(std::ceil(60 * envelopeRate / kMinimumBpm)),
+                 static_cast<qsizetype>(envelopeSize / 2));
+    const auto score = [&values, envelopeRate](qsizetype lag) {
+        const auto tempo = 60 * envelopeRate / static_cast<double>(lag);
+        const auto octaves = std::log2(tempo / kPriorBpm) / kPriorWidth;
+        const auto weight = std::exp(-0.5 * octaves * octaves);
+        const auto harmonic = 2 * lag < values.size() ? 0.5 * values[2 * lag] : 0.0;
+        return weight * (values[lag] + harmonic);
+    };
+    // Candidates are the local maxima of the score within the range, strongest first.
+    QList<std::pair<double, qsizetype>> peaks;
+    auto previous = 0.0;
+    auto current = score(minLag);
+    for (auto lag = minLag; lag <= maxLag; ++lag) {
+        const auto next = lag < maxLag ? score(lag + 1) : 0.0;
+        if (current > 0 && current >= previous && current > next) {
+            peaks.append({current, lag});
+        }
+        previous = current;
+        current = next;
+    }
+    std::sort(peaks.begin(), peaks.end(), std::greater<>());
+    QList<Candidate> ret;
+    for (const auto &[peakScore, peakLag] : std::as_const(peaks)) {
+        if (ret.size() == count) {
+            break;
+        }
+        // Parabolic interpolation around the peak for a fractional lag.
+        auto lag = static_cast<double>(peakLag);
+        if (peakLag > minLag && peakLag < maxLag) {
+            const auto left = values[peakLag - 1];
+            const auto centre = values[peakLag];
+            const auto right = values[peakLag + 1];
+            const auto denominator = left - 2 * centre + right;
+            if (denominator < 0) {
+                lag += 0.5 * (left - right) / denominator;
+            }
+        }
+        ret.append({60 * envelopeRate / lag, peakScore / peaks.first().first});
+    }
+    av_tx_uninit(&forward);
+    av_tx_uninit(&inverse);
+    av_free(signal);
+    av_free(spectrum);
+    return ret;
+}
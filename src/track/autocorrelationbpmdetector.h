@@ -0,0 +1,47 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/** @file */
+#pragma once
+#include <vector>
+
+#include "abstractbpmdetector.h"
+
+/**
+ * BPM detector based on the autocorrelation of an onset envelope.
+ *
+ * Input is reduced to an onset strength envelope at about 200 Hz (log energy per hop, half-wave
+ * rectified difference). getBpm() computes the autocorrelation of the whole envelope with one real
+ * FFT and one inverse FFT (libavutil `av_tx`), so the cost is O(n log n) in the envelope length
+ * rather than proportional to the lag range per block of input.
+ *
+ * The envelope can be taken with envelope() and given back with setEnvelope(), so tempo candidates
+ * can be computed again without decoding the audio.
+ */
+class AutocorrelationBpmDetector : public AbstractBpmDetector {
+    Q_OBJECT
+public:
+    /** Constructs an autocorrelation BPM detector. */
+    AutocorrelationBpmDetector(QObject *parent = nullptr);
+    ~AutocorrelationBpmDetector() override;
+    void inputSamples(const soundtouch::SAMPLETYPE *samples, int numSamples) override;
+    bpmtype getBpm() const override;
+    QList<Candidate> candidates(int count) const override;
+    void reset() override;
+    /** Get the onset envelope of the input so far. */
+    const std::vector<float> &envelope() const;
+    /** Get the rate of the onset envelope in Hz. */
+    double envelopeRate() const;
+    /**
+     * Replace the onset envelope, as if the audio it was computed from had been input.
+     * @param envelope Onset envelope, for example from envelope().
+     * @param rate Rate of @a envelope in Hz.
+     */
+    void setEnvelope(std::vector<float> envelope, double rate);
+
+private:
+    std::vector<float> envelope_;
+    double envelopeRate_ = 0;
+    double hopEnergy_ = 0;
+    float lastLogEnergy_ = 0;
+    int hopFill_ = 0;
+    int hopSize_ = 1;
+};
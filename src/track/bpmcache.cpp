@@ -0,0 +1,200 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <cstring>
+#include <type_traits>
+
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QSaveFile>
+#include <QtCore/QStandardPaths>
+
+#include "bpmcache.h"
+#include "debug.h"
+
+/** Start of the cache file, followed by the format version. */
+static constexpr char kMagic[] = {'B', 'P', 'M', 'C'};
+/** Bump when Record changes. */
+static constexpr quint32 kFormatVersion = 1;
+static constexpr qint64 kHeaderSize = sizeof(kMagic) + sizeof(quint32);
+/** New entries are written once this many are pending. */
+static constexpr qsizetype kFlushBatch = 256;
+/** Stale records tolerated beyond the number of entries before the file is compacted. */
+static constexpr qsizetype kCompactSlack = 1024;
+static constexpr quint32 kSavedFlag = 1;
+
+BpmCache::BpmCache(const QString &fileName) : fileName_(fileName) {
+    static_assert(std::is_trivially_copyable_v<Record>);
+    load();
+}
+
+BpmCache::~BpmCache() {
+    flush();
+}
+
+QString BpmCache::defaultFileName() {
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) +
+           QStringLiteral("/bpm-cache.bin");
+}
+
+QString BpmCache::fileName() const {
+    return fileName_;
+}
+
+void BpmCache::setHashContent(bool enable) {
+    QMutexLocker locker(&mutex_);
+    hashContent_ = enable;
+}
+
+bool BpmCache::hashesContent() const {
+    QMutexLocker locker(&mutex_);
+    return hashContent_;
+}
+
+bool BpmCache::identify(const QString &fileName, Record *record) const {
+    *record = {};
+    return identifyFile(fileName, hashesContent(), &record->identity);
+}
+
+bool BpmCache::lookup(const QString &fileName, Entry *entry) const {
+    Record current;
+    if (!identify(fileName, &current)) {
+        return false;
+    }
+    QMutexLocker locker(&mutex_);
+    const auto it = records_.constFind({current.identity.device, current.identity.inode});
+    if (it == records_.cend() || it->identity != current.identity) {
+        return false;
+    }
+    entry->bpm = it->bpm;
+    entry->rawBpm = it->rawBpm;
+    entry->length = it->length;
+    entry->detectorVersion = it->detectorVersion;
+    entry->saved = it->flags & kSavedFlag;
+    return true;
+}
+
+void BpmCache::insert(const QString &fileName, const Entry &entry) {
+    Record record;
+    if (!identify(fileName, &record)) {
+        return;
+    }
+    record.bpm = entry.bpm;
+    record.rawBpm = entry.rawBpm;
+    record.length = entry.length;
+    record.detectorVersion = entry.detectorVersion;
+    record.flags = entry.saved ? kSavedFlag : 0;
+    QMutexLocker locker(&mutex_);
+    auto &stored = records_[{record.identity.device, record.identity.inode}];
+    if (std::memcmp(&stored, &record, sizeof(Record)) == 0) {
+        return;
+    }
+    stored = record;
+    pending_.append(record);
+    if (pending_.size() >= kFlushBatch) {
+        locker.unlock();
+        flush();
+    }
+}
+
+void BpmCache::clear() {
+    QMutexLocker locker(&mutex_);
+    records_.clear();
+    pending_.clear();
+    needsRewrite_ = true;
+}
+
+qsizetype BpmCache::size() const {
+    QMutexLocker locker(&mutex_);
+    return records_.size();
+}
+
+bool BpmCache::flush() {
+    QMutexLocker locker(&mutex_);
+    if (needsRewrite_ || stored_ + pending_.size() > records_.size() * 2 + kCompactSlack) {
+        return rewrite();
+    }
+    if (pending_.isEmpty()) {
+        return true;
+    }
+    QDir().mkpath(QFileInfo(fileName_).absolutePath());
+    QFile file(fileName_);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qCWarning(gLogBpmDetect) << "Cannot write BPM cache" << fileName_ << file.errorString();
+        return false;
+    }
+    if (file.size() == 0) {
+        file.write(kMagic, sizeof(kMagic));
+        file.write(reinterpret_cast<const char *>(&kFormatVersion), sizeof(kFormatVersion));
+    }
+    const auto bytes = static_cast<qint64>(pending_.size() * sizeof(Record));
+    if (file.write(reinterpret_cast<const char *>(pending_.constData()), bytes) != bytes) {
+        // LCOV_EXCL_START
+        qCWarning(gLogBpmDetect) << "Cannot write BPM cache" << fileName_ << file.errorString();
+        // A partial record would misalign every record appended after it.
+        needsRewrite_ = true;
+        return false;
+        // LCOV_EXCL_STOP
+    }
+    stored_ += pending_.size();
+    pending_.clear();
+    return true;
+}
+
+void BpmCache::load() {
+    QFile file(fileName_);
+    if (!file.open(QIODevice::ReadOnly) || file.size() < kHeaderSize) {
+        return;
+    }
+    const auto size = file.size();
+    const auto data = file.map(0, size);
+    if (!data) {
+        // LCOV_EXCL_START
+        qCWarning(gLogBpmDetect) << "Cannot map BPM cache" << fileName_ << file.errorString();
+        return;
+        // LCOV_EXCL_STOP
+    }
+    quint32 version;
+    std::memcpy(&version, data + sizeof(kMagic), sizeof(version));
+    if (std::memcmp(data, kMagic, sizeof(kMagic)) != 0 || version != kFormatVersion) {
+        qCInfo(gLogBpmDetect) << "Discarding BPM cache with unknown format" << fileName_;
+        needsRewrite_ = true;
+        return;
+    }
+    const auto count = (size - kHeaderSize) / static_cast<qint64>(sizeof(Record));
+    records_.reserve(count);
+    for (qint64 i = 0; i < count; ++i) {
+        Record record;
+        std::memcpy(&record, data + kHeaderSize + i * static_cast<qint64>(sizeof(Record)),
+                    sizeof(Record));
+        // Later records replace earlier ones.
+        records_.insert({record.identity.device, record.identity.inode}, record);
+    }
+    stored_ = count;
+    // A trailing partial record is left by an interrupted write.
+    needsRewrite_ = kHeaderSize + count * static_cast<qint64>(sizeof(Record)) != size;
+    qCDebug(gLogBpmDetect) << "Loaded" << records_.size() << "BPM cache entries from" << fileName_;
+}
+
+bool BpmCache::rewrite() {
+    QDir().mkpath(QFileInfo(fileName_).absolutePath());
+    QSaveFile file(fileName_);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(gLogBpmDetect) << "Cannot write BPM cache" << fileName_ << file.errorString();
+        return false;
+    }
+    file.write(kMagic, sizeof(kMagic));
+    file.write(reinterpret_cast<const char *>(&kFormatVersion), sizeof(kFormatVersion));
+    for (const auto &record : std::as_const(records_)) {
+        file.write(reinterpret_cast<const char *>(&record), sizeof(Record));
+    }
+    if (!file.commit()) {
+        // LCOV_EXCL_START
+        qCWarning(gLogBpmDetect) << "Cannot write BPM cache" << fileName_ << file.errorString();
+        return false;
+        // LCOV_EXCL_STOP
+    }
+    stored_ = records_.size();
+    pending_.clear();
+    needsRewrite_ = false;
+    return true;
+}
@@ -0,0 +1,119 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/** @file */
+#pragma once
+
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+
+#include "fileidentity.h"
+#include "utils.h"
+
+/**
+ * Persistent cache of BPM results, keyed by file identity.
+ *
+ * A file is identified by its device and inode (a hash of the absolute path on Windows), size and
+ * modification time, and optionally a hash of its first and last 64 KiB (see identifyFile()). A
+ * file that was written, replaced or moved to another file system no longer matches and is looked
+ * at again; renaming a file within a file system keeps its entry.
+ *
+ * Entries are fixed-size records in a binary file that is read with a single map on construction.
+ * New entries are appended in batches, so an interrupted run keeps most of its results. The file
+ * is compacted when most of its records are stale. Records use the machine's byte order; the cache
+ * is not meant to be shared between machines.
+ *
+ * All methods are thread-safe.
+ */
+class BpmCache {
+public:
+    /** Cached result for one file. */
+    struct Entry {
+        /** BPM as last reported for the file: its tag, or the folded result of detection. */
+        bpmtype bpm = 0;
+        /** Result of detection before folding into the BPM range, or 0 if not detected. */
+        bpmtype rawBpm = 0;
+        /** Length in milliseconds. */
+        qint64 length = 0;
+        /** Track::detectorVersion() @a rawBpm was detected with. */
+        quint32 detectorVersion = 0;
+        /** If @a bpm is saved in the tags of the file. */
+        bool saved = false;
+    };
+    /**
+     * Constructor. Loads the cache file if it exists.
+     * @param fileName Path to the cache file. Its directory is created on the first flush().
+     */
+    explicit BpmCache(const QString &fileName);
+    /** Flushes new entries. */
+    ~BpmCache();
+    /** Get the default path of the cache file, in the user's cache directory (`XDG_CACHE_HOME`). */
+    static QString defaultFileName();
+    /** Get the path of the cache file. */
+    QString fileName() const;
+    /**
+     * Set if the identity of files includes a hash of their first and last 64 KiB. This catches
+     * files rewritten without a change of size or modification time, at the cost of reading them.
+     * Entries stored without the hash do not match while this is enabled, and the reverse.
+     */
+    void setHashContent(bool enable);
+    /** If the identity of files includes a content hash. */
+    bool hashesContent() const;
+    /**
+     * Look up a file.
+     * @param fileName Path to the file.
+     * @param[out] entry Cached result if found.
+     * @return `true` if the file has an entry and has not changed since.
+     */
+    bool lookup(const QString &fileName, Entry *entry) const;
+    /**
+     * Store the result for a file, replacing its entry. Does nothing if the file cannot be read.
+     * @param fileName Path to the file.
+     * @param entry Result.
+     */
+    void insert(const QString &fileName, const Entry &entry);
+    /** Remove every entry. The cache file is rewritten on the next flush(). */
+    void clear();
+    /** Get the number of entries. */
+    qsizetype size() const;
+    /**
+     * Write new entries to the cache file.
+     * @return `true` on success or if there was nothing to write.
+     */
+    bool flush();
+
+private:
+    /** On-disk record. */
+    struct Record {
+        /** Identity of the file when the entry was inserted. */
+        FileIdentity identity;
+        double bpm;
+        double rawBpm;
+        qint64 length;
+        quint32 detectorVersion;
+        /** Bit 0: saved. */
+        quint32 flags;
+    };
+    /** Identity of a file without the parts that change when it is written. */
+    struct Key {
+        quint64 device;
+        quint64 inode;
+        bool operator==(const Key &other) const = default;
+    };
+    friend size_t qHash(const Key &key, size_t seed) noexcept {
+        return qHashMulti(seed, key.device, key.inode);
+    }
+
+    bool identify(const QString &fileName, Record *record) const;
+    void load();
+    bool rewrite();
+
+    QString fileName_;
+    QHash<Key, Record> records_;
+    QList<Record> pending_;
+    mutable QMutex mutex_;
+    /** Records in the file, including stale ones. */
+    qsizetype stored_ = 0;
+    bool hashContent_ = false;
+    bool needsRewrite_ = false;
+};
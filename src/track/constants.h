@@ -2,7 +2,24 @@
 /** @file */
 #pragma once
 
-/** Number of channels used for BPM detection. */
-#define DETECTION_CHANNELS 2
-/** Sample rate used for BPM detection (all files will be resampled to this rate). */
-#define DETECTION_SAMPLE_RATE 48000
+/**
+ * Default number of channels used for BPM detection. Tempo only needs the envelope, so stereo input
+ * is downmixed.
+ */
+constexpr int kDefaultDetectionChannels = 1;
+/**
+ * Default sample rate used for BPM detection (all files will be resampled to this rate). The
+ * resampler low-pass filters before decimating, and the detector only looks at the envelope below a
+ * few hundred hertz.
+ */
+constexpr int kDefaultDetectionSampleRate = 11025;
+/**
+ * Revision of the detection algorithms, part of Track::detectorVersion(). Bump it when a change to
+ * a detector, the decoder or resampling changes results, so cached results are detected again.
+ */
+constexpr int kDetectorRevision = 1;
+/**
+ * Revision of the onset envelope, part of Track::envelopeVersion(). Bump it when a change to the
+ * envelope, the decoder or resampling changes envelopes, so cached envelopes are decoded again.
+ */
+constexpr int kEnvelopeRevision = 1;
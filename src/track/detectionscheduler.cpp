@@ -0,0 +1,172 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <algorithm>
+#include <atomic>
+#include <utility>
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QDebug>
+#include <QtCore/QEventLoop>
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+#ifndef NO_GUI
+#include <QtMultimedia/QAudioDecoder>
+#endif
+
+#include "abstractbpmdetector.h"
+#include "debug.h"
+#include "detectionscheduler.h"
+#include "track.h"
+
+/** State of one call to start(), shared by its workers. */
+struct DetectionScheduler::Run {
+    QList<Job> jobs;
+    DetectorFactory factory;
+    QAtomicInt next = 0;
+    std::atomic_bool cancelled = false;
+    /** Guards `active`. Held by stop() while it stops the tracks so none is destroyed meanwhile. */
+    QMutex mutex;
+    /** Tracks being detected and the event loops running them. */
+    QList<std::pair<Track *, QEventLoop *>> active;
+    /** Workers that have not exited yet. Only used on the scheduler's thread. */
+    int workers = 0;
+};
+
+DetectionScheduler::DetectionScheduler(QObject *parent)
+    : QObject(parent), factory_([]() { return Track::createDetector(); }) {
+}
+
+DetectionScheduler::~DetectionScheduler() {
+    stop();
+    for (auto thread : threads_) {
+        thread->wait();
+        delete thread;
+    }
+}
+
+void DetectionScheduler::setDetectorFactory(const DetectorFactory &factory) {
+    factory_ = factory;
+}
+
+void DetectionScheduler::setMaximumThreads(int count) {
+    maximumThreads_ = count;
+}
+
+int DetectionScheduler::maximumThreads() const {
+    return maximumThreads_ > 0 ? maximumThreads_ : QThread::idealThreadCount();
+}
+
+bool DetectionScheduler::isRunning() const {
+    return run_ != nullptr;
+}
+
+void DetectionScheduler::start(const QList<Job> &jobs) {
+    if (run_ || jobs.isEmpty()) {
+        return;
+    }
+    auto run = std::make_shared<Run>();
+    run->jobs = jobs;
+    run->factory = factory_;
+    run->workers = std::min(maximumThreads(), static_cast<int>(jobs.size()));
+    run_ = run;
+    qCDebug(gLogBpmDetect) << "Detecting" << jobs.size() << "files with" << run->workers
+                           << "threads.";
+    for (auto i = 0; i < run->workers; ++i) {
+        auto thread = QThread::create([this, run]() { runWorker(run); });
+        thread->setObjectName(QStringLiteral("detection %1").arg(i + 1));
+        connect(thread, &QThread::finished, this, [this, thread, run]() {
+            workerExited(thread, run);
+        });
+        threads_ << thread;
+        thread->start();
+    }
+}
+
+void DetectionScheduler::stop() {
+    if (!run_) {
+        return;
+    }
+    const auto run = std::move(run_);
+    run->cancelled = true;
+    QMutexLocker locker(&run->mutex);
+    for (const auto &[track, loop] : std::as_const(run->active)) {
+        track->stop();
+        // The decoder may not report anything after being stopped, so end the loop explicitly.
+        QMetaObject::invokeMethod(loop, [loop]() { loop->quit(); }, Qt::QueuedConnection);
+    }
+}
+
+void DetectionScheduler::runWorker(const std::shared_ptr<Run> &run) {
+    std::unique_ptr<AbstractBpmDetector> detector(run->factory());
+    for (auto index = run->next.fetchAndAddRelaxed(1); index < run->jobs.size() && !run->cancelled;
+         index = run->next.fetchAndAddRelaxed(1)) {
+        const auto &job = run->jobs.at(index);
+        ProbeResult probe;
+        probe.hasAudio = true;
+        probe.length = job.length;
+        probe.bpm = job.savedBpm;
+        QAudioDecoder *decoder = nullptr;
+#ifndef NO_GUI
+        std::unique_ptr<QAudioDecoder> ownedDecoder;
+        if (Track::decoderBackend() == Track::QtMultimediaBackend) {
+            ownedDecoder = std::make_unique<QAudioDecoder>();
+            decoder = ownedDecoder.get();
+        }
+#endif
+        // Queued to the scheduler's thread, where the run may have been stopped in the meantime.
+        const auto post = [this, run](const std::function<void()> &emitter) {
+            QMetaObject::invokeMethod(
+                this,
+                [run, emitter]() {
+                    if (!run->cancelled) {
+                        emitter();
+                    }
+                },
+                Qt::QueuedConnection);
+        };
+        auto lastPercent = qint64(-1);
+        Track track(job.fileName, probe, decoder);
+        track.setDetector(detector.get());
+        QEventLoop loop;
+        connect(&track, &Track::hasBpm, [this, index, &post](bpmtype bpm) {
+            post([this, index, bpm]() { emit jobBpm(index, bpm); });
+        });
+        connect(&track,
+                &Track::progress,
+                [this, index, &post, &lastPercent](qint64 pos, qint64 length) {
+                    const auto percent = length > 0 ? pos * 100 / length : 0;
+                    if (percent != lastPercent) {
+                        lastPercent = percent;
+                        post([this, index, pos, length]() {
+                            emit jobProgress(index, pos, length);
+                        });
+                    }
+                });
+        connect(&track, &Track::finished, &loop, &QEventLoop::quit);
+        {
+            QMutexLocker locker(&run->mutex);
+            if (run->cancelled) {
+                break;
+            }
+            run->active.append({&track, &loop});
+        }
+        post([this, index]() { emit jobStarted(index); });
+        if (track.detectBpm() == Track::Detecting) {
+            loop.exec();
+        }
+        {
+            QMutexLocker locker(&run->mutex);
+            run->active.removeOne(std::pair<Track *, QEventLoop *>(&track, &loop));
+        }
+        post([this, index]() { emit jobFinished(index); });
+    }
+}
+
+void DetectionScheduler::workerExited(QThread *thread, const std::shared_ptr<Run> &run) {
+    threads_.removeOne(thread);
+    thread->deleteLater();
+    if (--run->workers == 0 && run_ == run) {
+        run_.reset();
+        qCDebug(gLogBpmDetect) << "All detection jobs finished.";
+        emit finished();
+    }
+}
@@ -0,0 +1,109 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/** @file */
+#pragma once
+
+#include <functional>
+#include <memory>
+
+#include <QtCore/QList>
+#include <QtCore/QObject>
+#include <QtCore/QString>
+
+#include "utils.h"
+
+class AbstractBpmDetector;
+class QThread;
+
+/**
+ * Runs BPM detection for a list of files on a pool of worker threads.
+ *
+ * Each worker creates its own detector and, for every file it picks up, its own Track (and
+ * `QAudioDecoder` with the Qt Multimedia backend) inside a private event loop, so decoding
+ * callbacks never run on the thread that owns the scheduler. Results and progress are queued back
+ * to that thread and identified by the index of the job in the list passed to start().
+ */
+class DetectionScheduler : public QObject {
+    Q_OBJECT
+public:
+    /** Creates a detector for a worker. Called on the worker thread. */
+    using DetectorFactory = std::function<AbstractBpmDetector *()>;
+    /** A file to detect. */
+    struct Job {
+        /** Path to the file. */
+        QString fileName;
+        /** Length in milliseconds if already known, so the file does not have to be probed. */
+        qint64 length = 0;
+        /** BPM saved in the tags of the file when it was added, or 0. */
+        bpmtype savedBpm = 0;
+    };
+    /**
+     * Constructor.
+     * @param parent Parent object.
+     */
+    explicit DetectionScheduler(QObject *parent = nullptr);
+    /** Stops detection and waits for the worker threads to exit. */
+    ~DetectionScheduler() override;
+    /**
+     * Set the function workers use to create their detector. The default uses
+     * Track::createDetector().
+     * @param factory Detector factory.
+     */
+    void setDetectorFactory(const DetectorFactory &factory);
+    /**
+     * Set the maximum number of files detected at the same time.
+     * @param count Number of worker threads. Values below 1 use `QThread::idealThreadCount()`.
+     */
+    void setMaximumThreads(int count);
+    /** Get the maximum number of files detected at the same time. */
+    int maximumThreads() const;
+    /** If a run has been started and has neither finished nor been stopped. */
+    bool isRunning() const;
+    /**
+     * Start detecting @a jobs. Does nothing if a run is in progress.
+     * @param jobs Files to detect.
+     */
+    void start(const QList<Job> &jobs);
+    /**
+     * Stop the current run. Returns immediately: pending jobs are dropped, running detections are
+     * told to stop and no further signals are emitted for the run. Worker threads exit in the
+     * background.
+     */
+    void stop();
+
+Q_SIGNALS:
+    /**
+     * Emitted when a worker starts on a job.
+     * @param index Index of the job.
+     */
+    void jobStarted(int index);
+    /**
+     * Emitted when the BPM of a job has been detected.
+     * @param index Index of the job.
+     * @param bpm Detected BPM, already folded into the range (see Track::correctBpm()).
+     */
+    void jobBpm(int index, bpmtype bpm);
+    /**
+     * Progress of a job. Only emitted when the percentage changes.
+     * @param index Index of the job.
+     * @param pos Position in milliseconds.
+     * @param length Total length in milliseconds.
+     */
+    void jobProgress(int index, qint64 pos, qint64 length);
+    /**
+     * Emitted when a job is done, whether or not a BPM was found.
+     * @param index Index of the job.
+     */
+    void jobFinished(int index);
+    /** Emitted when every job of the run is done. Not emitted after stop(). */
+    void finished();
+
+private:
+    struct Run;
+    void runWorker(const std::shared_ptr<Run> &run);
+    void workerExited(QThread *thread, const std::shared_ptr<Run> &run);
+
+    DetectorFactory factory_;
+    QList<QThread *> threads_;
+    std::shared_ptr<Run> run_;
+    int maximumThreads_ = 0;
+};
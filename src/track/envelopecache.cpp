@@ -0,0 +1,152 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <algorithm>
+#include <cmath>
+
+#include <QtCore/QDataStream>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QSaveFile>
+#include <QtCore/QStandardPaths>
+
+#include "constants.h"
+#include "debug.h"
+#include "envelopecache.h"
+#include "fileidentity.h"
+
+/** Start of each cache file. */
+static constexpr quint32 kMagic = 0x42504d45; // "BPME"
+/** Bump when the file layout changes. */
+static constexpr quint32 kFormatVersion = 1;
+static constexpr QDataStream::Version kStreamVersion = QDataStream::Qt_6_0;
+/** Largest quantized value. */
+static constexpr float kLevels = 255;
+
+EnvelopeCache::EnvelopeCache(const QString &directory) : directory_(directory) {
+}
+
+QString EnvelopeCache::defaultDirectory() {
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) +
+           QStringLiteral("/envelopes");
+}
+
+QString EnvelopeCache::directory() const {
+    return directory_;
+}
+
+void EnvelopeCache::setHashContent(bool enable) {
+    hashContent_ = enable;
+}
+
+bool EnvelopeCache::hashesContent() const {
+    return hashContent_;
+}
+
+QString EnvelopeCache::entryFileName(quint64 device, quint64 inode) const {
+    return QStringLiteral("%1/%2-%3.env")
+        .arg(directory_, QString::number(device, 16), QString::number(inode, 16));
+}
+
+bool EnvelopeCache::lookup(const QString &fileName, Entry *entry, bool withEnvelope) const {
+    FileIdentity identity;
+    if (!identifyFile(fileName, hashesContent(), &identity)) {
+        return false;
+    }
+    QFile file(entryFileName(identity.device, identity.inode));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QDataStream in(&file);
+    in.setVersion(kStreamVersion);
+    quint32 magic, format, version, count;
+    auto stored = identity;
+    qint32 revision;
+    double rate;
+    in >> magic >> format;
+    if (in.status() != QDataStream::Ok || magic != kMagic || format != kFormatVersion) {
+        return false;
+    }
+    in >> stored.size >> stored.mtime >> stored.hash >> version >> revision >> rate >> count;
+    if (in.status() != QDataStream::Ok || stored != identity) {
+        return false;
+    }
+    QList<AbstractBpmDetector::Candidate> candidates;
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        AbstractBpmDetector::Candidate candidate;
+        in >> candidate.bpm >> candidate.score;
+        candidates << candidate;
+    }
+    std::vector<float> envelope;
+    if (withEnvelope) {
+        float scale;
+        QByteArray compressed;
+        in >> scale >> compressed;
+        const auto levels = qUncompress(compressed);
+        if (in.status() != QDataStream::Ok || (levels.isEmpty() && !compressed.isEmpty())) {
+            qCWarning(gLogBpmDetect)
+                << "Discarding corrupt envelope cache entry" << file.fileName();
+            return false;
+        }
+        envelope.reserve(static_cast<size_t>(levels.size()));
+        for (const auto level : levels) {
+            const auto value = static_cast<float>(static_cast<quint8>(level)) / kLevels;
+            envelope.push_back(value * value * scale);
+        }
+    }
+    if (in.status() != QDataStream::Ok) {
+        return false;
+    }
+    entry->envelope = std::move(envelope);
+    entry->rate = rate;
+    // Candidates are scored by the detector, which may have changed since.
+    entry->candidates = revision == kDetectorRevision ? candidates : decltype(candidates)();
+    entry->version = version;
+    return true;
+}
+
+qint64 EnvelopeCache::insert(const QString &fileName, const Entry &entry) {
+    FileIdentity identity;
+    if (!identifyFile(fileName, hashesContent(), &identity)) {
+        return -1;
+    }
+    const auto maximum = entry.envelope.empty() ?
+                             0.0f :
+                             *std::max_element(entry.envelope.cbegin(), entry.envelope.cend());
+    QByteArray levels(static_cast<qsizetype>(entry.envelope.size()), Qt::Uninitialized);
+    for (size_t i = 0; i < entry.envelope.size(); ++i) {
+        const auto value = maximum > 0 ? std::max(0.0f, entry.envelope[i]) / maximum : 0.0f;
+        levels[static_cast<qsizetype>(i)] =
+            static_cast<char>(static_cast<quint8>(std::lround(std::sqrt(value) * kLevels)));
+    }
+    QDir().mkpath(directory_);
+    QSaveFile file(entryFileName(identity.device, identity.inode));
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(gLogBpmDetect) << "Cannot write envelope cache" << file.fileName()
+                                 << file.errorString();
+        return -1;
+    }
+    QDataStream out(&file);
+    out.setVersion(kStreamVersion);
+    out << kMagic << kFormatVersion << identity.size << identity.mtime << identity.hash
+        << entry.version << static_cast<qint32>(kDetectorRevision) << entry.rate
+        << static_cast<quint32>(entry.candidates.size());
+    for (const auto &candidate : entry.candidates) {
+        out << candidate.bpm << candidate.score;
+    }
+    out << maximum << qCompress(levels);
+    const auto size = file.pos();
+    if (!file.commit()) {
+        // LCOV_EXCL_START
+        qCWarning(gLogBpmDetect) << "Cannot write envelope cache" << file.fileName()
+                                 << file.errorString();
+        return -1;
+        // LCOV_EXCL_STOP
+    }
+    return size;
+}
+
+void EnvelopeCache::clear() {
+    QDir dir(directory_);
+    for (const auto &name : dir.entryList({QStringLiteral("*.env")}, QDir::Files)) {
+        dir.remove(name);
+    }
+}
@@ -0,0 +1,75 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/** @file */
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include <QtCore/QList>
+#include <QtCore/QString>
+
+#include "abstractbpmdetector.h"
+
+/**
+ * Persistent cache of onset envelopes, keyed by file identity (see identifyFile()).
+ *
+ * The envelope is what AutocorrelationBpmDetector reduces the audio to, so keeping it lets tempo
+ * candidates be computed again in microseconds when the BPM range or the scoring changes, instead
+ * of decoding the file again. Envelopes are stored quantized to 8 bits (square-root companded,
+ * which keeps weak onsets) and compressed, a few KiB per minute of audio. The best tempo candidates
+ * are stored with them.
+ *
+ * Each file has its own cache file, written atomically, so entries can be inserted from several
+ * threads. All methods are thread-safe.
+ */
+class EnvelopeCache {
+public:
+    /** Cached analysis of one file. */
+    struct Entry {
+        /** Onset envelope. */
+        std::vector<float> envelope;
+        /** Rate of @a envelope in Hz. */
+        double rate = 0;
+        /** Best tempos, best first. Empty if they were computed by another detector revision. */
+        QList<AbstractBpmDetector::Candidate> candidates;
+        /** Track::envelopeVersion() @a envelope was computed with. */
+        quint32 version = 0;
+    };
+    /**
+     * Constructor.
+     * @param directory Directory holding the cache files. Created on the first insert().
+     */
+    explicit EnvelopeCache(const QString &directory);
+    /** Get the default directory, in the user's cache directory (`XDG_CACHE_HOME`). */
+    static QString defaultDirectory();
+    /** Get the directory holding the cache files. */
+    QString directory() const;
+    /** Set if the identity of files includes a content hash. See BpmCache::setHashContent(). */
+    void setHashContent(bool enable);
+    /** If the identity of files includes a content hash. */
+    bool hashesContent() const;
+    /**
+     * Look up a file.
+     * @param fileName Path to the file.
+     * @param[out] entry Cached analysis if found.
+     * @param withEnvelope If the envelope is read. Without it only the candidates and version are.
+     * @return `true` if the file has an entry and has not changed since.
+     */
+    bool lookup(const QString &fileName, Entry *entry, bool withEnvelope = true) const;
+    /**
+     * Store the analysis of a file, replacing its entry.
+     * @param fileName Path to the file.
+     * @param entry Analysis.
+     * @return Size of the entry in bytes, or -1 if the file cannot be read or the entry cannot be
+     * written.
+     */
+    qint64 insert(const QString &fileName, const Entry &entry);
+    /** Remove every entry. */
+    void clear();
+
+private:
+    QString entryFileName(quint64 device, quint64 inode) const;
+
+    QString directory_;
+    std::atomic_bool hashContent_ = false;
+};
@@ -0,0 +1,261 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswresample/swresample.h>
+}
+#include <QtCore/QDebug>
+#include <QtCore/QObject>
+
+#include "debug.h"
+#include "ffmpegdecoder.h"
+#include "ffmpegutils.h"
+
+#if defined(SOUNDTOUCH_INTEGER_SAMPLES) && SOUNDTOUCH_INTEGER_SAMPLES
+static constexpr auto kOutputSampleFormat = AV_SAMPLE_FMT_S16;
+#else
+static constexpr auto kOutputSampleFormat = AV_SAMPLE_FMT_FLT;
+#endif
+
+FfmpegDecoder::FfmpegDecoder(const QString &fileName,
+                             std::shared_ptr<AVFormatContext> formatContext)
+    : formatCtx_(std::move(formatContext)), fileName_(fileName) {
+}
+
+FfmpegDecoder::~FfmpegDecoder() {
+    close();
+}
+
+void FfmpegDecoder::close() {
+    av_frame_free(&frame_);
+    avcodec_free_context(&codecCtx_);
+    swr_free(&swrCtx_);
+    formatCtx_.reset();
+    streamIndex_ = -1;
+}
+
+bool FfmpegDecoder::open(int channels, int sampleRate) {
+    channels_ = channels;
+    sampleRate_ = sampleRate;
+    framesOut_ = 0;
+    int ret;
+    if (!formatCtx_) {
+        AVFormatContext *ctx = nullptr;
+        ret = avformat_open_input(&ctx, fileName_.toUtf8().constData(), nullptr, nullptr);
+        if (ret < 0) {
+            errorString_ = av_errToQString(ret);
+            qCDebug(gLogBpmDetect) << "libavformat failed to open file:" << fileName_
+                                   << ". avformat_open_input() returned" << ret << errorString_;
+            return false;
+        }
+        formatCtx_.reset(ctx, [](AVFormatContext *c) { avformat_close_input(&c); });
+    } else {
+        qCDebug(gLogBpmDetect) << "Reusing probed format context for file:" << fileName_;
+    }
+    const AVCodec *codec = nullptr;
+    ret = av_find_best_stream(formatCtx_.get(), AVMEDIA_TYPE_AUDIO, -1, -1, &codec, 0);
+    if (ret < 0 || !codec) {
+        // The headers were not enough to identify the codec (or the context was never probed), so
+        // fall back to reading stream information.
+        if ((ret = avformat_find_stream_info(formatCtx_.get(), nullptr)) < 0) {
+            // LCOV_EXCL_START
+            errorString_ = av_errToQString(ret);
+            qCDebug(gLogBpmDetect)
+                << "libavformat failed to open file:" << fileName_
+                << ". avformat_find_stream_info() returned" << ret << errorString_;
+            close();
+            return false;
+            // LCOV_EXCL_STOP
+        }
+        ret = av_find_best_stream(formatCtx_.get(), AVMEDIA_TYPE_AUDIO, -1, -1, &codec, 0);
+    }
+    if (ret < 0 || !codec) {
+        errorString_ = av_errToQString(ret);
+        qCDebug(gLogBpmDetect) << "No decodable audio stream in file:" << fileName_
+                               << ". av_find_best_stream() returned" << ret << errorString_;
+        close();
+        return false;
+    }
+    streamIndex_ = ret;
+    const auto *stream = formatCtx_->streams[streamIndex_];
+    codecCtx_ = avcodec_alloc_context3(codec);
+    if (!codecCtx_) {
+        // LCOV_EXCL_START
+        errorString_ = QObject::tr("libavcodec failed to allocate a decoder context.");
+        close();
+        return false;
+        // LCOV_EXCL_STOP
+    }
+    if ((ret = avcodec_parameters_to_context(codecCtx_, stream->codecpar)) < 0 ||
+        (ret = avcodec_open2(codecCtx_, codec, nullptr)) < 0) {
+        // LCOV_EXCL_START
+        errorString_ = av_errToQString(ret);
+        qCDebug(gLogBpmDetect) << "libavcodec failed to open decoder for file:" << fileName_
+                               << ". Returned" << ret << errorString_;
+        close();
+        return false;
+        // LCOV_EXCL_STOP
+    }
+    codecCtx_->pkt_timebase = stream->time_base;
+    frame_ = av_frame_alloc();
+    errorString_.clear();
+    return true;
+}
+
+bool FfmpegDecoder::setupResampler(const AVFrame *frame) {
+    // The resampler is configured from the first decoded frame because the sample format, rate and
+    // layout are only known for sure once the decoder has produced output.
+    AVChannelLayout inLayout;
+    AVChannelLayout outLayout;
+    if (frame->ch_layout.order == AV_CHANNEL_ORDER_UNSPEC) {
+        av_channel_layout_default(&inLayout, frame->ch_layout.nb_channels);
+    } else {
+        av_channel_layout_copy(&inLayout, &frame->ch_layout);
+    }
+    av_channel_layout_default(&outLayout, channels_);
+    auto ret = swr_alloc_set_opts2(&swrCtx_,
+                                   &outLayout,
+                                   kOutputSampleFormat,
+                                   sampleRate_,
+                                   &inLayout,
+                                   static_cast<AVSampleFormat>(frame->format),
+                                   frame->sample_rate,
+                                   0,
+                                   nullptr);
+    av_channel_layout_uninit(&inLayout);
+    av_channel_layout_uninit(&outLayout);
+    if (ret < 0 || (ret = swr_init(swrCtx_)) < 0) {
+        // LCOV_EXCL_START
+        errorString_ = av_errToQString(ret);
+        qCDebug(gLogBpmDetect) << "libswresample failed to initialise for file:" << fileName_
+                               << ". Returned" << ret << errorString_;
+        swr_free(&swrCtx_);
+        return false;
+        // LCOV_EXCL_STOP
+    }
+    return true;
+}
+
+bool FfmpegDecoder::convert(const AVFrame *frame, const SampleSink &sink) {
+    if (!swrCtx_ && (!frame || !setupResampler(frame))) {
+        return true;
+    }
+    const auto inFrames = frame ? frame->nb_samples : 0;
+    const auto maxFrames = swr_get_out_samples(swrCtx_, inFrames);
+    if (maxFrames <= 0) {
+        return true;
+    }
+    buffer_.resize(static_cast<size_t>(maxFrames) * static_cast<size_t>(channels_));
+    auto *out = reinterpret_cast<quint8 *>(buffer_.data());
+    const auto converted = swr_convert(
+        swrCtx_,
+        &out,
+        maxFrames,
+        frame ? const_cast<const quint8 **>(frame->extended_data) : nullptr,
+        inFrames);
+    if (converted < 0) {
+        // LCOV_EXCL_START
+        qCDebug(gLogBpmDetect) << "swr_convert() returned" << converted
+                               << av_errToQString(converted);
+        return true;
+        // LCOV_EXCL_STOP
+    }
+    if (converted == 0) {
+        return true;
+    }
+    framesOut_ += converted;
+    return sink(buffer_.data(), converted, framesOut_ * 1000 / sampleRate_);
+}
+
+void FfmpegDecoder::receiveFrames(const SampleSink &sink, bool *stop) {
+    int ret;
+    while ((ret = avcodec_receive_frame(codecCtx_, frame_)) >= 0) {
+        const auto keepGoing = convert(frame_, sink);
+        av_frame_unref(frame_);
+        if (!keepGoing) {
+            *stop = true;
+            return;
+        }
+    }
+    if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+        // LCOV_EXCL_START
+        // Damaged frames are skipped, like players do.
+        qCDebug(gLogBpmDetect) << "avcodec_receive_frame() returned" << ret
+                               << av_errToQString(ret);
+        // LCOV_EXCL_STOP
+    }
+}
+
+bool FfmpegDecoder::decode(const SampleSink &sink) {
+    if (!formatCtx_ || !codecCtx_ || !frame_) {
+        errorString_ = QObject::tr("Decoder is not open.");
+        return false;
+    }
+    auto *packet = av_packet_alloc();
+    auto stop = false;
+    auto ret = 0;
+    while (!stop && (ret = av_read_frame(formatCtx_.get(), packet)) >= 0) {
+        if (packet->stream_index == streamIndex_) {
+            ret = avcodec_send_packet(codecCtx_, packet);
+            if (ret < 0 && ret != AVERROR(EAGAIN)) {
+                // LCOV_EXCL_START
+                qCDebug(gLogBpmDetect) << "avcodec_send_packet() returned" << ret
+                                       << av_errToQString(ret);
+                // LCOV_EXCL_STOP
+            } else {
+                receiveFrames(sink, &stop);
+            }
+        }
+        av_packet_unref(packet);
+    }
+    av_packet_free(&packet);
+    if (stop) {
+        return true;
+    }
+    if (ret != AVERROR_EOF) {
+        // LCOV_EXCL_START
+        qCDebug(gLogBpmDetect) << "av_read_frame() returned" << ret << av_errToQString(ret)
+                               << "Treating as end of stream.";
+        // LCOV_EXCL_STOP
+    }
+    // Drain the decoder, then the resampler.
+    avcodec_send_packet(codecCtx_, nullptr);
+    receiveFrames(sink, &stop);
+    if (!stop) {
+        convert(nullptr, sink);
+    }
+    return true;
+}
+
+bool FfmpegDecoder::seek(qint64 position) {
+    if (!formatCtx_ || !codecCtx_) {
+        errorString_ = QObject::tr("Decoder is not open.");
+        return false;
+    }
+    const auto *stream = formatCtx_->streams[streamIndex_];
+    const auto timestamp = av_rescale_q(position, {1, 1000}, stream->time_base) +
+                           (stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0);
+    const auto ret =
+        av_seek_frame(formatCtx_.get(), streamIndex_, timestamp, AVSEEK_FLAG_BACKWARD);
+    if (ret < 0) {
+        errorString_ = av_errToQString(ret);
+        qCDebug(gLogBpmDetect) << "av_seek_frame() returned" << ret << errorString_;
+        return false;
+    }
+    avcodec_flush_buffers(codecCtx_);
+    // Samples still buffered in the resampler belong to the old position.
+    swr_free(&swrCtx_);
+    framesOut_ = position * sampleRate_ / 1000;
+    return true;
+}
+
+qint64 FfmpegDecoder::duration() const {
+    if (!formatCtx_ || formatCtx_->duration == AV_NOPTS_VALUE) {
+        return 0;
+    }
+    return static_cast<qint64>(formatCtx_->duration / (AV_TIME_BASE / 1000));
+}
+
+QString FfmpegDecoder::errorString() const {
+    return errorString_;
+}
@@ -0,0 +1,92 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/** @file */
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <QtCore/QString>
+#include <STTypes.h>
+
+struct AVCodecContext;
+struct AVFormatContext;
+struct AVFrame;
+struct SwrContext;
+
+/**
+ * Audio decoder built directly on libavformat, libavcodec and libswresample.
+ *
+ * Unlike `QAudioDecoder`, decoding is driven by a pull loop in decode() which hands every converted
+ * buffer straight to a callback. No event loop or signal dispatch is involved, so the decoder can
+ * be used from any thread.
+ */
+class FfmpegDecoder {
+public:
+    /**
+     * Callback receiving decoded audio.
+     * @param samples Interleaved samples in the format requested in open().
+     * @param frames Number of frames (samples per channel) in @a samples.
+     * @param position Position of the end of the buffer in milliseconds.
+     * @return `false` to stop decoding.
+     */
+    using SampleSink =
+        std::function<bool(const soundtouch::SAMPLETYPE *samples, int frames, qint64 position)>;
+
+    /**
+     * Constructor.
+     * @param fileName Path to the audio file.
+     * @param formatContext Format context already opened by probeFile(). If set, open() uses it
+     * instead of opening the file again.
+     */
+    explicit FfmpegDecoder(const QString &fileName,
+                           std::shared_ptr<AVFormatContext> formatContext = {});
+    ~FfmpegDecoder();
+    FfmpegDecoder(const FfmpegDecoder &) = delete;
+    FfmpegDecoder &operator=(const FfmpegDecoder &) = delete;
+    /**
+     * Open the file (unless a format context was passed to the constructor) and set up the decoder.
+     * The resampler is set up from the first decoded frame. Call this only once.
+     * @param channels Number of output channels.
+     * @param sampleRate Output sample rate.
+     * @return `true` on success. On failure errorString() describes the problem.
+     */
+    bool open(int channels, int sampleRate);
+    /**
+     * Decode the audio stream from the current position, passing every buffer to @a sink. Decoding
+     * can be resumed after @a sink stopped it, or continued elsewhere after seek().
+     * @param sink Callback receiving the samples.
+     * @return `true` if the end of the stream was reached or @a sink asked to stop, `false` on
+     * error.
+     */
+    bool decode(const SampleSink &sink);
+    /**
+     * Seek to @a position. Decoding resumes from the key frame at or before it, so the first
+     * buffer may start slightly earlier. Positions passed to the sink continue from @a position.
+     * @param position Position in milliseconds.
+     * @return `true` on success.
+     */
+    bool seek(qint64 position);
+    /** Get the duration of the audio stream in milliseconds, or 0 if unknown. */
+    qint64 duration() const;
+    /** Get the last error message. */
+    QString errorString() const;
+
+private:
+    bool convert(const AVFrame *frame, const SampleSink &sink);
+    void receiveFrames(const SampleSink &sink, bool *stop);
+    bool setupResampler(const AVFrame *frame);
+    void close();
+
+    AVCodecContext *codecCtx_ = nullptr;
+    std::shared_ptr<AVFormatContext> formatCtx_;
+    SwrContext *swrCtx_ = nullptr;
+    AVFrame *frame_ = nullptr;
+    QString errorString_;
+    QString fileName_;
+    int channels_ = 0;
+    int sampleRate_ = 0;
+    int streamIndex_ = -1;
+    qint64 framesOut_ = 0;
+    std::vector<soundtouch::SAMPLETYPE> buffer_;
+};
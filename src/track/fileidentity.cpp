@@ -0,0 +1,61 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <algorithm>
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QtEndian>
+
+#include "fileidentity.h"
+
+/** Bytes hashed at each end of a file. */
+static constexpr qint64 kHashedSize = 64 * 1024;
+
+bool identifyFile(const QString &fileName, bool hashContent, FileIdentity *identity) {
+    *identity = {};
+#ifdef Q_OS_WIN
+    // LCOV_EXCL_START
+    const QFileInfo info(fileName);
+    if (!info.isFile()) {
+        return false;
+    }
+    // File IDs need an open handle; the path is the closest identity `stat()` offers.
+    identity->inode = qHash(info.absoluteFilePath(), 0);
+    identity->size = info.size();
+    identity->mtime = info.lastModified().toMSecsSinceEpoch() * 1000000;
+    // LCOV_EXCL_STOP
+#else
+    struct stat st;
+    if (stat(QFile::encodeName(fileName).constData(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    identity->device = static_cast<quint64>(st.st_dev);
+    identity->inode = static_cast<quint64>(st.st_ino);
+    identity->size = static_cast<qint64>(st.st_size);
+#ifdef Q_OS_DARWIN
+    const auto &mtime = st.st_mtimespec;
+#else
+    const auto &mtime = st.st_mtim;
+#endif
+    identity->mtime = static_cast<qint64>(mtime.tv_sec) * 1000000000 + mtime.tv_nsec;
+#endif
+    if (!hashContent) {
+        return true;
+    }
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(file.read(kHashedSize));
+    if (identity->size > kHashedSize) {
+        file.seek(std::max(kHashedSize, identity->size - kHashedSize));
+        hash.addData(file.read(kHashedSize));
+    }
+    // 0 means not hashed.
+    identity->hash = std::max<quint64>(1, qFromUnaligned<quint64>(hash.result().constData()));
+    return true;
+}
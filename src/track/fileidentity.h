@@ -0,0 +1,34 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/** @file */
+#pragma once
+
+#include <QtCore/QString>
+
+/**
+ * Identity of a file for caches: what changes when the file is replaced, written or moved to
+ * another file system, but not when it is renamed within one.
+ */
+struct FileIdentity {
+    /** Device, or 0 on Windows. */
+    quint64 device = 0;
+    /** Inode, or a hash of the absolute path on Windows. */
+    quint64 inode = 0;
+    /** Size in bytes. */
+    qint64 size = 0;
+    /** Modification time in nanoseconds since the epoch. */
+    qint64 mtime = 0;
+    /** Hash of the first and last 64 KiB, or 0 if not hashed. */
+    quint64 hash = 0;
+    bool operator==(const FileIdentity &other) const = default;
+};
+
+/**
+ * Get the identity of a regular file.
+ * @param fileName Path to the file.
+ * @param hashContent If the identity includes a hash of the first and last 64 KiB of the file,
+ * which catches files rewritten without a change of size or modification time at the cost of
+ * reading them.
+ * @param[out] identity Identity.
+ * @return `false` if the file does not exist, is not a regular file or cannot be read.
+ */
+bool identifyFile(const QString &fileName, bool hashContent, FileIdentity *identity);
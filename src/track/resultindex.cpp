@@ -0,0 +1,150 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+
+#include "debug.h"
+#include "resultindex.h"
+
+/** New entries are written once this many are pending. */
+static constexpr qsizetype kFlushBatch = 1024;
+
+static QString absolutePath(const QString &fileName) {
+    return QFileInfo(fileName).absoluteFilePath();
+}
+
+ResultIndex::ResultIndex(const QString &fileName) : fileName_(fileName) {
+    load();
+}
+
+ResultIndex::~ResultIndex() {
+    flush();
+}
+
+QString ResultIndex::fileName() const {
+    return fileName_;
+}
+
+bool ResultIndex::lookup(const QString &fileName, Entry *entry) const {
+    FileIdentity identity;
+    if (!identifyFile(fileName, false, &identity)) {
+        return false;
+    }
+    QMutexLocker locker(&mutex_);
+    const auto it = records_.constFind(absolutePath(fileName));
+    if (it == records_.cend() || it->identity != identity) {
+        return false;
+    }
+    *entry = it->entry;
+    return true;
+}
+
+void ResultIndex::insert(const QString &fileName, const Entry &entry) {
+    Record record;
+    if (!identifyFile(fileName, false, &record.identity)) {
+        return;
+    }
+    record.entry = entry;
+    const auto path = absolutePath(fileName);
+    // 64-bit values are strings because JSON numbers are read as doubles.
+    const QJsonObject object{
+        {QStringLiteral("path"), path},
+        {QStringLiteral("device"), QString::number(record.identity.device)},
+        {QStringLiteral("inode"), QString::number(record.identity.inode)},
+        {QStringLiteral("size"), QString::number(record.identity.size)},
+        {QStringLiteral("mtime"), QString::number(record.identity.mtime)},
+        {QStringLiteral("bpm"), entry.bpm},
+        {QStringLiteral("rawBpm"), entry.rawBpm},
+        {QStringLiteral("length"), entry.length},
+        {QStringLiteral("detector"), entry.detector},
+        {QStringLiteral("detectorVersion"), static_cast<qint64>(entry.detectorVersion)},
+    };
+    QMutexLocker locker(&mutex_);
+    records_.insert(path, record);
+    pending_ += QJsonDocument(object).toJson(QJsonDocument::Compact);
+    pending_ += '\n';
+    if (++pendingCount_ >= kFlushBatch) {
+        flushLocked();
+    }
+}
+
+qsizetype ResultIndex::size() const {
+    QMutexLocker locker(&mutex_);
+    return records_.size();
+}
+
+bool ResultIndex::flush() {
+    QMutexLocker locker(&mutex_);
+    return flushLocked();
+}
+
+bool ResultIndex::flushLocked() {
+    if (pending_.isEmpty()) {
+        return true;
+    }
+    QDir().mkpath(QFileInfo(fileName_).absolutePath());
+    QFile file(fileName_);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qCWarning(gLogBpmDetect) << "Cannot write result index" << fileName_
+                                 << file.errorString();
+        return false;
+    }
+    if (needsNewline_) {
+        pending_.prepend('\n');
+    }
+    if (file.write(pending_) != pending_.size() || !file.flush()) {
+        // LCOV_EXCL_START
+        qCWarning(gLogBpmDetect) << "Cannot write result index" << fileName_
+                                 << file.errorString();
+        // Whatever was written may end in a partial line. The lines are kept for the next flush;
+        // those that did get written are then repeated, which does not change the index.
+        needsNewline_ = true;
+        return false;
+        // LCOV_EXCL_STOP
+    }
+    needsNewline_ = false;
+    pending_.clear();
+    pendingCount_ = 0;
+    return true;
+}
+
+void ResultIndex::load() {
+    QFile file(fileName_);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    const auto data = file.readAll();
+    needsNewline_ = !data.isEmpty() && !data.endsWith('\n');
+    qsizetype skipped = 0;
+    for (const auto &line : data.split('\n')) {
+        if (line.trimmed().isEmpty()) {
+            continue;
+        }
+        const auto object = QJsonDocument::fromJson(line).object();
+        const auto path = object.value(QStringLiteral("path")).toString();
+        if (path.isEmpty()) {
+            ++skipped;
+            continue;
+        }
+        Record record;
+        record.identity.device = object.value(QStringLiteral("device")).toString().toULongLong();
+        record.identity.inode = object.value(QStringLiteral("inode")).toString().toULongLong();
+        record.identity.size = object.value(QStringLiteral("size")).toString().toLongLong();
+        record.identity.mtime = object.value(QStringLiteral("mtime")).toString().toLongLong();
+        record.entry.bpm = object.value(QStringLiteral("bpm")).toDouble();
+        record.entry.rawBpm = object.value(QStringLiteral("rawBpm")).toDouble();
+        record.entry.length = object.value(QStringLiteral("length")).toInteger();
+        record.entry.detector = object.value(QStringLiteral("detector")).toString();
+        record.entry.detectorVersion =
+            static_cast<quint32>(object.value(QStringLiteral("detectorVersion")).toInteger());
+        // Later lines replace earlier ones.
+        records_.insert(path, record);
+    }
+    if (skipped > 0) {
+        qCInfo(gLogBpmDetect) << "Skipped" << skipped << "unreadable lines of result index"
+                              << fileName_;
+    }
+    qCDebug(gLogBpmDetect) << "Loaded" << records_.size() << "indexed results from" << fileName_;
+}
@@ -0,0 +1,92 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/** @file */
+#pragma once
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+
+#include "fileidentity.h"
+#include "utils.h"
+
+/**
+ * Index of BPM results kept next to a library instead of in the tags of its files, for archives
+ * that are read-only or must not change.
+ *
+ * The index is a JSON Lines file: one object per result with the absolute path of the file, its
+ * identity (device, inode, size and modification time, see identifyFile()), BPM, raw BPM, length
+ * and the detector that found it. The file is only ever appended to. Results are written in
+ * batches, each with a single write, and a later line for a path replaces the earlier ones. A line
+ * cut short by an interrupted run is skipped on load.
+ *
+ * Unlike BpmCache, the index is meant to be read by other tools and moved with the library, so it
+ * is keyed by path and text-based. A file that changed since its result was indexed does not
+ * match.
+ *
+ * All methods are thread-safe.
+ */
+class ResultIndex {
+public:
+    /** Indexed result for one file. */
+    struct Entry {
+        /** BPM: the tag of the file, or the folded result of detection. */
+        bpmtype bpm = 0;
+        /** Result of detection before folding into the BPM range, or 0 if not detected. */
+        bpmtype rawBpm = 0;
+        /** Length in milliseconds. */
+        qint64 length = 0;
+        /** Name of the detector (as given to `--detector`), or empty if not detected. */
+        QString detector;
+        /** Track::detectorVersion() @a rawBpm was detected with, or 0 if not detected. */
+        quint32 detectorVersion = 0;
+    };
+    /**
+     * Constructor. Loads the index file if it exists.
+     * @param fileName Path to the index file. Its directory is created on the first flush().
+     */
+    explicit ResultIndex(const QString &fileName);
+    /** Flushes new entries. */
+    ~ResultIndex();
+    /** Get the path of the index file. */
+    QString fileName() const;
+    /**
+     * Look up a file.
+     * @param fileName Path to the file.
+     * @param[out] entry Indexed result if found.
+     * @return `true` if the file has an entry and has not changed since.
+     */
+    bool lookup(const QString &fileName, Entry *entry) const;
+    /**
+     * Add the result for a file. Does nothing if the file cannot be read.
+     * @param fileName Path to the file.
+     * @param entry Result.
+     */
+    void insert(const QString &fileName, const Entry &entry);
+    /** Get the number of files with an entry. */
+    qsizetype size() const;
+    /**
+     * Append new entries to the index file.
+     * @return `true` on success or if there was nothing to write.
+     */
+    bool flush();
+
+private:
+    struct Record {
+        FileIdentity identity;
+        Entry entry;
+    };
+
+    bool flushLocked();
+    void load();
+
+    QString fileName_;
+    /** Records by absolute path. */
+    QHash<QString, Record> records_;
+    /** Lines not yet written. */
+    QByteArray pending_;
+    qsizetype pendingCount_ = 0;
+    mutable QMutex mutex_;
+    /** If the file ends in a partial line, which the next write has to end first. */
+    bool needsNewline_ = false;
+};
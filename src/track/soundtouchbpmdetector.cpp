@@ -2,7 +2,6 @@
 #include <BPMDetect.h>
 #include <QtCore/QDebug>
 
-#include "constants.h"
 #include "debug.h"
 #include "soundtouchbpmdetector.h"
 
@@ -18,7 +17,7 @@ void SoundTouchBpmDetector::inputSamples(const soundtouch::SAMPLETYPE *samples,
     if (!stDetector_) {
         // LCOV_EXCL_START
         qCWarning(gLogBpmDetect) << "Re-initialising SoundTouch BPM detector in inputSamples().";
-        stDetector_ = new soundtouch::BPMDetect(DETECTION_CHANNELS, DETECTION_SAMPLE_RATE);
+        stDetector_ = new soundtouch::BPMDetect(channels(), sampleRate());
         // LCOV_EXCL_STOP
     }
     stDetector_->inputSamples(samples, numSamples);
@@ -39,5 +38,5 @@ void SoundTouchBpmDetector::reset() {
         delete stDetector_;
         stDetector_ = nullptr;
     }
-    stDetector_ = new soundtouch::BPMDetect(DETECTION_CHANNELS, DETECTION_SAMPLE_RATE);
+    stDetector_ = new soundtouch::BPMDetect(channels(), sampleRate());
 }
@@ -0,0 +1,161 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <algorithm>
+
+#include <QtCore/QFileInfo>
+#include <QtCore/QThread>
+
+#include "debug.h"
+#include "tagwriter.h"
+#include "track.h"
+
+/** Default for setCapacity(). */
+static constexpr int kDefaultCapacity = 64;
+
+TagWriter::TagWriter(QObject *parent) : QObject(parent), capacity_(kDefaultCapacity) {
+}
+
+TagWriter::~TagWriter() {
+    flush();
+    {
+        QMutexLocker locker(&mutex_);
+        stopping_ = true;
+        queued_.wakeAll();
+    }
+    for (auto thread : std::as_const(threads_)) {
+        thread->wait();
+        delete thread;
+    }
+}
+
+void TagWriter::setMaximumThreads(int count) {
+    QMutexLocker locker(&mutex_);
+    maximumThreads_ = std::max(1, count);
+}
+
+void TagWriter::setCapacity(int capacity) {
+    QMutexLocker locker(&mutex_);
+    capacity_ = std::max(0, capacity);
+    // A larger queue may take writes that were waiting.
+    done_.wakeAll();
+}
+
+void TagWriter::start() {
+    for (auto i = 0; i < maximumThreads_; ++i) {
+        auto thread = QThread::create([this]() { runWorker(); });
+        thread->setObjectName(QStringLiteral("tag writer %1").arg(i + 1));
+        threads_ << thread;
+        thread->start();
+    }
+}
+
+void TagWriter::enqueue(const Job &job) {
+    const auto directory = QFileInfo(job.fileName).absolutePath();
+    QMutexLocker locker(&mutex_);
+    if (threads_.isEmpty()) {
+        start();
+    }
+    while (capacity_ > 0 && queuedCount_ >= capacity_) {
+        done_.wait(&mutex_);
+    }
+    auto &jobs = pending_[directory];
+    if (jobs.isEmpty() && !writing_.contains(directory)) {
+        ready_.enqueue(directory);
+    }
+    jobs.append(job);
+    ++queuedCount_;
+    ++outstanding_;
+    queued_.wakeOne();
+}
+
+void TagWriter::flush() {
+    QMutexLocker locker(&mutex_);
+    while (outstanding_ > 0) {
+        done_.wait(&mutex_);
+    }
+}
+
+bool TagWriter::isBusy() const {
+    QMutexLocker locker(&mutex_);
+    return outstanding_ > 0;
+}
+
+TagWriter::Summary TagWriter::summary() const {
+    QMutexLocker locker(&mutex_);
+    return summary_;
+}
+
+void TagWriter::resetSummary() {
+    QMutexLocker locker(&mutex_);
+    summary_ = {};
+    writtenDirectories_.clear();
+}
+
+void TagWriter::runWorker() {
+    QMutexLocker locker(&mutex_);
+    while (true) {
+        while (!stopping_ && ready_.isEmpty()) {
+            queued_.wait(&mutex_);
+        }
+        if (ready_.isEmpty()) {
+            return;
+        }
+        const auto directory = ready_.dequeue();
+        const auto jobs = pending_.take(directory);
+        writing_.insert(directory);
+        queuedCount_ -= jobs.size();
+        // A directory is usually drained in several batches while results keep arriving.
+        writtenDirectories_.insert(directory);
+        summary_.directories = writtenDirectories_.size();
+        done_.wakeAll();
+        locker.unlock();
+
+        qCDebug(gLogBpmDetect) << "Writing" << jobs.size() << "tags in" << directory;
+        Summary counts;
+        for (const auto &job : jobs) {
+            const auto result = Track::writeBpm(job.fileName, job.bpm);
+            if (result.ok) {
+                ++counts.written;
+                counts.inPlace += result.inPlace ? 1 : 0;
+            } else {
+                ++counts.failed;
+                qCWarning(gLogBpmDetect)
+                    << "Cannot write BPM tag of" << job.fileName << result.error;
+            }
+            const auto cache = Track::cache();
+            if (job.cacheEntry && cache) {
+                // Writing changes the modification time, so the entry is stored again.
+                auto entry = *job.cacheEntry;
+                if (job.bpm.isEmpty()) {
+                    entry.saved = !result.ok;
+                } else {
+                    entry.bpm = result.ok ? job.bpm.toDouble() : entry.bpm;
+                    entry.saved = result.ok;
+                }
+                cache->insert(job.fileName, entry);
+            }
+            QMetaObject::invokeMethod(
+                this,
+                [this, fileName = job.fileName, bpm = job.bpm, result]() {
+                    emit written(fileName, bpm, result);
+                },
+                Qt::QueuedConnection);
+        }
+
+        locker.relock();
+        writing_.remove(directory);
+        // Writes queued for the directory while it was being written to.
+        if (pending_.contains(directory)) {
+            ready_.enqueue(directory);
+            queued_.wakeOne();
+        }
+        summary_.written += counts.written;
+        summary_.inPlace += counts.inPlace;
+        summary_.failed += counts.failed;
+        outstanding_ -= jobs.size();
+        if (outstanding_ == 0) {
+            QMetaObject::invokeMethod(
+                this, [this]() { emit drained(); }, Qt::QueuedConnection);
+        }
+        done_.wakeAll();
+    }
+}
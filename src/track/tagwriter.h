@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/** @file */
+#pragma once
+
+#include <optional>
+
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QObject>
+#include <QtCore/QQueue>
+#include <QtCore/QSet>
+#include <QtCore/QString>
+#include <QtCore/QWaitCondition>
+
+#include "bpmcache.h"
+#include "ffmpegutils.h"
+
+class QThread;
+
+/**
+ * Writes BPM tags on worker threads, so detection of the next track overlaps with saving the last
+ * result.
+ *
+ * Writes are queued per directory. A worker takes every write queued for one directory and does
+ * them in a row, which keeps the directory's metadata hot and, with several workers, keeps them
+ * from contending for the same directory. Writes to the same file are done in the order they were
+ * queued. By default the queue is bounded: enqueue() blocks while it is full, so a slow disk holds
+ * detection back instead of letting results pile up. A writer fed from a GUI thread should be made
+ * unbounded with setCapacity() instead.
+ *
+ * Results are reported on the thread that owns the writer. enqueue() and flush() may be called from
+ * any thread.
+ */
+class TagWriter : public QObject {
+    Q_OBJECT
+public:
+    /** A tag to write. */
+    struct Job {
+        /** Path to the file. */
+        QString fileName;
+        /** Formatted BPM to save, or an empty string to remove the tag. */
+        QString bpm;
+        /**
+         * Entry stored in Track::cache() after the write, with `bpm` and `saved` set from the
+         * result. Nothing is stored if not set.
+         */
+        std::optional<BpmCache::Entry> cacheEntry;
+    };
+    /** Counts of the writes done since the last resetSummary(). */
+    struct Summary {
+        /** Tags written or removed. */
+        qint64 written = 0;
+        /** Of @a written, tags edited in place rather than by remuxing the file. */
+        qint64 inPlace = 0;
+        /** Writes that failed. */
+        qint64 failed = 0;
+        /** Distinct directories written to. */
+        qint64 directories = 0;
+    };
+    /**
+     * Constructor.
+     * @param parent Parent object.
+     */
+    explicit TagWriter(QObject *parent = nullptr);
+    /** Finishes the queued writes and waits for the worker threads to exit. */
+    ~TagWriter() override;
+    /**
+     * Set the number of worker threads. Only takes effect before the first enqueue().
+     * @param count Number of threads. Values below 1 use 1.
+     */
+    void setMaximumThreads(int count);
+    /**
+     * Set how many writes may be queued before enqueue() blocks.
+     * @param capacity Number of writes. Values below 1 make the queue unbounded, so enqueue()
+     * never blocks.
+     */
+    void setCapacity(int capacity);
+    /**
+     * Queue a write. Blocks while the queue is full (see setCapacity()).
+     * @param job Write.
+     */
+    void enqueue(const Job &job);
+    /** Block until every queued write is done. */
+    void flush();
+    /** If writes are queued or being done. */
+    bool isBusy() const;
+    /** Get the counts of the writes done since the last resetSummary(). */
+    Summary summary() const;
+    /** Reset the counts of summary(). */
+    void resetSummary();
+
+Q_SIGNALS:
+    /**
+     * Emitted after each write.
+     * @param fileName Path to the file.
+     * @param bpm Formatted BPM saved, or an empty string if the tag was removed.
+     * @param result Result of the write.
+     */
+    void written(const QString &fileName, const QString &bpm, const TagWriteResult &result);
+    /** Emitted when the last queued write is done. */
+    void drained();
+
+private:
+    void runWorker();
+    void start();
+
+    QList<QThread *> threads_;
+    mutable QMutex mutex_;
+    /** Woken when writes are queued or the writer is destroyed. */
+    QWaitCondition queued_;
+    /** Woken when writes are done. */
+    QWaitCondition done_;
+    /** Writes not yet taken by a worker, by directory. */
+    QHash<QString, QList<Job>> pending_;
+    /** Directories with pending writes that no worker is writing to, oldest first. */
+    QQueue<QString> ready_;
+    /** Directories a worker is writing to. */
+    QSet<QString> writing_;
+    Summary summary_;
+    /** Directories counted in summary_. */
+    QSet<QString> writtenDirectories_;
+    /** Writes queued or being done. */
+    qsizetype outstanding_ = 0;
+    /** Writes queued and not yet taken by a worker. */
+    qsizetype queuedCount_ = 0;
+    /** Maximum of queuedCount_, or 0 if unbounded. */
+    int capacity_;
+    int maximumThreads_ = 1;
+    bool stopping_ = false;
+};
@@ -1,4 +1,5 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
+#include <algorithm>
 #include <iostream>
 #ifdef DESKTOP_PORTAL
 #include <sys/xattr.h>
@@ -11,16 +12,46 @@ extern "C" {
 #include <QtCore/QDebug>
 #include <QtCore/QDir>
 #include <QtCore/QUrl>
+#ifndef NO_GUI
 #include <QtMultimedia/QAudioDecoder>
+#endif
 
+#include "autocorrelationbpmdetector.h"
+#include "bpmcache.h"
 #include "constants.h"
 #include "debug.h"
+#include "envelopecache.h"
+#include "ffmpegdecoder.h"
 #include "ffmpegutils.h"
+#include "profiler.h"
+#include "resultindex.h"
 #include "soundtouchbpmdetector.h"
+#include "tagwriter.h"
+#include "tracer.h"
 #include "track.h"
+#include "xattrtags.h"
+
+/** Number of detector candidates kept per track. */
+static constexpr int kCandidateCount = 5;
+/** Folded candidates closer than this fraction of their tempo are the same tempo. */
+static constexpr double kCandidateMergeTolerance = 0.01;
 
+BpmCache *Track::_cache = nullptr;
+EnvelopeCache *Track::_envelopeCache = nullptr;
+ResultIndex *Track::_index = nullptr;
+QString Track::_bpmAttribute;
 bpmtype Track::_dMinBpm = 80.;
 bpmtype Track::_dMaxBpm = 185.;
+#ifndef NO_GUI
+Track::DecoderBackend Track::_decoderBackend = Track::QtMultimediaBackend;
+#else
+Track::DecoderBackend Track::_decoderBackend = Track::FfmpegBackend;
+#endif
+Track::DetectorType Track::_detectorType = Track::SoundTouchDetector;
+Track::Convergence Track::_convergence;
+Track::Sampling Track::_sampling;
+int Track::_detectionChannels = kDefaultDetectionChannels;
+int Track::_detectionSampleRate = kDefaultDetectionSampleRate;
 
 Track::Track(const QString &fileName, QAudioDecoder *decoder, QObject *parent)
     : QObject(parent), decoder_(decoder), fileName_(fileName) {
@@ -29,6 +60,17 @@ Track::Track(const QString &fileName, QAudioDecoder *decoder, QObject *parent)
     setupDecoder();
 }
 
+Track::Track(const QString &fileName,
+             const ProbeResult &probe,
+             QAudioDecoder *decoder,
+             QObject *parent)
+    : QObject(parent), decoder_(decoder), fileName_(fileName) {
+    isValidFile_ = !fileName_.isEmpty();
+    applyProbe(probe);
+    formatContext_ = probe.formatContext;
+    setupDecoder();
+}
+
 Track::Track(const QString &fileName, QObject *parent) : QObject(parent), fileName_(fileName) {
     readTags();
 }
@@ -42,26 +84,24 @@ Track::~Track() {
 }
 
 void Track::setupDecoder() {
+#ifndef NO_GUI
     // LCOV_EXCL_START
     if (!decoder_) {
         return;
     }
     // LCOV_EXCL_STOP
-    QAudioFormat format;
-#if defined(SOUNDTOUCH_INTEGER_SAMPLES) && SOUNDTOUCH_INTEGER_SAMPLES
-    format.setSampleFormat(QAudioFormat::Int16);
-#else
-    format.setSampleFormat(QAudioFormat::Float);
-#endif
-    format.setChannelCount(DETECTION_CHANNELS);
-    format.setSampleRate(DETECTION_SAMPLE_RATE);
-    decoder_->setAudioFormat(format);
-
     connect(decoder_, &QAudioDecoder::bufferReady, [this]() {
         QAudioBuffer buffer;
-        if ((buffer = decoder_->read()).isValid()) {
-            detector_->inputSamples(buffer.constData<soundtouch::SAMPLETYPE>(),
-                                    static_cast<int>(buffer.frameCount()));
+        if (converged_ || !(buffer = decoder_->read()).isValid()) {
+            return;
+        }
+        const auto position = (buffer.startTime() + buffer.duration()) / 1000;
+        if (!inputSamples(buffer.constData<soundtouch::SAMPLETYPE>(),
+                          static_cast<int>(buffer.frameCount()),
+                          position)) {
+            decoder_->stop();
+            decoder_->setSource(QUrl()); // Release the file handle (only an issue on Windows).
+            finishDetection();
         }
     });
     connect(decoder_, &QAudioDecoder::positionChanged, [this](qint64 pos) {
@@ -70,24 +110,13 @@ void Track::setupDecoder() {
         }
     });
     connect(decoder_, &QAudioDecoder::finished, [this]() {
-        decoder_->setSource(QUrl()); // Release the file handle (only an issue on Windows).
-        if (stopped_) {
+        if (converged_) {
             // LCOV_EXCL_START
-            qCDebug(gLogBpmDetect) << "Detection stopped.";
-            emit finished();
             return;
             // LCOV_EXCL_STOP
         }
-        auto bpm = correctBpm(detector_->getBpm());
-        setBpm(bpm);
-        if (!hasValidBpm()) {
-            // LCOV_EXCL_START
-            qCInfo(gLogBpmDetect) << "Invalid BPM detected:" << bpm;
-            // LCOV_EXCL_STOP
-        } else {
-            emit hasBpm(bpm);
-        }
-        emit finished();
+        decoder_->setSource(QUrl()); // Release the file handle (only an issue on Windows).
+        finishDetection();
     });
     // LCOV_EXCL_START
     connect(decoder_, QOverload<QAudioDecoder::Error>::of(&QAudioDecoder::error), [this]() {
@@ -97,6 +126,225 @@ void Track::setupDecoder() {
         emit finished();
     });
     // LCOV_EXCL_STOP
+#endif
+}
+
+void Track::decodeWithFfmpeg() {
+    // A probed format context can only be decoded once; later detections reopen the file.
+    decodeStart_ = Tracer::now();
+    FfmpegDecoder decoder(fileName_, std::move(formatContext_));
+    if (!decoder.open(detector_->channels(), detector_->sampleRate())) {
+        traceDecode();
+        qCCritical(gLogBpmDetect) << "Audio decoder error:" << decoder.errorString();
+        stopped_ = true;
+        emit finished();
+        return;
+    }
+    const auto length = length_ ? length_ : decoder.duration();
+    const auto windows = samplingWindows(length);
+    if (!windows.isEmpty()) {
+        decodeWindows(decoder, windows);
+        return;
+    }
+    auto lastPercent = qint64(-1);
+    decoder.decode([this, length, &lastPercent](
+                       const soundtouch::SAMPLETYPE *samples, int frames, qint64 position) {
+        if (stopped_ || !inputSamples(samples, frames, position)) {
+            return false;
+        }
+        // Progress is only reported when the percentage changes to keep signal traffic low.
+        const auto percent = length > 0 ? position * 100 / length : 0;
+        if (percent != lastPercent) {
+            lastPercent = percent;
+            emit progress(position, length);
+        }
+        return true;
+    });
+    finishDetection();
+}
+
+bool Track::inputSamples(const soundtouch::SAMPLETYPE *samples, int frames, qint64 position) {
+    auto start = detectionTimer_.nsecsElapsed();
+    detector_->inputSamples(samples, frames);
+    detectorTime_ += detectionTimer_.nsecsElapsed() - start;
+    Profiler::addDecodedFrames(frames);
+    decoded_ = position;
+    if (!_convergence.enabled || position < nextCheck_) {
+        return true;
+    }
+    nextCheck_ = position + _convergence.interval;
+    start = detectionTimer_.nsecsElapsed();
+    const auto estimate = correctBpm(detector_->getBpm());
+    detectorTime_ += detectionTimer_.nsecsElapsed() - start;
+    if (estimate > 0 && qAbs(estimate - lastEstimate_) <= _convergence.tolerance) {
+        if (position - stableSince_ >= _convergence.window) {
+            qCDebug(gLogBpmDetect) << "BPM converged to" << estimate << "after" << position
+                                   << "ms of audio.";
+            converged_ = true;
+            return false;
+        }
+    } else {
+        lastEstimate_ = estimate;
+        stableSince_ = position;
+    }
+    return true;
+}
+
+void Track::decodeWindows(FfmpegDecoder &decoder, const QList<qint64> &windows) {
+    const auto windowLength = _sampling.windowLength;
+    const auto total = windowLength * windows.size();
+    // Unfolded estimates, so that rawBpm_ stays what the detector found.
+    QList<bpmtype> estimates;
+    for (const auto start : windows) {
+        if (stopped_) {
+            break;
+        }
+        if (!decoder.seek(start)) {
+            // LCOV_EXCL_START
+            qCWarning(gLogBpmDetect) << "Cannot seek in" << fileName_ << ":"
+                                     << decoder.errorString();
+            continue;
+            // LCOV_EXCL_STOP
+        }
+        detector_->reset();
+        const auto end = start + windowLength;
+        const auto done = decoded_;
+        decoder.decode([this, start, end, done, total](
+                           const soundtouch::SAMPLETYPE *samples, int frames, qint64 position) {
+            if (stopped_) {
+                return false;
+            }
+            const auto inputStart = detectionTimer_.nsecsElapsed();
+            detector_->inputSamples(samples, frames);
+            detectorTime_ += detectionTimer_.nsecsElapsed() - inputStart;
+            Profiler::addDecodedFrames(frames);
+            decoded_ = done + qMin(position, end) - start;
+            emit progress(decoded_, total);
+            return position < end;
+        });
+        const auto bpmStart = detectionTimer_.nsecsElapsed();
+        const auto traceStart = Tracer::now();
+        const auto estimate = detector_->getBpm();
+        Tracer::complete("detect", fileName_, traceStart, {{QStringLiteral("windowMs"), start}});
+        detectorTime_ += detectionTimer_.nsecsElapsed() - bpmStart;
+        qCDebug(gLogBpmDetect) << "Window at" << start << "ms:" << estimate << "BPM";
+        if (correctBpm(estimate) > 0) {
+            estimates << estimate;
+        }
+    }
+    traceDecode();
+    if (stopped_) {
+        finishDetection();
+        return;
+    }
+    // The median ignores a window that landed on a break or a tempo change. Windows are ordered by
+    // their folded tempo so that one detected at double or half tempo does not skew it, while the
+    // median keeps the octave the detector reported.
+    std::sort(estimates.begin(), estimates.end(), [](bpmtype a, bpmtype b) {
+        return correctBpm(a) < correctBpm(b);
+    });
+    const auto count = estimates.size();
+    if (count == 0) {
+        rawBpm_ = 0;
+    } else if (count % 2 == 1) {
+        rawBpm_ = estimates.at(count / 2);
+    } else {
+        const auto lower = estimates.at(count / 2 - 1);
+        rawBpm_ = lower / correctBpm(lower) *
+                  (correctBpm(lower) + correctBpm(estimates.at(count / 2))) / 2;
+    }
+    candidates_.clear();
+    if (rawBpm_ > 0) {
+        candidates_.append({rawBpm_, 1});
+    }
+    detectorVersion_ = detectorVersion();
+    reportBpm(correctBpm(rawBpm_), true);
+}
+
+void Track::finishDetection() {
+    traceDecode();
+    if (stopped_) {
+        // LCOV_EXCL_START
+        qCDebug(gLogBpmDetect) << "Detection stopped.";
+        emit finished();
+        return;
+        // LCOV_EXCL_STOP
+    }
+    const auto start = detectionTimer_.nsecsElapsed();
+    const auto traceStart = Tracer::now();
+    candidates_ = detector_->candidates(kCandidateCount);
+    Tracer::complete(
+        "detect", fileName_, traceStart, {{QStringLiteral("fromEnvelope"), fromEnvelope_}});
+    detectorTime_ += detectionTimer_.nsecsElapsed() - start;
+    rawBpm_ = candidates_.isEmpty() ? 0 : candidates_.first().bpm;
+    detectorVersion_ = detectorVersion();
+    // An envelope that stopped early would stand in for the whole file.
+    if (!fromEnvelope_ && !converged_) {
+        storeEnvelope();
+    }
+    reportBpm(correctBpm(rawBpm_), true);
+}
+
+bool Track::detectFromEnvelope() {
+    auto detector = qobject_cast<AutocorrelationBpmDetector *>(detector_);
+    if (!_envelopeCache || !detector || !samplingWindows(length_).isEmpty()) {
+        return false;
+    }
+    EnvelopeCache::Entry cached;
+    if (!_envelopeCache->lookup(fileName_, &cached) || cached.version != envelopeVersion()) {
+        return false;
+    }
+    qCDebug(gLogBpmDetect) << "Detecting from the cached envelope of" << fileName_;
+    detector->setFormat(_detectionChannels, _detectionSampleRate);
+    detector->reset();
+    detector->setEnvelope(std::move(cached.envelope), cached.rate);
+    converged_ = false;
+    fromEnvelope_ = true;
+    decoded_ = length_;
+    QMetaObject::invokeMethod(this, &Track::finishDetection, Qt::QueuedConnection);
+    return true;
+}
+
+void Track::traceDecode() {
+    // The detector is fed between buffers, so its time is part of the span.
+    Tracer::complete("decode",
+                     fileName_,
+                     decodeStart_,
+                     {{QStringLiteral("durationMs"), decoded_},
+                      {QStringLiteral("detectorMs"), static_cast<double>(detectorTime_) / 1e6}});
+    decodeStart_ = -1;
+}
+
+void Track::storeEnvelope() {
+    const auto detector = qobject_cast<const AutocorrelationBpmDetector *>(detector_);
+    if (!_envelopeCache || !detector || fileName_.isEmpty()) {
+        return;
+    }
+    const EnvelopeCache::Entry entry{
+        detector->envelope(), detector->envelopeRate(), candidates_, envelopeVersion()};
+    envelopeCacheSize_ = std::max<qint64>(0, _envelopeCache->insert(fileName_, entry));
+    qCInfo(gLogBpmDetect) << "Cached the onset envelope of" << fileName_ << "in"
+                          << envelopeCacheSize_ << "bytes.";
+}
+
+void Track::reportBpm(bpmtype bpm, bool detected) {
+    detectionTime_ = detectionTimer_.isValid() ? detectionTimer_.nsecsElapsed() : 0;
+    setBpm(bpm);
+    if (detected) {
+        // Until it is saved, a detected BPM leaves the cached tag value alone.
+        updateCache(hasSavedBpm_ ? savedBpm_ : bpm);
+        Profiler::record(Profiler::Decode, detectionTime_ - detectorTime_);
+        Profiler::record(Profiler::Detect, detectorTime_);
+    }
+    qCDebug(gLogBpmDetect) << "Decoded" << decoded_ << "ms of" << length_ << "ms.";
+    if (!hasValidBpm()) {
+        // LCOV_EXCL_START
+        qCInfo(gLogBpmDetect) << "Invalid BPM detected:" << bpm;
+        // LCOV_EXCL_STOP
+    } else {
+        emit hasBpm(bpm);
+    }
+    emit finished();
 }
 
 void Track::setMinimumBpm(bpmtype dMin) {
@@ -127,6 +375,162 @@ bpmtype Track::maximumBpm() {
     return _dMaxBpm;
 }
 
+void Track::setDecoderBackend(DecoderBackend backend) {
+#ifdef NO_GUI
+    if (backend != FfmpegBackend) {
+        qCWarning(gLogBpmDetect) << "Only the FFmpeg decoder backend is available in this build.";
+        return;
+    }
+#endif
+    _decoderBackend = backend;
+}
+
+Track::DecoderBackend Track::decoderBackend() {
+    return _decoderBackend;
+}
+
+void Track::setDetectorType(DetectorType type) {
+    _detectorType = type;
+}
+
+Track::DetectorType Track::detectorType() {
+    return _detectorType;
+}
+
+AbstractBpmDetector *Track::createDetector(QObject *parent) {
+    if (_detectorType == AutocorrelationDetector) {
+        return new AutocorrelationBpmDetector(parent);
+    }
+    return new SoundTouchBpmDetector(parent);
+}
+
+void Track::setConvergence(const Convergence &convergence) {
+    _convergence = convergence;
+}
+
+Track::Convergence Track::convergence() {
+    return _convergence;
+}
+
+void Track::setDetectionFormat(int channels, int sampleRate) {
+    if (channels < 1 || channels > 2 || sampleRate < 2000 || sampleRate > 192000) {
+        qCWarning(gLogBpmDetect) << "Ignoring unsupported detection format:" << channels
+                                 << "channels at" << sampleRate << "Hz.";
+        return;
+    }
+    _detectionChannels = channels;
+    _detectionSampleRate = sampleRate;
+}
+
+int Track::detectionChannels() {
+    return _detectionChannels;
+}
+
+int Track::detectionSampleRate() {
+    return _detectionSampleRate;
+}
+
+void Track::setSampling(const Sampling &sampling) {
+    _sampling = sampling;
+}
+
+Track::Sampling Track::sampling() {
+    return _sampling;
+}
+
+void Track::setCache(BpmCache *cache) {
+    _cache = cache;
+}
+
+BpmCache *Track::cache() {
+    return _cache;
+}
+
+void Track::setIndex(ResultIndex *index) {
+    _index = index;
+}
+
+ResultIndex *Track::index() {
+    return _index;
+}
+
+void Track::setBpmAttribute(const QString &name) {
+    _bpmAttribute = name;
+}
+
+QString Track::bpmAttribute() {
+    return _bpmAttribute;
+}
+
+TagWriteResult Track::writeBpm(const QString &fileName, const QString &bpm) {
+    Tracer::Span span("save", fileName);
+    QElapsedTimer timer;
+    timer.start();
+    TagWriteResult result;
+    if (!_bpmAttribute.isEmpty()) {
+        result = bpm.isEmpty() ? removeBpmFromAttribute(fileName, _bpmAttribute) :
+                                 storeBpmInAttribute(fileName, _bpmAttribute, bpm);
+    } else {
+        result = bpm.isEmpty() ? removeBpmFromFile(fileName) : storeBpmInFile(fileName, bpm);
+    }
+    result.elapsed = timer.nsecsElapsed();
+    Profiler::record(Profiler::TagWrite, result.elapsed);
+    span.setArg(QStringLiteral("ok"), result.ok);
+    return result;
+}
+
+quint32 Track::detectorVersion() {
+    auto hash = qHashMulti(0,
+                           kDetectorRevision,
+                           static_cast<int>(_detectorType),
+                           _detectionChannels,
+                           _detectionSampleRate,
+                           _sampling.windows,
+                           _convergence.enabled);
+    if (_sampling.windows > 0) {
+        hash = qHashMulti(hash, _sampling.windowLength, _sampling.skip);
+    }
+    if (_convergence.enabled) {
+        hash = qHashMulti(
+            hash, _convergence.interval, _convergence.window, _convergence.tolerance);
+    }
+    // 0 marks cache entries without a detection result.
+    return std::max<quint32>(1, static_cast<quint32>(hash));
+}
+
+void Track::setEnvelopeCache(EnvelopeCache *cache) {
+    _envelopeCache = cache;
+}
+
+EnvelopeCache *Track::envelopeCache() {
+    return _envelopeCache;
+}
+
+quint32 Track::envelopeVersion() {
+    const auto hash = qHashMulti(0, kEnvelopeRevision, _detectionChannels, _detectionSampleRate);
+    return std::max<quint32>(1, static_cast<quint32>(hash));
+}
+
+QList<qint64> Track::samplingWindows(qint64 length) {
+    QList<qint64> ret;
+    if (_sampling.windows < 1 || _sampling.windowLength <= 0 || length <= 0) {
+        return ret;
+    }
+    const auto skip =
+        static_cast<qint64>(static_cast<double>(length) * qBound(0.0, _sampling.skip, 0.45));
+    const auto span = length - 2 * skip;
+    const auto count = static_cast<qint64>(_sampling.windows);
+    if (span < count * _sampling.windowLength) {
+        return ret;
+    }
+    // Centre each window in an equal share of the span between intro and outro.
+    const auto share = span / count;
+    for (qint64 i = 0; i < count; ++i) {
+        ret << skip + i * share + (share - _sampling.windowLength) / 2;
+    }
+    return ret;
+}
+
 QString Track::formatted() const {
     return bpmToString(bpm(), format());
 }
@@ -136,13 +540,56 @@ QString Track::formatted(const QString &format) const {
 }
 
 void Track::readTags() {
-    auto map = readTagsFromFile(fileName_);
-    title_ = map[QStringLiteral("title")].toString();
-    artist_ = map[QStringLiteral("artist")].toString();
-    length_ = map[QStringLiteral("length")].toLongLong();
-    dBpm_ = map[QStringLiteral("bpm")].toDouble();
+    ResultIndex::Entry indexed;
+    if (_index && _index->lookup(fileName_, &indexed)) {
+        qCDebug(gLogBpmDetect) << "Using indexed BPM" << indexed.bpm << "for" << fileName_;
+        dBpm_ = indexed.bpm;
+        rawBpm_ = indexed.rawBpm;
+        length_ = indexed.length;
+        detectorVersion_ = indexed.detectorVersion;
+        return;
+    }
+    if (!_bpmAttribute.isEmpty()) {
+        dBpm_ = readBpmFromAttribute(fileName_, _bpmAttribute);
+        if (dBpm_ > 0) {
+            hasSavedBpm_ = true;
+            savedBpm_ = dBpm_;
+            return;
+        }
+    }
+    applyProbe(probeFile(fileName_));
+}
+
+void Track::applyProbe(const ProbeResult &probe) {
+    title_ = probe.title;
+    artist_ = probe.artist;
+    length_ = probe.length;
+    dBpm_ = probe.bpm;
+    if (!_bpmAttribute.isEmpty()) {
+        const auto bpm = readBpmFromAttribute(fileName_, _bpmAttribute);
+        dBpm_ = bpm > 0 ? bpm : dBpm_;
+    }
     if (hasValidBpm()) {
         hasSavedBpm_ = true;
+        savedBpm_ = dBpm_;
+    }
+    if (_cache && probe.hasAudio) {
+        // Keep the detection result of an unchanged file.
+        BpmCache::Entry cached;
+        if (_cache->lookup(fileName_, &cached)) {
+            rawBpm_ = cached.rawBpm;
+            detectorVersion_ = cached.detectorVersion;
+        }
+        // A probe that did not open the file (see DetectionScheduler) has no tags to store.
+        if (probe.opened) {
+            updateCache(dBpm_);
+        }
+    }
+}
+
+void Track::updateCache(bpmtype bpm) const {
+    if (_cache && !fileName_.isEmpty()) {
+        _cache->insert(fileName_, {bpm, rawBpm_, length_, detectorVersion_, hasSavedBpm_});
     }
 }
 
@@ -151,24 +598,28 @@ QString Track::fileName() const {
 }
 
 QString Track::hostFileName() const {
+    return hostFileName(fileName_);
+}
+
+QString Track::hostFileName(const QString &fileName) {
 #ifdef DESKTOP_PORTAL
     auto attr_size =
-        getxattr(fileName_.toUtf8().constData(), "user.document-portal.host-path", nullptr, 0);
+        getxattr(fileName.toUtf8().constData(), "user.document-portal.host-path", nullptr, 0);
     if (attr_size < 0) {
         qCDebug(gLogBpmDetect) << "Checking for host filename failed. Using original filename.";
-        return fileName_;
+        return fileName;
     }
     QList<char> buf(attr_size);
-    if (getxattr(fileName_.toUtf8().constData(),
+    if (getxattr(fileName.toUtf8().constData(),
                  "user.document-portal.host-path",
                  buf.data(),
                  static_cast<size_t>(attr_size)) == attr_size) {
         return QString::fromUtf8(buf.data(), attr_size);
     }
     qCDebug(gLogBpmDetect) << "getxattr() did not return expected size. Using original filename.";
-    return fileName_;
+    return fileName;
 #else
-    return fileName_;
+    return fileName;
 #endif
 }
 
@@ -192,13 +643,12 @@ bpmtype Track::bpm() const {
     return dBpm_;
 }
 
+bpmtype Track::rawBpm() const {
+    return rawBpm_;
+}
+
 QString Track::formattedLength() const {
-    auto csecs = length_ / 10;
-    auto secs = csecs / 100;
-    auto mins = secs / 60;
-    secs = secs % 60;
-    static const auto zero = QChar::fromLatin1('0');
-    return QStringLiteral("%1:%2").arg(mins, 2, 10, zero).arg(secs, 2, 10, zero);
+    return formatLength(length_);
 }
 
 QString Track::artist() const {
@@ -213,11 +663,21 @@ void Track::saveBpm() {
     storeBpm(bpmToString(bpm(), format()));
 }
 
+void Track::saveBpm(TagWriter *writer) const {
+    writer->enqueue({fileName_,
+                     bpmToString(bpm(), format()),
+                     BpmCache::Entry{dBpm_, rawBpm_, length_, detectorVersion_, false}});
+}
+
 void Track::clearBpm() {
     setBpm(0);
     removeBpm();
 }
 
+void Track::setFormatContext(const std::shared_ptr<AVFormatContext> &context) {
+    formatContext_ = context;
+}
+
 void Track::setDetector(AbstractBpmDetector *detector) {
     detector_ = detector;
 }
@@ -243,10 +703,64 @@ void Track::printBpm() const {
 }
 
 Track::DetectionState Track::detectBpm() {
-    if (isValidFile_ && detector_ != nullptr && decoder_ != nullptr) {
+    // Sampling needs to seek, which only the FFmpeg backend can do.
+    const auto useFfmpeg =
+        _decoderBackend == FfmpegBackend || !samplingWindows(length_).isEmpty();
+    if (isValidFile_ && detector_ != nullptr && (useFfmpeg || decoder_ != nullptr)) {
+        stopped_ = false;
+        decoded_ = 0;
+        envelopeCacheSize_ = 0;
+        fromEnvelope_ = false;
+        detectionTime_ = 0;
+        detectorTime_ = 0;
+        decodeStart_ = -1;
+        detectionTimer_.start();
+        BpmCache::Entry cached;
+        if (_cache && _cache->lookup(fileName_, &cached) && cached.rawBpm > 0 &&
+            cached.detectorVersion == detectorVersion()) {
+            qCDebug(gLogBpmDetect) << "Using cached BPM" << cached.rawBpm << "for" << fileName_;
+            rawBpm_ = cached.rawBpm;
+            detectorVersion_ = cached.detectorVersion;
+            EnvelopeCache::Entry envelope;
+            candidates_ = {{rawBpm_, 1}};
+            if (_envelopeCache && _envelopeCache->lookup(fileName_, &envelope, false) &&
+                envelope.version == envelopeVersion() && !envelope.candidates.isEmpty()) {
+                candidates_ = envelope.candidates;
+            }
+            QMetaObject::invokeMethod(
+                this, [this]() { reportBpm(correctBpm(rawBpm_)); }, Qt::QueuedConnection);
+            return Detecting;
+        }
+        if (detectFromEnvelope()) {
+            return Detecting;
+        }
+        // The decoder downmixes and resamples (low-pass filtered) to the detection format.
+        detector_->setFormat(_detectionChannels, _detectionSampleRate);
         detector_->reset();
-        decoder_->setSource(QUrl::fromLocalFile(fileName_));
-        decoder_->start();
+        converged_ = false;
+        lastEstimate_ = 0;
+        nextCheck_ = _convergence.interval;
+        stableSince_ = 0;
+        if (useFfmpeg) {
+            // Queued so that, like with QAudioDecoder, results are delivered once the caller is
+            // back in the event loop.
+            QMetaObject::invokeMethod(this, &Track::decodeWithFfmpeg, Qt::QueuedConnection);
+        } else {
+#ifndef NO_GUI
+            QAudioFormat format;
+#if defined(SOUNDTOUCH_INTEGER_SAMPLES) && SOUNDTOUCH_INTEGER_SAMPLES
+            format.setSampleFormat(QAudioFormat::Int16);
+#else
+            format.setSampleFormat(QAudioFormat::Float);
+#endif
+            format.setChannelCount(_detectionChannels);
+            format.setSampleRate(_detectionSampleRate);
+            decoder_->setAudioFormat(format);
+            decoder_->setSource(QUrl::fromLocalFile(fileName_));
+            decodeStart_ = Tracer::now();
+            decoder_->start();
+#endif
+        }
     } else {
         qCCritical(gLogBpmDetect) << "Invalid state for detection. Detector:"
                                   << (detector_ ? "valid" : "nullptr")
@@ -258,7 +772,10 @@ Track::DetectionState Track::detectBpm() {
 }
 
 void Track::storeBpm(const QString &sBpm) {
-    hasSavedBpm_ = storeBpmInFile(fileName_, sBpm);
+    hasSavedBpm_ = writeBpm(fileName_, sBpm).ok;
+    savedBpm_ = hasSavedBpm_ ? sBpm.toDouble() : 0;
+    // Saving changes the modification time, so the entry is stored again with what the tag holds.
+    updateCache(hasSavedBpm_ ? sBpm.toDouble() : dBpm_);
 }
 
 bool Track::hasSavedBpm() const {
@@ -266,14 +783,19 @@ bool Track::hasSavedBpm() const {
 }
 
 void Track::removeBpm() {
-    hasSavedBpm_ = !removeBpmFromFile(fileName_);
+    hasSavedBpm_ = !writeBpm(fileName_, QString()).ok;
+    savedBpm_ = hasSavedBpm_ ? savedBpm_ : 0;
+    updateCache(dBpm_);
 }
 
 void Track::stop() {
     stopped_ = true;
+#ifndef NO_GUI
     if (decoder_) {
-        decoder_->stop();
+        // Runs directly on the decoder's thread and is queued to it from any other thread.
+        QMetaObject::invokeMethod(decoder_, &QAudioDecoder::stop);
     }
+#endif
 }
 
 bool Track::hasValidBpm() const {
@@ -283,3 +805,49 @@ bool Track::hasValidBpm() const {
 qlonglong Track::length() const {
     return length_;
 }
+
+qint64 Track::decodedLength() const {
+    return decoded_;
+}
+
+double Track::decodedFraction() const {
+    if (length_ <= 0) {
+        return 0;
+    }
+    return qMin(1.0, static_cast<double>(decoded_) / static_cast<double>(length_));
+}
+
+QList<AbstractBpmDetector::Candidate> Track::candidates() const {
+    return foldCandidates(candidates_);
+}
+
+QList<AbstractBpmDetector::Candidate>
+Track::foldCandidates(const QList<AbstractBpmDetector::Candidate> &candidates) {
+    QList<AbstractBpmDetector::Candidate> ret;
+    for (const auto &candidate : candidates) {
+        const auto bpm = correctBpm(candidate.bpm);
+        if (bpm <= 0) {
+            continue;
+        }
+        // Octave errors fold onto the same tempo; the earlier candidate scored higher.
+        const auto same = std::find_if(ret.cbegin(), ret.cend(), [bpm](const auto &other) {
+            return qAbs(other.bpm - bpm) <= other.bpm * kCandidateMergeTolerance;
+        });
+        if (same == ret.cend()) {
+            ret.append({bpm, candidate.score});
+        }
+    }
+    return ret;
+}
+
+qint64 Track::detectionTime() const {
+    return detectionTime_;
+}
+
+qint64 Track::detectorTime() const {
+    return detectorTime_;
+}
+
+qint64 Track::envelopeCacheSize() const {
+    return envelopeCacheSize_;
+}
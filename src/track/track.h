@@ -2,13 +2,24 @@
 /** @file */
 #pragma once
 
+#include <atomic>
+#include <memory>
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QList>
 #include <QtCore/QSpan>
 #include <STTypes.h>
 
+#include "ffmpegutils.h"
 #include "soundtouchbpmdetector.h"
 #include "utils.h"
 
+class BpmCache;
+class EnvelopeCache;
+class FfmpegDecoder;
 class QAudioDecoder;
+class ResultIndex;
+class TagWriter;
 
 /** Represents a file on the system. */
 class Track : public QObject {
@@ -24,6 +35,36 @@ public:
         Detecting, //!< Currently detecting BPM.
         Error,     //!< Error occurred.
     };
+    /** Backends used to decode audio for detection. */
+    enum DecoderBackend {
+        QtMultimediaBackend, //!< `QAudioDecoder`, driven by the event loop.
+        FfmpegBackend,       //!< libavcodec in a pull loop (see FfmpegDecoder).
+    };
+    /** BPM detection algorithms. */
+    enum DetectorType {
+        SoundTouchDetector,      //!< SoundTouch `BPMDetect` (see SoundTouchBpmDetector).
+        AutocorrelationDetector, //!< FFT autocorrelation (see AutocorrelationBpmDetector).
+    };
+    /** Settings for stopping detection once the estimate is stable. */
+    struct Convergence {
+        /** If detection may stop before the end of the file. */
+        bool enabled = false;
+        /** How often the estimate is checked, in milliseconds of decoded audio. */
+        qint64 interval = 5000;
+        /** How long the estimate has to stay within @a tolerance, in milliseconds of audio. */
+        qint64 window = 30000;
+        /** Largest difference in BPM between checks that still counts as stable. */
+        bpmtype tolerance = 0.5;
+    };
+    /** Settings for analysing only a few windows of the track. */
+    struct Sampling {
+        /** Number of windows to decode. 0 decodes the whole track. */
+        int windows = 0;
+        /** Length of each window in milliseconds. */
+        qint64 windowLength = 20000;
+        /** Fraction of the track skipped at the start and at the end (intro and outro). */
+        double skip = 0.1;
+    };
     /**
      * Constructor.
      * @param fileName Filename.
@@ -31,6 +72,18 @@ public:
      * @param parent Parent object.
      */
     Track(const QString &fileName, QAudioDecoder *decoder, QObject *parent = nullptr);
+    /**
+     * Constructor that uses the result of probeFile() instead of opening the file again. If the
+     * probe kept the format context open, the FFmpeg decoder backend decodes from it.
+     * @param fileName Filename.
+     * @param probe Result of probeFile() for @a fileName.
+     * @param decoder Audio decoder.
+     * @param parent Parent object.
+     */
+    Track(const QString &fileName,
+          const ProbeResult &probe,
+          QAudioDecoder *decoder,
+          QObject *parent = nullptr);
     /**
      * Constructor.
      * @param fileName Filename.
@@ -61,18 +114,145 @@ public:
     static bpmtype minimumBpm();
     /** Get the maximum BPM. */
     static bpmtype maximumBpm();
+    /**
+     * Set the backend used to decode audio. Without Qt Multimedia (`NO_GUI`), only
+     * `FfmpegBackend` is available and other values are ignored.
+     * @param backend Decoder backend.
+     */
+    static void setDecoderBackend(DecoderBackend backend);
+    /** Get the backend used to decode audio. */
+    static DecoderBackend decoderBackend();
+    /**
+     * Set the algorithm created by createDetector().
+     * @param type Detector type.
+     */
+    static void setDetectorType(DetectorType type);
+    /** Get the algorithm created by createDetector(). */
+    static DetectorType detectorType();
+    /**
+     * Create a BPM detector of the type set with setDetectorType().
+     * @param parent Parent object.
+     * @return New detector owned by the caller (or @a parent).
+     */
+    static AbstractBpmDetector *createDetector(QObject *parent = nullptr);
+    /**
+     * Set when detection stops early. The folded BPM (see correctBpm()) is checked every
+     * `interval` of audio and decoding stops once it has stayed within `tolerance` for `window`.
+     * @param convergence Convergence settings.
+     */
+    static void setConvergence(const Convergence &convergence);
+    /** Get the convergence settings. */
+    static Convergence convergence();
+    /**
+     * Set the format audio is converted to before detection. Lower rates and mono cut the cost of
+     * resampling and detection; the default is mono at 11025 Hz. Unsupported values (other than 1
+     * or 2 channels, or rates outside 2000 to 192000 Hz) are ignored.
+     * @param channels Number of channels.
+     * @param sampleRate Sample rate in Hz.
+     */
+    static void setDetectionFormat(int channels, int sampleRate);
+    /** Get the number of channels used for detection. */
+    static int detectionChannels();
+    /** Get the sample rate used for detection. */
+    static int detectionSampleRate();
+    /**
+     * Set segment sampling. When enabled, detection seeks to `windows` windows spread over the
+     * track (after skipping the intro and outro), resets the detector for each and combines the
+     * estimates. Tracks too short to hold the windows are decoded in full. Sampling always decodes
+     * with FFmpeg because `QAudioDecoder` cannot seek.
+     * @param sampling Sampling settings.
+     */
+    static void setSampling(const Sampling &sampling);
+    /** Get the segment sampling settings. */
+    static Sampling sampling();
+    /**
+     * Get the start positions of the windows sampling would decode for a track.
+     * @param length Track length in milliseconds.
+     * @return Start positions in milliseconds, or an empty list if the whole track should be
+     * decoded.
+     */
+    static QList<qint64> samplingWindows(qint64 length);
+    /**
+     * Set the cache consulted before detecting and updated with tags read and results detected.
+     * @param cache Cache, or `nullptr` to disable caching. Not owned.
+     */
+    static void setCache(BpmCache *cache);
+    /** Get the cache set with setCache(). */
+    static BpmCache *cache();
+    /**
+     * Set the result index read by readTags(). A file with an entry in the index that has not
+     * changed since takes its BPM and length from it without being opened.
+     * @param index Index, or `nullptr` to always read the file. Not owned.
+     */
+    static void setIndex(ResultIndex *index);
+    /** Get the index set with setIndex(). */
+    static ResultIndex *index();
+    /**
+     * Set the extended attribute the BPM is saved in and read from first, instead of the tags of
+     * the file (see storeBpmInAttribute()). Saving then never rewrites the file.
+     * @param name Attribute name, or an empty string to use the tags.
+     */
+    static void setBpmAttribute(const QString &name);
+    /** Get the attribute set with setBpmAttribute(), or an empty string if tags are used. */
+    static QString bpmAttribute();
+    /**
+     * Save or remove the BPM of a file where setBpmAttribute() says: in its extended attribute, or
+     * in its tags with storeBpmInFile() and removeBpmFromFile(). Sets TagWriteResult::elapsed.
+     * @param fileName Path to the file.
+     * @param bpm Formatted BPM to save, or an empty string to remove it.
+     */
+    static TagWriteResult writeBpm(const QString &fileName, const QString &bpm);
+    /**
+     * Get a value identifying the detector type, its revision and the settings that change its
+     * result (detection format, sampling and convergence). Cached results detected with another
+     * value are not used.
+     */
+    static quint32 detectorVersion();
+    /**
+     * Set the cache of onset envelopes. With the autocorrelation detector, a file with a cached
+     * envelope is detected from it without being decoded, and the envelope of a file decoded in
+     * full is stored.
+     * @param cache Cache, or `nullptr` to disable it. Not owned.
+     */
+    static void setEnvelopeCache(EnvelopeCache *cache);
+    /** Get the cache set with setEnvelopeCache(). */
+    static EnvelopeCache *envelopeCache();
+    /**
+     * Get a value identifying the settings that change the onset envelope (its revision and the
+     * detection format). Cached envelopes computed with another value are not used.
+     */
+    static quint32 envelopeVersion();
+    /**
+     * Fold detector candidates into the BPM range with correctBpm(), keeping the first of those
+     * that fold onto the same tempo.
+     * @param candidates Candidates, best first.
+     */
+    static QList<AbstractBpmDetector::Candidate>
+    foldCandidates(const QList<AbstractBpmDetector::Candidate> &candidates);
+    /**
+     * Get the host filename of a file when sandboxed.
+     * @param fileName Path to the file.
+     */
+    static QString hostFileName(const QString &fileName);
     /** Clear the BPM. */
     void clearBpm();
     /** Detect the BPM. */
     DetectionState detectBpm();
     /** Save the BPM to the metadata of the file. */
     void saveBpm();
+    /**
+     * Queue the BPM to be saved by @a writer instead of saving it now. hasSavedBpm() is not
+     * updated; the cache entry is stored by the writer once the tag is written.
+     */
+    void saveBpm(TagWriter *writer) const;
     /** Print the BPM to standard output. */
     void printBpm() const;
     /** Set the BPM. */
     void setBpm(bpmtype dBpm);
     /** Get the BPM. */
     bpmtype bpm() const;
+    /** Get the result of the last detection before folding into the BPM range, or 0. */
+    bpmtype rawBpm() const;
     /** Get the BPM as a formatted string. */
     QString formatted() const;
     /** Get the BPM as a string according to the @a format passed in. */
@@ -93,18 +273,49 @@ public:
     void setFormat(const QString &format = QStringLiteral("0.00"));
     /** Get the BPM format. */
     QString format() const;
-    /** Stop detection if it is running. */
+    /** Stop detection if it is running. Can be called from any thread. */
     void stop();
-    /** Read tags (artist, title, BPM). */
+    /**
+     * Read tags (artist, title, BPM). With an index set (see setIndex()), an indexed file is not
+     * opened; its BPM and length come from the index and the artist and title are left empty. The
+     * same goes for a file with a BPM in the attribute set with setBpmAttribute().
+     */
     void readTags();
     /** Set BPM detector. */
     void setDetector(AbstractBpmDetector *detector);
+    /**
+     * Hand over a format context opened by probeFile(), so the next detection with the FFmpeg
+     * backend decodes from it instead of opening the file again.
+     * @param context Format context positioned at the start of the audio.
+     */
+    void setFormatContext(const std::shared_ptr<AVFormatContext> &context);
     /** Check if the BPM is set and is valid. */
     bool hasValidBpm() const;
     /** If the BPM is saved in the file metadata. */
     bool hasSavedBpm() const;
     /** Get the host filename when sandboxed. */
     QString hostFileName() const;
+    /** Get how much audio the last detection decoded, in milliseconds. */
+    qint64 decodedLength() const;
+    /**
+     * Get the fraction of the track the last detection decoded, from 0 to 1. This is below 1 when
+     * detection stopped early because the estimate converged. Returns 0 if the length is unknown.
+     */
+    double decodedFraction() const;
+    /**
+     * Get the tempos the last detection found most likely, folded into the BPM range and best
+     * first. Holds at least the BPM when it was detected, unless the detector found nothing.
+     */
+    QList<AbstractBpmDetector::Candidate> candidates() const;
+    /** Get the size in bytes of the onset envelope the last detection stored, or 0 if none. */
+    qint64 envelopeCacheSize() const;
+    /**
+     * Get the wall time of the last detection in nanoseconds, from detectBpm() until the BPM was
+     * reported. 0 if no BPM was reported.
+     */
+    qint64 detectionTime() const;
+    /** Get the part of detectionTime() spent in the detector. The rest was spent decoding. */
+    qint64 detectorTime() const;
 
 Q_SIGNALS:
     /**
@@ -128,21 +339,65 @@ protected:
     void removeBpm();
 
 private:
+    void applyProbe(const ProbeResult &probe);
+    void decodeWindows(FfmpegDecoder &decoder, const QList<qint64> &windows);
+    void decodeWithFfmpeg();
+    bool detectFromEnvelope();
+    void finishDetection();
+    void reportBpm(bpmtype bpm, bool detected = false);
+    bool inputSamples(const soundtouch::SAMPLETYPE *samples, int frames, qint64 position);
     void setupDecoder();
+    void storeEnvelope();
+    /** Record the decode span started at decodeStart_, if any. */
+    void traceDecode();
+    void updateCache(bpmtype bpm) const;
 
     AbstractBpmDetector *detector_ = nullptr;
+    std::shared_ptr<AVFormatContext> formatContext_;
     QAudioDecoder *decoder_ = nullptr;
     QString artist_;
     QString bpmFormat_ = QStringLiteral("0.00");
     QString fileName_;
     QString title_;
+    bool converged_ = false;
+    /** If the last detection ran on a cached envelope. */
+    bool fromEnvelope_ = false;
     bool hasSavedBpm_ = false;
     bool isValidFile_ = false;
     bool opened_ = false;
-    bool stopped_ = false;
+    std::atomic_bool stopped_ = false;
     bpmtype dBpm_ = 0;
+    bpmtype lastEstimate_ = 0;
+    /** Detector output before folding, kept for the cache. */
+    bpmtype rawBpm_ = 0;
+    /** BPM in the tags if hasSavedBpm_, which a detection does not change. */
+    bpmtype savedBpm_ = 0;
+    quint32 detectorVersion_ = 0;
+    /** Detector candidates before folding. */
+    QList<AbstractBpmDetector::Candidate> candidates_;
+    qint64 decoded_ = 0;
+    qint64 envelopeCacheSize_ = 0;
+    /** Started by detectBpm(). */
+    QElapsedTimer detectionTimer_;
+    qint64 detectionTime_ = 0;
+    /** Nanoseconds spent in the detector during the last detection. */
+    qint64 detectorTime_ = 0;
+    /** Tracer::now() when decoding started, or -1. */
+    qint64 decodeStart_ = -1;
+    qint64 nextCheck_ = 0;
+    qint64 stableSince_ = 0;
     qlonglong length_ = 0;
 
+    static BpmCache *_cache;
+    static EnvelopeCache *_envelopeCache;
+    static ResultIndex *_index;
+    static QString _bpmAttribute;
     static bpmtype _dMaxBpm;
     static bpmtype _dMinBpm;
+    static DecoderBackend _decoderBackend;
+    static DetectorType _detectorType;
+    static Convergence _convergence;
+    static Sampling _sampling;
+    static int _detectionChannels;
+    static int _detectionSampleRate;
 };
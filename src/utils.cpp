@@ -28,6 +28,14 @@ QString bpmToString(bpmtype dBpm, const QString &format) {
     return QString::number(dBpm, 'f', 2);
 }
 
+QString formatLength(qint64 length) {
+    auto secs = length / 1000;
+    auto mins = secs / 60;
+    secs = secs % 60;
+    static const auto zero = QChar::fromLatin1('0');
+    return QStringLiteral("%1:%2").arg(mins, 2, 10, zero).arg(secs, 2, 10, zero);
+}
+
 void parseCommandLine(QCommandLineParser &parser, const QCoreApplication &app) {
     parser.setApplicationDescription(
         QStringLiteral("BPM Detect - automatic BPM detection utility"));
@@ -44,6 +52,10 @@ void parseCommandLine(QCommandLineParser &parser, const QCoreApplication &app) {
     QCommandLineOption removeOpt(
         {QStringLiteral("r"), QStringLiteral("remove")},
         QCoreApplication::translate("main", "Remove BPM tags and do not perform detection."));
+    QCommandLineOption recursiveOpt(
+        {QStringLiteral("R"), QStringLiteral("recursive")},
+        QCoreApplication::translate(
+            "main", "Process the audio files in directories and their subdirectories."));
     QCommandLineOption noProgressOpt(
         {QStringLiteral("p"), QStringLiteral("no-progress")},
         QCoreApplication::translate("main", "Disable progress display."));
@@ -56,20 +68,155 @@ void parseCommandLine(QCommandLineParser &parser, const QCoreApplication &app) {
     QCommandLineOption limitOpt(
         {QStringLiteral("l"), QStringLiteral("limit")},
         QCoreApplication::translate("main", "Do not allow a BPM above the range."));
+    QCommandLineOption jobsOpt(
+        {QStringLiteral("j"), QStringLiteral("jobs")},
+        QCoreApplication::translate(
+            "main", "Number of files to process in parallel (default: number of CPUs)."),
+        QStringLiteral("count"));
+#ifndef NO_GUI
+    const auto defaultDecoder = QStringLiteral("qt");
+#else
+    const auto defaultDecoder = QStringLiteral("ffmpeg");
+#endif
+    QCommandLineOption decoderOpt(
+        QStringLiteral("decoder"),
+        QCoreApplication::translate(
+            "main", "Audio decoder backend: qt (Qt Multimedia) or ffmpeg (default: %1).")
+            .arg(defaultDecoder),
+        QStringLiteral("backend"));
+    QCommandLineOption detectorOpt(
+        QStringLiteral("detector"),
+        QCoreApplication::translate(
+            "main", "BPM detection algorithm: soundtouch or autocorrelation (default: %1).")
+            .arg(QStringLiteral("soundtouch")),
+        QStringLiteral("algorithm"));
+    QCommandLineOption convergeOpt(
+        QStringLiteral("converge"),
+        QCoreApplication::translate("main", "Stop decoding once the BPM estimate is stable."));
+    QCommandLineOption convergeToleranceOpt(
+        QStringLiteral("converge-tolerance"),
+        QCoreApplication::translate(
+            "main", "Largest BPM change that still counts as stable (default: 0.5)."),
+        QStringLiteral("bpm"));
+    QCommandLineOption convergeWindowOpt(
+        QStringLiteral("converge-window"),
+        QCoreApplication::translate(
+            "main", "Seconds of audio the estimate has to stay stable for (default: 30)."),
+        QStringLiteral("seconds"));
+    QCommandLineOption segmentsOpt(
+        QStringLiteral("segments"),
+        QCoreApplication::translate(
+            "main", "Only analyse this many windows spread over each file (default: whole file)."),
+        QStringLiteral("count"));
+    QCommandLineOption segmentLengthOpt(
+        QStringLiteral("segment-length"),
+        QCoreApplication::translate("main", "Length of each window in seconds (default: 20)."),
+        QStringLiteral("seconds"));
+    QCommandLineOption detectionRateOpt(
+        QStringLiteral("detection-rate"),
+        QCoreApplication::translate(
+            "main", "Sample rate audio is converted to for detection (default: 11025)."),
+        QStringLiteral("hz"));
+    QCommandLineOption detectionChannelsOpt(
+        QStringLiteral("detection-channels"),
+        QCoreApplication::translate("main", "Channels used for detection, 1 or 2 (default: 1)."),
+        QStringLiteral("count"));
+    QCommandLineOption noCacheOpt(
+        QStringLiteral("no-cache"),
+        QCoreApplication::translate("main", "Do not read or update the BPM cache."));
+    QCommandLineOption rebuildCacheOpt(
+        QStringLiteral("rebuild-cache"),
+        QCoreApplication::translate("main", "Discard the BPM cache and fill it again."));
+    QCommandLineOption cacheHashOpt(
+        QStringLiteral("cache-hash"),
+        QCoreApplication::translate(
+            "main", "Also identify cached files by a hash of their first and last 64 KiB."));
+    QCommandLineOption envelopeCacheOpt(
+        QStringLiteral("envelope-cache"),
+        QCoreApplication::translate("main",
+                                    "Keep onset envelopes so changed settings do not decode files "
+                                    "again (autocorrelation detector only)."));
+    QCommandLineOption indexOpt(
+        QStringLiteral("index"),
+        QCoreApplication::translate(
+            "main",
+            "Append results to this JSON Lines index and read unchanged files from it instead of "
+            "their tags."),
+        QStringLiteral("file"));
+    QCommandLineOption xattrOpt(
+        QStringLiteral("xattr"),
+        QCoreApplication::translate(
+            "main",
+            "Save the BPM in an extended attribute instead of the tags, and read it from there "
+            "first."));
+    QCommandLineOption xattrNameOpt(
+        QStringLiteral("xattr-name"),
+        QCoreApplication::translate("main", "Name of the BPM extended attribute (default: %1).")
+            .arg(QStringLiteral("user.bpm")),
+        QStringLiteral("name"),
+        QStringLiteral("user.bpm"));
+    QCommandLineOption outputOpt(
+        QStringLiteral("output"),
+        QCoreApplication::translate(
+            "main",
+            "Print one record per file with stage timings instead of text: json, jsonl or csv."),
+        QStringLiteral("format"));
+    QCommandLineOption profileOpt(
+        QStringLiteral("profile"),
+        QCoreApplication::translate(
+            "main",
+            "Print latency percentiles per stage, throughput and peak memory use on exit."));
+    QCommandLineOption traceOpt(
+        QStringLiteral("trace"),
+        QCoreApplication::translate(
+            "main", "Write the spans of each file to a Chrome Trace Event file on exit."),
+        QStringLiteral("file"));
+    QCommandLineOption candidatesOpt(
+        QStringLiteral("candidates"),
+        QCoreApplication::translate("main", "Print the most likely tempos after each BPM."));
+    QCommandLineOption dedupeOpt(
+        QStringLiteral("dedupe"),
+        QCoreApplication::translate(
+            "main",
+            "Detect files with the same audio once, comparing a hash of their compressed audio. "
+            "Hard links are always detected once."));
     QCommandLineOption formatOpt({QStringLiteral("f"), QStringLiteral("format")},
                                  QCoreApplication::translate("main", "Set BPM format."),
                                  QStringLiteral("format"),
                                  QStringLiteral("0.00"));
 
+    parser.addOption(cacheHashOpt);
+    parser.addOption(candidatesOpt);
     parser.addOption(consoleOpt);
+    parser.addOption(convergeOpt);
+    parser.addOption(convergeToleranceOpt);
+    parser.addOption(convergeWindowOpt);
+    parser.addOption(decoderOpt);
+    parser.addOption(dedupeOpt);
     parser.addOption(detectOpt);
+    parser.addOption(detectionChannelsOpt);
+    parser.addOption(detectionRateOpt);
+    parser.addOption(detectorOpt);
+    parser.addOption(envelopeCacheOpt);
     parser.addOption(formatOpt);
+    parser.addOption(indexOpt);
+    parser.addOption(jobsOpt);
     parser.addOption(limitOpt);
     parser.addOption(maxOpt);
     parser.addOption(minOpt);
+    parser.addOption(noCacheOpt);
     parser.addOption(noProgressOpt);
+    parser.addOption(outputOpt);
+    parser.addOption(profileOpt);
+    parser.addOption(rebuildCacheOpt);
+    parser.addOption(recursiveOpt);
     parser.addOption(removeOpt);
     parser.addOption(saveOpt);
+    parser.addOption(segmentLengthOpt);
+    parser.addOption(segmentsOpt);
+    parser.addOption(traceOpt);
+    parser.addOption(xattrOpt);
+    parser.addOption(xattrNameOpt);
     parser.addHelpOption();
     parser.addVersionOption();
     parser.addPositionalArgument(QStringLiteral("files"),
@@ -39,6 +39,13 @@ bpmtype stringToBpm(const QString &sBpm);
  */
 QString bpmToString(bpmtype dBpm, const QString &format = QStringLiteral("0.00"));
 
+/**
+ * Format a track length as minutes and seconds (`mm:ss`).
+ * @param length Length in milliseconds.
+ * @return Formatted length.
+ */
+QString formatLength(qint64 length);
+
 /**
  * Parse command line.
  *
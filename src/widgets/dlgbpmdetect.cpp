@@ -1,34 +1,36 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
+#include <QtCore/QFileInfo>
 #include <QtCore/QMimeData>
+#include <QtCore/QSortFilterProxyModel>
 #include <QtCore/QString>
 #include <QtGui/QCursor>
 #include <QtGui/QDropEvent>
 #include <QtWidgets/QFileDialog>
 #include <QtWidgets/QMenu>
 #include <QtWidgets/QMessageBox>
-#include <QtWidgets/QStyledItemDelegate>
 
 #include "debug.h"
+#include "directorywalker.h"
 #include "dlgbpmdetect.h"
 #include "dlgtestbpm.h"
 #include "ffmpegutils.h"
 #include "qdroplistview.h"
+#include "track/tagwriter.h"
 #include "track/track.h"
-#include "trackitem.h"
+#include "trackingester.h"
 #include "trackitemdelegate.h"
+#include "trackmodel.h"
 
-#define kProgressColumn 5
-
-const auto headerLabels = QStringList{QObject::tr("BPM", "BPM header label"),
-                                      QObject::tr("Saved", "Saved header label"),
-                                      QObject::tr("Artist", "Artist header label"),
-                                      QObject::tr("Title", "Title header label"),
-                                      QObject::tr("Length", "Length header label"),
-                                      QObject::tr("Progress", "Progress header label"),
-                                      QObject::tr("Filename", "Filename header label"),
-                                      QObject::tr("Last Error", "Last Error header label")};
+/** If @a bpm is within the BPM range (see Track::hasValidBpm()). */
+static bool isValidBpm(bpmtype bpm) {
+    return bpm >= Track::minimumBpm() && bpm <= Track::maximumBpm();
+}
 
-DlgBpmDetect::DlgBpmDetect(QWidget *parent) : QWidget(parent), columnMenu_(new QMenu(this)) {
+DlgBpmDetect::DlgBpmDetect(QWidget *parent)
+    : QWidget(parent), scheduler_(new DetectionScheduler(this)),
+      ingester_(new TrackIngester(this)), walker_(new DirectoryWalker(this)),
+      writer_(new TagWriter(this)), model_(new TrackModel(this)),
+      proxy_(new QSortFilterProxyModel(this)), columnMenu_(new QMenu(this)) {
     setupUi(this);
     loadSettings();
 
@@ -45,7 +47,12 @@ DlgBpmDetect::DlgBpmDetect(QWidget *parent) : QWidget(parent), columnMenu_(new Q
     listMenu_->addSeparator();
     listMenu_->addAction(tr("Save BPM"), this, &DlgBpmDetect::slotSaveBpm);
     listMenu_->addAction(tr("Clear BPM"), this, &DlgBpmDetect::slotClearBpm);
-    TrackList->setHeaderLabels(headerLabels);
+    // Writes are queued from the UI thread, which must not wait for the disk.
+    writer_->setCapacity(0);
+    proxy_->setSourceModel(model_);
+    proxy_->setSortRole(TrackModel::SortRole);
+    proxy_->setSortCaseSensitivity(Qt::CaseInsensitive);
+    TrackList->setModel(proxy_);
     TrackList->setColumnWidth(0, 60);
     TrackList->setColumnWidth(1, 25);
     TrackList->setColumnWidth(2, 200);
@@ -73,8 +80,8 @@ DlgBpmDetect::DlgBpmDetect(QWidget *parent) : QWidget(parent), columnMenu_(new Q
         action->setCheckable(true);
         action->setChecked(!TrackList->isColumnHidden(column));
     };
-    for (auto i = 1; i < headerLabels.size(); ++i) { // Skip BPM.
-        addColumnMenuAction(headerLabels[i], i);
+    for (auto i = 1; i < TrackModel::ColumnCount; ++i) { // Skip BPM.
+        addColumnMenuAction(model_->headerData(i, Qt::Horizontal).toString(), i);
     }
     TrackList->header()->setContextMenuPolicy(Qt::CustomContextMenu);
     TrackList->header()->setSectionsMovable(false);
@@ -83,46 +90,96 @@ DlgBpmDetect::DlgBpmDetect(QWidget *parent) : QWidget(parent), columnMenu_(new Q
         columnMenu_->popup(TrackList->header()->mapToGlobal(pos));
     });
     // LCOV_EXCL_STOP
-    const auto delegate = new TrackItemDelegate(this);
-    connect(delegate, &TrackItemDelegate::editingStarted, [this](const QModelIndex &index) {
-        // LCOV_EXCL_START
-        qCDebug(gLogBpmDetect) << "Editing started";
-        editing_ = true;
-        editingIndex_ = index;
-    });
-    // LCOV_EXCL_STOP
-    TrackList->setItemDelegate(delegate);
-    // ::itemChanged() gets triggered on first insertion before user edits anything, so the editing_
-    // flag is used to make sure that only user edits are processed.
-    connect(delegate, &TrackItemDelegate::closeEditor, [this]() {
-        // LCOV_EXCL_START
-        if (editingIndex_.column() != 0 || !editing_) {
-            qCDebug(gLogBpmDetect)
-                << "closeEditor called for column" << editingIndex_.column() << ", ignored.";
-            return;
+    TrackList->setItemDelegate(new TrackItemDelegate(this));
+    connect(model_, &TrackModel::bpmEdited, this, [this](int row) {
+        qCDebug(gLogBpmDetect) << "BPM edited for track" << model_->entry(row).fileName;
+        model_->setLastError(row, QStringLiteral(""));
+        const auto bpm = Track::correctBpm(model_->entry(row).bpm);
+        model_->setBpm(row, bpm);
+        if (chbSave->isChecked() && isValidBpm(bpm)) {
+            saveBpm(row);
         }
-        auto trackItem = static_cast<TrackItem *>(TrackList->topLevelItem(editingIndex_.row()));
-        if (!trackItem) {
-            return;
+    });
+
+    connect(btnStart, &QPushButton::clicked, this, &DlgBpmDetect::slotStartStop);
+    connect(cbDetector, &QComboBox::currentIndexChanged, [](int index) {
+        Track::setDetectorType(static_cast<Track::DetectorType>(index));
+    });
+
+    btnCancelAdd->hide();
+    connect(btnCancelAdd, &QPushButton::clicked, this, &DlgBpmDetect::slotCancelAdd);
+    connect(ingester_, &TrackIngester::batchReady, model_, &TrackModel::append);
+    connect(ingester_, &TrackIngester::progress, this, [this](qint64 probed, qint64 queued) {
+        TotalProgress->setMaximum(static_cast<int>(queued));
+        TotalProgress->setValue(static_cast<int>(probed));
+        const auto elapsed = ingestTimer_.elapsed();
+        lblCurrentTrack->setText(tr("Adding files: %1 of %2 (%3 files/s)")
+                                     .arg(probed)
+                                     .arg(queued)
+                                     .arg(elapsed > 0 ? probed * 1000 / elapsed : 0));
+    });
+    connect(ingester_, &TrackIngester::finished, this, [this]() {
+        if (!walker_->isRunning()) {
+            finishAdding();
         }
-        trackItem->resetLastError();
-        trackItem->setText(1, QStringLiteral(""));
-        trackItem->track()->setBpm(Track::correctBpm(trackItem->text(0).toDouble()));
-        trackItem->setText(0, trackItem->track()->formatted());
-        if (chbSave->isChecked() && trackItem->track()->hasValidBpm()) {
-            trackItem->track()->saveBpm();
+    });
+    connect(walker_, &DirectoryWalker::filesFound, this, [this](const QStringList &files) {
+        slotAddFiles(files);
+    });
+    connect(walker_, &DirectoryWalker::finished, this, [this]() {
+        if (!ingester_->isRunning()) {
+            finishAdding();
         }
-        editing_ = false;
-        trackItem->refreshSavedBpmIndicator();
-        qCDebug(gLogBpmDetect) << "Editing finished";
-        // LCOV_EXCL_STOP
     });
 
-    connect(btnStart, &QPushButton::clicked, this, &DlgBpmDetect::slotStartStop);
+    connect(scheduler_, &DetectionScheduler::jobStarted, this, [this](int index) {
+        const auto row = runRows_.at(index);
+        model_->setLastError(row, QStringLiteral(""));
+        model_->setProgress(row, 0);
+    });
+    connect(scheduler_,
+            &DetectionScheduler::jobProgress,
+            this,
+            [this](int index, qint64 pos, qint64 length) {
+                if (length > 0) {
+                    model_->setProgress(runRows_.at(index), static_cast<int>(pos * 100 / length));
+                }
+            });
+    connect(scheduler_, &DetectionScheduler::jobBpm, this, [this](int index, bpmtype bpm) {
+        const auto row = runRows_.at(index);
+        qCDebug(gLogBpmDetect) << "Received BPM for track" << model_->entry(row).fileName;
+        model_->setBpm(row, bpm);
+        if (chbSave->isChecked()) {
+            saveBpm(row);
+        }
+    });
+    connect(scheduler_, &DetectionScheduler::jobFinished, this, [this](int index) {
+        model_->setProgress(runRows_.at(index), -1);
+        TotalProgress->setValue(TotalProgress->maximum() - --pendingTracks_);
+    });
+    connect(scheduler_, &DetectionScheduler::finished, this, [this]() {
+        qCDebug(gLogBpmDetect) << "No more pending tracks, stopping.";
+        slotStop();
+    });
+    connect(writer_,
+            &TagWriter::written,
+            this,
+            [this](const QString &fileName, const QString &bpm, const TagWriteResult &result) {
+                // Rows may have moved or been removed since the write was queued.
+                for (const auto row : model_->rowsOf(fileName)) {
+                    model_->setSaved(row, bpm.isEmpty() ? !result.ok : result.ok);
+                    model_->setLastError(row, result.error);
+                }
+            });
+    connect(writer_, &TagWriter::drained, this, [this]() {
+        if (!scheduler_->isRunning()) {
+            showWriteSummary();
+        }
+    });
 }
 
 DlgBpmDetect::~DlgBpmDetect() {
-    if (innerEventLoop_ && innerEventLoop_->isRunning()) {
+    if (scheduler_->isRunning()) {
         // LCOV_EXCL_START
         slotStop();
         // LCOV_EXCL_STOP
@@ -149,12 +206,19 @@ void DlgBpmDetect::loadSettings() {
     auto recentPath = settings_.value(QStringLiteral("RecentPath"), QStringLiteral("")).toString();
     auto minBPM = settings_.value(QStringLiteral("MinBPM"), 80).toInt();
     auto maxBPM = settings_.value(QStringLiteral("MaxBPM"), 190).toInt();
+    auto detector =
+        settings_.value(QStringLiteral("Detector"), static_cast<int>(Track::detectorType()))
+            .toInt();
     chbSkipScanned->setChecked(skip);
     chbSave->setChecked(save);
     auto idx = cbFormat->findText(format);
     if (idx >= 0) {
         cbFormat->setCurrentIndex(idx);
     }
+    if (detector >= 0 && detector < cbDetector->count()) {
+        cbDetector->setCurrentIndex(detector);
+        Track::setDetectorType(static_cast<Track::DetectorType>(detector));
+    }
     setRecentPath(recentPath);
     spMin->setValue(minBPM);
     spMax->setValue(maxBPM);
@@ -171,6 +235,7 @@ void DlgBpmDetect::saveSettings() {
     settings.setValue(QStringLiteral("RecentPath"), recentPath());
     settings.setValue(QStringLiteral("MinBPM"), spMin->value());
     settings.setValue(QStringLiteral("MaxBPM"), spMax->value());
+    settings.setValue(QStringLiteral("Detector"), cbDetector->currentIndex());
     settings.setValue(QStringLiteral("Geometry"), saveGeometry());
     settings.setValue(QStringLiteral("Position"), pos());
     settings.setValue(QStringLiteral("Size"), size());
@@ -179,6 +244,21 @@ void DlgBpmDetect::saveSettings() {
     settings.sync();
 }
 
+void DlgBpmDetect::saveBpm(int row) {
+    const auto &entry = model_->entry(row);
+    writer_->enqueue({entry.fileName, bpmToString(entry.bpm, cbFormat->currentText()), {}});
+}
+
+void DlgBpmDetect::showWriteSummary() {
+    const auto summary = writer_->summary();
+    if (summary.written + summary.failed == 0) {
+        return;
+    }
+    lblCurrentTrack->setText(
+        tr("Saved %1 tags (%2 failed).").arg(summary.written).arg(summary.failed));
+    writer_->resetSummary();
+}
+
 void DlgBpmDetect::enableControls(bool enable) {
     btnAddFiles->setEnabled(enable);
     btnAddDir->setEnabled(enable);
@@ -186,8 +266,11 @@ void DlgBpmDetect::enableControls(bool enable) {
     btnClearList->setEnabled(enable);
     TrackList->setEnabled(enable);
     cbFormat->setEnabled(enable);
+    cbDetector->setEnabled(enable);
     spMin->setEnabled(enable);
     spMax->setEnabled(enable);
+    // Keeps rows from moving (and the proxy from re-sorting) as results come in.
+    proxy_->setDynamicSortFilter(enable);
 
     if (enable) {
         btnStart->setText(tr("St&art"));
@@ -205,7 +288,7 @@ void DlgBpmDetect::enableControls(bool enable) {
 }
 
 void DlgBpmDetect::slotStartStop() {
-    if (innerEventLoop_ && innerEventLoop_->isRunning()) {
+    if (scheduler_->isRunning()) {
         // LCOV_EXCL_START
         Q_ASSERT_X(btnStart->text() == tr("Stop"), "slotStartStop", "Button text should be 'Stop'");
         slotStop();
@@ -218,138 +301,93 @@ void DlgBpmDetect::slotStartStop() {
 }
 
 void DlgBpmDetect::slotStart() {
-    if ((innerEventLoop_ && innerEventLoop_->isRunning()) || !TrackList->topLevelItemCount()) {
+    if (scheduler_->isRunning() || isAdding() || !model_->rowCount()) {
         return;
     }
     enableControls(false);
-    pendingTracks_ = TrackList->topLevelItemCount();
-    QList<TrackItem *> items;
-    for (auto i = 0; i < TrackList->topLevelItemCount(); ++i) {
-        auto item = static_cast<TrackItem *>(TrackList->topLevelItem(i));
-        if (chbSkipScanned->isChecked() && item->track()->hasValidBpm()) {
-            --pendingTracks_;
+    runRows_.clear();
+    QList<DetectionScheduler::Job> jobs;
+    for (auto row = 0; row < model_->rowCount(); ++row) {
+        const auto &entry = model_->entry(row);
+        if (chbSkipScanned->isChecked() && isValidBpm(entry.bpm)) {
             continue;
         }
-        items.append(item);
+        runRows_.append(row);
+        jobs.append({entry.fileName, entry.length, entry.saved ? entry.bpm : 0});
     }
+    pendingTracks_ = static_cast<int>(jobs.size());
     if (!pendingTracks_) {
         enableControls(true);
         return;
     }
     TotalProgress->setMaximum(pendingTracks_);
     TotalProgress->setValue(0);
-    for (const auto &item : items) {
-        innerEventLoop_ = new QEventLoop(this);
-        item->resetLastError();
-        item->progressBar()->setValue(0);
-        item->progressBar()->setTextVisible(true);
-        item->track()->setDetector(detector_);
-        item->track()->detectBpm();
-        qCDebug(gLogBpmDetect) << "Starting inner loop. File:" << item->track()->fileName();
-        if (innerEventLoop_->exec(QEventLoop::ExcludeUserInputEvents |
-                                  QEventLoop::ExcludeSocketNotifiers)) {
-            // LCOV_EXCL_START
-            qCDebug(gLogBpmDetect) << "Inner loop exited with non-zero code. Stopping.";
-            break;
-            // LCOV_EXCL_STOP
-        }
-        qCDebug(gLogBpmDetect) << "Inner loop exited. File:" << item->track()->fileName();
-    }
+    scheduler_->start(jobs);
 }
 
 void DlgBpmDetect::slotStop() {
-    if (innerEventLoop_ && innerEventLoop_->isRunning()) {
+    if (scheduler_->isRunning()) {
         // LCOV_EXCL_START
-        qCDebug(gLogBpmDetect) << "Stopping inner loop.";
-        innerEventLoop_->exit(1);
+        qCDebug(gLogBpmDetect) << "Stopping detection.";
+        scheduler_->stop();
         // LCOV_EXCL_STOP
     }
     pendingTracks_ = 0;
+    runRows_.clear();
     lblCurrentTrack->setText(QStringLiteral(""));
-    for (auto i = 0; i < TrackList->topLevelItemCount(); ++i) {
-        auto item = static_cast<TrackItem *>(TrackList->topLevelItem(i));
-        item->progressBar()->setValue(0);
-        item->progressBar()->setTextVisible(false);
-    }
+    model_->clearProgress();
     enableControls(true);
+    // Otherwise shown when the last queued tag is written.
+    if (!writer_->isBusy()) {
+        showWriteSummary();
+    }
 }
 
 void DlgBpmDetect::slotAddFiles(const QStringList &files) {
-    if (innerEventLoop_ && innerEventLoop_->isRunning()) {
+    if (scheduler_->isRunning()) {
         // LCOV_EXCL_START
         return;
         // LCOV_EXCL_STOP
     }
-    QStringList filteredFiles;
-    for (const auto &file : files) {
-        qCDebug(gLogBpmDetect) << "Checking file" << file;
-        if (!isDecodableFile(file)) {
-            qCDebug(gLogBpmDetect) << "File is not decodable, skipping:" << file;
-            continue;
-        }
-        filteredFiles << file;
+    if (files.isEmpty()) {
+        return;
     }
-    if (filteredFiles.size()) {
-        pendingTracks_ += static_cast<int>(filteredFiles.size());
-        TotalProgress->setMaximum(pendingTracks_);
+    startAdding();
+    ingester_->add(files);
+}
+
+void DlgBpmDetect::addDirectories(const QStringList &dirs) {
+    if (scheduler_->isRunning() || dirs.isEmpty()) {
+        return;
     }
-    auto i = 0;
-    for (const auto &fileName : filteredFiles) {
-        auto track = new Track(fileName, new QAudioDecoder(this), this);
-        auto item = new TrackItem(TrackList, track);
-        item->setFlags(item->flags() | Qt::ItemIsEnabled | Qt::ItemIsEditable);
-        auto progressBar = new QProgressBar(this);
-        progressBar->setMaximum(100);
-        progressBar->setMaximumHeight(15);
-        item->setProgressBar(progressBar);
-        TrackList->setItemWidget(item, kProgressColumn, progressBar);
-        connect(track, &Track::hasBpm, [item, this, track](bpmtype bpm) {
-            if (!innerEventLoop_ || !innerEventLoop_->isRunning()) {
-                // LCOV_EXCL_START
-                qCDebug(gLogBpmDetect)
-                    << "Loop is not running. Ignoring BPM for track" << track->fileName();
-                return;
-                // LCOV_EXCL_STOP
-            }
-            qCDebug(gLogBpmDetect) << "Received BPM for track" << track->fileName();
-            item->setText(0, QString::number(bpm, 'f', 2));
-            if (chbSave->isChecked()) {
-                item->track()->setFormat(cbFormat->currentText());
-                item->track()->saveBpm();
-                item->refreshSavedBpmIndicator();
-                item->setLastError(getLastError());
-            }
-        });
-        connect(track, &Track::finished, this, [track, this, progressBar]() {
-            progressBar->setValue(0);
-            progressBar->setTextVisible(false);
-            if (!innerEventLoop_ || !innerEventLoop_->isRunning()) {
-                // LCOV_EXCL_START
-                qCDebug(gLogBpmDetect)
-                    << "Loop not running. Ignoring finished signal for track" << track;
-                return;
-                // LCOV_EXCL_STOP
-            }
-            innerEventLoop_->quit();
-            if (--pendingTracks_ == 0) {
-                qCDebug(gLogBpmDetect) << "No more pending tracks, stopping.";
-                slotStop();
-            } else {
-                TotalProgress->setValue(TotalProgress->maximum() - pendingTracks_);
-            }
-        });
-        connect(track, &Track::progress, this, [this, progressBar](qint64 pos, qint64 length) {
-            if (length > 0 && innerEventLoop_ && innerEventLoop_->isRunning()) {
-                auto currentFilePercent =
-                    (static_cast<double>(pos) / static_cast<double>(length)) * 100;
-                progressBar->setValue(static_cast<int>(currentFilePercent));
-            }
-        });
-        lblCurrentTrack->setText(tr("Adding %1").arg(fileName));
-        TotalProgress->setValue(++i);
+    startAdding();
+    walker_->add(dirs);
+}
+
+void DlgBpmDetect::slotCancelAdd() {
+    walker_->cancel();
+    ingester_->cancel();
+    finishAdding();
+}
+
+bool DlgBpmDetect::isAdding() const {
+    return walker_->isRunning() || ingester_->isRunning();
+}
+
+void DlgBpmDetect::startAdding() {
+    if (isAdding()) {
+        return;
     }
+    ingestTimer_.start();
+    btnCancelAdd->show();
+    btnStart->setEnabled(false);
+}
+
+void DlgBpmDetect::finishAdding() {
+    btnCancelAdd->hide();
+    btnStart->setEnabled(true);
     lblCurrentTrack->setText(QStringLiteral(""));
-    auto itemCount = TrackList->topLevelItemCount();
+    auto itemCount = model_->rowCount();
     if (itemCount) {
         TotalProgress->setMaximum(itemCount * 100);
     } else {
@@ -359,45 +397,20 @@ void DlgBpmDetect::slotAddFiles(const QStringList &files) {
     TotalProgress->setValue(0);
 }
 
-QStringList DlgBpmDetect::filesFromDir(const QString &path) const {
-    QDir d(path), f(path);
-    QStringList files;
-    if (!d.exists(path)) {
-        return files;
+QList<int> DlgBpmDetect::selectedRows() const {
+    QList<int> rows;
+    for (const auto &index : TrackList->selectionModel()->selectedRows()) {
+        rows.append(proxy_->mapToSource(index).row());
     }
-    d.setFilter(QDir::Dirs | QDir::Hidden | QDir::NoSymLinks | QDir::NoDotAndDotDot);
-    f.setFilter(QDir::Files | QDir::Hidden | QDir::NoSymLinks);
-
-    auto dirs = d.entryList();
-    files = f.entryList();
-
-    for (const auto &currentDir : dirs) {
-        for (const auto &dirFile :
-             filesFromDir(d.absolutePath() + QStringLiteral("/") + currentDir)) {
-            files.append(currentDir + QStringLiteral("/") + dirFile);
-        }
-    }
-
-    return files;
+    return rows;
 }
 
 void DlgBpmDetect::slotClearTrackList() {
-    TrackList->clear();
+    model_->clear();
 }
 
 void DlgBpmDetect::slotClearDetected() {
-    for (auto i = 0; i < TrackList->topLevelItemCount(); ++i) {
-        auto item = static_cast<TrackItem *>(TrackList->topLevelItem(i));
-        if (!item) {
-            // LCOV_EXCL_START
-            break;
-            // LCOV_EXCL_STOP
-        }
-        if (item->track()->hasValidBpm()) {
-            delete item;
-            --i;
-        }
-    }
+    model_->removeIf([](const TrackModel::Entry &entry) { return isValidBpm(entry.bpm); });
 }
 
 void DlgBpmDetect::slotDropped(QDropEvent *e) {
@@ -414,27 +427,18 @@ void DlgBpmDetect::slotDropped(QDropEvent *e) {
     // LCOV_EXCL_STOP
     auto urllist = mdata->urls();
     e->accept();
-    QStringList files;
+    QStringList files, dirs;
     for (const auto &url : urllist) {
-        files << url.toLocalFile();
+        const auto path = url.toLocalFile();
+        (QFileInfo(path).isDir() ? dirs : files) << path;
     }
+    addDirectories(dirs);
     slotAddFiles(files);
 }
 
 void DlgBpmDetect::slotSaveBpm() {
-    auto items = TrackList->selectedItems();
-    if (!items.size()) {
-        return;
-    }
-
-    for (const auto qItem : items) {
-        auto item = static_cast<TrackItem *>(qItem);
-        auto track = item->track();
-        track->setBpm(item->text(0).toDouble());
-        track->setFormat(cbFormat->currentText());
-        track->saveBpm();
-        item->refreshSavedBpmIndicator();
-        item->setLastError(getLastError());
+    for (const auto row : selectedRows()) {
+        saveBpm(row);
     }
 }
 
@@ -446,8 +450,17 @@ QString DlgBpmDetect::recentPath() const {
     return recentPath_;
 }
 
-void DlgBpmDetect::setDetector(AbstractBpmDetector *detector) {
-    detector_ = detector;
+void DlgBpmDetect::setDetectorFactory(const DetectionScheduler::DetectorFactory &factory) {
+    scheduler_->setDetectorFactory(factory);
+}
+
+void DlgBpmDetect::setDetectorType(Track::DetectorType type) {
+    cbDetector->setCurrentIndex(static_cast<int>(type));
+    Track::setDetectorType(type);
+}
+
+void DlgBpmDetect::setMaximumJobs(int count) {
+    scheduler_->setMaximumThreads(count);
 }
 
 // LCOV_EXCL_START
@@ -466,27 +479,10 @@ void DlgBpmDetect::slotAddFiles() {
 }
 
 void DlgBpmDetect::slotAddDir() {
-    auto path = QFileDialog::getExistingDirectory(this, tr("Add directory"), recentPath());
-
-    if (path != nullptr) {
+    const auto path = QFileDialog::getExistingDirectory(this, tr("Add directory"), recentPath());
+    if (!path.isEmpty()) {
         setRecentPath(path);
-        QStringList list;
-        list = filesFromDir(path);
-        if (!list.size()) {
-            return;
-        }
-
-        if (!path.endsWith(QStringLiteral("/"))) {
-            path.append(QStringLiteral("/"));
-        }
-
-        QStringList files;
-        for (auto i = 0; i < list.size(); i++) {
-            auto fileName = path + list[i];
-            files.append(fileName);
-        }
-
-        slotAddFiles(files);
+        addDirectories({path});
     }
 }
 
@@ -495,8 +491,8 @@ void DlgBpmDetect::slotListMenuPopup(const QPoint &) {
 }
 
 void DlgBpmDetect::slotClearBpm() {
-    auto items = TrackList->selectedItems();
-    if (!items.size()) {
+    const auto rows = selectedRows();
+    if (!rows.size()) {
         return;
     }
 
@@ -509,35 +505,32 @@ void DlgBpmDetect::slotClearBpm() {
         return;
     }
 
-    for (const auto qItem : items) {
-        auto item = static_cast<TrackItem *>(qItem);
-        item->track()->clearBpm();
-        item->setText(0, QStringLiteral("000.00"));
-        item->refreshSavedBpmIndicator();
-        item->setLastError(getLastError());
+    for (const auto row : rows) {
+        model_->setBpm(row, 0);
+        // Queued like saves so that it is not overtaken by a pending save of the same file.
+        writer_->enqueue({model_->entry(row).fileName, QString(), {}});
     }
 }
 
 void DlgBpmDetect::slotTestBpm() {
-    auto item = static_cast<TrackItem *>(TrackList->currentItem());
-    if (!item || !item->track()->hasValidBpm()) {
+    const auto current = TrackList->currentIndex();
+    if (!current.isValid()) {
+        return;
+    }
+    const auto row = proxy_->mapToSource(current).row();
+    const auto &entry = model_->entry(row);
+    if (!isValidBpm(entry.bpm)) {
         return;
     }
     DlgTestBpm testBpmDialog(
-        item->track()->fileName(),
-        item->track()->bpm(),
-        new DlgTestBpmPlayer(item->track()->fileName(), 4, item->track()->bpm(), 0, this));
-    connect(&testBpmDialog, &DlgTestBpm::newBpmOnClose, [this, item](bpmtype newBpm) {
-        const auto oldBpm = item->track()->bpm();
-        item->track()->setBpm(Track::correctBpm(newBpm));
-        if (item->track()->hasValidBpm()) {
-            item->setText(0, item->track()->formatted());
+        entry.fileName, entry.bpm, new DlgTestBpmPlayer(entry.fileName, 4, entry.bpm, 0, this));
+    connect(&testBpmDialog, &DlgTestBpm::newBpmOnClose, [this, row](bpmtype newBpm) {
+        const auto bpm = Track::correctBpm(newBpm);
+        if (isValidBpm(bpm)) {
+            model_->setBpm(row, bpm);
             if (chbSave->isChecked()) {
-                item->track()->saveBpm();
+                saveBpm(row);
             }
-            item->refreshSavedBpmIndicator();
-        } else {
-            item->track()->setBpm(oldBpm);
         }
     });
     testBpmDialog.exec();
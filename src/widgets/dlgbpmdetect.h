@@ -4,17 +4,21 @@
 
 #include <BPMDetect.h>
 #include <QtCore/QAtomicInt>
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QSettings>
 
+#include "track/detectionscheduler.h"
+#include "track/track.h"
 #include "ui_dlgbpmdetect.h"
 #include "utils.h"
 
-class AbstractBpmDetector;
 class QDropEvent;
-class QEventLoop;
 class QMenu;
-class Track;
-class TrackItem;
+class DirectoryWalker;
+class QSortFilterProxyModel;
+class TagWriter;
+class TrackIngester;
+class TrackModel;
 
 /** Main dialog of the application. */
 class DlgBpmDetect : public QWidget, public Ui_DlgBpmDetect {
@@ -28,11 +32,27 @@ public:
      */
     DlgBpmDetect(QWidget *parent = nullptr);
     ~DlgBpmDetect() override;
-    /** Set the BPM detector. */
-    void setDetector(AbstractBpmDetector *detector);
+    /**
+     * Set the function used to create a detector for each worker thread. The default creates the
+     * type selected in the dialog (see Track::createDetector()).
+     */
+    void setDetectorFactory(const DetectionScheduler::DetectorFactory &factory);
+    /**
+     * Select the detector type, overriding the saved setting.
+     * @param type Detector type.
+     */
+    void setDetectorType(Track::DetectorType type);
+    /**
+     * Set how many files are detected at the same time.
+     * @param count Number of worker threads. Values below 1 use the number of CPUs.
+     */
+    void setMaximumJobs(int count);
 
 public Q_SLOTS:
-    /** Slot to add files. */
+    /**
+     * Slot to add files. Files are probed in the background and appear in the list in batches.
+     * @param files Paths to the files.
+     */
     void slotAddFiles(const QStringList &files);
 
 protected Q_SLOTS:
@@ -42,6 +62,8 @@ protected Q_SLOTS:
     void slotAddDir();
     /** Slot to add files via file dialog. */
     void slotAddFiles();
+    /** Slot to stop adding files. Files already probed stay in the list. */
+    void slotCancelAdd();
     /** Slot to start BPM detection. */
     void slotStart();
     /** Slot to stop BPM detection. */
@@ -73,20 +95,35 @@ protected Q_SLOTS:
 
 private:
     QString recentPath() const;
-    QStringList filesFromDir(const QString &path) const;
+    QList<int> selectedRows() const;
+    /** Walk @a dirs in the background, adding the audio files found as with slotAddFiles(). */
+    void addDirectories(const QStringList &dirs);
     void enableControls(bool enable);
+    void finishAdding();
+    /** If directories are being walked or files probed. */
+    bool isAdding() const;
     void loadSettings();
+    /** Queue the BPM of @a row to be saved. The row is updated when the tag is written. */
+    void saveBpm(int row);
     void saveSettings();
     void setRecentPath(const QString &path);
+    /** Show how many tags were saved since the last summary, if any. */
+    void showWriteSummary();
+    void startAdding();
 
-    AbstractBpmDetector *detector_ = nullptr;
+    DetectionScheduler *scheduler_ = nullptr;
+    TrackIngester *ingester_ = nullptr;
+    DirectoryWalker *walker_ = nullptr;
+    TagWriter *writer_ = nullptr;
+    TrackModel *model_ = nullptr;
+    QSortFilterProxyModel *proxy_ = nullptr;
     QAtomicInt pendingTracks_ = 0;
-    QEventLoop *innerEventLoop_ = nullptr;
+    QElapsedTimer ingestTimer_;
+    /** Rows of #model_ for the jobs of the current run, by job index. */
+    QList<int> runRows_;
     QMenu *columnMenu_ = nullptr;
     QMenu *listMenu_ = nullptr;
     QSettings settings_;
     QString recentPath_;
     QStringList displayedColumns_;
-    bool editing_ = false;
-    QModelIndex editingIndex_;
 };
@@ -1,4 +1,8 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
+#include <algorithm>
+#include <functional>
+
+#include <QtCore/QItemSelectionModel>
 #include <QtGui/QDragEnterEvent>
 #include <QtGui/QDragLeaveEvent>
 #include <QtGui/QDragMoveEvent>
@@ -7,18 +11,35 @@
 
 #include "qdroplistview.h"
 
-QDropListView::QDropListView(QWidget *parent) : QTreeWidget(parent) {
+QDropListView::QDropListView(QWidget *parent) : QTreeView(parent) {
     setAcceptDrops(true);
     setAllColumnsShowFocus(true);
+    setRootIsDecorated(false);
+    // Lets the view lay out rows without asking for the size of each one.
+    setUniformRowHeights(true);
 }
 
 QDropListView::~QDropListView() {
 }
 
 void QDropListView::slotRemoveSelected() {
-    auto items = selectedItems();
-    for (auto i = 0; i < items.size(); ++i) {
-        delete items.at(i);
+    if (!selectionModel()) {
+        return;
+    }
+    QList<int> rows;
+    for (const auto &index : selectionModel()->selectedRows()) {
+        rows.append(index.row());
+    }
+    std::sort(rows.begin(), rows.end(), std::greater<int>());
+    // Remove from the bottom up, a block of adjacent rows at a time.
+    for (qsizetype i = 0; i < rows.size();) {
+        auto first = rows.at(i);
+        auto count = 1;
+        while (++i < rows.size() && rows.at(i) == first - 1) {
+            --first;
+            ++count;
+        }
+        model()->removeRows(first, count);
     }
 }
 
@@ -26,13 +47,13 @@ void QDropListView::keyPressEvent(QKeyEvent *e) {
     if (e->key() == Qt::Key_Delete) {
         slotRemoveSelected();
     } else {
-        QTreeWidget::keyPressEvent(e);
+        QTreeView::keyPressEvent(e);
     }
     emit keyPress(e);
 }
 
 void QDropListView::keyReleaseEvent(QKeyEvent *e) {
-    QTreeWidget::keyReleaseEvent(e);
+    QTreeView::keyReleaseEvent(e);
     emit keyRelease(e);
 }
 
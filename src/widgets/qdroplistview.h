@@ -2,7 +2,7 @@
 /** @file */
 #pragma once
 
-#include <QtWidgets/QTreeWidget>
+#include <QtWidgets/QTreeView>
 
 class QDragEnterEvent;
 class QDragLeaveEvent;
@@ -11,7 +11,7 @@ class QDropEvent;
 class QKeyEvent;
 
 /** Custom widget to allow for dropping files. */
-class QDropListView : public QTreeWidget {
+class QDropListView : public QTreeView {
     Q_OBJECT
 #ifdef TESTING
     friend class QDropListViewTest;
@@ -37,7 +37,7 @@ public:
     Q_SIGNAL void drop(QDropEvent *e);
 
 public Q_SLOTS:
-    /** Remove selected items from list. */
+    /** Remove the selected rows from the model. */
     void slotRemoveSelected();
 
 protected:
@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include "debug.h"
+#include "ffmpegutils.h"
+#include "track/track.h"
+#include "trackingester.h"
+
+/** Session of an ingestion. */
+struct TrackIngester::Ingestion : Session {
+    /** Probed files waiting to be published. */
+    QList<TrackModel::Entry> ready;
+    /** Files added since ingestion started. */
+    qint64 added = 0;
+    qint64 probed = 0;
+};
+
+TrackIngester::TrackIngester(QObject *parent) : BatchWorkerPool(parent) {
+    setThreadName(QStringLiteral("ingest"));
+}
+
+TrackIngester::~TrackIngester() {
+    cancelAndWait();
+}
+
+std::shared_ptr<BatchWorkerPool::Session> TrackIngester::createSession() const {
+    return std::make_shared<Ingestion>();
+}
+
+void TrackIngester::enqueue(Session &session, const QStringList &paths) {
+    BatchWorkerPool::enqueue(session, paths);
+    static_cast<Ingestion &>(session).added += paths.size();
+}
+
+void TrackIngester::publish() {
+    const auto ingestion = session<Ingestion>();
+    QList<TrackModel::Entry> entries;
+    qint64 probed, added;
+    {
+        QMutexLocker locker(&ingestion->mutex);
+        entries.swap(ingestion->ready);
+        probed = ingestion->probed;
+        added = ingestion->added;
+    }
+    if (!entries.isEmpty()) {
+        emit batchReady(entries);
+    }
+    emit progress(probed, added);
+}
+
+void TrackIngester::runWorker(const std::shared_ptr<Session> &session) {
+    auto &ingestion = static_cast<Ingestion &>(*session);
+    while (true) {
+        QString fileName;
+        {
+            QMutexLocker locker(&ingestion.mutex);
+            if (ingestion.cancelled || ingestion.queue.isEmpty()) {
+                exitWorker(session);
+                return;
+            }
+            fileName = ingestion.queue.dequeue();
+        }
+        const auto probe = probeFile(fileName);
+        TrackModel::Entry entry;
+        if (probe.hasAudio) {
+            const Track track(fileName, probe, nullptr);
+            entry.fileName = fileName;
+            if (track.hostFileName() != fileName) {
+                entry.displayName = track.hostFileName();
+            }
+            entry.artist = track.artist();
+            entry.title = track.title();
+            entry.length = track.length();
+            entry.bpm = track.bpm();
+            entry.saved = track.hasSavedBpm();
+        } else {
+            qCDebug(gLogBpmDetect) << "File is not decodable, skipping:" << fileName;
+        }
+        QMutexLocker locker(&ingestion.mutex);
+        ++ingestion.probed;
+        if (probe.hasAudio) {
+            ingestion.ready.append(entry);
+        }
+    }
+}
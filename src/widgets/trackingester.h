@@ -0,0 +1,48 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/** @file */
+#pragma once
+
+#include "batchworkerpool.h"
+#include "trackmodel.h"
+
+/**
+ * Probes files for the track list on worker threads.
+ *
+ * Files passed to add() are queued and probed in parallel (see probeFile()). Files with audio are
+ * collected and published on the thread that owns the ingester in batches, at most once per
+ * batch interval, so adding thousands of files costs the GUI a few model insertions rather than
+ * one event per file. More files can be added while earlier ones are still being probed.
+ */
+class TrackIngester : public BatchWorkerPool {
+    Q_OBJECT
+public:
+    /**
+     * Constructor.
+     * @param parent Parent object.
+     */
+    explicit TrackIngester(QObject *parent = nullptr);
+    /** Cancels ingestion and waits for the worker threads to exit. */
+    ~TrackIngester() override;
+
+Q_SIGNALS:
+    /**
+     * Files with audio that have been probed since the last batch.
+     * @param entries Rows for the track list, in no particular order.
+     */
+    void batchReady(const QList<TrackModel::Entry> &entries);
+    /**
+     * Emitted with each batch.
+     * @param probed Number of files probed so far, with or without audio.
+     * @param queued Number of files added since ingestion started.
+     */
+    void progress(qint64 probed, qint64 queued);
+
+protected:
+    std::shared_ptr<Session> createSession() const override;
+    void enqueue(Session &session, const QStringList &paths) override;
+    void runWorker(const std::shared_ptr<Session> &session) override;
+    void publish() override;
+
+private:
+    struct Ingestion;
+};
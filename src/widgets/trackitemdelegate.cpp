@@ -1,6 +1,13 @@
+#include <QtWidgets/QApplication>
 #include <QtWidgets/QLineEdit>
+#include <QtWidgets/QStyle>
+#include <QtWidgets/QStyleOption>
 
 #include "trackitemdelegate.h"
+#include "trackmodel.h"
+
+/** Height of the painted progress bars, like the widgets they replace. */
+static constexpr int kProgressBarHeight = 15;
 
 TrackItemDelegate::TrackItemDelegate(QObject *parent) : QStyledItemDelegate(parent) {
 }
@@ -20,3 +27,35 @@ QWidget *TrackItemDelegate::createEditor(QWidget *parent,
     emit editingStarted(index);
     return editor;
 }
+
+void TrackItemDelegate::paint(QPainter *painter,
+                              const QStyleOptionViewItem &option,
+                              const QModelIndex &index) const {
+    const auto progress = index.data(TrackModel::ProgressRole);
+    if (!progress.isValid()) {
+        QStyledItemDelegate::paint(painter, option, index);
+        return;
+    }
+    QStyleOptionViewItem itemOption(option);
+    initStyleOption(&itemOption, index);
+    const auto style = option.widget ? option.widget->style() : QApplication::style();
+    // Background and selection like the other cells.
+    style->drawPrimitive(QStyle::PE_PanelItemViewItem, &itemOption, painter, option.widget);
+    const auto percent = progress.toInt();
+    QStyleOptionProgressBar bar;
+    bar.direction = option.direction;
+    bar.fontMetrics = option.fontMetrics;
+    bar.palette = option.palette;
+    bar.state = option.state | QStyle::State_Horizontal;
+    bar.rect = option.rect;
+    if (bar.rect.height() > kProgressBarHeight) {
+        bar.rect.setTop(bar.rect.center().y() - kProgressBarHeight / 2);
+        bar.rect.setHeight(kProgressBarHeight);
+    }
+    bar.minimum = 0;
+    bar.maximum = 100;
+    bar.progress = qMax(0, percent);
+    bar.text = QStringLiteral("%1%").arg(bar.progress);
+    bar.textVisible = percent >= 0;
+    style->drawControl(QStyle::CE_ProgressBar, &bar, painter, option.widget);
+}
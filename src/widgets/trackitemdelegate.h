@@ -8,6 +8,10 @@ public:
     virtual QWidget *createEditor(QWidget *parent,
                                   const QStyleOptionViewItem &option,
                                   const QModelIndex &index) const override;
+    /** Paints a progress bar for cells with TrackModel::ProgressRole data. */
+    void paint(QPainter *painter,
+               const QStyleOptionViewItem &option,
+               const QModelIndex &index) const override;
 
 Q_SIGNALS:
     /** Event for when editing began. */
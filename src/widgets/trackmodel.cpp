@@ -0,0 +1,217 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include "trackmodel.h"
+
+TrackModel::TrackModel(QObject *parent) : QAbstractTableModel(parent) {
+}
+
+TrackModel::~TrackModel() {
+}
+
+void TrackModel::append(const QList<Entry> &entries) {
+    if (entries.isEmpty()) {
+        return;
+    }
+    const auto first = static_cast<int>(entries_.size());
+    beginInsertRows(QModelIndex(), first, first + static_cast<int>(entries.size()) - 1);
+    entries_.append(entries);
+    if (!rowsStale_) {
+        for (auto i = 0; i < entries.size(); ++i) {
+            rows_[entries.at(i).fileName] << first + i;
+        }
+    }
+    endInsertRows();
+}
+
+const TrackModel::Entry &TrackModel::entry(int row) const {
+    return entries_.at(row);
+}
+
+QList<int> TrackModel::rowsOf(const QString &fileName) const {
+    if (rowsStale_) {
+        for (auto row = 0; row < entries_.size(); ++row) {
+            rows_[entries_.at(row).fileName] << row;
+        }
+        rowsStale_ = false;
+    }
+    return rows_.value(fileName);
+}
+
+void TrackModel::setBpm(int row, bpmtype bpm) {
+    entries_[row].bpm = bpm;
+    emitChanged(row, BpmColumn);
+}
+
+void TrackModel::setSaved(int row, bool saved) {
+    entries_[row].saved = saved;
+    emitChanged(row, SavedColumn);
+}
+
+void TrackModel::setProgress(int row, int percent) {
+    const auto value = static_cast<qint8>(qBound(-1, percent, 100));
+    if (entries_.at(row).progress == value) {
+        return;
+    }
+    entries_[row].progress = value;
+    emitChanged(row, ProgressColumn);
+}
+
+void TrackModel::clearProgress() {
+    if (entries_.isEmpty()) {
+        return;
+    }
+    for (auto &entry : entries_) {
+        entry.progress = -1;
+    }
+    // One signal for the whole column instead of one per row.
+    emit dataChanged(index(0, ProgressColumn),
+                     index(static_cast<int>(entries_.size()) - 1, ProgressColumn));
+}
+
+void TrackModel::setLastError(int row, const QString &error) {
+    entries_[row].lastError = error;
+    emitChanged(row, LastErrorColumn);
+}
+
+void TrackModel::clear() {
+    beginResetModel();
+    entries_.clear();
+    rows_.clear();
+    rowsStale_ = false;
+    endResetModel();
+}
+
+int TrackModel::removeIf(const std::function<bool(const Entry &)> &predicate) {
+    auto removed = 0;
+    for (auto last = static_cast<int>(entries_.size()) - 1; last >= 0; --last) {
+        if (!predicate(entries_.at(last))) {
+            continue;
+        }
+        auto first = last;
+        while (first > 0 && predicate(entries_.at(first - 1))) {
+            --first;
+        }
+        removeRows(first, last - first + 1);
+        removed += last - first + 1;
+        last = first;
+    }
+    return removed;
+}
+
+int TrackModel::rowCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : static_cast<int>(entries_.size());
+}
+
+int TrackModel::columnCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : ColumnCount;
+}
+
+QVariant TrackModel::data(const QModelIndex &index, int role) const {
+    if (!checkIndex(index, CheckIndexOption::IndexIsValid)) {
+        return {};
+    }
+    const auto &entry = entries_.at(index.row());
+    if (role == ProgressRole) {
+        return index.column() == ProgressColumn ? QVariant(static_cast<int>(entry.progress))
+                                                : QVariant();
+    }
+    if (role == SortRole) {
+        switch (index.column()) {
+        case BpmColumn:
+            return entry.bpm;
+        case SavedColumn:
+            return entry.saved;
+        case LengthColumn:
+            return entry.length;
+        case ProgressColumn:
+            return static_cast<int>(entry.progress);
+        default:
+            return data(index, Qt::DisplayRole);
+        }
+    }
+    if (role == Qt::EditRole && index.column() == BpmColumn) {
+        return bpmToString(entry.bpm);
+    }
+    if (role != Qt::DisplayRole) {
+        return {};
+    }
+    switch (index.column()) {
+    case BpmColumn:
+        return bpmToString(entry.bpm, QStringLiteral("000.00"));
+    case SavedColumn:
+        return entry.saved ? QStringLiteral("✅") : QStringLiteral("❌");
+    case ArtistColumn:
+        return entry.artist;
+    case TitleColumn:
+        return entry.title;
+    case LengthColumn:
+        return formatLength(entry.length);
+    case FileNameColumn:
+        return entry.displayName.isEmpty() ? entry.fileName : entry.displayName;
+    case LastErrorColumn:
+        return entry.lastError;
+    default:
+        return {};
+    }
+}
+
+QVariant TrackModel::headerData(int section, Qt::Orientation orientation, int role) const {
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole) {
+        return QAbstractTableModel::headerData(section, orientation, role);
+    }
+    switch (section) {
+    case BpmColumn:
+        return tr("BPM", "BPM header label");
+    case SavedColumn:
+        return tr("Saved", "Saved header label");
+    case ArtistColumn:
+        return tr("Artist", "Artist header label");
+    case TitleColumn:
+        return tr("Title", "Title header label");
+    case LengthColumn:
+        return tr("Length", "Length header label");
+    case ProgressColumn:
+        return tr("Progress", "Progress header label");
+    case FileNameColumn:
+        return tr("Filename", "Filename header label");
+    case LastErrorColumn:
+        return tr("Last Error", "Last Error header label");
+    default:
+        return {};
+    }
+}
+
+Qt::ItemFlags TrackModel::flags(const QModelIndex &index) const {
+    auto ret = QAbstractTableModel::flags(index);
+    if (index.isValid() && index.column() == BpmColumn) {
+        ret |= Qt::ItemIsEditable;
+    }
+    return ret;
+}
+
+bool TrackModel::setData(const QModelIndex &index, const QVariant &value, int role) {
+    if (role != Qt::EditRole || index.column() != BpmColumn ||
+        !checkIndex(index, CheckIndexOption::IndexIsValid)) {
+        return false;
+    }
+    setBpm(index.row(), value.toDouble());
+    emit bpmEdited(index.row());
+    return true;
+}
+
+bool TrackModel::removeRows(int row, int count, const QModelIndex &parent) {
+    if (parent.isValid() || row < 0 || count < 1 || row + count > entries_.size()) {
+        return false;
+    }
+    beginRemoveRows(parent, row, row + count - 1);
+    entries_.remove(row, count);
+    // Later rows move up, so the lookup is rebuilt once when next needed rather than per removal.
+    rows_.clear();
+    rowsStale_ = true;
+    endRemoveRows();
+    return true;
+}
+
+void TrackModel::emitChanged(int row, int column) {
+    const auto changed = index(row, column);
+    emit dataChanged(changed, changed);
+}
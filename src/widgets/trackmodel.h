@@ -0,0 +1,134 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/** @file */
+#pragma once
+
+#include <functional>
+
+#include <QtCore/QAbstractTableModel>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QString>
+
+#include "utils.h"
+
+/**
+ * Table of the tracks in the main dialog.
+ *
+ * Rows are plain values rather than Track objects or widgets, so large libraries only cost a few
+ * strings per file. Progress is exposed through ProgressRole for TrackItemDelegate to paint.
+ */
+class TrackModel : public QAbstractTableModel {
+    Q_OBJECT
+public:
+    /** Columns of the table. */
+    enum Column {
+        BpmColumn,       //!< BPM, editable.
+        SavedColumn,     //!< If the BPM is saved in the file.
+        ArtistColumn,    //!< Artist tag.
+        TitleColumn,     //!< Title tag.
+        LengthColumn,    //!< Length as `mm:ss`.
+        ProgressColumn,  //!< Detection progress.
+        FileNameColumn,  //!< File name (host file name when sandboxed).
+        LastErrorColumn, //!< Last error saving or clearing the BPM.
+        ColumnCount,     //!< Number of columns.
+    };
+    /** Custom data roles. */
+    enum Role {
+        /**
+         * Detection progress in percent, or -1 if the track is not being detected. Only set for
+         * ProgressColumn.
+         */
+        ProgressRole = Qt::UserRole + 1,
+        /** Value to sort by: numbers for the numeric columns, strings for the others. */
+        SortRole,
+    };
+    /** One track. */
+    struct Entry {
+        /** Path to the file. */
+        QString fileName;
+        /** Name to display if different from @a fileName (see Track::hostFileName()). */
+        QString displayName;
+        /** Artist tag. */
+        QString artist;
+        /** Title tag. */
+        QString title;
+        /** Last error message. */
+        QString lastError;
+        /** Length in milliseconds. */
+        qint64 length = 0;
+        /** BPM, or 0 if not known. */
+        bpmtype bpm = 0;
+        /** Progress in percent, or -1 if not being detected. */
+        qint8 progress = -1;
+        /** If the BPM is saved in the file. */
+        bool saved = false;
+    };
+    /**
+     * Constructor.
+     * @param parent Parent object.
+     */
+    explicit TrackModel(QObject *parent = nullptr);
+    ~TrackModel() override;
+    /**
+     * Append tracks as a single insertion.
+     * @param entries Tracks to append.
+     */
+    void append(const QList<Entry> &entries);
+    /** Get the track in @a row. */
+    const Entry &entry(int row) const;
+    /**
+     * Get the rows of the tracks of a file.
+     * @param fileName Path to the file.
+     * @return Rows in ascending order, empty if the file is not in the model.
+     */
+    QList<int> rowsOf(const QString &fileName) const;
+    /** Set the BPM of the track in @a row. */
+    void setBpm(int row, bpmtype bpm);
+    /** Set if the BPM of the track in @a row is saved in the file. */
+    void setSaved(int row, bool saved);
+    /**
+     * Set the detection progress of the track in @a row.
+     * @param row Row.
+     * @param percent Progress in percent, or -1 if the track is not being detected.
+     */
+    void setProgress(int row, int percent);
+    /** Mark every track as not being detected. */
+    void clearProgress();
+    /** Set the last error message of the track in @a row. */
+    void setLastError(int row, const QString &error);
+    /** Remove all tracks. */
+    void clear();
+    /**
+     * Remove the tracks matching @a predicate. Adjacent rows are removed together.
+     * @param predicate Returns `true` for tracks to remove.
+     * @return Number of tracks removed.
+     */
+    int removeIf(const std::function<bool(const Entry &)> &predicate);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section,
+                        Qt::Orientation orientation,
+                        int role = Qt::DisplayRole) const override;
+    Qt::ItemFlags flags(const QModelIndex &index) const override;
+    bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole) override;
+    bool removeRows(int row, int count, const QModelIndex &parent = QModelIndex()) override;
+
+Q_SIGNALS:
+    /**
+     * Emitted when the BPM of a track has been edited in a view.
+     * @param row Row of the track.
+     */
+    void bpmEdited(int row);
+
+private:
+    void emitChanged(int row, int column);
+
+    QList<Entry> entries_;
+    /** Rows by file name. Rebuilt on the next rowsOf() after rows are removed. */
+    mutable QHash<QString, QList<int>> rows_;
+    mutable bool rowsStale_ = false;
+};
+
+Q_DECLARE_METATYPE(TrackModel::Entry)
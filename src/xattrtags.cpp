@@ -0,0 +1,122 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <array>
+#include <cerrno>
+#include <cstring>
+
+#include <QtCore/QFile>
+#if defined(Q_OS_LINUX) || defined(Q_OS_DARWIN)
+#include <sys/xattr.h>
+#endif
+
+#include "debug.h"
+#include "xattrtags.h"
+
+#if defined(Q_OS_LINUX) || defined(Q_OS_DARWIN)
+/** Largest attribute value read. A formatted BPM is far shorter. */
+static constexpr size_t kMaxValueSize = 64;
+
+static TagWriteResult attributeResult(int ret) {
+    TagWriteResult result;
+    if (ret != 0) {
+        result.error = QString::fromLocal8Bit(std::strerror(errno));
+        return result;
+    }
+    result.ok = true;
+    result.inPlace = true;
+    return result;
+}
+
+/** If the last call failed because the attribute is not set. */
+static bool attributeMissing() {
+#ifdef ENOATTR
+    return errno == ENOATTR;
+#else
+    return errno == ENODATA;
+#endif
+}
+#endif
+
+TagWriteResult storeBpmInAttribute(const QString &fileName,
+                                   const QString &name,
+                                   const QString &sBpm) {
+    qCDebug(gLogBpmDetect) << "Storing BPM:" << sBpm << "in attribute" << name << "of" << fileName;
+#if defined(Q_OS_LINUX) || defined(Q_OS_DARWIN)
+    const auto path = QFile::encodeName(fileName);
+    const auto attribute = name.toUtf8();
+    const auto value = sBpm.toUtf8();
+#ifdef Q_OS_DARWIN
+    const auto ret = setxattr(path.constData(),
+                              attribute.constData(),
+                              value.constData(),
+                              static_cast<size_t>(value.size()),
+                              0,
+                              0);
+#else
+    const auto ret = setxattr(path.constData(),
+                              attribute.constData(),
+                              value.constData(),
+                              static_cast<size_t>(value.size()),
+                              0);
+#endif
+    return attributeResult(ret);
+#else
+    // LCOV_EXCL_START
+    Q_UNUSED(fileName)
+    Q_UNUSED(name)
+    TagWriteResult result;
+    result.error = QStringLiteral("Extended attributes are not supported on this platform.");
+    return result;
+    // LCOV_EXCL_STOP
+#endif
+}
+
+TagWriteResult removeBpmFromAttribute(const QString &fileName, const QString &name) {
+    qCDebug(gLogBpmDetect) << "Removing BPM attribute" << name << "from" << fileName;
+#if defined(Q_OS_LINUX) || defined(Q_OS_DARWIN)
+    const auto path = QFile::encodeName(fileName);
+    const auto attribute = name.toUtf8();
+#ifdef Q_OS_DARWIN
+    const auto ret = removexattr(path.constData(), attribute.constData(), 0);
+#else
+    const auto ret = removexattr(path.constData(), attribute.constData());
+#endif
+    if (ret != 0 && attributeMissing()) {
+        return attributeResult(0);
+    }
+    return attributeResult(ret);
+#else
+    // LCOV_EXCL_START
+    Q_UNUSED(fileName)
+    Q_UNUSED(name)
+    TagWriteResult result;
+    result.error = QStringLiteral("Extended attributes are not supported on this platform.");
+    return result;
+    // LCOV_EXCL_STOP
+#endif
+}
+
+double readBpmFromAttribute(const QString &fileName, const QString &name) {
+#if defined(Q_OS_LINUX) || defined(Q_OS_DARWIN)
+    const auto path = QFile::encodeName(fileName);
+    const auto attribute = name.toUtf8();
+    std::array<char, kMaxValueSize> value;
+#ifdef Q_OS_DARWIN
+    const auto size =
+        getxattr(path.constData(), attribute.constData(), value.data(), value.size(), 0, 0);
+#else
+    const auto size = getxattr(path.constData(), attribute.constData(), value.data(), value.size());
+#endif
+    if (size <= 0) {
+        return 0;
+    }
+    auto ok = false;
+    const auto bpm = QByteArray(value.data(), static_cast<qsizetype>(size)).trimmed().toDouble(&ok);
+    return ok && bpm > 0 ? bpm : 0;
+#else
+    // LCOV_EXCL_START
+    Q_UNUSED(fileName)
+    Q_UNUSED(name)
+    return 0;
+    // LCOV_EXCL_STOP
+#endif
+}
@@ -0,0 +1,39 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/** @file */
+#pragma once
+
+#include <QtCore/QString>
+
+#include "ffmpegutils.h"
+
+/**
+ * Store the BPM in an extended attribute of a file instead of its tags.
+ *
+ * This is a single `setxattr(2)` call: the contents and modification time of the file do not
+ * change, so it works on read-only media libraries and keeps checksums valid. The value is the
+ * formatted BPM in UTF-8. Only Linux and macOS are supported, on file systems that allow
+ * attributes in the namespace of @a name (`user.` for regular users on Linux).
+ *
+ * @param fileName The path to the audio file.
+ * @param name Name of the attribute.
+ * @param sBpm The BPM value to store.
+ * @return The result, with `ok` and `inPlace` set if the attribute was set.
+ */
+TagWriteResult
+storeBpmInAttribute(const QString &fileName, const QString &name, const QString &sBpm);
+
+/**
+ * Remove the BPM extended attribute of a file.
+ * @param fileName The path to the audio file.
+ * @param name Name of the attribute.
+ * @return The result, with `ok` and `inPlace` set if the attribute was removed or was not set.
+ */
+TagWriteResult removeBpmFromAttribute(const QString &fileName, const QString &name);
+
+/**
+ * Read the BPM extended attribute of a file without opening it.
+ * @param fileName The path to the audio file.
+ * @param name Name of the attribute.
+ * @return The BPM, or 0 if the attribute is not set, not a number or not supported.
+ */
+double readBpmFromAttribute(const QString &fileName, const QString &name);
@@ -0,0 +1,168 @@
+#include <QtCore/QSemaphore>
+#include <QtTest>
+
+#include "batchworkerpool.h"
+
+/** Publishes the paths it is given, upper-cased. */
+class EchoPool : public BatchWorkerPool {
+    Q_OBJECT
+public:
+    explicit EchoPool(QObject *parent = nullptr) : BatchWorkerPool(parent) {
+    }
+    ~EchoPool() override {
+        cancelAndWait();
+    }
+    /** Acquired by workers before each path while blocking. */
+    QSemaphore gate;
+    bool blocking = false;
+    std::atomic_int busy = 0;
+    std::atomic_int mostBusy = 0;
+
+Q_SIGNALS:
+    void batchReady(const QStringList &results);
+
+protected:
+    struct Echo : Session {
+        QStringList ready;
+    };
+
+    std::shared_ptr<Session> createSession() const override {
+        return std::make_shared<Echo>();
+    }
+    void runWorker(const std::shared_ptr<Session> &session) override {
+        auto &echo = static_cast<Echo &>(*session);
+        while (true) {
+            QString path;
+            {
+                QMutexLocker locker(&echo.mutex);
+                if (echo.cancelled || echo.queue.isEmpty()) {
+                    exitWorker(session);
+                    return;
+                }
+                path = echo.queue.dequeue();
+            }
+            const auto now = ++busy;
+            auto most = mostBusy.load();
+            while (now > most && !mostBusy.compare_exchange_weak(most, now)) {
+            }
+            if (blocking) {
+                gate.acquire();
+            }
+            --busy;
+            QMutexLocker locker(&echo.mutex);
+            echo.ready << path.toUpper();
+        }
+    }
+    void publish() override {
+        const auto echo = session<Echo>();
+        QStringList results;
+        {
+            QMutexLocker locker(&echo->mutex);
+            results.swap(echo->ready);
+        }
+        if (!results.isEmpty()) {
+            emit batchReady(results);
+        }
+    }
+};
+
+class BatchWorkerPoolTest : public QObject {
+    Q_OBJECT
+public:
+    explicit BatchWorkerPoolTest(QObject *parent = nullptr);
+    ~BatchWorkerPoolTest() override;
+
+private Q_SLOTS:
+    void testMaximumThreads();
+    void testRun();
+    void testAddWhileRunning();
+    void testCancel();
+};
+
+static QStringList collect(const QSignalSpy &spy) {
+    QStringList results;
+    for (const auto &arguments : spy) {
+        results.append(arguments.at(0).toStringList());
+    }
+    results.sort();
+    return results;
+}
+
+BatchWorkerPoolTest::BatchWorkerPoolTest(QObject *parent) : QObject(parent) {
+}
+
+BatchWorkerPoolTest::~BatchWorkerPoolTest() {
+}
+
+void BatchWorkerPoolTest::testMaximumThreads() {
+    EchoPool pool;
+    QCOMPARE(pool.maximumThreads(), QThread::idealThreadCount());
+    pool.setMaximumThreads(3);
+    QCOMPARE(pool.maximumThreads(), 3);
+    pool.setMaximumThreads(0);
+    QCOMPARE(pool.maximumThreads(), QThread::idealThreadCount());
+}
+
+void BatchWorkerPoolTest::testRun() {
+    EchoPool pool;
+    pool.setMaximumThreads(2);
+    pool.setBatchInterval(10);
+    QSignalSpy ready(&pool, &EchoPool::batchReady);
+    QSignalSpy finished(&pool, &EchoPool::finished);
+    QStringList paths, expected;
+    for (auto i = 0; i < 50; ++i) {
+        paths << QStringLiteral("a%1").arg(i);
+        expected << QStringLiteral("A%1").arg(i);
+    }
+    expected.sort();
+    pool.add({});
+    QVERIFY(!pool.isRunning());
+    pool.add(paths);
+    QVERIFY(pool.isRunning());
+    QVERIFY(finished.wait());
+    QVERIFY(!pool.isRunning());
+    QCOMPARE(collect(ready), expected);
+    QVERIFY(pool.mostBusy <= 2);
+    QTest::qWait(20);
+    QCOMPARE(finished.size(), 1);
+}
+
+void BatchWorkerPoolTest::testAddWhileRunning() {
+    EchoPool pool;
+    pool.setMaximumThreads(1);
+    pool.blocking = true;
+    QSignalSpy ready(&pool, &EchoPool::batchReady);
+    QSignalSpy finished(&pool, &EchoPool::finished);
+    pool.add({QStringLiteral("a")});
+    pool.add({QStringLiteral("b")});
+    pool.gate.release(2);
+    QVERIFY(finished.wait());
+    QCOMPARE(collect(ready), QStringList({QStringLiteral("A"), QStringLiteral("B")}));
+    QCOMPARE(finished.size(), 1);
+    // A new session starts after the last one finished.
+    pool.gate.release();
+    pool.add({QStringLiteral("c")});
+    QVERIFY(finished.wait());
+    QCOMPARE(ready.last().at(0).toStringList(), QStringList({QStringLiteral("C")}));
+}
+
+void BatchWorkerPoolTest::testCancel() {
+    EchoPool pool;
+    pool.setMaximumThreads(1);
+    pool.blocking = true;
+    QSignalSpy ready(&pool, &EchoPool::batchReady);
+    QSignalSpy finished(&pool, &EchoPool::finished);
+    pool.add({QStringLiteral("a"), QStringLiteral("b")});
+    QTRY_COMPARE(pool.busy.load(), 1);
+    pool.cancel();
+    QVERIFY(!pool.isRunning());
+    pool.cancel();
+    pool.gate.release();
+    QTest::qWait(50);
+    QVERIFY(ready.isEmpty());
+    QVERIFY(finished.isEmpty());
+}
+
+QTEST_GUILESS_MAIN(BatchWorkerPoolTest)
+
+#include "batchworkerpooltest.moc"
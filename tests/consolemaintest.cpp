@@ -1,13 +1,20 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 #include <iostream>
+#include <unistd.h>
 
 #include <QtCore/QCommandLineParser>
 #include <QtCore/QCoreApplication>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
 #include <QtCore/QStringList>
 #include <QtTest/QtTest>
 
 #include "consolemain.h"
 #include "ffmpegutils.h"
+#include "track/bpmcache.h"
+#include "track/envelopecache.h"
+#include "track/resultindex.h"
+#include "track/track.h"
 #include "utils.h"
 
 class ConsoleMainTest : public QObject {
@@ -21,6 +28,15 @@ private Q_SLOTS:
     void testRemoveBpmTag();
     void testDetection();
     void testDetectUndecodable();
+    void testDetectionInParallelKeepsOrder();
+    void testRecursive();
+    void testCache();
+    void testCacheKeepsTagAfterDetection();
+    void testCandidates();
+    void testIndex();
+    void testIndexUnformattedBpm();
+    void testOutput();
+    void testDuplicates();
 };
 
 ConsoleMainTest::ConsoleMainTest(QObject *parent) : QObject(parent) {
@@ -49,6 +65,30 @@ static void copyToTempFile(const QString &source, QTemporaryFile &tempFile) {
     qDebug() << "Copied" << source << "to" << tempFile.fileName();
 }
 
+/** Run consoleMain() with @a args and get what it printed. */
+static QString runConsoleMain(const QStringList &args) {
+    QByteArrayList arguments{QByteArrayLiteral("bpmdetect")};
+    for (const auto &arg : args) {
+        arguments << arg.toUtf8();
+    }
+    QList<char *> argv;
+    for (auto &arg : arguments) {
+        argv << arg.data();
+    }
+    auto argc = static_cast<int>(argv.size());
+    std::stringstream buffer;
+    auto old = std::cout.rdbuf(buffer.rdbuf());
+    QCommandLineParser parser;
+    QCoreApplication app(argc, argv.data());
+    parseCommandLine(parser, app);
+    const auto ret = consoleMain(app, parser, parser.positionalArguments());
+    std::cout.rdbuf(old);
+    if (ret != 0) {
+        return QString();
+    }
+    return QString::fromStdString(buffer.str());
+}
+
 void ConsoleMainTest::testRemoveBpmTag() {
     QTemporaryFile tempFile;
     copyToTempFile(QString::fromUtf8(TEST_FILE_140BPM), tempFile);
@@ -138,6 +178,366 @@ void ConsoleMainTest::testDetectUndecodable() {
     QCOMPARE(ret, 0);
 }
 
+void ConsoleMainTest::testDetectionInParallelKeepsOrder() {
+    QTemporaryFile tempFile, tempFile2;
+    copyToTempFile(QString::fromUtf8(TEST_FILE_140BPM), tempFile);
+    copyToTempFile(QString::fromUtf8(TEST_FILE_140BPM), tempFile2);
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunsafe-buffer-usage-in-libc-call"
+    auto tempFileDup = strdup(tempFile.fileName().toUtf8().constData());
+    auto tempFile2Dup = strdup(tempFile2.fileName().toUtf8().constData());
+#pragma clang diagnostic pop
+    const char *argv[] = {
+        "bpmdetect", "--no-progress", "--jobs", "2", tempFileDup, "CMakeLists.txt", tempFile2Dup};
+    auto argc = 7;
+
+    std::stringstream buffer;
+    auto old = std::cout.rdbuf(buffer.rdbuf());
+    QCommandLineParser parser;
+    QCoreApplication app(argc, const_cast<char **>(argv));
+    parseCommandLine(parser, app);
+    QCOMPARE(parser.value(QStringLiteral("jobs")), QStringLiteral("2"));
+
+    auto ret = consoleMain(app, parser, parser.positionalArguments());
+    free(tempFileDup);
+    free(tempFile2Dup);
+    std::cout.rdbuf(old);
+    QCOMPARE(ret, 0);
+
+    auto output = QString::fromStdString(buffer.str());
+    auto first = output.indexOf(tempFile.fileName() + QStringLiteral(": 140"));
+    auto skipped = output.indexOf(QStringLiteral("File is not decodable, skipping: CMakeLists.txt"));
+    auto second = output.indexOf(tempFile2.fileName() + QStringLiteral(": 140"));
+    QVERIFY(first >= 0);
+    QVERIFY(skipped > first);
+    QVERIFY(second > skipped);
+}
+
+void ConsoleMainTest::testRecursive() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QVERIFY(QDir(dir.path()).mkpath(QStringLiteral("a/b")));
+    const auto source = QString::fromUtf8(TEST_FILE_140BPM);
+    QVERIFY(QFile::copy(source, dir.filePath(QStringLiteral("a/b/1.ogg"))));
+    QVERIFY(QFile::copy(source, dir.filePath(QStringLiteral("2.ogg"))));
+    QFile notes(dir.filePath(QStringLiteral("a/notes.txt")));
+    QVERIFY(notes.open(QIODevice::WriteOnly));
+    notes.write("Notes");
+    notes.close();
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunsafe-buffer-usage-in-libc-call"
+    auto dirDup = strdup(dir.path().toUtf8().constData());
+#pragma clang diagnostic pop
+    const char *argv[] = {"bpmdetect", "--no-progress", "--recursive", dirDup};
+    auto argc = 4;
+
+    std::stringstream buffer;
+    auto old = std::cout.rdbuf(buffer.rdbuf());
+    QCommandLineParser parser;
+    QCoreApplication app(argc, const_cast<char **>(argv));
+    parseCommandLine(parser, app);
+    QVERIFY(parser.isSet(QStringLiteral("recursive")));
+
+    auto ret = consoleMain(app, parser, parser.positionalArguments());
+    free(dirDup);
+    std::cout.rdbuf(old);
+    QCOMPARE(ret, 0);
+
+    auto output = QString::fromStdString(buffer.str());
+    QVERIFY(output.contains(QStringLiteral("/a/b/1.ogg: 140")));
+    QVERIFY(output.contains(QStringLiteral("/2.ogg: 140")));
+    QVERIFY(!output.contains(QStringLiteral("notes.txt")));
+}
+
+void ConsoleMainTest::testCache() {
+    QTemporaryFile tempFile;
+    copyToTempFile(QString::fromUtf8(TEST_FILE_140BPM), tempFile);
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    BpmCache cache(dir.filePath(QStringLiteral("cache.bin")));
+    BpmCache::Entry entry;
+    entry.rawBpm = 99;
+    entry.detectorVersion = Track::detectorVersion();
+    cache.insert(tempFile.fileName(), entry);
+    Track::setCache(&cache);
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunsafe-buffer-usage-in-libc-call"
+    auto tempFileDup = strdup(tempFile.fileName().toUtf8().constData());
+#pragma clang diagnostic pop
+    const char *argv[] = {"bpmdetect", "--no-progress", "--detect", tempFileDup};
+    auto argc = 4;
+
+    std::stringstream buffer;
+    auto old = std::cout.rdbuf(buffer.rdbuf());
+    QCommandLineParser parser;
+    QCoreApplication app(argc, const_cast<char **>(argv));
+    parseCommandLine(parser, app);
+    auto ret = consoleMain(app, parser, parser.positionalArguments());
+    free(tempFileDup);
+    std::cout.rdbuf(old);
+    Track::setCache(nullptr);
+    QCOMPARE(ret, 0);
+
+    // Answered from the cache without decoding.
+    auto output = QString::fromStdString(buffer.str());
+    QVERIFY(output.contains(QStringLiteral(": 99.00 BPM")));
+
+    // A cached tag value follows the format too.
+    entry.bpm = 139.87;
+    entry.saved = true;
+    cache.insert(tempFile.fileName(), entry);
+    Track::setCache(&cache);
+    output = runConsoleMain({QStringLiteral("--no-progress"),
+                             QStringLiteral("-f"),
+                             QStringLiteral("0"),
+                             tempFile.fileName()});
+    Track::setCache(nullptr);
+    QVERIFY(output.contains(tempFile.fileName() + QStringLiteral(": ") +
+                            bpmToString(139.87, QStringLiteral("0")) + QStringLiteral(" BPM")));
+    QVERIFY(!output.contains(QStringLiteral("139.87")));
+}
+
+void ConsoleMainTest::testCacheKeepsTagAfterDetection() {
+    QTemporaryFile tempFile;
+    copyToTempFile(QString::fromUtf8(TEST_FILE_140BPM), tempFile);
+    QVERIFY(storeBpmInFile(tempFile.fileName(), QStringLiteral("120.00")).ok);
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    BpmCache cache(dir.filePath(QStringLiteral("cache.bin")));
+    Track::setCache(&cache);
+
+    const auto detected = runConsoleMain(
+        {QStringLiteral("--no-progress"), QStringLiteral("--detect"), tempFile.fileName()});
+    const auto plain = runConsoleMain({QStringLiteral("--no-progress"), tempFile.fileName()});
+    Track::setCache(nullptr);
+
+    QVERIFY(detected.contains(QStringLiteral(": 140.")));
+    // The detection is not saved, so the cache still answers with the tag.
+    QVERIFY(plain.contains(QStringLiteral(": 120.00 BPM")));
+    BpmCache::Entry entry;
+    QVERIFY(cache.lookup(tempFile.fileName(), &entry));
+    QVERIFY(entry.saved);
+    QCOMPARE(entry.bpm, 120.0);
+    QCOMPARE(static_cast<int>(Track::correctBpm(entry.rawBpm)), 140);
+}
+
+void ConsoleMainTest::testCandidates() {
+    QTemporaryFile tempFile;
+    copyToTempFile(QString::fromUtf8(TEST_FILE_140BPM), tempFile);
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    BpmCache cache(dir.filePath(QStringLiteral("cache.bin")));
+    BpmCache::Entry entry;
+    entry.rawBpm = 99;
+    entry.detectorVersion = Track::detectorVersion();
+    cache.insert(tempFile.fileName(), entry);
+    Track::setCache(&cache);
+    EnvelopeCache envelopeCache(dir.filePath(QStringLiteral("envelopes")));
+    EnvelopeCache::Entry envelope;
+    envelope.rate = 200;
+    envelope.candidates = {{99, 1}, {66, 0.4}};
+    envelope.version = Track::envelopeVersion();
+    QVERIFY(envelopeCache.insert(tempFile.fileName(), envelope) > 0);
+    Track::setEnvelopeCache(&envelopeCache);
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunsafe-buffer-usage-in-libc-call"
+    auto tempFileDup = strdup(tempFile.fileName().toUtf8().constData());
+#pragma clang diagnostic pop
+    const char *argv[] = {"bpmdetect", "--no-progress", "--detect", "--candidates", tempFileDup};
+    auto argc = 5;
+
+    std::stringstream buffer;
+    auto old = std::cout.rdbuf(buffer.rdbuf());
+    QCommandLineParser parser;
+    QCoreApplication app(argc, const_cast<char **>(argv));
+    parseCommandLine(parser, app);
+    auto ret = consoleMain(app, parser, parser.positionalArguments());
+    free(tempFileDup);
+    std::cout.rdbuf(old);
+    Track::setCache(nullptr);
+    Track::setEnvelopeCache(nullptr);
+    QCOMPARE(ret, 0);
+
+    // Candidates are folded into the range.
+    auto output = QString::fromStdString(buffer.str());
+    QVERIFY(output.contains(QStringLiteral(": 99.00 BPM [candidates: 99.00 100%, 132.00 40%]")));
+}
+
+void ConsoleMainTest::testIndex() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const auto indexed = dir.filePath(QStringLiteral("indexed.ogg"));
+    const auto detected = dir.filePath(QStringLiteral("detected.ogg"));
+    QVERIFY(QFile::copy(QString::fromUtf8(TEST_FILE_140BPM), indexed));
+    QVERIFY(QFile::copy(QString::fromUtf8(TEST_FILE_140BPM), detected));
+    ResultIndex index(dir.filePath(QStringLiteral("results.jsonl")));
+    ResultIndex::Entry entry;
+    entry.bpm = 99;
+    index.insert(indexed, entry);
+    Track::setIndex(&index);
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunsafe-buffer-usage-in-libc-call"
+    auto indexedDup = strdup(indexed.toUtf8().constData());
+    auto detectedDup = strdup(detected.toUtf8().constData());
+#pragma clang diagnostic pop
+    const char *argv[] = {"bpmdetect", "--no-progress", "--no-cache", indexedDup, detectedDup};
+    auto argc = 5;
+
+    std::stringstream buffer;
+    auto old = std::cout.rdbuf(buffer.rdbuf());
+    QCommandLineParser parser;
+    QCoreApplication app(argc, const_cast<char **>(argv));
+    parseCommandLine(parser, app);
+    auto ret = consoleMain(app, parser, parser.positionalArguments());
+    free(indexedDup);
+    free(detectedDup);
+    std::cout.rdbuf(old);
+    Track::setIndex(nullptr);
+    QCOMPARE(ret, 0);
+
+    // The indexed file is answered without being opened and the other is added to the index.
+    auto output = QString::fromStdString(buffer.str());
+    QVERIFY(output.contains(indexed + QStringLiteral(": 99.00 BPM")));
+    QVERIFY(index.lookup(detected, &entry));
+    QCOMPARE(static_cast<int>(entry.bpm), 140);
+    QVERIFY(entry.rawBpm > 0);
+    QVERIFY(entry.length > 0);
+    QVERIFY(!entry.detector.isEmpty());
+    QCOMPARE(entry.detectorVersion, Track::detectorVersion());
+    // The file is left untouched.
+    QVERIFY(readTagsFromFile(detected)[QStringLiteral("bpm")].toString().isEmpty());
+}
+
+void ConsoleMainTest::testIndexUnformattedBpm() {
+    QTemporaryFile tempFile;
+    copyToTempFile(QString::fromUtf8(TEST_FILE_140BPM), tempFile);
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    BpmCache cache(dir.filePath(QStringLiteral("cache.bin")));
+    BpmCache::Entry cached;
+    cached.rawBpm = 139.87;
+    cached.detectorVersion = Track::detectorVersion();
+    cache.insert(tempFile.fileName(), cached);
+    Track::setCache(&cache);
+    ResultIndex index(dir.filePath(QStringLiteral("results.jsonl")));
+    Track::setIndex(&index);
+
+    const auto output = runConsoleMain({QStringLiteral("--no-progress"),
+                                        QStringLiteral("--detect"),
+                                        QStringLiteral("-f"),
+                                        QStringLiteral("0"),
+                                        tempFile.fileName()});
+    Track::setCache(nullptr);
+    Track::setIndex(nullptr);
+
+    QVERIFY(!output.isEmpty());
+    QVERIFY(!output.contains(QStringLiteral("139.87")));
+    // The index keeps the value, not its formatting.
+    ResultIndex::Entry entry;
+    QVERIFY(index.lookup(tempFile.fileName(), &entry));
+    QCOMPARE(entry.bpm, 139.87);
+    QCOMPARE(entry.rawBpm, 139.87);
+}
+
+void ConsoleMainTest::testOutput() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const auto audio = dir.filePath(QStringLiteral("a.ogg"));
+    const auto text = dir.filePath(QStringLiteral("notes.txt"));
+    QVERIFY(QFile::copy(QString::fromUtf8(TEST_FILE_140BPM), audio));
+    QFile(audio).setPermissions(QFile::ReadOwner | QFile::WriteOwner);
+    {
+        QFile file(text);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write("not audio");
+    }
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunsafe-buffer-usage-in-libc-call"
+    auto audioDup = strdup(audio.toUtf8().constData());
+    auto textDup = strdup(text.toUtf8().constData());
+#pragma clang diagnostic pop
+    const char *argv[] = {
+        "bpmdetect", "--no-cache", "--save", "--output", "jsonl", audioDup, textDup};
+    auto argc = 7;
+
+    std::stringstream buffer;
+    auto old = std::cout.rdbuf(buffer.rdbuf());
+    QCommandLineParser parser;
+    QCoreApplication app(argc, const_cast<char **>(argv));
+    parseCommandLine(parser, app);
+    auto ret = consoleMain(app, parser, parser.positionalArguments());
+    free(audioDup);
+    free(textDup);
+    std::cout.rdbuf(old);
+    QCOMPARE(ret, 0);
+
+    // One record per file in order, and nothing else (no progress).
+    const auto lines = QByteArray::fromStdString(buffer.str()).trimmed().split('\n');
+    QCOMPARE(lines.size(), 2);
+    const auto detected = QJsonDocument::fromJson(lines.at(0)).object();
+    QCOMPARE(detected.value(QStringLiteral("path")).toString(), audio);
+    QCOMPARE(detected.value(QStringLiteral("status")).toString(), QStringLiteral("detected"));
+    QCOMPARE(static_cast<int>(detected.value(QStringLiteral("bpm")).toDouble()), 140);
+    QVERIFY(detected.value(QStringLiteral("rawBpm")).toDouble() > 0);
+    QVERIFY(detected.value(QStringLiteral("durationMs")).toInteger() > 0);
+    QVERIFY(detected.value(QStringLiteral("probeMs")).toDouble() > 0);
+    QVERIFY(detected.value(QStringLiteral("decodeMs")).toDouble() > 0);
+    QVERIFY(detected.value(QStringLiteral("detectMs")).toDouble() > 0);
+    QVERIFY(detected.value(QStringLiteral("writeMs")).toDouble() > 0);
+    const auto failed = QJsonDocument::fromJson(lines.at(1)).object();
+    QCOMPARE(failed.value(QStringLiteral("path")).toString(), text);
+    QCOMPARE(failed.value(QStringLiteral("status")).toString(), QStringLiteral("failed"));
+    QVERIFY(!failed.value(QStringLiteral("error")).toString().isEmpty());
+}
+
+void ConsoleMainTest::testDuplicates() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const auto first = dir.filePath(QStringLiteral("a.ogg"));
+    const auto link = dir.filePath(QStringLiteral("b.ogg"));
+    const auto copy = dir.filePath(QStringLiteral("c.ogg"));
+    QVERIFY(QFile::copy(QString::fromUtf8(TEST_FILE_140BPM), first));
+    QCOMPARE(::link(first.toUtf8().constData(), link.toUtf8().constData()), 0);
+    QVERIFY(QFile::copy(QString::fromUtf8(TEST_FILE_140BPM), copy));
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunsafe-buffer-usage-in-libc-call"
+    auto firstDup = strdup(first.toUtf8().constData());
+    auto linkDup = strdup(link.toUtf8().constData());
+    auto copyDup = strdup(copy.toUtf8().constData());
+#pragma clang diagnostic pop
+    const char *argv[] = {
+        "bpmdetect", "--no-progress", "--dedupe", "--jobs", "3", firstDup, linkDup, copyDup};
+    auto argc = 8;
+
+    std::stringstream buffer;
+    auto old = std::cout.rdbuf(buffer.rdbuf());
+    QCommandLineParser parser;
+    QCoreApplication app(argc, const_cast<char **>(argv));
+    parseCommandLine(parser, app);
+    auto ret = consoleMain(app, parser, parser.positionalArguments());
+    free(firstDup);
+    free(linkDup);
+    free(copyDup);
+    std::cout.rdbuf(old);
+    QCOMPARE(ret, 0);
+
+    // Every path gets the result, in order.
+    auto output = QString::fromStdString(buffer.str());
+    const auto firstLine = output.indexOf(first + QStringLiteral(": 140"));
+    const auto linkLine = output.indexOf(link + QStringLiteral(": 140"));
+    const auto copyLine = output.indexOf(copy + QStringLiteral(": 140"));
+    QVERIFY(firstLine >= 0);
+    QVERIFY(linkLine > firstLine);
+    QVERIFY(copyLine > linkLine);
+}
+
 QTEST_GUILESS_MAIN(ConsoleMainTest)
 
 #include "consolemaintest.moc"
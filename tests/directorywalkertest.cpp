@@ -0,0 +1,118 @@
+#include <QtCore/QTemporaryDir>
+#include <QtTest>
+
+#include "directorywalker.h"
+
+class DirectoryWalkerTest : public QObject {
+    Q_OBJECT
+public:
+    explicit DirectoryWalkerTest(QObject *parent = nullptr);
+    ~DirectoryWalkerTest() override;
+
+private Q_SLOTS:
+    void testIsAudioFile();
+    void testWalk();
+    void testNonexistentDirectory();
+    void testCancel();
+};
+
+static void writeFile(const QString &fileName, const QByteArray &data) {
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(data);
+}
+
+static QStringList collect(const QSignalSpy &spy) {
+    QStringList files;
+    for (const auto &arguments : spy) {
+        files.append(arguments.at(0).toStringList());
+    }
+    files.sort();
+    return files;
+}
+
+DirectoryWalkerTest::DirectoryWalkerTest(QObject *parent) : QObject(parent) {
+}
+
+DirectoryWalkerTest::~DirectoryWalkerTest() {
+}
+
+void DirectoryWalkerTest::testIsAudioFile() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    // Known extensions are not opened.
+    QVERIFY(DirectoryWalker::isAudioFile(dir.filePath(QStringLiteral("missing.MP3"))));
+    writeFile(dir.filePath(QStringLiteral("cover.jpg")), QByteArrayLiteral("\xff\xd8\xff\xe0"));
+    QVERIFY(!DirectoryWalker::isAudioFile(dir.filePath(QStringLiteral("cover.jpg"))));
+    writeFile(dir.filePath(QStringLiteral("notes.txt")), QByteArrayLiteral("Notes"));
+    QVERIFY(!DirectoryWalker::isAudioFile(dir.filePath(QStringLiteral("notes.txt"))));
+    writeFile(dir.filePath(QStringLiteral("track")), QByteArrayLiteral("fLaC\0\0\0\x22"));
+    QVERIFY(DirectoryWalker::isAudioFile(dir.filePath(QStringLiteral("track"))));
+    writeFile(dir.filePath(QStringLiteral("track.bin")),
+              QByteArrayLiteral("\0\0\0\x20" "ftypM4A "));
+    QVERIFY(DirectoryWalker::isAudioFile(dir.filePath(QStringLiteral("track.bin"))));
+    writeFile(dir.filePath(QStringLiteral("empty")), {});
+    QVERIFY(!DirectoryWalker::isAudioFile(dir.filePath(QStringLiteral("empty"))));
+}
+
+void DirectoryWalkerTest::testWalk() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QStringList expected;
+    for (auto i = 0; i < 20; ++i) {
+        const auto sub = QStringLiteral("a/%1/b").arg(i);
+        QVERIFY(QDir(dir.path()).mkpath(sub));
+        expected << dir.filePath(sub + QStringLiteral("/track.mp3"));
+        writeFile(expected.last(), {});
+        writeFile(dir.filePath(sub + QStringLiteral("/cover.jpg")), QByteArrayLiteral("\xff\xd8"));
+    }
+    writeFile(dir.filePath(QStringLiteral(".hidden.ogg")), {});
+    expected << dir.filePath(QStringLiteral(".hidden.ogg"));
+    expected.sort();
+
+    DirectoryWalker walker;
+    walker.setMaximumThreads(4);
+    walker.setBatchInterval(10);
+    QSignalSpy found(&walker, &DirectoryWalker::filesFound);
+    QSignalSpy finished(&walker, &DirectoryWalker::finished);
+    walker.add({dir.path()});
+    QVERIFY(walker.isRunning());
+    QVERIFY(finished.wait());
+    QVERIFY(!walker.isRunning());
+    QCOMPARE(finished.size(), 1);
+    QCOMPARE(collect(found), expected);
+}
+
+void DirectoryWalkerTest::testNonexistentDirectory() {
+    DirectoryWalker walker;
+    QSignalSpy found(&walker, &DirectoryWalker::filesFound);
+    QSignalSpy finished(&walker, &DirectoryWalker::finished);
+    walker.add({QStringLiteral("/nonexistent-path")});
+    QVERIFY(finished.wait());
+    QVERIFY(found.isEmpty());
+}
+
+void DirectoryWalkerTest::testCancel() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    for (auto i = 0; i < 50; ++i) {
+        QVERIFY(QDir(dir.path()).mkpath(QString::number(i)));
+        writeFile(dir.filePath(QStringLiteral("%1/track.mp3").arg(i)), {});
+    }
+    DirectoryWalker walker;
+    QSignalSpy found(&walker, &DirectoryWalker::filesFound);
+    QSignalSpy finished(&walker, &DirectoryWalker::finished);
+    walker.add({dir.path()});
+    walker.cancel();
+    QVERIFY(!walker.isRunning());
+    QVERIFY(!finished.wait(200));
+    QVERIFY(found.isEmpty());
+    // Can be started again.
+    walker.add({dir.path()});
+    QVERIFY(finished.wait());
+    QCOMPARE(collect(found).size(), 50);
+}
+
+QTEST_GUILESS_MAIN(DirectoryWalkerTest)
+
+#include "directorywalkertest.moc"
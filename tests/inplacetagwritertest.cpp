@@ -0,0 +1,336 @@
+#include <QtCore/QtEndian>
+#include <QtTest>
+
+#include "ffmpegutils.h"
+#include "inplacetagwriter.h"
+
+class InPlaceTagWriterTest : public QObject {
+    Q_OBJECT
+public:
+    explicit InPlaceTagWriterTest(QObject *parent = nullptr);
+    ~InPlaceTagWriterTest() override;
+
+private Q_SLOTS:
+    void testFlacPadding();
+    void testFlacNoPadding();
+    void testFlacRewrite();
+    void testId3v2Padding();
+    void testId3v2NoPadding();
+    void testId3v2Rewrite();
+    void testMp4FreeAtom();
+    void testMp4NoFreeAtom();
+    void testOggSameLength();
+    void testRemuxReplacesLinkTarget();
+    void testUnsupportedFile();
+    void testConcurrentWrites();
+
+private:
+    QString writeTempFile(const QByteArray &data);
+    QTemporaryDir dir_;
+};
+
+static QByteArray bigEndian32(quint32 value) {
+    char bytes[4];
+    qToBigEndian(value, bytes);
+    return {bytes, 4};
+}
+
+static QByteArray littleEndian32(quint32 value) {
+    char bytes[4];
+    qToLittleEndian(value, bytes);
+    return {bytes, 4};
+}
+
+static QByteArray flacBlock(uchar type, const QByteArray &data, bool last) {
+    auto header = bigEndian32(static_cast<quint32>(data.size()));
+    header[0] = static_cast<char>(type | (last ? 0x80 : 0));
+    return header + data;
+}
+
+static QByteArray vorbisComment(const QList<QByteArray> &comments) {
+    auto ret = littleEndian32(4) + QByteArrayLiteral("test") +
+               littleEndian32(static_cast<quint32>(comments.size()));
+    for (const auto &comment : comments) {
+        ret += littleEndian32(static_cast<quint32>(comment.size())) + comment;
+    }
+    return ret;
+}
+
+static QByteArray mp4Box(const QByteArray &type, const QByteArray &payload) {
+    return bigEndian32(static_cast<quint32>(payload.size() + 8)) + type + payload;
+}
+
+static QByteArray mp4File(const QByteArray &metaChildren) {
+    const auto title = mp4Box(QByteArrayLiteral("\xa9nam"),
+                              mp4Box(QByteArrayLiteral("data"),
+                                     bigEndian32(1) + bigEndian32(0) + QByteArrayLiteral("Title")));
+    const auto ilst = mp4Box(QByteArrayLiteral("ilst"), title);
+    const auto meta = mp4Box(QByteArrayLiteral("meta"), bigEndian32(0) + ilst + metaChildren);
+    return mp4Box(QByteArrayLiteral("ftyp"), QByteArrayLiteral("M4A ") + bigEndian32(0)) +
+           mp4Box(QByteArrayLiteral("moov"), mp4Box(QByteArrayLiteral("udta"), meta)) +
+           mp4Box(QByteArrayLiteral("mdat"), QByteArray(64, '\x55'));
+}
+
+static QByteArray readFile(const QString &fileName) {
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return {};
+    }
+    return file.readAll();
+}
+
+InPlaceTagWriterTest::InPlaceTagWriterTest(QObject *parent) : QObject(parent) {
+}
+
+InPlaceTagWriterTest::~InPlaceTagWriterTest() {
+}
+
+QString InPlaceTagWriterTest::writeTempFile(const QByteArray &data) {
+    static auto counter = 0;
+    const auto fileName = dir_.filePath(QString::number(++counter));
+    QFile file(fileName);
+    if (file.open(QIODevice::WriteOnly)) {
+        file.write(data);
+    }
+    return fileName;
+}
+
+void InPlaceTagWriterTest::testFlacPadding() {
+    const auto original =
+        QByteArrayLiteral("fLaC") + flacBlock(0, QByteArray(34, '\0'), false) +
+        flacBlock(4, vorbisComment({QByteArrayLiteral("TITLE=Title")}), false) +
+        flacBlock(1, QByteArray(100, '\0'), true) + QByteArray(64, '\x55');
+    const auto fileName = writeTempFile(original);
+    QVERIFY(writeBpmInPlace(fileName, QStringLiteral("120.00")));
+    auto data = readFile(fileName);
+    QCOMPARE(data.size(), original.size());
+    QVERIFY(data.contains("BPM=120.00"));
+    QVERIFY(data.contains("TITLE=Title"));
+    QVERIFY(data.endsWith(QByteArray(64, '\x55')));
+
+    QVERIFY(writeBpmInPlace(fileName, QStringLiteral("95.50")));
+    data = readFile(fileName);
+    QCOMPARE(data.size(), original.size());
+    QVERIFY(data.contains("BPM=95.50"));
+    QVERIFY(!data.contains("BPM=120.00"));
+
+    QVERIFY(writeBpmInPlace(fileName, QString()));
+    QCOMPARE(readFile(fileName), original);
+}
+
+void InPlaceTagWriterTest::testFlacNoPadding() {
+    const auto original = QByteArrayLiteral("fLaC") + flacBlock(0, QByteArray(34, '\0'), false) +
+                          flacBlock(4, vorbisComment({}), true) + QByteArray(64, '\x55');
+    const auto fileName = writeTempFile(original);
+    QVERIFY(!writeBpmInPlace(fileName, QStringLiteral("120.00")));
+    QCOMPARE(readFile(fileName), original);
+    // Nothing to remove.
+    QVERIFY(writeBpmInPlace(fileName, QString()));
+}
+
+void InPlaceTagWriterTest::testFlacRewrite() {
+    const QByteArray audio(10000, '\x55');
+    const auto original = QByteArrayLiteral("fLaC") + flacBlock(0, QByteArray(34, '\0'), false) +
+                          flacBlock(4, vorbisComment({QByteArrayLiteral("TITLE=Title")}), true) +
+                          audio;
+    const auto fileName = writeTempFile(original);
+    QFile::setPermissions(fileName, QFile::ReadOwner | QFile::WriteOwner | QFile::ReadGroup);
+    const auto permissions = QFile::permissions(fileName);
+    QVERIFY(rewriteBpmWithPadding(fileName, QStringLiteral("120.00")));
+    auto data = readFile(fileName);
+    QVERIFY(data.contains("TITLE=Title"));
+    QVERIFY(data.contains("BPM=120.00"));
+    QVERIFY(data.endsWith(audio));
+    QVERIFY(data.size() - original.size() >= 4096);
+    // The audio keeps its offset within a file system block.
+    QCOMPARE((data.size() - audio.size()) % 4096, (original.size() - audio.size()) % 4096);
+    QCOMPARE(QFile::permissions(fileName), permissions);
+
+    // The new padding leaves room for changes in place.
+    QVERIFY(writeBpmInPlace(fileName, QStringLiteral("95.50")));
+    QCOMPARE(readFile(fileName).size(), data.size());
+    QVERIFY(writeBpmInPlace(fileName, QString()));
+    data = readFile(fileName);
+    QVERIFY(!data.contains("BPM="));
+    QVERIFY(data.endsWith(audio));
+
+    QVERIFY(!rewriteBpmWithPadding(writeTempFile(QByteArrayLiteral("OggS") + audio),
+                                   QStringLiteral("120.00")));
+}
+
+void InPlaceTagWriterTest::testId3v2Padding() {
+    // Rebuild the ID3v2.4 tag of the test file without the extended header and with padding.
+    const auto source = readFile(QString::fromUtf8(TEST_FILE_5S_SILENT));
+    QVERIFY(source.startsWith("ID3"));
+    const auto frames = source.mid(22, 33);
+    const auto body = frames + QByteArray(64, '\0');
+    QByteArray size(4, '\0');
+    for (auto i = 0; i < 4; ++i) {
+        size[3 - i] = static_cast<char>((body.size() >> (7 * i)) & 0x7f);
+    }
+    const auto original = QByteArrayLiteral("ID3\x04\x00\x00") + size + body + source.mid(55);
+    const auto fileName = writeTempFile(original);
+    QCOMPARE(readTagsFromFile(fileName)[QStringLiteral("title")].toString(),
+             QStringLiteral("Title"));
+
+    QVERIFY(writeBpmInPlace(fileName, QStringLiteral("128.00")));
+    QCOMPARE(readFile(fileName).size(), original.size());
+    auto tags = readTagsFromFile(fileName);
+    QCOMPARE(tags[QStringLiteral("bpm")].toDouble(), 128.0);
+    QCOMPARE(tags[QStringLiteral("artist")].toString(), QStringLiteral("Artist"));
+
+    QVERIFY(storeBpmInFile(fileName, QStringLiteral("140.50")).ok);
+    QCOMPARE(readFile(fileName).size(), original.size());
+    QCOMPARE(readTagsFromFile(fileName)[QStringLiteral("bpm")].toDouble(), 140.5);
+
+    QVERIFY(removeBpmFromFile(fileName).ok);
+    QCOMPARE(readFile(fileName), original);
+}
+
+void InPlaceTagWriterTest::testId3v2NoPadding() {
+    const auto original = readFile(QString::fromUtf8(TEST_FILE_5S_SILENT));
+    const auto fileName = writeTempFile(original);
+    QVERIFY(!writeBpmInPlace(fileName, QStringLiteral("128.00")));
+    QCOMPARE(readFile(fileName), original);
+}
+
+void InPlaceTagWriterTest::testId3v2Rewrite() {
+    const auto original = readFile(QString::fromUtf8(TEST_FILE_5S_SILENT));
+    const auto fileName = writeTempFile(original);
+    const auto tagSize = [](const QByteArray &data) {
+        qint64 size = 0;
+        for (auto i = 6; i < 10; ++i) {
+            size = size << 7 | (data.at(i) & 0x7f);
+        }
+        return 10 + size;
+    };
+    QVERIFY(rewriteBpmWithPadding(fileName, QStringLiteral("128.00")));
+    const auto data = readFile(fileName);
+    QVERIFY(data.endsWith(original.mid(tagSize(original))));
+    QCOMPARE(tagSize(data) % 4096, tagSize(original) % 4096);
+    auto tags = readTagsFromFile(fileName);
+    QCOMPARE(tags[QStringLiteral("bpm")].toDouble(), 128.0);
+    QCOMPARE(tags[QStringLiteral("artist")].toString(), QStringLiteral("Artist"));
+    QCOMPARE(tags[QStringLiteral("title")].toString(), QStringLiteral("Title"));
+
+    QVERIFY(writeBpmInPlace(fileName, QStringLiteral("140.00")));
+    QCOMPARE(readTagsFromFile(fileName)[QStringLiteral("bpm")].toDouble(), 140.0);
+}
+
+void InPlaceTagWriterTest::testMp4FreeAtom() {
+    const auto original = mp4File(mp4Box(QByteArrayLiteral("free"), QByteArray(32, '\0')));
+    const auto fileName = writeTempFile(original);
+    QVERIFY(writeBpmInPlace(fileName, QStringLiteral("128.50")));
+    auto data = readFile(fileName);
+    QCOMPARE(data.size(), original.size());
+    const auto tmpo = data.indexOf("tmpo");
+    QVERIFY(tmpo > 0);
+    QCOMPARE(qFromBigEndian<quint32>(data.constData() + tmpo - 4), 26U);
+    QCOMPARE(qFromBigEndian<quint16>(data.constData() + tmpo + 20), quint16(128));
+    QVERIFY(data.endsWith(mp4Box(QByteArrayLiteral("mdat"), QByteArray(64, '\x55'))));
+
+    // Replacing keeps the size of the item list.
+    QVERIFY(writeBpmInPlace(fileName, QStringLiteral("90")));
+    data = readFile(fileName);
+    QCOMPARE(data.indexOf("tmpo"), tmpo);
+    QCOMPARE(qFromBigEndian<quint16>(data.constData() + tmpo + 20), quint16(90));
+
+    QVERIFY(writeBpmInPlace(fileName, QString()));
+    QCOMPARE(readFile(fileName), original);
+}
+
+void InPlaceTagWriterTest::testMp4NoFreeAtom() {
+    const auto original = mp4File({});
+    const auto fileName = writeTempFile(original);
+    QVERIFY(!writeBpmInPlace(fileName, QStringLiteral("128")));
+    QCOMPARE(readFile(fileName), original);
+}
+
+void InPlaceTagWriterTest::testOggSameLength() {
+    QFile::copy(QString::fromUtf8(TEST_FILE_140BPM), dir_.filePath(QStringLiteral("test.ogg")));
+    const auto fileName = dir_.filePath(QStringLiteral("test.ogg"));
+    QFile::setPermissions(fileName, QFile::ReadOwner | QFile::WriteOwner);
+    const auto original = readFile(fileName);
+    // No BPM yet, so the comment header would grow.
+    QVERIFY(!writeBpmInPlace(fileName, QStringLiteral("140.00")));
+    QCOMPARE(readFile(fileName), original);
+
+    QVERIFY(storeBpmInFile(fileName, QStringLiteral("140.00")).ok);
+    const auto size = readFile(fileName).size();
+    QVERIFY(writeBpmInPlace(fileName, QStringLiteral("128.00")));
+    QCOMPARE(readFile(fileName).size(), size);
+    // libavformat checks the page CRC.
+    QCOMPARE(readTagsFromFile(fileName)[QStringLiteral("bpm")].toDouble(), 128.0);
+}
+
+void InPlaceTagWriterTest::testRemuxReplacesLinkTarget() {
+#ifdef Q_OS_WIN
+    QSKIP("Needs symbolic links.");
+#endif
+    QDir(dir_.path()).mkdir(QStringLiteral("link"));
+    const auto target = dir_.filePath(QStringLiteral("link/target.ogg"));
+    const auto link = dir_.filePath(QStringLiteral("link/link.ogg"));
+    QVERIFY(QFile::copy(QString::fromUtf8(TEST_FILE_140BPM), target));
+    QFile::setPermissions(target, QFile::ReadOwner | QFile::WriteOwner | QFile::ReadGroup);
+    const auto permissions = QFile::permissions(target);
+    QVERIFY(QFile::link(target, link));
+
+    const auto result = storeBpmInFile(link, QStringLiteral("140.00"));
+    QVERIFY(result.ok);
+    QVERIFY(!result.inPlace);
+    QVERIFY(QFileInfo(link).isSymLink());
+    QCOMPARE(readTagsFromFile(target)[QStringLiteral("bpm")].toDouble(), 140.0);
+    QCOMPARE(QFile::permissions(target), permissions);
+    // The temporary file was renamed, not left behind.
+    QCOMPARE(QDir(dir_.filePath(QStringLiteral("link")))
+                 .entryList(QDir::Files | QDir::Hidden | QDir::System)
+                 .size(),
+             2);
+}
+
+void InPlaceTagWriterTest::testUnsupportedFile() {
+    const auto fileName = writeTempFile(QByteArrayLiteral("RIFF") + QByteArray(64, '\0'));
+    QVERIFY(!writeBpmInPlace(fileName, QStringLiteral("128.00")));
+    QVERIFY(!writeBpmInPlace(dir_.filePath(QStringLiteral("does-not-exist")), QString()));
+}
+
+void InPlaceTagWriterTest::testConcurrentWrites() {
+    QStringList fileNames;
+    for (auto i = 0; i < 4; ++i) {
+        const auto fileName = dir_.filePath(QStringLiteral("concurrent-%1.ogg").arg(i));
+        QVERIFY(QFile::copy(QString::fromUtf8(TEST_FILE_140BPM), fileName));
+        QFile::setPermissions(fileName, QFile::ReadOwner | QFile::WriteOwner);
+        fileNames << fileName;
+    }
+    fileNames << dir_.filePath(QStringLiteral("does-not-exist.ogg"));
+    QList<TagWriteResult> results(fileNames.size());
+    QList<QThread *> threads;
+    for (qsizetype i = 0; i < fileNames.size(); ++i) {
+        threads << QThread::create([&fileNames, &results, i]() {
+            results[i] = storeBpmInFile(fileNames.at(i), QStringLiteral("%1.00").arg(100 + i));
+        });
+        threads.last()->start();
+    }
+    for (auto thread : std::as_const(threads)) {
+        QVERIFY(thread->wait());
+        delete thread;
+    }
+    // Each call reports its own outcome.
+    for (qsizetype i = 0; i < 4; ++i) {
+        QVERIFY(results.at(i).ok);
+        QVERIFY(!results.at(i).inPlace);
+        QVERIFY(results.at(i).error.isEmpty());
+        QCOMPARE(readTagsFromFile(fileNames.at(i))[QStringLiteral("bpm")].toDouble(), 100.0 + i);
+    }
+    QVERIFY(!results.last().ok);
+    QVERIFY(!results.last().error.isEmpty());
+    QString error;
+    QVERIFY(readTagsFromFile(fileNames.last(), &error).isEmpty());
+    QVERIFY(!error.isEmpty());
+    QVERIFY(!isDecodableFile(fileNames.last(), &error));
+    QVERIFY(!error.isEmpty());
+}
+
+QTEST_GUILESS_MAIN(InPlaceTagWriterTest)
+
+#include "inplacetagwritertest.moc"
@@ -0,0 +1,100 @@
+#include <QtTest>
+
+#include "profiler.h"
+
+class ProfilerTest : public QObject {
+    Q_OBJECT
+public:
+    explicit ProfilerTest(QObject *parent = nullptr);
+    ~ProfilerTest() override;
+
+private Q_SLOTS:
+    void cleanup();
+    void testDisabled();
+    void testPercentiles();
+    void testTimer();
+    void testResourceUsage();
+};
+
+ProfilerTest::ProfilerTest(QObject *parent) : QObject(parent) {
+}
+
+ProfilerTest::~ProfilerTest() {
+}
+
+void ProfilerTest::cleanup() {
+    Profiler::setEnabled(false);
+}
+
+void ProfilerTest::testDisabled() {
+    Profiler::setEnabled(true);
+    Profiler::setEnabled(false);
+    QVERIFY(!Profiler::isEnabled());
+    Profiler::record(Profiler::Probe, 1000000);
+    Profiler::addDecodedFrames(100);
+    {
+        const Profiler::Timer timer(Profiler::Detect);
+    }
+    const auto report = Profiler::report();
+    QVERIFY(!report.contains(QStringLiteral("probe")));
+    QVERIFY(!report.contains(QStringLiteral("detect")));
+    QVERIFY(report.contains(QStringLiteral("Samples decoded: 0")));
+}
+
+void ProfilerTest::testPercentiles() {
+    Profiler::setEnabled(true);
+    QVERIFY(Profiler::isEnabled());
+    // 1 to 100 ms.
+    for (qint64 i = 100; i >= 1; --i) {
+        Profiler::record(Profiler::Decode, i * 1000000);
+    }
+    Profiler::addDecodedFrames(11025);
+    const auto lines = Profiler::report().split(QLatin1Char('\n'));
+    QVERIFY(lines.at(0).startsWith(QStringLiteral("stage")));
+    const auto decode = lines.at(1).split(QLatin1Char(' '), Qt::SkipEmptyParts);
+    QCOMPARE(decode,
+             QStringList({QStringLiteral("decode"),
+                          QStringLiteral("100"),
+                          QStringLiteral("50.000"),
+                          QStringLiteral("90.000"),
+                          QStringLiteral("99.000"),
+                          QStringLiteral("5.050")}));
+    // 11025 frames in 5.05 s of decoding.
+    QCOMPARE(lines.at(2), QStringLiteral("Samples decoded: 11025 (2183 per second of decoding)"));
+    // Enabling again starts over.
+    Profiler::setEnabled(true);
+    QVERIFY(!Profiler::report().contains(QStringLiteral("decode")));
+}
+
+void ProfilerTest::testTimer() {
+    Profiler::setEnabled(true);
+    {
+        const Profiler::Timer timer(Profiler::TagWrite);
+        QThread::msleep(5);
+    }
+    const auto report = Profiler::report();
+    const auto line = report.split(QLatin1Char('\n')).at(1);
+    QVERIFY(line.startsWith(QStringLiteral("tag write")));
+    const auto fields = line.mid(10).split(QLatin1Char(' '), Qt::SkipEmptyParts);
+    QCOMPARE(fields.at(0), QStringLiteral("1"));
+    QVERIFY(fields.at(1).toDouble() >= 5);
+}
+
+void ProfilerTest::testResourceUsage() {
+#ifdef Q_OS_WIN
+    QSKIP("Resource usage is not reported on Windows.");
+#endif
+    QVERIFY(Profiler::peakResidentSetSize() > 0);
+    Profiler::setEnabled(true);
+    const auto report = Profiler::report();
+    QVERIFY(report.contains(QStringLiteral("Peak RSS: ")));
+    QVERIFY(report.contains(QStringLiteral("Wall time: ")));
+#ifdef Q_OS_LINUX
+    QVERIFY(Profiler::bytesRead() > 0);
+    QVERIFY(report.contains(QStringLiteral("Bytes read: ")));
+#endif
+}
+
+QTEST_GUILESS_MAIN(ProfilerTest)
+
+#include "profilertest.moc"
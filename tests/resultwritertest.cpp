@@ -0,0 +1,132 @@
+#include <sstream>
+
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtTest>
+
+#include "resultwriter.h"
+
+class ResultWriterTest : public QObject {
+    Q_OBJECT
+public:
+    explicit ResultWriterTest(QObject *parent = nullptr);
+    ~ResultWriterTest() override;
+
+private Q_SLOTS:
+    void testFormatFromName();
+    void testJson();
+    void testJsonEmpty();
+    void testJsonLines();
+    void testCsv();
+};
+
+static ResultWriter::Record makeRecord() {
+    ResultWriter::Record record;
+    record.path = QStringLiteral("/music/a, \"b\".mp3");
+    record.status = QStringLiteral("detected");
+    record.bpm = QStringLiteral("140.00");
+    record.rawBpm = 70;
+    record.length = 180000;
+    record.probeTime = 1500000;
+    record.decodeTime = 250000000;
+    record.detectTime = 40000000;
+    record.writeTime = 2000;
+    return record;
+}
+
+static ResultWriter::Record makeFailedRecord() {
+    ResultWriter::Record record;
+    record.path = QStringLiteral("/music/notes.txt");
+    record.status = QStringLiteral("failed");
+    record.error = QStringLiteral("Invalid data found when processing input");
+    return record;
+}
+
+ResultWriterTest::ResultWriterTest(QObject *parent) : QObject(parent) {
+}
+
+ResultWriterTest::~ResultWriterTest() {
+}
+
+void ResultWriterTest::testFormatFromName() {
+    QVERIFY(ResultWriter::formatFromName(QStringLiteral("json")) == ResultWriter::Json);
+    QVERIFY(ResultWriter::formatFromName(QStringLiteral("jsonl")) == ResultWriter::JsonLines);
+    QVERIFY(ResultWriter::formatFromName(QStringLiteral("csv")) == ResultWriter::Csv);
+    QVERIFY(!ResultWriter::formatFromName(QStringLiteral("xml")));
+}
+
+void ResultWriterTest::testJson() {
+    std::stringstream out;
+    {
+        ResultWriter writer(ResultWriter::Json, out);
+        writer.write(makeRecord());
+        writer.write(makeFailedRecord());
+    }
+    QJsonParseError error;
+    const auto document = QJsonDocument::fromJson(QByteArray::fromStdString(out.str()), &error);
+    QCOMPARE(error.error, QJsonParseError::NoError);
+    const auto records = document.array();
+    QCOMPARE(records.size(), 2);
+    const auto first = records.at(0).toObject();
+    QCOMPARE(first.value(QStringLiteral("path")).toString(), makeRecord().path);
+    QCOMPARE(first.value(QStringLiteral("status")).toString(), QStringLiteral("detected"));
+    QCOMPARE(first.value(QStringLiteral("bpm")).toDouble(), 140.0);
+    QCOMPARE(first.value(QStringLiteral("rawBpm")).toDouble(), 70.0);
+    QCOMPARE(first.value(QStringLiteral("durationMs")).toInteger(), qint64(180000));
+    QVERIFY(first.value(QStringLiteral("error")).isNull());
+    QCOMPARE(first.value(QStringLiteral("probeMs")).toDouble(), 1.5);
+    QCOMPARE(first.value(QStringLiteral("decodeMs")).toDouble(), 250.0);
+    QCOMPARE(first.value(QStringLiteral("detectMs")).toDouble(), 40.0);
+    QCOMPARE(first.value(QStringLiteral("writeMs")).toDouble(), 0.002);
+    const auto second = records.at(1).toObject();
+    QVERIFY(second.value(QStringLiteral("bpm")).isNull());
+    QVERIFY(second.value(QStringLiteral("rawBpm")).isNull());
+    QCOMPARE(second.value(QStringLiteral("error")).toString(), makeFailedRecord().error);
+}
+
+void ResultWriterTest::testJsonEmpty() {
+    std::stringstream out;
+    ResultWriter(ResultWriter::Json, out).finish();
+    QCOMPARE(out.str(), std::string("[]\n"));
+}
+
+void ResultWriterTest::testJsonLines() {
+    std::stringstream out;
+    ResultWriter writer(ResultWriter::JsonLines, out);
+    writer.write(makeRecord());
+    // Each record is complete as soon as it is written.
+    QCOMPARE(QString::fromStdString(out.str()).count(QLatin1Char('\n')), 1);
+    writer.write(makeFailedRecord());
+    writer.finish();
+    const auto lines = QByteArray::fromStdString(out.str()).split('\n');
+    QCOMPARE(lines.size(), 3);
+    QVERIFY(lines.at(2).isEmpty());
+    QCOMPARE(
+        QJsonDocument::fromJson(lines.at(1)).object().value(QStringLiteral("status")).toString(),
+        QStringLiteral("failed"));
+}
+
+void ResultWriterTest::testCsv() {
+    std::stringstream out;
+    {
+        ResultWriter writer(ResultWriter::Csv, out);
+        writer.write(makeRecord());
+        writer.write(makeFailedRecord());
+    }
+    const auto lines = QString::fromStdString(out.str()).split(QLatin1Char('\n'));
+    QCOMPARE(lines.size(), 4);
+    QCOMPARE(lines.at(0),
+             QStringLiteral(
+                 "path,status,bpm,rawBpm,durationMs,error,probeMs,decodeMs,detectMs,writeMs"));
+    QCOMPARE(lines.at(1),
+             QStringLiteral(
+                 "\"/music/a, \"\"b\"\".mp3\",detected,140.00,70,180000,,1.5,250,40,0.002"));
+    QCOMPARE(lines.at(2),
+             QStringLiteral("/music/notes.txt,failed,,,0,Invalid data found when processing "
+                            "input,0,0,0,0"));
+}
+
+QTEST_GUILESS_MAIN(ResultWriterTest)
+
+#include "resultwritertest.moc"
@@ -0,0 +1,155 @@
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QTemporaryDir>
+#include <QtCore/QThread>
+#include <QtTest>
+
+#include "tracer.h"
+
+class TracerTest : public QObject {
+    Q_OBJECT
+public:
+    explicit TracerTest(QObject *parent = nullptr);
+    ~TracerTest() override;
+
+private Q_SLOTS:
+    void cleanup();
+    void testDisabled();
+    void testSpans();
+    void testThreads();
+    void testWrite();
+};
+
+static QJsonArray traceEvents() {
+    return QJsonDocument::fromJson(Tracer::toJson())
+        .object()
+        .value(QStringLiteral("traceEvents"))
+        .toArray();
+}
+
+/** Get the events with the given phase. */
+static QList<QJsonObject> eventsOfPhase(const QString &phase) {
+    QList<QJsonObject> ret;
+    for (const auto &value : traceEvents()) {
+        const auto event = value.toObject();
+        if (event.value(QStringLiteral("ph")).toString() == phase) {
+            ret << event;
+        }
+    }
+    return ret;
+}
+
+TracerTest::TracerTest(QObject *parent) : QObject(parent) {
+}
+
+TracerTest::~TracerTest() {
+}
+
+void TracerTest::cleanup() {
+    Tracer::setEnabled(false);
+}
+
+void TracerTest::testDisabled() {
+    Tracer::setEnabled(true);
+    Tracer::setEnabled(false);
+    QVERIFY(!Tracer::isEnabled());
+    QCOMPARE(Tracer::now(), qint64(-1));
+    {
+        Tracer::Span span("probe", QString());
+    }
+    Tracer::complete("decode", QString(), 0);
+    QVERIFY(traceEvents().isEmpty());
+}
+
+void TracerTest::testSpans() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const auto fileName = dir.filePath(QStringLiteral("a.mp3"));
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    QCOMPARE(file.write(QByteArray(1000, 'x')), qint64(1000));
+    file.close();
+    Tracer::setEnabled(true);
+    QVERIFY(Tracer::isEnabled());
+    const auto start = Tracer::now();
+    QVERIFY(start >= 0);
+    {
+        Tracer::Span span("probe", fileName);
+        span.setArg(QStringLiteral("durationMs"), 180000);
+        QThread::msleep(2);
+    }
+    Tracer::complete("decode", fileName, start, {{QStringLiteral("detectorMs"), 1.5}});
+    // A negative start is a span that never began.
+    Tracer::complete("detect", fileName, -1);
+    const auto spans = eventsOfPhase(QStringLiteral("X"));
+    QCOMPARE(spans.size(), 2);
+    const auto probe = spans.at(0);
+    QCOMPARE(probe.value(QStringLiteral("name")).toString(), QStringLiteral("probe"));
+    QCOMPARE(probe.value(QStringLiteral("pid")).toInteger(), QCoreApplication::applicationPid());
+    QVERIFY(probe.value(QStringLiteral("ts")).toDouble() >= static_cast<double>(start) / 1000);
+    QVERIFY(probe.value(QStringLiteral("dur")).toDouble() >= 2000);
+    const auto args = probe.value(QStringLiteral("args")).toObject();
+    QCOMPARE(args.value(QStringLiteral("file")).toString(), fileName);
+    QCOMPARE(args.value(QStringLiteral("size")).toInteger(), qint64(1000));
+    QCOMPARE(args.value(QStringLiteral("durationMs")).toInteger(), qint64(180000));
+    const auto decode = spans.at(1);
+    QCOMPARE(decode.value(QStringLiteral("name")).toString(), QStringLiteral("decode"));
+    QCOMPARE(decode.value(QStringLiteral("ts")).toDouble(), static_cast<double>(start) / 1000);
+    QVERIFY(decode.value(QStringLiteral("dur")).toDouble() >=
+            probe.value(QStringLiteral("dur")).toDouble());
+    QCOMPARE(decode.value(QStringLiteral("args"))
+                 .toObject()
+                 .value(QStringLiteral("detectorMs"))
+                 .toDouble(),
+             1.5);
+    // Enabling again starts over.
+    Tracer::setEnabled(true);
+    QVERIFY(eventsOfPhase(QStringLiteral("X")).isEmpty());
+}
+
+void TracerTest::testThreads() {
+    Tracer::setEnabled(true);
+    Tracer::complete("probe", QString(), Tracer::now());
+    std::unique_ptr<QThread> thread(
+        QThread::create([]() { Tracer::complete("save", QString(), Tracer::now()); }));
+    thread->setObjectName(QStringLiteral("tag writer 1"));
+    thread->start();
+    QVERIFY(thread->wait());
+    const auto names = eventsOfPhase(QStringLiteral("M"));
+    QCOMPARE(names.size(), 2);
+    QHash<QString, qint64> threads;
+    for (const auto &event : names) {
+        QCOMPARE(event.value(QStringLiteral("name")).toString(), QStringLiteral("thread_name"));
+        threads.insert(
+            event.value(QStringLiteral("args")).toObject().value(QStringLiteral("name")).toString(),
+            event.value(QStringLiteral("tid")).toInteger());
+    }
+    QVERIFY(threads.contains(QStringLiteral("main")));
+    QVERIFY(threads.contains(QStringLiteral("tag writer 1")));
+    QVERIFY(threads.value(QStringLiteral("main")) != threads.value(QStringLiteral("tag writer 1")));
+    for (const auto &event : eventsOfPhase(QStringLiteral("X"))) {
+        const auto name = event.value(QStringLiteral("name")).toString();
+        const auto expected = threads.value(name == QStringLiteral("save") ?
+                                                QStringLiteral("tag writer 1") :
+                                                QStringLiteral("main"));
+        QCOMPARE(event.value(QStringLiteral("tid")).toInteger(), expected);
+    }
+}
+
+void TracerTest::testWrite() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    Tracer::setEnabled(true);
+    Tracer::complete("probe", QString(), Tracer::now());
+    const auto fileName = dir.filePath(QStringLiteral("trace.json"));
+    QVERIFY(Tracer::write(fileName));
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QCOMPARE(file.readAll(), Tracer::toJson());
+    QVERIFY(!Tracer::write(dir.filePath(QStringLiteral("missing/trace.json"))));
+}
+
+QTEST_GUILESS_MAIN(TracerTest)
+
+#include "tracertest.moc"
@@ -0,0 +1,132 @@
+#include <cmath>
+#include <vector>
+
+#include <QtTest>
+
+#include "track/autocorrelationbpmdetector.h"
+
+class AutocorrelationBpmDetectorTest : public QObject {
+    Q_OBJECT
+public:
+    explicit AutocorrelationBpmDetectorTest(QObject *parent = nullptr);
+    ~AutocorrelationBpmDetectorTest() override;
+
+private Q_SLOTS:
+    void testClickTrack_data();
+    void testClickTrack();
+    void testStereo();
+    void testTooShort();
+    void testReset();
+    void testCandidates();
+    void testSetEnvelope();
+};
+
+/** Decaying 1 kHz bursts at @a bpm, interleaved to @a channels. */
+static std::vector<soundtouch::SAMPLETYPE>
+clickTrack(double bpm, int seconds, int channels, int sampleRate) {
+    const auto frames = static_cast<size_t>(seconds) * static_cast<size_t>(sampleRate);
+    const auto period = 60.0 * sampleRate / bpm;
+    std::vector<soundtouch::SAMPLETYPE> samples(frames * static_cast<size_t>(channels));
+    for (size_t i = 0; i < frames; ++i) {
+        const auto phase = std::fmod(static_cast<double>(i), period);
+        const auto value = std::exp(-phase / (0.01 * sampleRate)) *
+                           std::sin(2 * M_PI * 1000 * static_cast<double>(i) / sampleRate);
+        for (auto c = 0; c < channels; ++c) {
+#if defined(SOUNDTOUCH_INTEGER_SAMPLES) && SOUNDTOUCH_INTEGER_SAMPLES
+            samples[i * static_cast<size_t>(channels) + static_cast<size_t>(c)] =
+                static_cast<soundtouch::SAMPLETYPE>(value * 16384);
+#else
+            samples[i * static_cast<size_t>(channels) + static_cast<size_t>(c)] =
+                static_cast<soundtouch::SAMPLETYPE>(value * 0.5);
+#endif
+        }
+    }
+    return samples;
+}
+
+AutocorrelationBpmDetectorTest::AutocorrelationBpmDetectorTest(QObject *parent)
+    : QObject(parent) {
+}
+
+AutocorrelationBpmDetectorTest::~AutocorrelationBpmDetectorTest() {
+}
+
+void AutocorrelationBpmDetectorTest::testClickTrack_data() {
+    QTest::addColumn<double>("bpm");
+    QTest::newRow("90") << 90.0;
+    QTest::newRow("120") << 120.0;
+    QTest::newRow("128") << 128.0;
+    QTest::newRow("174") << 174.0;
+}
+
+void AutocorrelationBpmDetectorTest::testClickTrack() {
+    QFETCH(double, bpm);
+    AutocorrelationBpmDetector detector;
+    detector.setFormat(1, 11025);
+    detector.reset();
+    const auto samples = clickTrack(bpm, 30, 1, 11025);
+    // Feed in blocks like the decoders do.
+    for (size_t offset = 0; offset < samples.size(); offset += 4096) {
+        const auto count = std::min<size_t>(4096, samples.size() - offset);
+        detector.inputSamples(samples.data() + offset, static_cast<int>(count));
+    }
+    QVERIFY(std::abs(detector.getBpm() - bpm) < 1.0);
+}
+
+void AutocorrelationBpmDetectorTest::testStereo() {
+    AutocorrelationBpmDetector detector;
+    detector.setFormat(2, 44100);
+    detector.reset();
+    const auto samples = clickTrack(140, 20, 2, 44100);
+    detector.inputSamples(samples.data(), static_cast<int>(samples.size() / 2));
+    QVERIFY(std::abs(detector.getBpm() - 140) < 1.0);
+}
+
+void AutocorrelationBpmDetectorTest::testTooShort() {
+    AutocorrelationBpmDetector detector;
+    const auto samples = clickTrack(120, 2, 1, 11025);
+    detector.inputSamples(samples.data(), static_cast<int>(samples.size()));
+    QCOMPARE(detector.getBpm(), 0.0);
+}
+
+void AutocorrelationBpmDetectorTest::testReset() {
+    AutocorrelationBpmDetector detector;
+    const auto samples = clickTrack(120, 10, 1, 11025);
+    detector.inputSamples(samples.data(), static_cast<int>(samples.size()));
+    QVERIFY(detector.getBpm() > 0);
+    detector.reset();
+    QCOMPARE(detector.getBpm(), 0.0);
+}
+
+void AutocorrelationBpmDetectorTest::testCandidates() {
+    AutocorrelationBpmDetector detector;
+    const auto samples = clickTrack(120, 20, 1, 11025);
+    detector.inputSamples(samples.data(), static_cast<int>(samples.size()));
+    const auto candidates = detector.candidates(3);
+    QVERIFY(!candidates.isEmpty());
+    QVERIFY(candidates.size() <= 3);
+    QCOMPARE(candidates.first().bpm, detector.getBpm());
+    QCOMPARE(candidates.first().score, 1.0);
+    for (qsizetype i = 1; i < candidates.size(); ++i) {
+        QVERIFY(candidates.at(i).score <= candidates.at(i - 1).score);
+    }
+    QVERIFY(detector.candidates(0).isEmpty());
+}
+
+void AutocorrelationBpmDetectorTest::testSetEnvelope() {
+    AutocorrelationBpmDetector detector;
+    const auto samples = clickTrack(128, 20, 1, 11025);
+    detector.inputSamples(samples.data(), static_cast<int>(samples.size()));
+    const auto bpm = detector.getBpm();
+    const auto envelope = detector.envelope();
+    const auto rate = detector.envelopeRate();
+    QVERIFY(rate > 0);
+    detector.reset();
+    QCOMPARE(detector.getBpm(), 0.0);
+    detector.setEnvelope(envelope, rate);
+    QCOMPARE(detector.getBpm(), bpm);
+}
+
+QTEST_GUILESS_MAIN(AutocorrelationBpmDetectorTest)
+
+#include "autocorrelationbpmdetectortest.moc"
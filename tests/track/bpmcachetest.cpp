@@ -0,0 +1,167 @@
+#include <QtTest>
+
+#include "fileidentityfixture.h"
+#include "track/bpmcache.h"
+
+class BpmCacheTest : public FileIdentityFixture {
+    Q_OBJECT
+public:
+    explicit BpmCacheTest(QObject *parent = nullptr);
+    ~BpmCacheTest() override;
+
+private Q_SLOTS:
+    void init();
+    void testInsertLookup();
+    void testModifiedFile();
+    void testPersistence();
+    void testClear();
+    void testHashContent();
+    void testTruncatedFile();
+
+private:
+    QString cacheFile_;
+};
+
+static BpmCache::Entry makeEntry(bpmtype bpm, bpmtype rawBpm = 0) {
+    BpmCache::Entry entry;
+    entry.bpm = bpm;
+    entry.rawBpm = rawBpm;
+    entry.length = 180000;
+    entry.detectorVersion = rawBpm > 0 ? 42 : 0;
+    entry.saved = rawBpm == 0;
+    return entry;
+}
+
+BpmCacheTest::BpmCacheTest(QObject *parent) : FileIdentityFixture(parent) {
+}
+
+BpmCacheTest::~BpmCacheTest() {
+}
+
+void BpmCacheTest::init() {
+    cacheFile_ = filePath(QStringLiteral("cache/bpm-cache.bin"));
+    QFile::remove(cacheFile_);
+    initFiles();
+}
+
+void BpmCacheTest::testInsertLookup() {
+    BpmCache cache(cacheFile_);
+    BpmCache::Entry entry;
+    QVERIFY(!cache.lookup(filePath(QStringLiteral("a.mp3")), &entry));
+    QVERIFY(!cache.lookup(filePath(QStringLiteral("missing.mp3")), &entry));
+    cache.insert(filePath(QStringLiteral("missing.mp3")), makeEntry(120));
+    QCOMPARE(cache.size(), 0);
+    cache.insert(filePath(QStringLiteral("a.mp3")), makeEntry(0, 256.5));
+    QCOMPARE(cache.size(), 1);
+    QVERIFY(cache.lookup(filePath(QStringLiteral("a.mp3")), &entry));
+    QCOMPARE(entry.rawBpm, 256.5);
+    QCOMPARE(entry.length, 180000);
+    QCOMPARE(entry.detectorVersion, 42u);
+    QVERIFY(!entry.saved);
+    QVERIFY(!cache.lookup(filePath(QStringLiteral("b.mp3")), &entry));
+    // Renaming keeps the entry.
+    QVERIFY(QFile::rename(filePath(QStringLiteral("a.mp3")), filePath(QStringLiteral("c.mp3"))));
+    QVERIFY(cache.lookup(filePath(QStringLiteral("c.mp3")), &entry));
+}
+
+void BpmCacheTest::testModifiedFile() {
+    BpmCache cache(cacheFile_);
+    cache.insert(filePath(QStringLiteral("a.mp3")), makeEntry(128));
+    modifyFile(QStringLiteral("a.mp3"));
+    BpmCache::Entry entry;
+    QVERIFY(!cache.lookup(filePath(QStringLiteral("a.mp3")), &entry));
+}
+
+void BpmCacheTest::testPersistence() {
+    {
+        BpmCache cache(cacheFile_);
+        cache.insert(filePath(QStringLiteral("a.mp3")), makeEntry(128));
+        cache.insert(filePath(QStringLiteral("b.mp3")), makeEntry(0, 70));
+        QVERIFY(cache.flush());
+        cache.insert(filePath(QStringLiteral("a.mp3")), makeEntry(130));
+    }
+    QVERIFY(QFileInfo::exists(cacheFile_));
+    BpmCache cache(cacheFile_);
+    QCOMPARE(cache.size(), 2);
+    BpmCache::Entry entry;
+    QVERIFY(cache.lookup(filePath(QStringLiteral("a.mp3")), &entry));
+    QCOMPARE(entry.bpm, 130.0);
+    QVERIFY(entry.saved);
+    QVERIFY(cache.lookup(filePath(QStringLiteral("b.mp3")), &entry));
+    QCOMPARE(entry.rawBpm, 70.0);
+}
+
+void BpmCacheTest::testClear() {
+    {
+        BpmCache cache(cacheFile_);
+        cache.insert(filePath(QStringLiteral("a.mp3")), makeEntry(128));
+    }
+    {
+        BpmCache cache(cacheFile_);
+        QCOMPARE(cache.size(), 1);
+        cache.clear();
+        QCOMPARE(cache.size(), 0);
+        cache.insert(filePath(QStringLiteral("b.mp3")), makeEntry(140));
+    }
+    BpmCache cache(cacheFile_);
+    QCOMPARE(cache.size(), 1);
+    BpmCache::Entry entry;
+    QVERIFY(!cache.lookup(filePath(QStringLiteral("a.mp3")), &entry));
+    QVERIFY(cache.lookup(filePath(QStringLiteral("b.mp3")), &entry));
+}
+
+void BpmCacheTest::testHashContent() {
+    BpmCache cache(cacheFile_);
+    cache.setHashContent(true);
+    QVERIFY(cache.hashesContent());
+    const auto fileName = filePath(QStringLiteral("a.mp3"));
+    writeFile(QStringLiteral("a.mp3"), QByteArray(200 * 1024, 'x'));
+    const auto mtime = QFileInfo(fileName).lastModified();
+    cache.insert(fileName, makeEntry(128));
+    BpmCache::Entry entry;
+    QVERIFY(cache.lookup(fileName, &entry));
+    // Same size and modification time, different content at the end.
+    {
+        QFile file(fileName);
+        QVERIFY(file.open(QIODevice::ReadWrite));
+        QVERIFY(file.seek(file.size() - 1));
+        file.write("y");
+        QVERIFY(file.setFileTime(mtime, QFileDevice::FileModificationTime));
+    }
+    QVERIFY(!cache.lookup(fileName, &entry));
+    // Entries stored with a hash do not match without one.
+    cache.setHashContent(false);
+    QVERIFY(!cache.lookup(fileName, &entry));
+}
+
+void BpmCacheTest::testTruncatedFile() {
+    {
+        BpmCache cache(cacheFile_);
+        cache.insert(filePath(QStringLiteral("a.mp3")), makeEntry(128));
+        cache.insert(filePath(QStringLiteral("b.mp3")), makeEntry(140));
+    }
+    {
+        QFile file(cacheFile_);
+        QVERIFY(file.resize(file.size() - 10));
+    }
+    {
+        BpmCache cache(cacheFile_);
+        QCOMPARE(cache.size(), 1);
+        cache.insert(filePath(QStringLiteral("b.mp3")), makeEntry(141));
+    }
+    BpmCache cache(cacheFile_);
+    QCOMPARE(cache.size(), 2);
+    BpmCache::Entry entry;
+    QVERIFY(cache.lookup(filePath(QStringLiteral("b.mp3")), &entry));
+    QCOMPARE(entry.bpm, 141.0);
+
+    QFile file(cacheFile_);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write("not a cache file");
+    file.close();
+    QCOMPARE(BpmCache(cacheFile_).size(), 0);
+}
+
+QTEST_GUILESS_MAIN(BpmCacheTest)
+
+#include "bpmcachetest.moc"
@@ -0,0 +1,134 @@
+#include <QtCore/QSet>
+#include <QtTest>
+
+#include "track/abstractbpmdetector.h"
+#include "track/bpmcache.h"
+#include "track/detectionscheduler.h"
+#include "track/track.h"
+
+class DummyBpmDetector : public AbstractBpmDetector {
+    Q_OBJECT
+public:
+    DummyBpmDetector(QObject *parent = nullptr) : AbstractBpmDetector(parent) {
+    }
+    void inputSamples(const soundtouch::SAMPLETYPE *samples, int numSamples) override {
+        Q_UNUSED(samples)
+        Q_UNUSED(numSamples)
+    }
+    bpmtype getBpm() const override {
+        return 120.0;
+    }
+    void reset() override {
+    }
+};
+
+class DetectionSchedulerTest : public QObject {
+    Q_OBJECT
+public:
+    explicit DetectionSchedulerTest(QObject *parent = nullptr);
+    ~DetectionSchedulerTest() override;
+
+private Q_SLOTS:
+    void init();
+    void testRun();
+    void testStop();
+    void testKeepsCachedTag();
+    void testMaximumThreads();
+};
+
+DetectionSchedulerTest::DetectionSchedulerTest(QObject *parent) : QObject(parent) {
+}
+
+DetectionSchedulerTest::~DetectionSchedulerTest() {
+}
+
+void DetectionSchedulerTest::init() {
+    Track::setDecoderBackend(Track::FfmpegBackend);
+}
+
+void DetectionSchedulerTest::testRun() {
+    DetectionScheduler scheduler;
+    scheduler.setMaximumThreads(2);
+    QAtomicInt created = 0;
+    scheduler.setDetectorFactory([&created]() {
+        created.ref();
+        return new DummyBpmDetector;
+    });
+    QSignalSpy started(&scheduler, &DetectionScheduler::jobStarted);
+    QSignalSpy bpm(&scheduler, &DetectionScheduler::jobBpm);
+    QSignalSpy jobFinished(&scheduler, &DetectionScheduler::jobFinished);
+    QSignalSpy finished(&scheduler, &DetectionScheduler::finished);
+    const auto fileName = QString::fromUtf8(TEST_FILE_140BPM);
+    scheduler.start({{fileName, 0}, {fileName, 0}, {fileName, 0}});
+    QVERIFY(scheduler.isRunning());
+    QVERIFY(finished.wait());
+    QVERIFY(!scheduler.isRunning());
+    QCOMPARE(started.size(), 3);
+    QCOMPARE(bpm.size(), 3);
+    QCOMPARE(jobFinished.size(), 3);
+    // One detector per worker, not per job.
+    QCOMPARE(created.loadRelaxed(), 2);
+    QSet<int> indexes;
+    for (const auto &arguments : std::as_const(bpm)) {
+        indexes << arguments.at(0).toInt();
+        QCOMPARE(arguments.at(1).toDouble(), 120.0);
+    }
+    QCOMPARE(indexes, QSet<int>({0, 1, 2}));
+}
+
+void DetectionSchedulerTest::testStop() {
+    DetectionScheduler scheduler;
+    scheduler.setMaximumThreads(1);
+    scheduler.setDetectorFactory([]() { return new DummyBpmDetector; });
+    QSignalSpy jobFinished(&scheduler, &DetectionScheduler::jobFinished);
+    QSignalSpy finished(&scheduler, &DetectionScheduler::finished);
+    const auto fileName = QString::fromUtf8(TEST_FILE_140BPM);
+    QList<DetectionScheduler::Job> jobs;
+    for (auto i = 0; i < 50; ++i) {
+        jobs.append({fileName, 0});
+    }
+    scheduler.start(jobs);
+    scheduler.stop();
+    QVERIFY(!scheduler.isRunning());
+    QVERIFY(!finished.wait(500));
+    QCOMPARE(jobFinished.size(), 0);
+    // A new run can start while the old workers wind down.
+    scheduler.start({{fileName, 0}});
+    QVERIFY(finished.wait());
+    QCOMPARE(jobFinished.size(), 1);
+}
+
+void DetectionSchedulerTest::testKeepsCachedTag() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const auto fileName = dir.filePath(QStringLiteral("140bpm.ogg"));
+    QVERIFY(QFile::copy(QString::fromUtf8(TEST_FILE_140BPM), fileName));
+    BpmCache cache(dir.filePath(QStringLiteral("cache.bin")));
+    BpmCache::Entry entry;
+    entry.bpm = 130;
+    entry.saved = true;
+    cache.insert(fileName, entry);
+    Track::setCache(&cache);
+    DetectionScheduler scheduler;
+    scheduler.setDetectorFactory([]() { return new DummyBpmDetector; });
+    QSignalSpy finished(&scheduler, &DetectionScheduler::finished);
+    scheduler.start({{fileName, 0, 130}});
+    QVERIFY(finished.wait());
+    Track::setCache(nullptr);
+    // Only the detection result is new; the tag is not saved yet.
+    QVERIFY(cache.lookup(fileName, &entry));
+    QCOMPARE(entry.bpm, 130.0);
+    QVERIFY(entry.saved);
+    QCOMPARE(entry.rawBpm, 120.0);
+}
+
+void DetectionSchedulerTest::testMaximumThreads() {
+    DetectionScheduler scheduler;
+    QCOMPARE(scheduler.maximumThreads(), QThread::idealThreadCount());
+    scheduler.setMaximumThreads(3);
+    QCOMPARE(scheduler.maximumThreads(), 3);
+}
+
+QTEST_GUILESS_MAIN(DetectionSchedulerTest)
+
+#include "detectionschedulertest.moc"
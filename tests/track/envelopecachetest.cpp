@@ -0,0 +1,110 @@
+#include <QtTest>
+
+#include "fileidentityfixture.h"
+#include "track/envelopecache.h"
+
+class EnvelopeCacheTest : public FileIdentityFixture {
+    Q_OBJECT
+public:
+    explicit EnvelopeCacheTest(QObject *parent = nullptr);
+    ~EnvelopeCacheTest() override;
+
+private Q_SLOTS:
+    void init();
+    void testInsertLookup();
+    void testModifiedFile();
+    void testWithoutEnvelope();
+    void testClear();
+    void testCorruptEntry();
+
+private:
+    QString cacheDir_;
+};
+
+static EnvelopeCache::Entry makeEntry() {
+    EnvelopeCache::Entry entry;
+    for (auto i = 0; i < 2000; ++i) {
+        entry.envelope.push_back(i % 50 == 0 ? 2.0f : (i % 25 == 0 ? 0.5f : 0.0f));
+    }
+    entry.rate = 200.5;
+    entry.candidates = {{120, 1}, {80, 0.5}};
+    entry.version = 42;
+    return entry;
+}
+
+EnvelopeCacheTest::EnvelopeCacheTest(QObject *parent) : FileIdentityFixture(parent) {
+}
+
+EnvelopeCacheTest::~EnvelopeCacheTest() {
+}
+
+void EnvelopeCacheTest::init() {
+    cacheDir_ = filePath(QStringLiteral("envelopes"));
+    EnvelopeCache(cacheDir_).clear();
+    initFiles();
+}
+
+void EnvelopeCacheTest::testInsertLookup() {
+    EnvelopeCache cache(cacheDir_);
+    EnvelopeCache::Entry entry;
+    QVERIFY(!cache.lookup(filePath(QStringLiteral("a.mp3")), &entry));
+    QCOMPARE(cache.insert(filePath(QStringLiteral("missing.mp3")), makeEntry()), -1);
+    const auto size = cache.insert(filePath(QStringLiteral("a.mp3")), makeEntry());
+    // Quantized and compressed, well below 4 bytes per value.
+    QVERIFY(size > 0);
+    QVERIFY(size < 2000);
+    QVERIFY(cache.lookup(filePath(QStringLiteral("a.mp3")), &entry));
+    QCOMPARE(entry.version, 42u);
+    QCOMPARE(entry.rate, 200.5);
+    QCOMPARE(entry.candidates.size(), 2);
+    QCOMPARE(entry.candidates.at(1).bpm, 80.0);
+    QCOMPARE(entry.candidates.at(1).score, 0.5);
+    const auto expected = makeEntry().envelope;
+    QCOMPARE(entry.envelope.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        QVERIFY(qAbs(entry.envelope[i] - expected[i]) < 0.02f);
+    }
+    QVERIFY(!cache.lookup(filePath(QStringLiteral("b.mp3")), &entry));
+}
+
+void EnvelopeCacheTest::testModifiedFile() {
+    EnvelopeCache cache(cacheDir_);
+    cache.insert(filePath(QStringLiteral("a.mp3")), makeEntry());
+    modifyFile(QStringLiteral("a.mp3"));
+    EnvelopeCache::Entry entry;
+    QVERIFY(!cache.lookup(filePath(QStringLiteral("a.mp3")), &entry));
+}
+
+void EnvelopeCacheTest::testWithoutEnvelope() {
+    EnvelopeCache cache(cacheDir_);
+    cache.insert(filePath(QStringLiteral("a.mp3")), makeEntry());
+    EnvelopeCache::Entry entry;
+    QVERIFY(cache.lookup(filePath(QStringLiteral("a.mp3")), &entry, false));
+    QVERIFY(entry.envelope.empty());
+    QCOMPARE(entry.candidates.size(), 2);
+}
+
+void EnvelopeCacheTest::testClear() {
+    EnvelopeCache cache(cacheDir_);
+    cache.insert(filePath(QStringLiteral("a.mp3")), makeEntry());
+    cache.clear();
+    EnvelopeCache::Entry entry;
+    QVERIFY(!cache.lookup(filePath(QStringLiteral("a.mp3")), &entry));
+}
+
+void EnvelopeCacheTest::testCorruptEntry() {
+    EnvelopeCache cache(cacheDir_);
+    cache.insert(filePath(QStringLiteral("a.mp3")), makeEntry());
+    const auto files = QDir(cacheDir_).entryInfoList({QStringLiteral("*.env")}, QDir::Files);
+    QCOMPARE(files.size(), 1);
+    {
+        QFile file(files.first().absoluteFilePath());
+        QVERIFY(file.resize(file.size() - 10));
+    }
+    EnvelopeCache::Entry entry;
+    QVERIFY(!cache.lookup(filePath(QStringLiteral("a.mp3")), &entry));
+}
+
+QTEST_GUILESS_MAIN(EnvelopeCacheTest)
+
+#include "envelopecachetest.moc"
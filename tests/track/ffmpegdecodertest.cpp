@@ -0,0 +1,86 @@
+#include <QtTest>
+
+#include "ffmpegutils.h"
+#include "track/ffmpegdecoder.h"
+
+class FfmpegDecoderTest : public QObject {
+    Q_OBJECT
+public:
+    explicit FfmpegDecoderTest(QObject *parent = nullptr);
+    ~FfmpegDecoderTest() override;
+
+private Q_SLOTS:
+    void testDecode();
+    void testDecodeStopsWhenSinkReturnsFalse();
+    void testDecodeWithProbedContext();
+    void testDecodeWithoutOpen();
+    void testOpenInvalidFile();
+};
+
+FfmpegDecoderTest::FfmpegDecoderTest(QObject *parent) : QObject(parent) {
+}
+
+FfmpegDecoderTest::~FfmpegDecoderTest() {
+}
+
+void FfmpegDecoderTest::testDecode() {
+    FfmpegDecoder decoder(QString::fromUtf8(TEST_FILE_5S_SILENT));
+    QVERIFY(decoder.open(2, 48000));
+    QVERIFY(decoder.duration() >= 5000);
+    qint64 frames = 0;
+    qint64 lastPosition = 0;
+    QVERIFY(decoder.decode(
+        [&frames, &lastPosition](const soundtouch::SAMPLETYPE *samples, int count, qint64 pos) {
+            Q_UNUSED(samples)
+            frames += count;
+            lastPosition = pos;
+            return true;
+        }));
+    // About 5 seconds at 48 kHz.
+    QVERIFY(frames >= 48000 * 5);
+    QVERIFY(lastPosition >= 5000);
+}
+
+void FfmpegDecoderTest::testDecodeStopsWhenSinkReturnsFalse() {
+    FfmpegDecoder decoder(QString::fromUtf8(TEST_FILE_5S_SILENT));
+    QVERIFY(decoder.open(1, 11025));
+    auto calls = 0;
+    QVERIFY(decoder.decode([&calls](const soundtouch::SAMPLETYPE *, int, qint64) {
+        ++calls;
+        return false;
+    }));
+    QCOMPARE(calls, 1);
+}
+
+void FfmpegDecoderTest::testDecodeWithProbedContext() {
+    // The probe only reads headers, so the decoder must cope with incomplete codec parameters.
+    const auto fileName = QString::fromUtf8(TEST_FILE_5S_SILENT);
+    auto probe = probeFile(fileName, true);
+    QVERIFY(probe.formatContext);
+    QVERIFY(probe.length >= 5000);
+    FfmpegDecoder decoder(fileName, std::move(probe.formatContext));
+    QVERIFY(decoder.open(1, 11025));
+    qint64 frames = 0;
+    QVERIFY(decoder.decode([&frames](const soundtouch::SAMPLETYPE *, int count, qint64) {
+        frames += count;
+        return true;
+    }));
+    QVERIFY(frames >= 11025 * 5);
+}
+
+void FfmpegDecoderTest::testDecodeWithoutOpen() {
+    FfmpegDecoder decoder(QString::fromUtf8(TEST_FILE_5S_SILENT));
+    QVERIFY(!decoder.decode([](const soundtouch::SAMPLETYPE *, int, qint64) { return true; }));
+    QVERIFY(!decoder.errorString().isEmpty());
+}
+
+void FfmpegDecoderTest::testOpenInvalidFile() {
+    FfmpegDecoder decoder(QStringLiteral("does-not-exist.mp3"));
+    QVERIFY(!decoder.open(2, 48000));
+    QVERIFY(!decoder.errorString().isEmpty());
+    QCOMPARE(decoder.duration(), 0);
+}
+
+QTEST_GUILESS_MAIN(FfmpegDecoderTest)
+
+#include "ffmpegdecodertest.moc"
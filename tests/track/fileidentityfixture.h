@@ -0,0 +1,40 @@
+#pragma once
+
+#include <QtCore/QFile>
+#include <QtCore/QObject>
+#include <QtCore/QTemporaryDir>
+#include <QtTest>
+
+/**
+ * Base of the tests of stores keyed by file identity (see identifyFile()). Provides a temporary
+ * directory with the files `a.mp3` and `b.mp3`, whose contents differ.
+ */
+class FileIdentityFixture : public QObject {
+public:
+    explicit FileIdentityFixture(QObject *parent = nullptr) : QObject(parent) {
+    }
+
+protected:
+    /** Write `a.mp3` and `b.mp3` again. Call from the `init()` slot. */
+    void initFiles() {
+        QVERIFY(dir_.isValid());
+        writeFile(QStringLiteral("a.mp3"), QByteArrayLiteral("a"));
+        writeFile(QStringLiteral("b.mp3"), QByteArrayLiteral("b"));
+    }
+    /** Get the path of a file in the temporary directory. */
+    QString filePath(const QString &name) const {
+        return dir_.filePath(name);
+    }
+    /** Write a file in the temporary directory. */
+    void writeFile(const QString &name, const QByteArray &data) {
+        QFile file(filePath(name));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(data);
+    }
+    /** Change the size of a file, which changes its identity. */
+    void modifyFile(const QString &name) {
+        writeFile(name, QByteArrayLiteral("longer"));
+    }
+
+    QTemporaryDir dir_;
+};
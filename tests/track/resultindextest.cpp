@@ -0,0 +1,146 @@
+#include <QtTest>
+
+#include "fileidentityfixture.h"
+#include "track/resultindex.h"
+
+class ResultIndexTest : public FileIdentityFixture {
+    Q_OBJECT
+public:
+    explicit ResultIndexTest(QObject *parent = nullptr);
+    ~ResultIndexTest() override;
+
+private Q_SLOTS:
+    void init();
+    void testInsertLookup();
+    void testModifiedFile();
+    void testPersistence();
+    void testAppendOnly();
+    void testPartialLine();
+
+private:
+    QStringList readLines() const;
+
+    QString indexFile_;
+};
+
+static ResultIndex::Entry makeEntry(bpmtype bpm) {
+    ResultIndex::Entry entry;
+    entry.bpm = bpm;
+    entry.rawBpm = bpm / 2;
+    entry.length = 180000;
+    entry.detector = QStringLiteral("autocorrelation");
+    entry.detectorVersion = 4000000000u;
+    return entry;
+}
+
+ResultIndexTest::ResultIndexTest(QObject *parent) : FileIdentityFixture(parent) {
+}
+
+ResultIndexTest::~ResultIndexTest() {
+}
+
+void ResultIndexTest::init() {
+    indexFile_ = filePath(QStringLiteral("index/results.jsonl"));
+    QFile::remove(indexFile_);
+    initFiles();
+}
+
+QStringList ResultIndexTest::readLines() const {
+    QFile file(indexFile_);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return {};
+    }
+    return QString::fromUtf8(file.readAll()).split(QLatin1Char('\n'), Qt::SkipEmptyParts);
+}
+
+void ResultIndexTest::testInsertLookup() {
+    ResultIndex index(indexFile_);
+    ResultIndex::Entry entry;
+    QVERIFY(!index.lookup(filePath(QStringLiteral("a.mp3")), &entry));
+    index.insert(filePath(QStringLiteral("missing.mp3")), makeEntry(120));
+    QCOMPARE(index.size(), 0);
+    index.insert(filePath(QStringLiteral("a.mp3")), makeEntry(140));
+    QVERIFY(index.lookup(filePath(QStringLiteral("a.mp3")), &entry));
+    QCOMPARE(entry.bpm, 140.0);
+    QCOMPARE(entry.rawBpm, 70.0);
+    QCOMPARE(entry.length, 180000);
+    QCOMPARE(entry.detector, QStringLiteral("autocorrelation"));
+    QCOMPARE(entry.detectorVersion, 4000000000u);
+    QVERIFY(!index.lookup(filePath(QStringLiteral("b.mp3")), &entry));
+    // Relative paths name the same entry.
+    QVERIFY(QDir::setCurrent(dir_.path()));
+    QVERIFY(index.lookup(QStringLiteral("a.mp3"), &entry));
+}
+
+void ResultIndexTest::testModifiedFile() {
+    ResultIndex index(indexFile_);
+    index.insert(filePath(QStringLiteral("a.mp3")), makeEntry(140));
+    modifyFile(QStringLiteral("a.mp3"));
+    ResultIndex::Entry entry;
+    QVERIFY(!index.lookup(filePath(QStringLiteral("a.mp3")), &entry));
+}
+
+void ResultIndexTest::testPersistence() {
+    {
+        ResultIndex index(indexFile_);
+        index.insert(filePath(QStringLiteral("a.mp3")), makeEntry(140));
+        index.insert(filePath(QStringLiteral("b.mp3")), makeEntry(100));
+        // Nothing is written before a flush or a full batch.
+        QVERIFY(readLines().isEmpty());
+        QVERIFY(index.flush());
+        QCOMPARE(readLines().size(), 2);
+        index.insert(filePath(QStringLiteral("a.mp3")), makeEntry(150));
+    }
+    ResultIndex index(indexFile_);
+    QCOMPARE(index.size(), 2);
+    ResultIndex::Entry entry;
+    QVERIFY(index.lookup(filePath(QStringLiteral("a.mp3")), &entry));
+    QCOMPARE(entry.bpm, 150.0);
+    QCOMPARE(entry.detectorVersion, 4000000000u);
+    QVERIFY(index.lookup(filePath(QStringLiteral("b.mp3")), &entry));
+    QCOMPARE(entry.bpm, 100.0);
+}
+
+void ResultIndexTest::testAppendOnly() {
+    {
+        ResultIndex index(indexFile_);
+        index.insert(filePath(QStringLiteral("a.mp3")), makeEntry(140));
+    }
+    const auto first = readLines();
+    QCOMPARE(first.size(), 1);
+    QVERIFY(first.first().contains(QStringLiteral("\"bpm\":140")));
+    {
+        ResultIndex index(indexFile_);
+        index.insert(filePath(QStringLiteral("a.mp3")), makeEntry(150));
+    }
+    const auto lines = readLines();
+    QCOMPARE(lines.size(), 2);
+    QCOMPARE(lines.first(), first.first());
+}
+
+void ResultIndexTest::testPartialLine() {
+    {
+        ResultIndex index(indexFile_);
+        index.insert(filePath(QStringLiteral("a.mp3")), makeEntry(140));
+    }
+    {
+        // As left by an interrupted write.
+        QFile file(indexFile_);
+        QVERIFY(file.open(QIODevice::Append));
+        file.write(QByteArrayLiteral("{\"path\":\"/trunc"));
+    }
+    {
+        ResultIndex index(indexFile_);
+        QCOMPARE(index.size(), 1);
+        index.insert(filePath(QStringLiteral("b.mp3")), makeEntry(100));
+    }
+    ResultIndex index(indexFile_);
+    QCOMPARE(index.size(), 2);
+    ResultIndex::Entry entry;
+    QVERIFY(index.lookup(filePath(QStringLiteral("b.mp3")), &entry));
+    QCOMPARE(entry.bpm, 100.0);
+}
+
+QTEST_GUILESS_MAIN(ResultIndexTest)
+
+#include "resultindextest.moc"
@@ -0,0 +1,153 @@
+#include <QtCore/QTemporaryDir>
+#include <QtTest/QSignalSpy>
+#include <QtTest>
+
+#include "ffmpegutils.h"
+#include "track/bpmcache.h"
+#include "track/tagwriter.h"
+#include "track/track.h"
+
+class TagWriterTest : public QObject {
+    Q_OBJECT
+public:
+    explicit TagWriterTest(QObject *parent = nullptr);
+    ~TagWriterTest() override;
+
+private Q_SLOTS:
+    void init();
+    void testWriteAndRemove();
+    void testGroupsByDirectory();
+    void testFailedWrite();
+    void testUnbounded();
+    void testCacheEntry();
+
+private:
+    QString copyTestFile(const QString &name);
+
+    QTemporaryDir dir_;
+};
+
+TagWriterTest::TagWriterTest(QObject *parent) : QObject(parent) {
+    qRegisterMetaType<TagWriteResult>();
+}
+
+TagWriterTest::~TagWriterTest() {
+}
+
+void TagWriterTest::init() {
+    QVERIFY(dir_.isValid());
+}
+
+QString TagWriterTest::copyTestFile(const QString &name) {
+    const auto fileName = dir_.filePath(name);
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+    QFile::remove(fileName);
+    if (!QFile::copy(QString::fromUtf8(TEST_FILE_140BPM), fileName)) {
+        return {};
+    }
+    QFile(fileName).setPermissions(QFile::ReadOwner | QFile::WriteOwner);
+    return fileName;
+}
+
+void TagWriterTest::testWriteAndRemove() {
+    const auto fileName = copyTestFile(QStringLiteral("a.ogg"));
+    QVERIFY(!fileName.isEmpty());
+    TagWriter writer;
+    QSignalSpy written(&writer, &TagWriter::written);
+    QSignalSpy drained(&writer, &TagWriter::drained);
+    writer.enqueue({fileName, QStringLiteral("140.00"), {}});
+    writer.flush();
+    QCOMPARE(readTagsFromFile(fileName)[QStringLiteral("bpm")].toString(),
+             QStringLiteral("140.00"));
+    // Queued after the save of the same file, so it is done after it.
+    writer.enqueue({fileName, QStringLiteral("150.00"), {}});
+    writer.enqueue({fileName, QString(), {}});
+    writer.flush();
+    QVERIFY(readTagsFromFile(fileName)[QStringLiteral("bpm")].toString().isEmpty());
+    QTRY_COMPARE(written.size(), 3);
+    QCOMPARE(written.at(0).at(0).toString(), fileName);
+    QCOMPARE(written.at(2).at(1).toString(), QString());
+    QVERIFY(written.at(2).at(2).value<TagWriteResult>().ok);
+    QTRY_VERIFY(drained.size() >= 1);
+    QVERIFY(!writer.isBusy());
+    const auto summary = writer.summary();
+    QCOMPARE(summary.written, 3);
+    QCOMPARE(summary.failed, 0);
+    // Written in two batches, to one directory.
+    QCOMPARE(summary.directories, 1);
+    writer.resetSummary();
+    QCOMPARE(writer.summary().written, 0);
+    QCOMPARE(writer.summary().directories, 0);
+}
+
+void TagWriterTest::testGroupsByDirectory() {
+    QStringList files;
+    for (const auto &name : {QStringLiteral("x/1.ogg"),
+                             QStringLiteral("y/1.ogg"),
+                             QStringLiteral("x/2.ogg"),
+                             QStringLiteral("y/2.ogg")}) {
+        files << copyTestFile(name);
+        QVERIFY(!files.last().isEmpty());
+    }
+    TagWriter writer;
+    writer.setMaximumThreads(2);
+    writer.setCapacity(1);
+    for (const auto &file : std::as_const(files)) {
+        writer.enqueue({file, QStringLiteral("120.00"), {}});
+    }
+    writer.flush();
+    for (const auto &file : std::as_const(files)) {
+        QCOMPARE(readTagsFromFile(file)[QStringLiteral("bpm")].toString(),
+                 QStringLiteral("120.00"));
+    }
+    const auto summary = writer.summary();
+    QCOMPARE(summary.written, 4);
+    QCOMPARE(summary.directories, 2);
+}
+
+void TagWriterTest::testFailedWrite() {
+    TagWriter writer;
+    QSignalSpy written(&writer, &TagWriter::written);
+    writer.enqueue({dir_.filePath(QStringLiteral("missing.ogg")), QStringLiteral("120.00"), {}});
+    writer.flush();
+    QCOMPARE(writer.summary().failed, 1);
+    QCOMPARE(writer.summary().written, 0);
+    QTRY_COMPARE(written.size(), 1);
+    const auto result = written.at(0).at(2).value<TagWriteResult>();
+    QVERIFY(!result.ok);
+    QVERIFY(!result.error.isEmpty());
+}
+
+void TagWriterTest::testUnbounded() {
+    TagWriter writer;
+    writer.setCapacity(0);
+    for (auto i = 0; i < 200; ++i) {
+        writer.enqueue(
+            {dir_.filePath(QStringLiteral("missing%1.ogg").arg(i)), QStringLiteral("120.00"), {}});
+    }
+    writer.flush();
+    QCOMPARE(writer.summary().failed, 200);
+}
+
+void TagWriterTest::testCacheEntry() {
+    const auto fileName = copyTestFile(QStringLiteral("cached.ogg"));
+    QVERIFY(!fileName.isEmpty());
+    BpmCache cache(dir_.filePath(QStringLiteral("cache.bin")));
+    Track::setCache(&cache);
+    {
+        TagWriter writer;
+        writer.enqueue({fileName, QStringLiteral("140.00"), BpmCache::Entry{139.5, 70, 5000, 7}});
+    }
+    Track::setCache(nullptr);
+    BpmCache::Entry entry;
+    QVERIFY(cache.lookup(fileName, &entry));
+    QCOMPARE(entry.bpm, 140.0);
+    QCOMPARE(entry.rawBpm, 70.0);
+    QCOMPARE(entry.length, 5000);
+    QCOMPARE(entry.detectorVersion, 7u);
+    QVERIFY(entry.saved);
+}
+
+QTEST_GUILESS_MAIN(TagWriterTest)
+
+#include "tagwritertest.moc"
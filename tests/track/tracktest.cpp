@@ -3,11 +3,17 @@
 #include <QtCore/QDir>
 #include <QtCore/QFile>
 #include <QtCore/QFileInfo>
+#include <QtCore/QTemporaryDir>
 #include <QtCore/QTemporaryFile>
 #include <QtMultimedia/QAudioDecoder>
 #include <QtTest>
 
+#include "track/autocorrelationbpmdetector.h"
+#include "track/bpmcache.h"
+#include "track/envelopecache.h"
+#include "track/ffmpegdecoder.h"
 #include "track/track.h"
+#include "xattrtags.h"
 
 struct DummyTrack : public Track {
     DummyTrack() : Track() {
@@ -35,6 +41,28 @@ public:
     }
 };
 
+/** Reports the given estimates in turn, one per call of getBpm(). */
+class SequenceBpmDetector : public AbstractBpmDetector {
+    Q_OBJECT
+public:
+    SequenceBpmDetector(const QList<bpmtype> &estimates, QObject *parent = nullptr)
+        : AbstractBpmDetector(parent), estimates_(estimates) {
+    }
+    void inputSamples(const soundtouch::SAMPLETYPE *samples, int numSamples) override {
+        Q_UNUSED(samples)
+        Q_UNUSED(numSamples)
+    }
+    bpmtype getBpm() const override {
+        return estimates_.value(next_++);
+    }
+    void reset() override {
+    }
+
+private:
+    QList<bpmtype> estimates_;
+    mutable qsizetype next_ = 0;
+};
+
 class TrackTest : public QObject {
     Q_OBJECT
 public:
@@ -56,6 +84,19 @@ private Q_SLOTS:
     void testValidFile();
     void testSetBpmTag();
     void testStop();
+    void testFfmpegBackend();
+    void testConvergence();
+    void testSamplingWindows();
+    void testSampling();
+    void testSamplingKeepsRawBpm();
+    void testDetectionFormat();
+    void testProbeConstructor();
+    void testProbeInvalidFile();
+    void testProbeAudioHash();
+    void testCache();
+    void testEnvelopeCache();
+    void testBpmAttribute();
+    void testFoldCandidates();
 };
 
 TrackTest::TrackTest(QObject *parent) : QObject(parent) {
@@ -218,6 +259,314 @@ void TrackTest::testStop() {
     QVERIFY(t.stopped_);
 }
 
+void TrackTest::testFfmpegBackend() {
+    const auto oldBackend = Track::decoderBackend();
+    Track::setDecoderBackend(Track::FfmpegBackend);
+    QCOMPARE(Track::decoderBackend(), Track::FfmpegBackend);
+    Track t(QString::fromUtf8(TEST_FILE_5S_SILENT), static_cast<QAudioDecoder *>(nullptr));
+    t.setDetector(new DummyBpmDetector(this));
+    QSignalSpy finishedSpy(&t, &Track::finished);
+    QSignalSpy progressSpy(&t, &Track::progress);
+    QCOMPARE(t.detectBpm(), Track::Detecting);
+    QVERIFY(finishedSpy.wait());
+    QVERIFY(progressSpy.count() > 0);
+    QVERIFY(t.bpm() > 0);
+    Track::setDecoderBackend(oldBackend);
+}
+
+void TrackTest::testConvergence() {
+    const auto oldBackend = Track::decoderBackend();
+    const auto oldConvergence = Track::convergence();
+    Track::setDecoderBackend(Track::FfmpegBackend);
+    Track::Convergence convergence;
+    convergence.enabled = true;
+    convergence.interval = 1000;
+    convergence.window = 2000;
+    Track::setConvergence(convergence);
+    Track t(QString::fromUtf8(TEST_FILE_5S_SILENT), static_cast<QAudioDecoder *>(nullptr));
+    t.setDetector(new DummyBpmDetector(this));
+    QSignalSpy finishedSpy(&t, &Track::finished);
+    QSignalSpy hasBpmSpy(&t, &Track::hasBpm);
+    QCOMPARE(t.detectBpm(), Track::Detecting);
+    QVERIFY(finishedSpy.wait());
+    QCOMPARE(hasBpmSpy.count(), 1);
+    QCOMPARE(t.bpm(), 120.0);
+    // The estimate never changes, so decoding stops at the third check.
+    QVERIFY(t.decodedLength() >= 3000);
+    QVERIFY(t.decodedLength() < 4000);
+    QVERIFY(t.decodedFraction() > 0 && t.decodedFraction() < 1);
+    Track::setConvergence(oldConvergence);
+    Track::setDecoderBackend(oldBackend);
+}
+
+void TrackTest::testSamplingWindows() {
+    const auto oldSampling = Track::sampling();
+    Track::Sampling sampling;
+    QVERIFY(Track::samplingWindows(600000).isEmpty());
+    sampling.windows = 3;
+    Track::setSampling(sampling);
+    // 10 minutes: 60 s skipped at each end, 160 s per share.
+    QCOMPARE(Track::samplingWindows(600000), QList<qint64>({130000, 290000, 450000}));
+    // Too short to hold 3 windows of 20 s.
+    QVERIFY(Track::samplingWindows(60000).isEmpty());
+    QVERIFY(Track::samplingWindows(0).isEmpty());
+    Track::setSampling(oldSampling);
+}
+
+void TrackTest::testSampling() {
+    const auto oldSampling = Track::sampling();
+    Track::Sampling sampling;
+    sampling.windows = 2;
+    sampling.windowLength = 1000;
+    Track::setSampling(sampling);
+    Track t(QString::fromUtf8(TEST_FILE_5S_SILENT), static_cast<QAudioDecoder *>(nullptr));
+    t.setDetector(new DummyBpmDetector(this));
+    QSignalSpy finishedSpy(&t, &Track::finished);
+    QSignalSpy hasBpmSpy(&t, &Track::hasBpm);
+    QCOMPARE(t.detectBpm(), Track::Detecting);
+    QVERIFY(finishedSpy.wait());
+    QCOMPARE(hasBpmSpy.count(), 1);
+    QCOMPARE(t.bpm(), 120.0);
+    QCOMPARE(t.decodedLength(), qint64(2000));
+    Track::setSampling(oldSampling);
+}
+
+void TrackTest::testSamplingKeepsRawBpm() {
+    const auto oldSampling = Track::sampling();
+    Track::Sampling sampling;
+    sampling.windows = 2;
+    sampling.windowLength = 1000;
+    Track::setSampling(sampling);
+    Track t(QString::fromUtf8(TEST_FILE_5S_SILENT), static_cast<QAudioDecoder *>(nullptr));
+    // The first window is detected at double tempo.
+    t.setDetector(new SequenceBpmDetector({236, 122}, this));
+    QSignalSpy finishedSpy(&t, &Track::finished);
+    QCOMPARE(t.detectBpm(), Track::Detecting);
+    QVERIFY(finishedSpy.wait());
+    QCOMPARE(t.bpm(), 120.0);
+    // The median stays in the octave of the detector, not the folded one.
+    QCOMPARE(t.rawBpm(), 240.0);
+    Track::setSampling(oldSampling);
+}
+
+void TrackTest::testDetectionFormat() {
+    QCOMPARE(Track::detectionChannels(), 1);
+    QCOMPARE(Track::detectionSampleRate(), 11025);
+    Track::setDetectionFormat(3, 11025);
+    Track::setDetectionFormat(1, 100);
+    QCOMPARE(Track::detectionChannels(), 1);
+    QCOMPARE(Track::detectionSampleRate(), 11025);
+
+    const auto oldBackend = Track::decoderBackend();
+    Track::setDecoderBackend(Track::FfmpegBackend);
+    Track::setDetectionFormat(2, 8000);
+    Track t(QString::fromUtf8(TEST_FILE_5S_SILENT), static_cast<QAudioDecoder *>(nullptr));
+    auto detector = new DummyBpmDetector(this);
+    t.setDetector(detector);
+    QCOMPARE(t.detectBpm(), Track::Detecting);
+    QCOMPARE(detector->channels(), 2);
+    QCOMPARE(detector->sampleRate(), 8000);
+    t.stop();
+    Track::setDetectionFormat(1, 11025);
+    Track::setDecoderBackend(oldBackend);
+}
+
+void TrackTest::testProbeConstructor() {
+    const auto fileName = QString::fromUtf8(TEST_FILE_5S_SILENT);
+    auto probe = probeFile(fileName, true);
+    QVERIFY(probe.opened);
+    QVERIFY(probe.hasAudio);
+    QVERIFY(probe.formatContext);
+    QVERIFY(probe.error.isEmpty());
+    QCOMPARE(probe.bpmKey, QStringLiteral("TBPM"));
+    Track t(fileName, probe, static_cast<QAudioDecoder *>(nullptr));
+    QCOMPARE(t.artist(), QStringLiteral("Artist"));
+    QCOMPARE(t.title(), QStringLiteral("Title"));
+    QVERIFY(t.length() >= 5000);
+    QVERIFY(t.isValid());
+    QCOMPARE(t.formatContext_, probe.formatContext);
+}
+
+void TrackTest::testProbeInvalidFile() {
+    auto probe = probeFile(QStringLiteral("does-not-exist.mp3"), true);
+    QVERIFY(!probe.opened);
+    QVERIFY(!probe.hasAudio);
+    QVERIFY(!probe.formatContext);
+    QVERIFY(!probe.error.isEmpty());
+}
+
+void TrackTest::testProbeAudioHash() {
+    const auto fileName = QString::fromUtf8(TEST_FILE_5S_SILENT);
+    auto context = probeFile(fileName, true).formatContext;
+    QVERIFY(context);
+    const auto hash = hashAudio(context);
+    QVERIFY(hash != 0);
+    // The context is rewound, so it hashes the same again and can still be decoded.
+    QVERIFY(context);
+    QCOMPARE(hashAudio(context), hash);
+    FfmpegDecoder decoder(fileName, context);
+    QVERIFY(decoder.open(1, 11025));
+    auto frames = qint64(0);
+    decoder.decode([&frames](const soundtouch::SAMPLETYPE *, int count, qint64) {
+        frames += count;
+        return true;
+    });
+    QVERIFY(frames > 11025 * 4);
+    // Tags are not part of the hash.
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const auto copy = dir.filePath(QStringLiteral("copy.mp3"));
+    QVERIFY(QFile::copy(fileName, copy));
+    QVERIFY(storeBpmInFile(copy, QStringLiteral("123")).ok);
+    QCOMPARE(hashAudio(copy), hash);
+    QCOMPARE(hashAudio(dir.filePath(QStringLiteral("missing.mp3"))), 0u);
+}
+
+void TrackTest::testCache() {
+    const auto oldBackend = Track::decoderBackend();
+    Track::setDecoderBackend(Track::FfmpegBackend);
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const auto fileName = dir.filePath(QStringLiteral("track.mp3"));
+    QVERIFY(QFile::copy(QString::fromUtf8(TEST_FILE_5S_SILENT), fileName));
+    BpmCache cache(dir.filePath(QStringLiteral("cache.bin")));
+    Track::setCache(&cache);
+    {
+        Track t(fileName, static_cast<QAudioDecoder *>(nullptr));
+        QCOMPARE(cache.size(), 1);
+        t.setDetector(new DummyBpmDetector(this));
+        QSignalSpy finishedSpy(&t, &Track::finished);
+        QCOMPARE(t.detectBpm(), Track::Detecting);
+        QVERIFY(finishedSpy.wait());
+    }
+    BpmCache::Entry entry;
+    QVERIFY(cache.lookup(fileName, &entry));
+    QCOMPARE(entry.rawBpm, 120.0);
+    QCOMPARE(entry.detectorVersion, Track::detectorVersion());
+    QVERIFY(!entry.saved);
+
+    // A cached result is reported without decoding.
+    entry.rawBpm = 200;
+    cache.insert(fileName, entry);
+    {
+        Track t(fileName, static_cast<QAudioDecoder *>(nullptr));
+        t.setDetector(new DummyBpmDetector(this));
+        QSignalSpy finishedSpy(&t, &Track::finished);
+        QSignalSpy progressSpy(&t, &Track::progress);
+        QCOMPARE(t.detectBpm(), Track::Detecting);
+        QVERIFY(finishedSpy.wait());
+        QCOMPARE(progressSpy.count(), 0);
+        QCOMPARE(t.bpm(), Track::correctBpm(200));
+    }
+
+    // Results of other settings are not used.
+    const auto version = Track::detectorVersion();
+    Track::setDetectionFormat(2, 22050);
+    QVERIFY(Track::detectorVersion() != version);
+    Track::setDetectionFormat(1, 11025);
+    QCOMPARE(Track::detectorVersion(), version);
+
+    Track::setCache(nullptr);
+    Track::setDecoderBackend(oldBackend);
+}
+
+void TrackTest::testBpmAttribute() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const auto fileName = dir.filePath(QStringLiteral("track.mp3"));
+    QVERIFY(QFile::copy(QString::fromUtf8(TEST_FILE_5S_SILENT), fileName));
+    QFile(fileName).setPermissions(QFile::ReadOwner | QFile::WriteOwner);
+    const auto size = QFileInfo(fileName).size();
+    const auto modified = QFileInfo(fileName).lastModified();
+    Track::setBpmAttribute(QStringLiteral("user.bpm"));
+    {
+        DummyTrack t(fileName);
+        t.setBpm(128);
+        t.saveBpm();
+        if (!t.hasSavedBpm()) {
+            Track::setBpmAttribute(QString());
+            QSKIP("Extended attributes are not supported here.");
+        }
+    }
+    QCOMPARE(readBpmFromAttribute(fileName, QStringLiteral("user.bpm")), 128.0);
+    // The file itself is not written.
+    QCOMPARE(QFileInfo(fileName).size(), size);
+    QCOMPARE(QFileInfo(fileName).lastModified(), modified);
+    QCOMPARE(readTagsFromFile(fileName)[QStringLiteral("bpm")].toDouble(), 0.0);
+    {
+        DummyTrack t(fileName);
+        QCOMPARE(t.bpm(), 128.0);
+        QVERIFY(t.hasSavedBpm());
+        t.clearBpm();
+    }
+    QCOMPARE(readBpmFromAttribute(fileName, QStringLiteral("user.bpm")), 0.0);
+    // Removing an attribute that is not set succeeds.
+    QVERIFY(Track::writeBpm(fileName, QString()).ok);
+    Track::setBpmAttribute(QString());
+}
+
+void TrackTest::testEnvelopeCache() {
+    const auto oldBackend = Track::decoderBackend();
+    Track::setDecoderBackend(Track::FfmpegBackend);
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const auto fileName = dir.filePath(QStringLiteral("track.mp3"));
+    QVERIFY(QFile::copy(QString::fromUtf8(TEST_FILE_5S_SILENT), fileName));
+    EnvelopeCache cache(dir.filePath(QStringLiteral("envelopes")));
+    Track::setEnvelopeCache(&cache);
+    {
+        Track t(fileName, static_cast<QAudioDecoder *>(nullptr));
+        t.setDetector(new AutocorrelationBpmDetector(this));
+        QSignalSpy finishedSpy(&t, &Track::finished);
+        QCOMPARE(t.detectBpm(), Track::Detecting);
+        QVERIFY(finishedSpy.wait());
+        QVERIFY(t.envelopeCacheSize() > 0);
+    }
+    EnvelopeCache::Entry entry;
+    QVERIFY(cache.lookup(fileName, &entry));
+    QCOMPARE(entry.version, Track::envelopeVersion());
+    QVERIFY(!entry.envelope.empty());
+
+    // The cached envelope is used without decoding and is not stored again.
+    {
+        Track t(fileName, static_cast<QAudioDecoder *>(nullptr));
+        t.setDetector(new AutocorrelationBpmDetector(this));
+        QSignalSpy finishedSpy(&t, &Track::finished);
+        QSignalSpy progressSpy(&t, &Track::progress);
+        QCOMPARE(t.detectBpm(), Track::Detecting);
+        QVERIFY(finishedSpy.wait());
+        QCOMPARE(progressSpy.count(), 0);
+        QCOMPARE(t.envelopeCacheSize(), 0);
+    }
+
+    // Other detectors have no envelope to store.
+    {
+        Track t(fileName, static_cast<QAudioDecoder *>(nullptr));
+        t.setDetector(new DummyBpmDetector(this));
+        QSignalSpy finishedSpy(&t, &Track::finished);
+        QCOMPARE(t.detectBpm(), Track::Detecting);
+        QVERIFY(finishedSpy.wait());
+        QCOMPARE(t.envelopeCacheSize(), 0);
+    }
+
+    // Envelopes of another detection format are not used.
+    const auto version = Track::envelopeVersion();
+    Track::setDetectionFormat(1, 22050);
+    QVERIFY(Track::envelopeVersion() != version);
+    Track::setDetectionFormat(1, 11025);
+
+    Track::setEnvelopeCache(nullptr);
+    Track::setDecoderBackend(oldBackend);
+}
+
+void TrackTest::testFoldCandidates() {
+    const auto folded = Track::foldCandidates({{240, 1}, {120, 0.8}, {90, 0.5}, {0, 0.1}});
+    QCOMPARE(folded.size(), 2);
+    QCOMPARE(folded.at(0).bpm, 120.0);
+    QCOMPARE(folded.at(0).score, 1.0);
+    QCOMPARE(folded.at(1).bpm, 90.0);
+}
+
 QTEST_MAIN(TrackTest)
 
 #include "tracktest.moc"
@@ -10,6 +10,7 @@ public:
 private Q_SLOTS:
     void testBpmToString();
     void testBpmToString_data();
+    void testFormatLength();
     void testStringToBpm();
     void testStringToBpm_data();
     void testParseCommandLine();
@@ -59,6 +60,12 @@ void UtilsTest::testBpmToString() {
     QCOMPARE(bpmToString(input, format), expected);
 }
 
+void UtilsTest::testFormatLength() {
+    QCOMPARE(formatLength(0), QStringLiteral("00:00"));
+    QCOMPARE(formatLength(59999), QStringLiteral("00:59"));
+    QCOMPARE(formatLength(225000), QStringLiteral("03:45"));
+}
+
 void UtilsTest::testParseCommandLine() {
     int argc = 4;
     const char *argv[] = {"bpmdetect", "-s", "-n", "100"};
@@ -7,7 +7,7 @@
 #include "track/abstractbpmdetector.h"
 #include "track/track.h"
 #include "widgets/dlgbpmdetect.h"
-#include "widgets/trackitem.h"
+#include "widgets/trackmodel.h"
 
 class DummyBpmDetector : public AbstractBpmDetector {
     Q_OBJECT
@@ -34,9 +34,11 @@ public:
 private Q_SLOTS:
     void testConstructor();
     void testEnableControls();
-    void testFilesFromDir();
+    void testAddDirectories();
+    void testSetDetectorType();
     void testSetRecentPath();
     void testSlotAddFiles();
+    void testSlotCancelAdd();
     void testSlotClearDetected();
     void testSlotClearTrackList();
     void testSlotDropped();
@@ -68,60 +70,104 @@ void DlgBpmDetectTest::testEnableControls() {
     QVERIFY(!dlg.btnAddFiles->isEnabled());
 }
 
+void DlgBpmDetectTest::testSetDetectorType() {
+    {
+        DlgBpmDetect dlg;
+        dlg.setDetectorType(Track::SoundTouchDetector);
+        dlg.cbDetector->setCurrentIndex(static_cast<int>(Track::AutocorrelationDetector));
+        QCOMPARE(Track::detectorType(), Track::AutocorrelationDetector);
+    }
+    // The saved setting is restored and can be overridden.
+    DlgBpmDetect dlg;
+    QCOMPARE(dlg.cbDetector->currentIndex(), static_cast<int>(Track::AutocorrelationDetector));
+    dlg.setDetectorType(Track::SoundTouchDetector);
+    QCOMPARE(dlg.cbDetector->currentIndex(), static_cast<int>(Track::SoundTouchDetector));
+    QCOMPARE(Track::detectorType(), Track::SoundTouchDetector);
+}
+
 void DlgBpmDetectTest::testSetRecentPath() {
     DlgBpmDetect dlg;
     dlg.setRecentPath(QStringLiteral("/tmp"));
     QCOMPARE(dlg.recentPath(), QStringLiteral("/tmp"));
 }
 
-void DlgBpmDetectTest::testFilesFromDir() {
+void DlgBpmDetectTest::testAddDirectories() {
     DlgBpmDetect dlg;
-    QCOMPARE(dlg.filesFromDir(QStringLiteral("/nonexistent-path")).size(), 0);
-
     QVERIFY(QDir(QStringLiteral("testdir")).removeRecursively());
-    QVERIFY(QDir().mkdir(QStringLiteral("testdir")));
-    QFileInfo fi(QStringLiteral("testdir"));
-    QVERIFY(fi.exists());
-    QVERIFY(fi.isDir());
-    QVERIFY(QDir(QStringLiteral("testdir")).mkdir(QStringLiteral("subdir")));
+    QVERIFY(QDir().mkpath(QStringLiteral("testdir/subdir")));
     QFile file1(QStringLiteral("testdir/file1.txt"));
     QVERIFY(file1.open(QIODevice::WriteOnly));
     file1.close();
-    QFile file2(QStringLiteral("testdir/subdir/file2.mp3"));
-    QVERIFY(file2.open(QIODevice::WriteOnly));
-    file2.close();
-    auto files = dlg.filesFromDir(fi.absoluteFilePath());
-    QCOMPARE(files.size(), 2);
+    QVERIFY(QFile::copy(QString::fromUtf8(TEST_FILE), QStringLiteral("testdir/subdir/file2.ogg")));
+    dlg.addDirectories({QStringLiteral("testdir")});
+    QVERIFY(dlg.isAdding());
+    QVERIFY(!dlg.btnStart->isEnabled());
+    QTRY_VERIFY(!dlg.isAdding());
+    QVERIFY(dlg.btnStart->isEnabled());
+    QCOMPARE(dlg.model_->rowCount(), 1);
+    QVERIFY(dlg.model_->entry(0).fileName.endsWith(QStringLiteral("subdir/file2.ogg")));
+    QVERIFY(QDir(QStringLiteral("testdir")).removeRecursively());
 }
 
 void DlgBpmDetectTest::testSlotStartStop() {
     DlgBpmDetect dlg;
-    dlg.setDetector(new DummyBpmDetector(&dlg));
+    dlg.setDetectorFactory([]() { return new DummyBpmDetector; });
     dlg.slotStartStop();
     QCOMPARE(dlg.pendingTracks_, 0);
 
     dlg.chbSkipScanned->setChecked(false);
     dlg.chbSave->setChecked(false);
     dlg.slotAddFiles({QString::fromUtf8(TEST_FILE), QString::fromUtf8(TEST_FILE)});
+    QVERIFY(dlg.btnCancelAdd->isVisibleTo(&dlg));
+    QVERIFY(!dlg.btnStart->isEnabled());
+    QTRY_VERIFY(!dlg.ingester_->isRunning());
+    QVERIFY(!dlg.btnCancelAdd->isVisibleTo(&dlg));
+    QVERIFY(dlg.btnStart->isEnabled());
     dlg.slotStartStop();
+    QVERIFY(dlg.scheduler_->isRunning());
+    QVERIFY(!dlg.btnAddFiles->isEnabled());
+    QTRY_VERIFY(!dlg.scheduler_->isRunning());
     QCOMPARE(dlg.pendingTracks_, 0);
+    QVERIFY(dlg.btnAddFiles->isEnabled());
+    QCOMPARE(dlg.model_->rowCount(), 2);
+    for (auto row = 0; row < dlg.model_->rowCount(); ++row) {
+        QCOMPARE(dlg.model_->entry(row).bpm, 120.0);
+        QCOMPARE(dlg.model_->entry(row).progress, qint8(-1));
+    }
 }
 
 void DlgBpmDetectTest::testSlotClearTrackList() {
     DlgBpmDetect dlg;
-    auto item = new TrackItem(nullptr, new Track(this));
-    item->setText(0, QStringLiteral("test.mp3"));
-    dlg.TrackList->addTopLevelItem(item);
-    QCOMPARE(dlg.TrackList->topLevelItemCount(), 1);
+    TrackModel::Entry entry;
+    entry.fileName = QStringLiteral("test.mp3");
+    dlg.model_->append({entry});
+    QCOMPARE(dlg.TrackList->model()->rowCount(), 1);
     dlg.slotClearTrackList();
-    QCOMPARE(dlg.TrackList->topLevelItemCount(), 0);
+    QCOMPARE(dlg.TrackList->model()->rowCount(), 0);
     QCOMPARE(dlg.TotalProgress->value(), 0);
 }
 
 void DlgBpmDetectTest::testSlotAddFiles() {
     DlgBpmDetect dlg;
     dlg.slotAddFiles(QStringList{QStringLiteral("test.mp3")});
-    QCOMPARE(dlg.TrackList->topLevelItemCount(), 0);
+    QTRY_VERIFY(!dlg.ingester_->isRunning());
+    QCOMPARE(dlg.model_->rowCount(), 0);
+}
+
+void DlgBpmDetectTest::testSlotCancelAdd() {
+    DlgBpmDetect dlg;
+    QStringList files;
+    for (auto i = 0; i < 200; ++i) {
+        files.append(QString::fromUtf8(TEST_FILE));
+    }
+    dlg.slotAddFiles(files);
+    dlg.slotCancelAdd();
+    QVERIFY(!dlg.ingester_->isRunning());
+    QVERIFY(!dlg.btnCancelAdd->isVisibleTo(&dlg));
+    QVERIFY(dlg.btnStart->isEnabled());
+    const auto rows = dlg.model_->rowCount();
+    QTest::qWait(200);
+    QCOMPARE(dlg.model_->rowCount(), rows);
 }
 
 void DlgBpmDetectTest::testSlotDropped() {
@@ -132,18 +178,18 @@ void DlgBpmDetectTest::testSlotDropped() {
     mimeData->setUrls(urls);
     QDropEvent dropEvent(QPoint(10, 10), Qt::CopyAction, mimeData, Qt::LeftButton, Qt::NoModifier);
     dlg.slotDropped(&dropEvent);
-    QCOMPARE(dlg.TrackList->topLevelItemCount(), 0);
+    QTRY_VERIFY(!dlg.ingester_->isRunning());
+    QCOMPARE(dlg.model_->rowCount(), 0);
 }
 
 void DlgBpmDetectTest::testSlotStartStopSkipsFilesWithValidBpmIfSkipScannedIsChecked() {
     DlgBpmDetect dlg;
-    dlg.setDetector(new DummyBpmDetector(&dlg));
+    dlg.setDetectorFactory([]() { return new DummyBpmDetector; });
 
-    auto item1 = new TrackItem(dlg.TrackList, new Track(this));
-    item1->setProgressBar(new QProgressBar(&dlg));
-    item1->setText(0, QStringLiteral("test1.mp3"));
-    item1->track()->dBpm_ = 120.0;
-    dlg.TrackList->addTopLevelItem(item1);
+    TrackModel::Entry entry;
+    entry.fileName = QStringLiteral("test1.mp3");
+    entry.bpm = 120.0;
+    dlg.model_->append({entry});
 
     dlg.chbSkipScanned->setChecked(true);
     dlg.slotStartStop();
@@ -153,7 +199,7 @@ void DlgBpmDetectTest::testSlotStartStopSkipsFilesWithValidBpmIfSkipScannedIsChe
 
 void DlgBpmDetectTest::testSlotStartStopSavesBpmIfSaveIsChecked() {
     DlgBpmDetect dlg;
-    dlg.setDetector(new DummyBpmDetector(&dlg));
+    dlg.setDetectorFactory([]() { return new DummyBpmDetector; });
 
     QTemporaryFile tempFile;
     tempFile.setFileTemplate(QDir::tempPath() + QStringLiteral("/XXXXXX.ogg"));
@@ -166,47 +212,49 @@ void DlgBpmDetectTest::testSlotStartStopSavesBpmIfSaveIsChecked() {
     originalFile.close();
 
     dlg.slotAddFiles({tempFile.fileName()});
-    QCOMPARE(dlg.TrackList->topLevelItemCount(), 1);
+    QTRY_VERIFY(!dlg.ingester_->isRunning());
+    QCOMPARE(dlg.model_->rowCount(), 1);
 
     dlg.chbSave->setChecked(true);
     dlg.slotStartStop();
+    QTRY_VERIFY(!dlg.scheduler_->isRunning());
     QCOMPARE(dlg.pendingTracks_, 0);
 
     auto map = readTagsFromFile(tempFile.fileName());
     auto setBpm = map[QStringLiteral("bpm")].toDouble();
     qDebug() << "BPM in file:" << setBpm;
+    QTRY_VERIFY(dlg.model_->entry(0).saved);
 }
 
 void DlgBpmDetectTest::testSlotClearDetected() {
     DlgBpmDetect dlg;
 
-    auto item1 = new TrackItem(dlg.TrackList, new Track(this));
-    item1->setText(1, QStringLiteral("test1.mp3"));
-    item1->track()->setBpm(120.0);
-    dlg.TrackList->addTopLevelItem(item1);
-
-    auto item2 = new TrackItem(dlg.TrackList, new Track(this));
-    item2->setText(1, QStringLiteral("test2.mp3"));
-    dlg.TrackList->addTopLevelItem(item2);
+    TrackModel::Entry entry1;
+    entry1.fileName = QStringLiteral("test1.mp3");
+    entry1.bpm = 120.0;
+    TrackModel::Entry entry2;
+    entry2.fileName = QStringLiteral("test2.mp3");
+    dlg.model_->append({entry1, entry2});
 
-    QCOMPARE(dlg.TrackList->topLevelItemCount(), 2);
+    QCOMPARE(dlg.model_->rowCount(), 2);
     dlg.slotClearDetected();
-    QCOMPARE(dlg.TrackList->topLevelItemCount(), 1);
-    QCOMPARE(dlg.TrackList->topLevelItem(0)->text(1), QStringLiteral("test2.mp3"));
+    QCOMPARE(dlg.model_->rowCount(), 1);
+    QCOMPARE(dlg.model_->entry(0).fileName, QStringLiteral("test2.mp3"));
 }
 
 void DlgBpmDetectTest::testSlotSaveBpm() {
     DlgBpmDetect dlg;
     dlg.slotSaveBpm();
 
-    auto item1 = new TrackItem(dlg.TrackList, new Track(this));
-    item1->setText(0, QStringLiteral("120.0"));
-    item1->track()->dBpm_ = 0.0;
-    dlg.TrackList->addTopLevelItem(item1);
-    dlg.TrackList->setCurrentItem(item1);
+    TrackModel::Entry entry;
+    entry.fileName = QStringLiteral("nonexistent.mp3");
+    entry.bpm = 120.0;
+    dlg.model_->append({entry});
+    dlg.TrackList->selectAll();
 
     dlg.slotSaveBpm();
-    QCOMPARE(item1->track()->bpm(), 120.0);
+    QVERIFY(!dlg.model_->entry(0).saved);
+    QTRY_VERIFY(!dlg.model_->entry(0).lastError.isEmpty());
 }
 
 QTEST_MAIN(DlgBpmDetectTest)
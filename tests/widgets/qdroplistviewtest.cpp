@@ -1,3 +1,4 @@
+#include <QtGui/QStandardItemModel>
 #include <QtTest>
 
 #include "widgets/qdroplistview.h"
@@ -28,14 +29,20 @@ QDropListViewTest::~QDropListViewTest() {
 
 void QDropListViewTest::testRemoveSelected() {
     QDropListView view;
-    auto *item1 = new QTreeWidgetItem();
-    auto *item2 = new QTreeWidgetItem();
-    view.addTopLevelItem(item1);
-    view.addTopLevelItem(item2);
-    item1->setSelected(true);
-    item2->setSelected(true);
+    QStandardItemModel model(5, 2);
+    for (auto i = 0; i < model.rowCount(); ++i) {
+        model.setItem(i, 0, new QStandardItem(QString::number(i)));
+    }
+    view.setModel(&model);
+    view.setSelectionMode(QAbstractItemView::ExtendedSelection);
+    for (const auto row : {0, 1, 3}) {
+        view.selectionModel()->select(model.index(row, 0),
+                                      QItemSelectionModel::Select | QItemSelectionModel::Rows);
+    }
     view.slotRemoveSelected();
-    QCOMPARE(view.topLevelItemCount(), 0);
+    QCOMPARE(model.rowCount(), 2);
+    QCOMPARE(model.item(0)->text(), QStringLiteral("2"));
+    QCOMPARE(model.item(1)->text(), QStringLiteral("4"));
 }
 
 void QDropListViewTest::testKeyPressEvent() {
@@ -0,0 +1,95 @@
+#include <QtTest>
+
+#include "track/track.h"
+#include "widgets/trackingester.h"
+
+class TrackIngesterTest : public QObject {
+    Q_OBJECT
+public:
+    explicit TrackIngesterTest(QObject *parent = nullptr);
+    ~TrackIngesterTest() override;
+
+private Q_SLOTS:
+    void testAdd();
+    void testAddWhileRunning();
+    void testCancel();
+    void testMaximumThreads();
+};
+
+TrackIngesterTest::TrackIngesterTest(QObject *parent) : QObject(parent) {
+}
+
+TrackIngesterTest::~TrackIngesterTest() {
+}
+
+void TrackIngesterTest::testAdd() {
+    TrackIngester ingester;
+    ingester.setMaximumThreads(2);
+    QSignalSpy batches(&ingester, &TrackIngester::batchReady);
+    QSignalSpy progress(&ingester, &TrackIngester::progress);
+    QSignalSpy finished(&ingester, &TrackIngester::finished);
+    const auto fileName = QString::fromUtf8(TEST_FILE_140BPM);
+    ingester.add({fileName, QStringLiteral("nonexistent.mp3"), fileName});
+    QVERIFY(ingester.isRunning());
+    QVERIFY(finished.wait());
+    QVERIFY(!ingester.isRunning());
+    QList<TrackModel::Entry> entries;
+    for (const auto &arguments : std::as_const(batches)) {
+        entries.append(arguments.at(0).value<QList<TrackModel::Entry>>());
+    }
+    QCOMPARE(entries.size(), 2);
+    for (const auto &entry : std::as_const(entries)) {
+        QCOMPARE(entry.fileName, fileName);
+        QVERIFY(entry.length > 0);
+        QCOMPARE(entry.progress, qint8(-1));
+    }
+    QVERIFY(!progress.isEmpty());
+    QCOMPARE(progress.last().at(0).toLongLong(), 3);
+    QCOMPARE(progress.last().at(1).toLongLong(), 3);
+}
+
+void TrackIngesterTest::testAddWhileRunning() {
+    TrackIngester ingester;
+    ingester.setMaximumThreads(1);
+    ingester.setBatchInterval(10);
+    QSignalSpy progress(&ingester, &TrackIngester::progress);
+    QSignalSpy finished(&ingester, &TrackIngester::finished);
+    const auto fileName = QString::fromUtf8(TEST_FILE_140BPM);
+    ingester.add({fileName});
+    ingester.add({fileName, fileName});
+    QVERIFY(finished.wait());
+    QCOMPARE(finished.size(), 1);
+    QCOMPARE(progress.last().at(0).toLongLong(), 3);
+}
+
+void TrackIngesterTest::testCancel() {
+    TrackIngester ingester;
+    ingester.setMaximumThreads(1);
+    QSignalSpy batches(&ingester, &TrackIngester::batchReady);
+    QSignalSpy finished(&ingester, &TrackIngester::finished);
+    const auto fileName = QString::fromUtf8(TEST_FILE_140BPM);
+    QStringList files;
+    for (auto i = 0; i < 100; ++i) {
+        files.append(fileName);
+    }
+    ingester.add(files);
+    ingester.cancel();
+    QVERIFY(!ingester.isRunning());
+    QVERIFY(!finished.wait(500));
+    QCOMPARE(batches.size(), 0);
+    // A new run can start while the old workers wind down.
+    ingester.add({fileName});
+    QVERIFY(finished.wait());
+    QCOMPARE(batches.size(), 1);
+}
+
+void TrackIngesterTest::testMaximumThreads() {
+    TrackIngester ingester;
+    QCOMPARE(ingester.maximumThreads(), QThread::idealThreadCount());
+    ingester.setMaximumThreads(3);
+    QCOMPARE(ingester.maximumThreads(), 3);
+}
+
+QTEST_GUILESS_MAIN(TrackIngesterTest)
+
+#include "trackingestertest.moc"
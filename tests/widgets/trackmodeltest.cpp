@@ -0,0 +1,169 @@
+#include <QtCore/QSortFilterProxyModel>
+#include <QtTest>
+
+#include "widgets/trackmodel.h"
+
+class TrackModelTest : public QObject {
+    Q_OBJECT
+public:
+    explicit TrackModelTest(QObject *parent = nullptr);
+    ~TrackModelTest() override;
+
+private Q_SLOTS:
+    void testAppend();
+    void testData();
+    void testProgress();
+    void testRemoveIf();
+    void testRowsOf();
+    void testSetData();
+    void testSort();
+};
+
+static TrackModel::Entry makeEntry(const QString &fileName, bpmtype bpm, qint64 length = 0) {
+    TrackModel::Entry entry;
+    entry.fileName = fileName;
+    entry.bpm = bpm;
+    entry.length = length;
+    return entry;
+}
+
+TrackModelTest::TrackModelTest(QObject *parent) : QObject(parent) {
+}
+
+TrackModelTest::~TrackModelTest() {
+}
+
+void TrackModelTest::testAppend() {
+    TrackModel model;
+    QSignalSpy inserted(&model, &QAbstractItemModel::rowsInserted);
+    model.append({});
+    QCOMPARE(inserted.size(), 0);
+    QList<TrackModel::Entry> entries;
+    for (auto i = 0; i < 100000; ++i) {
+        entries.append(makeEntry(QStringLiteral("%1.mp3").arg(i), 0));
+    }
+    model.append(entries);
+    QCOMPARE(inserted.size(), 1);
+    QCOMPARE(model.rowCount(), 100000);
+    QCOMPARE(model.columnCount(), static_cast<int>(TrackModel::ColumnCount));
+    QCOMPARE(model.entry(99999).fileName, QStringLiteral("99999.mp3"));
+    model.clear();
+    QCOMPARE(model.rowCount(), 0);
+}
+
+void TrackModelTest::testData() {
+    TrackModel model;
+    auto entry = makeEntry(QStringLiteral("/music/a.mp3"), 95.5, 225000);
+    entry.artist = QStringLiteral("Artist");
+    entry.title = QStringLiteral("Title");
+    entry.saved = true;
+    model.append({entry});
+    QCOMPARE(model.index(0, TrackModel::BpmColumn).data().toString(), QStringLiteral("095.50"));
+    QCOMPARE(model.index(0, TrackModel::BpmColumn).data(Qt::EditRole).toString(),
+             QStringLiteral("95.50"));
+    QCOMPARE(model.index(0, TrackModel::SavedColumn).data().toString(), QStringLiteral("✅"));
+    QCOMPARE(model.index(0, TrackModel::ArtistColumn).data().toString(), QStringLiteral("Artist"));
+    QCOMPARE(model.index(0, TrackModel::TitleColumn).data().toString(), QStringLiteral("Title"));
+    QCOMPARE(model.index(0, TrackModel::LengthColumn).data().toString(), QStringLiteral("03:45"));
+    QCOMPARE(model.index(0, TrackModel::FileNameColumn).data().toString(),
+             QStringLiteral("/music/a.mp3"));
+    model.setLastError(0, QStringLiteral("Error"));
+    QCOMPARE(model.index(0, TrackModel::LastErrorColumn).data().toString(),
+             QStringLiteral("Error"));
+    QCOMPARE(model.headerData(TrackModel::BpmColumn, Qt::Horizontal).toString(),
+             QStringLiteral("BPM"));
+    QVERIFY(model.flags(model.index(0, TrackModel::BpmColumn)).testFlag(Qt::ItemIsEditable));
+    QVERIFY(!model.flags(model.index(0, TrackModel::TitleColumn)).testFlag(Qt::ItemIsEditable));
+}
+
+void TrackModelTest::testProgress() {
+    TrackModel model;
+    model.append({makeEntry(QStringLiteral("a.mp3"), 0), makeEntry(QStringLiteral("b.mp3"), 0)});
+    QSignalSpy changed(&model, &QAbstractItemModel::dataChanged);
+    QCOMPARE(model.index(0, TrackModel::ProgressColumn).data(TrackModel::ProgressRole).toInt(),
+             -1);
+    QVERIFY(!model.index(0, TrackModel::BpmColumn).data(TrackModel::ProgressRole).isValid());
+    model.setProgress(0, 42);
+    model.setProgress(0, 42);
+    QCOMPARE(changed.size(), 1);
+    QCOMPARE(model.index(0, TrackModel::ProgressColumn).data(TrackModel::ProgressRole).toInt(),
+             42);
+    model.setProgress(1, 150);
+    QCOMPARE(model.entry(1).progress, qint8(100));
+    model.clearProgress();
+    QCOMPARE(changed.size(), 3);
+    QCOMPARE(model.entry(0).progress, qint8(-1));
+    QCOMPARE(model.entry(1).progress, qint8(-1));
+}
+
+void TrackModelTest::testRemoveIf() {
+    TrackModel model;
+    QList<TrackModel::Entry> entries;
+    for (const auto bpm : {120.0, 0.0, 128.0, 140.0, 0.0, 90.0}) {
+        entries.append(makeEntry(QString::number(bpm), bpm));
+    }
+    model.append(entries);
+    QSignalSpy removed(&model, &QAbstractItemModel::rowsRemoved);
+    QCOMPARE(model.removeIf([](const TrackModel::Entry &entry) { return entry.bpm > 0; }), 4);
+    // 90, then 128 and 140 together, then 120.
+    QCOMPARE(removed.size(), 3);
+    QCOMPARE(model.rowCount(), 2);
+    QVERIFY(!model.removeRows(1, 2));
+    QVERIFY(model.removeRows(0, 2));
+    QCOMPARE(model.rowCount(), 0);
+}
+
+void TrackModelTest::testRowsOf() {
+    TrackModel model;
+    model.append({makeEntry(QStringLiteral("a.mp3"), 0),
+                  makeEntry(QStringLiteral("b.mp3"), 0),
+                  makeEntry(QStringLiteral("a.mp3"), 0)});
+    QCOMPARE(model.rowsOf(QStringLiteral("a.mp3")), QList<int>({0, 2}));
+    QVERIFY(model.rowsOf(QStringLiteral("c.mp3")).isEmpty());
+    QVERIFY(model.removeRows(0, 1));
+    model.append({makeEntry(QStringLiteral("c.mp3"), 0)});
+    QCOMPARE(model.rowsOf(QStringLiteral("a.mp3")), QList<int>({1}));
+    QCOMPARE(model.rowsOf(QStringLiteral("b.mp3")), QList<int>({0}));
+    QCOMPARE(model.rowsOf(QStringLiteral("c.mp3")), QList<int>({2}));
+    model.append({makeEntry(QStringLiteral("b.mp3"), 0)});
+    QCOMPARE(model.rowsOf(QStringLiteral("b.mp3")), QList<int>({0, 3}));
+    model.clear();
+    QVERIFY(model.rowsOf(QStringLiteral("b.mp3")).isEmpty());
+}
+
+void TrackModelTest::testSetData() {
+    TrackModel model;
+    model.append({makeEntry(QStringLiteral("a.mp3"), 0)});
+    QSignalSpy edited(&model, &TrackModel::bpmEdited);
+    QVERIFY(!model.setData(model.index(0, TrackModel::TitleColumn), QStringLiteral("Title")));
+    QVERIFY(model.setData(model.index(0, TrackModel::BpmColumn), QStringLiteral("128.5")));
+    QCOMPARE(edited.size(), 1);
+    QCOMPARE(edited.at(0).at(0).toInt(), 0);
+    QCOMPARE(model.entry(0).bpm, 128.5);
+}
+
+void TrackModelTest::testSort() {
+    TrackModel model;
+    model.append({makeEntry(QStringLiteral("b.mp3"), 95, 60000),
+                  makeEntry(QStringLiteral("a.mp3"), 128, 5000),
+                  makeEntry(QStringLiteral("c.mp3"), 100, 600000)});
+    QSortFilterProxyModel proxy;
+    proxy.setSourceModel(&model);
+    proxy.setSortRole(TrackModel::SortRole);
+    proxy.sort(TrackModel::BpmColumn);
+    QCOMPARE(proxy.index(0, TrackModel::FileNameColumn).data().toString(),
+             QStringLiteral("b.mp3"));
+    QCOMPARE(proxy.index(2, TrackModel::FileNameColumn).data().toString(),
+             QStringLiteral("a.mp3"));
+    // Numerically, not as `mm:ss` strings.
+    proxy.sort(TrackModel::LengthColumn, Qt::DescendingOrder);
+    QCOMPARE(proxy.index(0, TrackModel::FileNameColumn).data().toString(),
+             QStringLiteral("c.mp3"));
+    proxy.sort(TrackModel::FileNameColumn);
+    QCOMPARE(proxy.index(0, TrackModel::FileNameColumn).data().toString(),
+             QStringLiteral("a.mp3"));
+}
+
+QTEST_GUILESS_MAIN(TrackModelTest)
+
+#include "trackmodeltest.moc"